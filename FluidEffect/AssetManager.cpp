@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "AssetManager.h"
+#include "StaticMesh.h"
+
+AssetManager::AssetManager()
+{
+	m_numPending = 0;
+}
+
+AssetManager::~AssetManager()
+{
+}
+
+AssetManager& AssetManager::GetInstance()
+{
+	static AssetManager assetManager;
+	return assetManager;
+}
+
+AssetHandle<StaticMesh> AssetManager::LoadMesh(RenderDevice* device, const std::string& fileName, const DirectX::XMFLOAT3& color, const WCHAR* shaderFileName)
+{
+	// Assets of different devices can not be shared
+	std::ostringstream key;
+	key << "mesh " << device << " " << fileName;
+
+	std::wstring shader = shaderFileName;
+	return Load<StaticMesh>(key.str(), [device, fileName, color, shader]()
+	{
+		StaticMesh* mesh = new StaticMesh(fileName, device, shader.c_str());
+		mesh->SetColor(device, color);
+		return mesh;
+	}, [](StaticMesh* mesh)
+	{
+		delete mesh;
+	}, [](const StaticMesh* mesh)
+	{
+		return mesh->GetNumBytes();
+	});
+}
+
+AssetHandle<RenderShaderProgram> AssetManager::LoadShaderProgram(RenderDevice* device, const RenderShaderProgramDesc& desc)
+{
+	std::string fileName(desc.fileName.begin(), desc.fileName.end());
+	std::ostringstream key;
+	key << "shader " << device << " " << fileName << " " << desc.vertexEntryPoint << (desc.geometryEntryPoint.empty() ? "" : "/") << desc.geometryEntryPoint << "/" << desc.pixelEntryPoint;
+	for (const RenderShaderDefine& define : desc.defines)
+		key << " " << define.name << "=" << define.value;
+
+	return Load<RenderShaderProgram>(key.str(), [device, desc, fileName]()
+	{
+		RenderShaderProgram* program = nullptr;
+		if (FAILED(device->CreateShaderProgram(desc, &program)))
+			std::cout << "Loading Shader " << fileName << " failed." << std::endl;
+		return program;
+	}, [](RenderShaderProgram* program)
+	{
+		program->Release();
+	}, [](const RenderShaderProgram* program)
+	{
+		return static_cast<uint64_t>(program->GetNumBytes());
+	});
+}
+
+AssetHandle<RenderShaderProgram> AssetManager::LoadShaderProgram(RenderDevice* device, const WCHAR* fileName, bool hasGeometryShader)
+{
+	return LoadShaderProgram(device, RenderShaderProgramDesc::FromFile(fileName, hasGeometryShader));
+}
+
+int AssetManager::GetNumAssets()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<int>(m_assets.size());
+}
+
+uint64_t AssetManager::GetNumBytes()
+{
+	uint64_t numBytes = 0;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& asset : m_assets)
+	{
+		AssetRecord* record = asset.second;
+		bool isLoaded = record->asset.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		if (isLoaded && record->asset.get() && record->getNumBytes)
+			numBytes += record->getNumBytes(record->asset.get());
+	}
+	return numBytes;
+}
+
+void AssetManager::Wait()
+{
+	while (GetNumPending() > 0)
+	{
+		std::vector<std::shared_future<void*>> assets;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& asset : m_assets)
+				assets.push_back(asset.second->asset);
+		}
+
+		for (std::shared_future<void*>& asset : assets)
+			asset.wait();
+
+		// The last loads may have finished without having left the count yet
+		std::this_thread::yield();
+	}
+}
+
+void AssetManager::WriteReport(std::ostream& out)
+{
+	std::vector<std::string> lines;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& asset : m_assets)
+		{
+			AssetRecord* record = asset.second;
+			std::ostringstream line;
+			line << record->key << ": " << record->numRefs.load(std::memory_order_relaxed) << " handles, ";
+			if (record->asset.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				line << "loading";
+			else if (!record->asset.get())
+				line << "failed";
+			else if (record->getNumBytes)
+				line << record->getNumBytes(record->asset.get()) << " bytes";
+			else
+				line << "loaded";
+			lines.push_back(line.str());
+		}
+	}
+
+	std::sort(lines.begin(), lines.end());
+	for (const std::string& line : lines)
+		out << line << std::endl;
+}
+
+void AssetManager::Release(AssetRecord* record)
+{
+	{
+		// Under the lock, so a request can not pick the record up again while it is freed
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (record->numRefs.fetch_sub(1, std::memory_order_acq_rel) > 1)
+			return;
+		m_assets.erase(record->key);
+	}
+
+	// Freeing may release assets the freed one held, so it happens outside of the lock
+	void* asset = record->asset.get();
+	if (asset)
+		record->free(asset);
+	delete record;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <DirectXMath.h>
+#include "RenderDevice.h"
+#include "JobSystem.h"
+
+class StaticMesh;
+
+// Shared by all handles of one asset
+struct AssetRecord
+{
+	std::string key;
+	std::shared_future<void*> asset;
+	std::function<void(void*)> free;
+	std::function<uint64_t(const void*)> getNumBytes;
+	std::atomic<int> numRefs;
+};
+
+// Counted reference to an asset that may still be loading. The asset is freed when its last
+// handle goes away.
+template <typename T>
+class AssetHandle
+{
+public:
+	AssetHandle() : m_record(nullptr) {}
+	// Takes over a reference the AssetManager already counted
+	explicit AssetHandle(AssetRecord* record) : m_record(record) {}
+	AssetHandle(const AssetHandle& other);
+	AssetHandle(AssetHandle&& other) : m_record(other.m_record) { other.m_record = nullptr; }
+	~AssetHandle();
+
+	AssetHandle& operator=(AssetHandle other);
+
+	bool IsValid() const { return m_record != nullptr; }
+	bool IsReady() const { return m_record && m_record->asset.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+	// Blocks until the load finished, nullptr if it failed
+	T* Get() const { return m_record ? static_cast<T*>(m_record->asset.get()) : nullptr; }
+	// nullptr while still loading
+	T* TryGet() const { return IsReady() ? static_cast<T*>(m_record->asset.get()) : nullptr; }
+
+private:
+	AssetRecord* m_record;
+};
+
+// Loads meshes, shader programs and other assets as background jobs on the JobSystem. Meshes are
+// interned by file, shader programs by file, entry points and defines, so every asset is loaded and
+// kept on the device once, however many handles refer to it. Handles have to be gone before the
+// device their assets were created on.
+class AssetManager
+{
+public:
+	static AssetManager& GetInstance();
+
+	// The vertex color and shader are part of the mesh, so later requests of the file get the first ones
+	AssetHandle<StaticMesh> LoadMesh(RenderDevice* device, const std::string& fileName, const DirectX::XMFLOAT3& color, const WCHAR* shaderFileName);
+	AssetHandle<RenderShaderProgram> LoadShaderProgram(RenderDevice* device, const RenderShaderProgramDesc& desc);
+	AssetHandle<RenderShaderProgram> LoadShaderProgram(RenderDevice* device, const WCHAR* fileName, bool hasGeometryShader);
+
+	// Runs load as a job the first time key is asked for. load may wait on assets requested before
+	// it, those were queued first. The last handle deletes the asset, or hands it to free.
+	template <typename T>
+	AssetHandle<T> Load(const std::string& key, const std::function<T*()>& load);
+	template <typename T>
+	AssetHandle<T> Load(const std::string& key, const std::function<T*()>& load, const std::function<void(T*)>& free,
+		const std::function<uint64_t(const T*)>& getNumBytes = std::function<uint64_t(const T*)>());
+
+	int GetNumPending() const { return m_numPending.load(std::memory_order_acquire); }
+	int GetNumAssets();
+	// Of the loaded assets that know their size
+	uint64_t GetNumBytes();
+
+	// Blocks until every requested load finished, including the ones started by other loads
+	void Wait();
+	// One line per asset with its handles and bytes
+	void WriteReport(std::ostream& out);
+
+	// Frees the asset once the last handle released it
+	void Release(AssetRecord* record);
+
+private:
+	AssetManager();
+	~AssetManager();
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, AssetRecord*> m_assets;
+	std::atomic<int> m_numPending;
+};
+
+template <typename T>
+AssetHandle<T>::AssetHandle(const AssetHandle& other) : m_record(other.m_record)
+{
+	if (m_record)
+		m_record->numRefs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+AssetHandle<T>::~AssetHandle()
+{
+	if (m_record)
+		AssetManager::GetInstance().Release(m_record);
+}
+
+template <typename T>
+AssetHandle<T>& AssetHandle<T>::operator=(AssetHandle other)
+{
+	std::swap(m_record, other.m_record);
+	return *this;
+}
+
+template <typename T>
+AssetHandle<T> AssetManager::Load(const std::string& key, const std::function<T*()>& load)
+{
+	return Load<T>(key, load, [](T* asset) { delete asset; });
+}
+
+template <typename T>
+AssetHandle<T> AssetManager::Load(const std::string& key, const std::function<T*()>& load, const std::function<void(T*)>& free,
+	const std::function<uint64_t(const T*)>& getNumBytes)
+{
+	std::shared_ptr<std::promise<void*>> promise = std::make_shared<std::promise<void*>>();
+	AssetRecord* record = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_assets.find(key);
+		if (found != m_assets.end())
+		{
+			found->second->numRefs.fetch_add(1, std::memory_order_relaxed);
+			return AssetHandle<T>(found->second);
+		}
+
+		record = new AssetRecord();
+		record->key = key;
+		record->asset = promise->get_future().share();
+		record->free = [free](void* asset) { free(static_cast<T*>(asset)); };
+		if (getNumBytes)
+			record->getNumBytes = [getNumBytes](const void* asset) { return getNumBytes(static_cast<const T*>(asset)); };
+		record->numRefs = 1;
+		m_assets[key] = record;
+		m_numPending.fetch_add(1, std::memory_order_acq_rel);
+	}
+
+	JobSystem::GetInstance().SubmitBackground([this, promise, load]()
+	{
+		promise->set_value(load());
+		m_numPending.fetch_sub(1, std::memory_order_acq_rel);
+	});
+	return AssetHandle<T>(record);
+}
@@ -0,0 +1,3279 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "RandomValues.h"
+#include "ParticleSpawner.h"
+#include "JobSystem.h"
+#include "SphSolver.h"
+#include "PbfSolver.h"
+#include "SignedDistanceField.h"
+#include "StaticMesh.h"
+#include "TriangleBvh.h"
+#include "IsoSurfaceExtractor.h"
+#include "SparseDensityGrid.h"
+#include "SimulationRecorder.h"
+#include "SimulationReplayer.h"
+#include "SharedParticleExporter.h"
+#include "SharedParticleReader.h"
+#include "NeighborCache.h"
+#include "MortonCode.h"
+#include "RadixSort.h"
+#include "DepthSorter.h"
+#include "NullRenderDevice.h"
+#include "SoftwareRenderDevice.h"
+#include "GameObject.h"
+#include "ParticleSystem.h"
+#include "AssetManager.h"
+#include "RenderQueue.h"
+#include "InstanceBatcher.h"
+#include "LightClusters.h"
+#include "SimulationThread.h"
+#include "TaskGraph.h"
+#include "FrameArena.h"
+#include "HeapTracker.h"
+
+namespace
+{
+	typedef void (*BenchmarkFunction)(std::ostream& out);
+
+	struct BenchmarkEntry
+	{
+		const char* name;
+		BenchmarkFunction function;
+	};
+
+	// gridSize x gridSize pipes on the xz plane around the origin, each turned randomly about y
+	void PlacePipes(std::vector<GameObject>& pipes, int gridSize, float spacing, Mesh* mesh)
+	{
+		RandomGenerator random(11);
+		pipes.resize(gridSize * gridSize);
+		for (int i = 0; i < gridSize * gridSize; i++)
+		{
+			float x = (i % gridSize - (gridSize - 1) * 0.5f) * spacing;
+			float z = (i / gridSize - (gridSize - 1) * 0.5f) * spacing;
+			pipes[i].SetMesh(mesh);
+			pipes[i].SetPosition({ x, 0.0f, z });
+			pipes[i].SetRotation({ 0.0f, random.NextFloat(0.0f, 360.0f), 0.0f });
+		}
+	}
+
+	// Keeps the thread busy for ms, like a frame stage would
+	void Spin(double ms)
+	{
+		long long end = Profiler::GetTimestamp() + static_cast<long long>(ms * 1000000.0);
+		while (Profiler::GetTimestamp() < end)
+		{
+		}
+	}
+
+#ifdef _WIN32
+	typedef HANDLE ProcessHandle;
+#else
+	typedef pid_t ProcessHandle;
+#endif
+
+	// Starts this executable once more with the given command line arguments
+	bool StartProcessOfSelf(const std::vector<std::string>& arguments, ProcessHandle& process)
+	{
+#ifdef _WIN32
+		char path[MAX_PATH];
+		if (GetModuleFileNameA(nullptr, path, MAX_PATH) == 0)
+			return false;
+
+		std::string commandLine = "\"" + std::string(path) + "\"";
+		for (const std::string& argument : arguments)
+			commandLine += " " + argument;
+
+		STARTUPINFOA startupInfo = {};
+		startupInfo.cb = sizeof(startupInfo);
+		PROCESS_INFORMATION processInfo = {};
+		if (!CreateProcessA(path, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+			return false;
+
+		CloseHandle(processInfo.hThread);
+		process = processInfo.hProcess;
+		return true;
+#else
+		const char* path = "/proc/self/exe";
+		std::vector<char*> argv;
+		argv.push_back(const_cast<char*>(path));
+		for (const std::string& argument : arguments)
+			argv.push_back(const_cast<char*>(argument.c_str()));
+		argv.push_back(nullptr);
+		return posix_spawn(&process, path, nullptr, nullptr, argv.data(), environ) == 0;
+#endif
+	}
+
+	// False while the process runs, otherwise its exit code is set and the handle is gone
+	bool HasProcessExited(ProcessHandle process, int& exitCode)
+	{
+#ifdef _WIN32
+		if (WaitForSingleObject(process, 0) != WAIT_OBJECT_0)
+			return false;
+
+		DWORD code = 1;
+		GetExitCodeProcess(process, &code);
+		CloseHandle(process);
+		exitCode = static_cast<int>(code);
+		return true;
+#else
+		int status = 0;
+		if (waitpid(process, &status, WNOHANG) != process)
+			return false;
+
+		exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+		return true;
+#endif
+	}
+
+	// Column of fluid at rest spacing in one corner of a box four times as wide
+	void SetupDamBreak(int numParticles, float spacing, std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax)
+	{
+		int side = static_cast<int>(std::ceil(std::cbrt(numParticles * 0.5f)));
+		int height = (numParticles + side * side - 1) / (side * side);
+		boundsMin = { 0.0f, 0.0f, 0.0f };
+		boundsMax = { side * spacing * 4.0f, height * spacing * 2.0f, side * spacing };
+
+		positions.resize(numParticles);
+		velocities.assign(numParticles, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+		for (int i = 0; i < numParticles; i++)
+		{
+			int x = i % side;
+			int z = (i / side) % side;
+			int y = i / (side * side);
+			positions[i] = DirectX::XMFLOAT3((x + 0.5f) * spacing, (y + 0.5f) * spacing, (z + 0.5f) * spacing);
+		}
+	}
+
+	// Counts edges not shared by exactly two triangles, 0 for a closed surface
+	int CountOpenEdges(const std::vector<unsigned int>& indices)
+	{
+		std::unordered_map<uint64_t, int> edgeUses;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint64_t a = indices[t + k];
+				uint64_t b = indices[t + (k + 1) % 3];
+				edgeUses[a < b ? (a << 32) | b : (b << 32) | a]++;
+			}
+		}
+
+		int numOpen = 0;
+		for (const auto& edge : edgeUses)
+			numOpen += edge.second != 2 ? 1 : 0;
+		return numOpen;
+	}
+
+	void SetupDamBreak(SphSolver& solver, std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, int numParticles)
+	{
+		const float spacing = 0.05f;
+		solver.m_settings = SphSettings::ForParticleSpacing(spacing);
+		SetupDamBreak(numParticles, spacing, positions, velocities, solver.m_settings.boundsMin, solver.m_settings.boundsMax);
+	}
+
+	void SetupDamBreak(PbfSolver& solver, std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, int numParticles)
+	{
+		const float spacing = 0.05f;
+		int numIterations = solver.m_settings.numIterations;
+		solver.m_settings = PbfSettings::ForParticleSpacing(spacing);
+		solver.m_settings.numIterations = numIterations;
+		SetupDamBreak(numParticles, spacing, positions, velocities, solver.m_settings.boundsMin, solver.m_settings.boundsMax);
+	}
+}
+
+int Benchmark::s_numFailed = 0;
+
+int Benchmark::Run(const std::string& filter, std::ostream& out)
+{
+	const BenchmarkEntry benchmarks[] =
+	{
+		{ "profiler", &Benchmark::ProfilerOverhead },
+		{ "random_statistics", &Benchmark::RandomStatistics },
+		{ "random_throughput", &Benchmark::RandomThroughput },
+		{ "spawner_rate", &Benchmark::SpawnerEmissionRate },
+		{ "sph_dambreak", &Benchmark::SphDamBreak },
+		{ "pbf_iterations", &Benchmark::PbfIterations },
+		{ "sdf", &Benchmark::SdfBakeAndQuery },
+		{ "bvh", &Benchmark::BvhBuildAndQuery },
+		{ "marching_cubes", &Benchmark::IsoSurfaceExtraction },
+		{ "density_cache", &Benchmark::DensityCache },
+		{ "recorder", &Benchmark::SimulationRecording },
+		{ "shared_memory", &Benchmark::SharedParticleExport },
+		{ "neighbor_cache", &Benchmark::NeighborCacheReuse },
+		{ "morton_reorder", &Benchmark::MortonReorder },
+		{ "depth_sort", &Benchmark::DepthSort },
+		{ "null_device", &Benchmark::NullDeviceFrames },
+		{ "software_raster", &Benchmark::SoftwareRasterizer },
+		{ "asset_loading", &Benchmark::AssetLoading },
+		{ "render_queue", &Benchmark::RenderQueueSorting },
+		{ "instancing", &Benchmark::InstancedPipes },
+		{ "light_clusters", &Benchmark::LightClusterAssignment },
+		{ "simulation_thread", &Benchmark::SimulationThreadFrames },
+		{ "task_graph", &Benchmark::TaskGraphScheduling },
+		{ "frame_arena", &Benchmark::FrameArenaScratch },
+	};
+
+	s_numFailed = 0;
+	int numRun = 0;
+	for (const BenchmarkEntry& benchmark : benchmarks)
+	{
+		if (!filter.empty() && std::string(benchmark.name).find(filter) == std::string::npos)
+			continue;
+
+		out << "== " << benchmark.name << " ==" << std::endl;
+		benchmark.function(out);
+		out << std::endl;
+		numRun++;
+	}
+
+	if (numRun == 0)
+	{
+		out << "No benchmark matches \"" << filter << "\"." << std::endl;
+		return 1;
+	}
+
+	out << s_numFailed << " checks failed" << std::endl;
+	return s_numFailed == 0 ? 0 : 1;
+}
+
+double Benchmark::GetElapsedMs(long long startNs, long long endNs)
+{
+	return static_cast<double>(endNs - startNs) / 1000000.0;
+}
+
+const char* Benchmark::Verdict(bool isPassed)
+{
+	if (!isPassed)
+		s_numFailed++;
+	return isPassed ? "PASS" : "FAIL";
+}
+
+void Benchmark::ProfilerOverhead(std::ostream& out)
+{
+	const int iterations = 10000000;
+	volatile int sink = 0;
+	Profiler& profiler = Profiler::GetInstance();
+
+	// Baseline loop without any marker
+	long long start = Profiler::GetTimestamp();
+	for (int i = 0; i < iterations; i++)
+		sink = sink + i;
+	double baselineMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+	profiler.SetEnabled(false);
+	start = Profiler::GetTimestamp();
+	for (int i = 0; i < iterations; i++)
+	{
+		PROFILE_SCOPE("Overhead");
+		sink = sink + i;
+	}
+	double disabledMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+	profiler.SetEnabled(true);
+	start = Profiler::GetTimestamp();
+	for (int i = 0; i < iterations; i++)
+	{
+		PROFILE_SCOPE("Overhead");
+		sink = sink + i;
+	}
+	double enabledMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	profiler.SetEnabled(false);
+
+	out << "iterations:          " << iterations << std::endl;
+	out << "baseline:            " << baselineMs * 1000000.0 / iterations << " ns/iteration" << std::endl;
+	out << "disabled scope cost: " << (disabledMs - baselineMs) * 1000000.0 / iterations << " ns/scope" << std::endl;
+	out << "enabled scope cost:  " << (enabledMs - baselineMs) * 1000000.0 / iterations << " ns/scope" << std::endl;
+}
+
+void Benchmark::RandomStatistics(std::ostream& out)
+{
+	const int numValues = 1 << 22;
+	const int numBuckets = 64;
+	const float min = -3.0f;
+	const float max = 5.0f;
+
+	std::vector<float> values(numValues);
+	RandomGenerator generator(1234);
+	generator.Fill(values.data(), values.size(), min, max);
+
+	// Range, mean and variance against the uniform distribution
+	bool inRange = true;
+	double sum = 0.0;
+	double sumSq = 0.0;
+	double sumLag = 0.0;
+	int buckets[numBuckets] = {};
+	for (int i = 0; i < numValues; i++)
+	{
+		float value = values[i];
+		inRange = inRange && value >= min && value < max;
+		sum += value;
+		sumSq += static_cast<double>(value) * value;
+		if (i > 0)
+			sumLag += (static_cast<double>(values[i - 1]) - 1.0) * (value - 1.0);
+
+		int bucket = static_cast<int>((value - min) / (max - min) * numBuckets);
+		buckets[bucket < 0 ? 0 : bucket >= numBuckets ? numBuckets - 1 : bucket]++;
+	}
+
+	double mean = sum / numValues;
+	double variance = sumSq / numValues - mean * mean;
+	double expectedMean = (min + max) * 0.5;
+	double expectedVariance = (max - min) * (max - min) / 12.0;
+	double lagCorrelation = sumLag / (numValues - 1) / expectedVariance;
+
+	double expectedPerBucket = static_cast<double>(numValues) / numBuckets;
+	double chiSquare = 0.0;
+	for (int bucket : buckets)
+		chiSquare += (bucket - expectedPerBucket) * (bucket - expectedPerBucket) / expectedPerBucket;
+
+	// Same seed has to give the same sequence, a different stream a different one
+	std::vector<float> repeat(1024);
+	std::vector<float> otherStream(1024);
+	RandomGenerator repeatGenerator(1234);
+	RandomGenerator otherGenerator(1234, 1);
+	repeatGenerator.Fill(repeat.data(), repeat.size(), min, max);
+	otherGenerator.Fill(otherStream.data(), otherStream.size(), min, max);
+	bool reproducible = std::equal(repeat.begin(), repeat.end(), values.begin());
+	bool streamsDiffer = !std::equal(otherStream.begin(), otherStream.end(), values.begin());
+
+	// 63 degrees of freedom: chi square above ~100 happens with p < 0.002
+	bool meanOk = std::fabs(mean - expectedMean) < 0.01;
+	bool varianceOk = std::fabs(variance - expectedVariance) / expectedVariance < 0.01;
+	bool chiSquareOk = chiSquare < 100.0;
+	bool lagOk = std::fabs(lagCorrelation) < 0.01;
+
+	out << "values:         " << numValues << " in [" << min << ", " << max << ")" << std::endl;
+	out << "range:          " << Verdict(inRange) << std::endl;
+	out << "mean:           " << mean << " (expected " << expectedMean << ") " << Verdict(meanOk) << std::endl;
+	out << "variance:       " << variance << " (expected " << expectedVariance << ") " << Verdict(varianceOk) << std::endl;
+	out << "chi square:     " << chiSquare << " over " << numBuckets << " buckets " << Verdict(chiSquareOk) << std::endl;
+	out << "lag-1 corr.:    " << lagCorrelation << " " << Verdict(lagOk) << std::endl;
+	out << "reproducible:   " << Verdict(reproducible) << std::endl;
+	out << "streams differ: " << Verdict(streamsDiffer) << std::endl;
+}
+
+void Benchmark::RandomThroughput(std::ostream& out)
+{
+	const int numValues = 1 << 24;
+	std::vector<float> values(numValues);
+	volatile float sink = 0.0f;
+
+	std::mt19937 mersenne(1234);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	long long start = Profiler::GetTimestamp();
+	for (int i = 0; i < numValues; i++)
+		values[i] = distribution(mersenne);
+	double mersenneMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	sink = sink + values[numValues - 1];
+
+	start = Profiler::GetTimestamp();
+	for (int i = 0; i < numValues; i++)
+		values[i] = RandomValues::GetRandomValue(-1.0f, 1.0f);
+	double scalarMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	sink = sink + values[numValues - 1];
+
+	start = Profiler::GetTimestamp();
+	RandomValues::FillRandomValues(values.data(), values.size(), -1.0f, 1.0f);
+	double fillMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	sink = sink + values[numValues - 1];
+
+	out << "values:                         " << numValues << std::endl;
+	out << "mt19937 + distribution:         " << mersenneMs << " ms (" << numValues / mersenneMs / 1000.0 << " M/s)" << std::endl;
+	out << "RandomValues::GetRandomValue:   " << scalarMs << " ms (" << numValues / scalarMs / 1000.0 << " M/s)" << std::endl;
+	out << "RandomValues::FillRandomValues: " << fillMs << " ms (" << numValues / fillMs / 1000.0 << " M/s)" << std::endl;
+}
+
+void Benchmark::SpawnerEmissionRate(std::ostream& out)
+{
+	// Long runs with jittery frame times must emit m_spawnRate particles per second, independent of the step size
+	const float duration = 600.0f;
+	const float spawnRates[] = { 6.0f, 40.0f, 1000.0f };
+	const float minStep = 1.0f / 240.0f;
+	const float maxStep = 1.0f / 8.0f;
+	RandomGenerator stepGenerator(42);
+
+	for (float spawnRate : spawnRates)
+	{
+		std::vector<Particle*> particles;
+		ParticleSpawner spawner({ 0.0f, 0.0f, 0.0f }, particles, nullptr);
+		spawner.m_spawnRate = spawnRate;
+		spawner.AddBurst(500, duration * 0.5f);
+
+		long long start = Profiler::GetTimestamp();
+		while (spawner.GetTime() < duration)
+		{
+			float step = stepGenerator.NextFloat(minStep, maxStep);
+			if (spawner.GetTime() + step > duration)
+				step = duration - spawner.GetTime();
+
+			spawner.Update(step);
+
+			for (Particle* particle : particles)
+				delete particle;
+			particles.clear();
+		}
+		double elapsedMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+		// The first particle is born at t = 0, so the expected count includes it
+		double expected = std::floor(spawnRate * duration) + 1.0 + 500.0;
+		double emitted = static_cast<double>(spawner.GetNumEmitted());
+		bool countOk = std::fabs(emitted - expected) <= 1.0;
+
+		out << "rate " << spawnRate << "/s over " << duration << " s + burst of 500: emitted " << emitted << ", expected " << expected
+			<< " " << Verdict(countOk) << " (" << elapsedMs << " ms)" << std::endl;
+	}
+
+	// A single slow step has to catch up instead of emitting only one particle
+	std::vector<Particle*> particles;
+	ParticleSpawner spawner({ 0.0f, 0.0f, 0.0f }, particles, nullptr);
+	spawner.m_spawnRate = 40.0f;
+	spawner.Update(0.5f);
+	bool catchUpOk = particles.size() == 20;
+
+	// Sub-frame births must be spread over the step instead of stacking on the emitter
+	float minY = particles.empty() ? 0.0f : particles[0]->GetPosition().y;
+	float maxY = minY;
+	for (Particle* particle : particles)
+	{
+		minY = std::min(minY, particle->GetPosition().y);
+		maxY = std::max(maxY, particle->GetPosition().y);
+		delete particle;
+	}
+	bool spreadOk = maxY - minY > 1.0f;
+
+	out << "one 0.5 s step at 40/s: emitted " << spawner.GetNumEmitted() << " " << Verdict(catchUpOk) << std::endl;
+	out << "sub-frame spread along emission direction: " << maxY - minY << " m " << Verdict(spreadOk) << std::endl;
+}
+
+void Benchmark::SphDamBreak(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	const int particleCounts[] = { 10000, 50000, 100000 };
+	const int warmupSteps = 5;
+	const int timedSteps = 20;
+
+	out << "threads: " << jobSystem.GetNumThreads() << std::endl;
+
+	for (int numParticles : particleCounts)
+	{
+		SphSolver solver;
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT3> velocities;
+		SetupDamBreak(solver, positions, velocities, numParticles);
+		float step = solver.m_settings.maxTimeStep;
+
+		for (int i = 0; i < warmupSteps; i++)
+			solver.Substep(positions, velocities, step);
+
+		long long start = Profiler::GetTimestamp();
+		for (int i = 0; i < timedSteps; i++)
+			solver.Substep(positions, velocities, step);
+		double msPerStep = GetElapsedMs(start, Profiler::GetTimestamp()) / timedSteps;
+
+		out << numParticles << " particles: " << msPerStep << " ms/step (dt " << step * 1000.0f << " ms, density error "
+			<< solver.GetAverageDensityError() * 100.0f << "%)" << std::endl;
+	}
+
+	// Two runs with the same thread count have to produce bit-identical particles
+	const int numParticles = 4000;
+	const int numSteps = 200;
+	std::vector<DirectX::XMFLOAT3> runPositions[2];
+	std::vector<DirectX::XMFLOAT3> runVelocities[2];
+	for (int run = 0; run < 2; run++)
+	{
+		SphSolver solver;
+		SetupDamBreak(solver, runPositions[run], runVelocities[run], numParticles);
+		for (int i = 0; i < numSteps; i++)
+			solver.Substep(runPositions[run], runVelocities[run], solver.m_settings.maxTimeStep);
+	}
+
+	bool deterministic = std::memcmp(runPositions[0].data(), runPositions[1].data(), numParticles * sizeof(DirectX::XMFLOAT3)) == 0
+		&& std::memcmp(runVelocities[0].data(), runVelocities[1].data(), numParticles * sizeof(DirectX::XMFLOAT3)) == 0;
+
+	// The column has to collapse without exploding or leaving the box
+	SphSolver reference;
+	std::vector<DirectX::XMFLOAT3> initialPositions;
+	std::vector<DirectX::XMFLOAT3> initialVelocities;
+	SetupDamBreak(reference, initialPositions, initialVelocities, numParticles);
+
+	float maxX = 0.0f;
+	float maxSpeedSq = 0.0f;
+	bool finite = true;
+	for (int i = 0; i < numParticles; i++)
+	{
+		const DirectX::XMFLOAT3& p = runPositions[0][i];
+		const DirectX::XMFLOAT3& v = runVelocities[0][i];
+		finite = finite && std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+		maxX = std::max(maxX, p.x);
+		maxSpeedSq = std::max(maxSpeedSq, v.x * v.x + v.y * v.y + v.z * v.z);
+	}
+
+	float initialMaxX = 0.0f;
+	for (const DirectX::XMFLOAT3& p : initialPositions)
+		initialMaxX = std::max(initialMaxX, p.x);
+
+	bool collapsed = finite && maxX > initialMaxX * 1.5f;
+
+	out << "determinism over " << numSteps << " steps: " << Verdict(deterministic) << std::endl;
+	out << "front moved from " << initialMaxX << " m to " << maxX << " m, max speed " << std::sqrt(maxSpeedSq) << " m/s "
+		<< Verdict(collapsed) << std::endl;
+}
+
+void Benchmark::PbfIterations(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// One second of a 10k particle dam break at 60 Hz, the time step the goo effect runs with
+	const int numParticles = 10000;
+	const int numSteps = 60;
+	const float step = 1.0f / 60.0f;
+	const float spacing = 0.05f;
+	const int iterationCounts[] = { 1, 2, 4, 8 };
+	// Average errors at any and at the default iteration count
+	const double maxError = 0.75;
+	const int defaultIterations = PbfSettings::ForParticleSpacing(spacing).numIterations;
+	const double maxDefaultError = 0.1;
+
+	out << "threads: " << jobSystem.GetNumThreads() << ", " << numParticles << " particles, " << numSteps << " steps of " << step * 1000.0f << " ms" << std::endl;
+
+	double previousError = DBL_MAX;
+	double defaultError = DBL_MAX;
+	for (int numIterations : iterationCounts)
+	{
+		PbfSolver solver;
+		solver.m_settings.numIterations = numIterations;
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT3> velocities;
+		SetupDamBreak(solver, positions, velocities, numParticles);
+		// Twice as long, so the front doesn't run up the far wall within the second and no particle
+		// has a reason to rise above the column it started in
+		solver.m_settings.boundsMax.x *= 2.0f;
+
+		float columnHeight = 0.0f;
+		for (const DirectX::XMFLOAT3& p : positions)
+			columnHeight = std::max(columnHeight, p.y + 0.5f * spacing);
+
+		double errorSum = 0.0;
+		float stepMaxError = 0.0f;
+		float maxHeight = 0.0f;
+		double stepMs = 0.0;
+		for (int i = 0; i < numSteps; i++)
+		{
+			long long start = Profiler::GetTimestamp();
+			solver.Substep(positions, velocities, step);
+			stepMs += GetElapsedMs(start, Profiler::GetTimestamp());
+			errorSum += solver.GetAverageDensityError();
+			stepMaxError = std::max(stepMaxError, solver.GetAverageDensityError());
+			for (const DirectX::XMFLOAT3& p : positions)
+				maxHeight = std::max(maxHeight, p.y);
+		}
+		double msPerStep = stepMs / numSteps;
+
+		bool finite = true;
+		for (const DirectX::XMFLOAT3& p : positions)
+			finite = finite && std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+
+		// Every iteration count has to leave less compression than the one before, stay below a fixed bound
+		// and keep all particles below the starting column
+		double averageError = errorSum / numSteps;
+		out << numIterations << " iterations: " << msPerStep << " ms/step, density error avg " << averageError * 100.0 << "% max "
+			<< stepMaxError * 100.0f << "%, highest particle " << maxHeight << " m of a " << columnHeight << " m column "
+			<< Verdict(finite && averageError < previousError && averageError < maxError && maxHeight <= columnHeight) << std::endl;
+		previousError = averageError;
+		if (numIterations == defaultIterations)
+			defaultError = averageError;
+	}
+	out << "density error at the default " << defaultIterations << " iterations below " << maxDefaultError * 100.0 << "%: "
+		<< Verdict(defaultError < maxDefaultError) << std::endl;
+}
+
+void Benchmark::SdfBakeAndQuery(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	std::vector<DirectX::XMFLOAT3> vertices;
+	std::vector<unsigned int> indices;
+
+	// The floor is a slab from y = -0.25 to 0.25, the band clamps distances above 0.5 m
+	StaticMesh floorMesh("Floor.obj", nullptr);
+	floorMesh.GetTriangles(DirectX::XMMatrixIdentity(), vertices, indices);
+	SignedDistanceField floorField;
+	floorField.Bake(vertices, indices, 0.1f, 0.5f);
+	float inside = floorField.Sample(DirectX::XMFLOAT3(0.03f, -0.15f, 0.07f));
+	float above = floorField.Sample(DirectX::XMFLOAT3(0.03f, 0.45f, 0.07f));
+	float far = floorField.Sample(DirectX::XMFLOAT3(0.03f, 2.0f, 0.07f));
+	bool signOk = std::fabs(inside + 0.1f) < 0.01f && std::fabs(above - 0.2f) < 0.01f && far == 0.5f;
+	out << "floor slab: " << inside << " m at y = -0.15, " << above << " m at y = 0.45, " << far << " m far away " << Verdict(signOk) << std::endl;
+
+	StaticMesh pipeMesh("Pipe.obj", nullptr);
+	if (pipeMesh.GetNumVertices() == 0)
+	{
+		out << "Pipe.obj not found, run from the FluidEffect directory." << std::endl;
+		return;
+	}
+
+	pipeMesh.GetTriangles(DirectX::XMMatrixIdentity(), vertices, indices);
+	out << "Pipe.obj: " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, threads: " << jobSystem.GetNumThreads() << std::endl;
+
+	const float bandWidth = 0.2f;
+	const float voxelSizes[] = { 0.1f, 0.05f };
+	SignedDistanceField field;
+	for (float voxelSize : voxelSizes)
+	{
+		long long start = Profiler::GetTimestamp();
+		field.Bake(vertices, indices, voxelSize, bandWidth);
+		double bakeMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+		out << "bake at " << voxelSize << " m: " << field.GetSizeX() << "x" << field.GetSizeY() << "x" << field.GetSizeZ() << " voxels in "
+			<< bakeMs << " ms" << std::endl;
+	}
+
+	// Compare against a brute force search over all triangles, inside the band the error is bounded by interpolation
+	RandomGenerator generator(7);
+	const DirectX::XMFLOAT3& origin = field.GetOrigin();
+	DirectX::XMFLOAT3 extent(field.GetSizeX() * field.GetVoxelSize(), field.GetSizeY() * field.GetVoxelSize(), field.GetSizeZ() * field.GetVoxelSize());
+	float maxError = 0.0f;
+	int numCompared = 0;
+	for (int i = 0; i < 20000 && numCompared < 500; i++)
+	{
+		DirectX::XMFLOAT3 p(origin.x + generator.NextFloat() * extent.x, origin.y + generator.NextFloat() * extent.y, origin.z + generator.NextFloat() * extent.z);
+		float bruteForceSq = FLT_MAX;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			TriangleFeature feature;
+			DirectX::XMFLOAT3 closest = TriangleBvh::ClosestPointOnTriangle(p, vertices[indices[t]], vertices[indices[t + 1]], vertices[indices[t + 2]], feature);
+			float dx = p.x - closest.x;
+			float dy = p.y - closest.y;
+			float dz = p.z - closest.z;
+			bruteForceSq = std::min(bruteForceSq, dx * dx + dy * dy + dz * dz);
+		}
+
+		float bruteForce = std::sqrt(bruteForceSq);
+		if (bruteForce > bandWidth - 2.0f * field.GetVoxelSize())
+			continue;
+
+		maxError = std::max(maxError, std::fabs(std::fabs(field.Sample(p)) - bruteForce));
+		numCompared++;
+	}
+	bool accuracyOk = numCompared > 0 && maxError < field.GetVoxelSize();
+	out << "max error vs brute force over " << numCompared << " points in the band: " << maxError << " m " << Verdict(accuracyOk) << std::endl;
+
+	// Cache round trip
+	const char* cacheFileName = "Benchmark.sdf";
+	field.Save(cacheFileName);
+	SignedDistanceField cached;
+	long long start = Profiler::GetTimestamp();
+	bool fromCache = cached.LoadOrBake(cacheFileName, vertices, indices, field.GetVoxelSize(), bandWidth);
+	double loadMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	bool cacheOk = fromCache && cached.GetDistances() == field.GetDistances();
+	bool staleRejected = !cached.Load(cacheFileName, SignedDistanceField::GetSourceHash(vertices, indices, field.GetVoxelSize(), bandWidth * 2.0f));
+	std::remove(cacheFileName);
+	out << "cache load: " << loadMs << " ms " << Verdict(cacheOk) << ", stale cache rejected " << Verdict(staleRejected) << std::endl;
+
+	// Per particle cost over random positions, most of which are outside the band like in the scene
+	const int numQueries = 1000000;
+	std::vector<DirectX::XMFLOAT3> positions(numQueries);
+	for (DirectX::XMFLOAT3& p : positions)
+		p = DirectX::XMFLOAT3(origin.x + generator.NextFloat() * extent.x, origin.y + generator.NextFloat() * extent.y, origin.z + generator.NextFloat() * extent.z);
+
+	volatile float sink = 0.0f;
+	start = Profiler::GetTimestamp();
+	float sum = 0.0f;
+	for (const DirectX::XMFLOAT3& p : positions)
+		sum += field.Sample(p);
+	double sampleNs = GetElapsedMs(start, Profiler::GetTimestamp()) * 1000000.0 / numQueries;
+	sink = sink + sum;
+
+	int numContacts = 0;
+	start = Profiler::GetTimestamp();
+	for (DirectX::XMFLOAT3& p : positions)
+	{
+		DirectX::XMFLOAT3 velocity(0.0f, -1.0f, 0.0f);
+		numContacts += field.ResolveCollision(p, velocity, 0.1f, 0.2f, 0.1f) ? 1 : 0;
+	}
+	double collisionNs = GetElapsedMs(start, Profiler::GetTimestamp()) * 1000000.0 / numQueries;
+
+	out << "Sample: " << sampleNs << " ns/query" << std::endl;
+	out << "ResolveCollision: " << collisionNs << " ns/particle (" << numContacts * 100.0 / numQueries << "% in contact)" << std::endl;
+}
+
+void Benchmark::BvhBuildAndQuery(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	int numThreads = jobSystem.GetNumThreads();
+
+	StaticMesh pipeMesh("Pipe.obj", nullptr);
+	if (pipeMesh.GetNumVertices() == 0)
+	{
+		out << "Pipe.obj not found, run from the FluidEffect directory." << std::endl;
+		return;
+	}
+
+	std::vector<DirectX::XMFLOAT3> vertices;
+	std::vector<unsigned int> indices;
+	pipeMesh.GetTriangles(DirectX::XMMatrixIdentity(), vertices, indices);
+	int numTriangles = static_cast<int>(indices.size() / 3);
+	out << "Pipe.obj: " << numTriangles << " triangles" << std::endl;
+
+	TriangleBvh bvh;
+	const int buildRuns = 5;
+	int threadCounts[] = { 1, numThreads };
+	for (int threads : threadCounts)
+	{
+		jobSystem.Initialize(threads);
+		long long start = Profiler::GetTimestamp();
+		for (int i = 0; i < buildRuns; i++)
+			bvh.Build(vertices, indices);
+		double buildMs = GetElapsedMs(start, Profiler::GetTimestamp()) / buildRuns;
+		out << "build with " << threads << " threads: " << buildMs << " ms, " << bvh.GetNumNodes() << " 4-wide nodes" << std::endl;
+	}
+
+	// Random segments through the bounds, short ones like particle steps and long ones like picking rays
+	DirectX::XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	DirectX::XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const DirectX::XMFLOAT3& v : vertices)
+	{
+		boundsMin = DirectX::XMFLOAT3(std::min(boundsMin.x, v.x), std::min(boundsMin.y, v.y), std::min(boundsMin.z, v.z));
+		boundsMax = DirectX::XMFLOAT3(std::max(boundsMax.x, v.x), std::max(boundsMax.y, v.y), std::max(boundsMax.z, v.z));
+	}
+
+	RandomGenerator generator(11);
+	const int numSegments = 1000000;
+	const float segmentLengths[] = { 0.2f, 20.0f };
+	std::vector<DirectX::XMFLOAT3> starts(numSegments);
+	std::vector<DirectX::XMFLOAT3> ends(numSegments);
+	std::vector<SegmentHit> hits(numSegments);
+
+	for (float segmentLength : segmentLengths)
+	{
+		for (int i = 0; i < numSegments; i++)
+		{
+			starts[i] = DirectX::XMFLOAT3(generator.NextFloat(boundsMin.x, boundsMax.x), generator.NextFloat(boundsMin.y, boundsMax.y), generator.NextFloat(boundsMin.z, boundsMax.z));
+			DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMVectorSet(generator.NextFloat(-1.0f, 1.0f), generator.NextFloat(-1.0f, 1.0f), generator.NextFloat(-1.0f, 1.0f), 0.0f));
+			DirectX::XMStoreFloat3(&ends[i], DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&starts[i]), DirectX::XMVectorScale(direction, segmentLength)));
+		}
+
+		// Brute force reference for the first few segments
+		int mismatches = 0;
+		const int numChecked = 300;
+		for (int i = 0; i < numChecked; i++)
+		{
+			SegmentHit hit = bvh.IntersectSegment(starts[i], ends[i]);
+			DirectX::XMVECTOR start = DirectX::XMLoadFloat3(&starts[i]);
+			DirectX::XMVECTOR direction = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&ends[i]), start);
+			float closest = FLT_MAX;
+			for (int t = 0; t < numTriangles; t++)
+			{
+				DirectX::XMVECTOR a = DirectX::XMLoadFloat3(&vertices[indices[t * 3]]);
+				DirectX::XMVECTOR edge1 = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&vertices[indices[t * 3 + 1]]), a);
+				DirectX::XMVECTOR edge2 = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&vertices[indices[t * 3 + 2]]), a);
+				DirectX::XMVECTOR p = DirectX::XMVector3Cross(direction, edge2);
+				float determinant = DirectX::XMVectorGetX(DirectX::XMVector3Dot(edge1, p));
+				if (std::fabs(determinant) < 1e-12f)
+					continue;
+
+				DirectX::XMVECTOR s = DirectX::XMVectorSubtract(start, a);
+				float u = DirectX::XMVectorGetX(DirectX::XMVector3Dot(s, p)) / determinant;
+				DirectX::XMVECTOR q = DirectX::XMVector3Cross(s, edge1);
+				float v = DirectX::XMVectorGetX(DirectX::XMVector3Dot(direction, q)) / determinant;
+				float tHit = DirectX::XMVectorGetX(DirectX::XMVector3Dot(edge2, q)) / determinant;
+				if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && tHit >= 0.0f && tHit <= 1.0f)
+					closest = std::min(closest, tHit * segmentLength);
+			}
+
+			bool bruteForceHit = closest != FLT_MAX;
+			if (bruteForceHit != (hit.triangle >= 0) || (bruteForceHit && std::fabs(closest - hit.distance) > 1e-3f))
+				mismatches++;
+		}
+
+		long long start = Profiler::GetTimestamp();
+		int numHits = 0;
+		for (int i = 0; i < numSegments; i++)
+			numHits += bvh.IntersectSegment(starts[i], ends[i]).triangle >= 0 ? 1 : 0;
+		double singleMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+		start = Profiler::GetTimestamp();
+		bvh.IntersectSegments(starts.data(), ends.data(), numSegments, hits.data());
+		double batchMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+		out << segmentLength << " m segments: " << numHits * 100.0 / numSegments << "% hit, " << numSegments / singleMs / 1000.0 << " M queries/s single, "
+			<< numSegments / batchMs / 1000.0 << " M queries/s batched, " << mismatches << " of " << numChecked << " differ from brute force "
+			<< Verdict(mismatches == 0) << std::endl;
+	}
+
+	// Triangles spaced exponentially along x make the tree as deep as floats allow, and gave
+	// denormal centroid extents to the SAH binning
+	{
+		std::vector<DirectX::XMFLOAT3> chainVertices;
+		std::vector<unsigned int> chainIndices;
+		for (float x = 1.0f; x < 1e30f; x *= 1.05f)
+		{
+			unsigned int first = static_cast<unsigned int>(chainVertices.size());
+			chainVertices.push_back(DirectX::XMFLOAT3(x, 0.0f, 0.0f));
+			chainVertices.push_back(DirectX::XMFLOAT3(x, 1.0f, 0.0f));
+			chainVertices.push_back(DirectX::XMFLOAT3(x, 0.0f, 1.0f));
+			chainIndices.insert(chainIndices.end(), { first, first + 1, first + 2 });
+		}
+
+		TriangleBvh chain;
+		chain.Build(chainVertices, chainIndices);
+		int numChainTriangles = chain.GetNumTriangles();
+		int chainMismatches = 0;
+		for (int i = 0; i < numChainTriangles; i++)
+		{
+			float x = chainVertices[i * 3].x;
+			ClosestTriangleHit closest = chain.FindClosest(DirectX::XMFLOAT3(x, 0.25f, 0.25f), 1.0f);
+			SegmentHit hit = chain.IntersectSegment(DirectX::XMFLOAT3(x * 0.99f, 0.25f, 0.25f), DirectX::XMFLOAT3(x * 1.01f, 0.25f, 0.25f));
+			chainMismatches += closest.triangle == i && hit.triangle == i ? 0 : 1;
+		}
+		out << "degenerate chain of " << numChainTriangles << " triangles: stack of " << chain.GetMaxStackSize() << " entries, " << chainMismatches
+			<< " queries miss their triangle " << Verdict(chainMismatches == 0) << std::endl;
+	}
+}
+
+void Benchmark::IsoSurfaceExtraction(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// A lone particle gives a sphere where exp(-k * r) = iso
+	IsoSurfaceExtractor extractor;
+	extractor.m_settings.cellSize = 0.05f;
+	DirectX::XMFLOAT3 center(0.03f, 0.04f, 0.05f);
+	std::vector<DirectX::XMFLOAT3> particles(1, center);
+	extractor.Extract(particles);
+
+	float expectedRadius = std::log(1.0f / extractor.m_settings.isoValue) / extractor.m_settings.fieldFalloff;
+	double radiusSum = 0.0;
+	int numInward = 0;
+	for (const Vertex& vertex : extractor.GetVertices())
+	{
+		DirectX::XMFLOAT3 offset(vertex.position.x - center.x, vertex.position.y - center.y, vertex.position.z - center.z);
+		radiusSum += std::sqrt(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+		numInward += offset.x * vertex.normal.x + offset.y * vertex.normal.y + offset.z * vertex.normal.z <= 0.0f ? 1 : 0;
+	}
+
+	// Winding has to agree with the normals, like in the OBJ meshes
+	const std::vector<Vertex>& vertices = extractor.GetVertices();
+	const std::vector<unsigned int>& indices = extractor.GetIndices();
+	int numFlipped = 0;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		DirectX::XMVECTOR a = DirectX::XMLoadFloat3(&vertices[indices[t]].position);
+		DirectX::XMVECTOR b = DirectX::XMLoadFloat3(&vertices[indices[t + 1]].position);
+		DirectX::XMVECTOR c = DirectX::XMLoadFloat3(&vertices[indices[t + 2]].position);
+		DirectX::XMVECTOR faceNormal = DirectX::XMVector3Cross(DirectX::XMVectorSubtract(b, a), DirectX::XMVectorSubtract(c, a));
+		numFlipped += DirectX::XMVectorGetX(DirectX::XMVector3Dot(faceNormal, DirectX::XMLoadFloat3(&vertices[indices[t]].normal))) < 0.0f ? 1 : 0;
+	}
+
+	float meanRadius = vertices.empty() ? 0.0f : static_cast<float>(radiusSum / vertices.size());
+	int numOpenEdges = CountOpenEdges(indices);
+	bool sphereOk = std::fabs(meanRadius - expectedRadius) < 0.01f && numInward == 0 && numFlipped == 0 && numOpenEdges == 0;
+	out << "single particle: mean radius " << meanRadius << " m (expected " << expectedRadius << "), " << numInward << " inward normals, "
+		<< numFlipped << " flipped triangles, " << numOpenEdges << " open edges " << Verdict(sphereOk) << std::endl;
+
+	// OBJ round trip through the mesh loader
+	const char* objFileName = "Benchmark.obj";
+	extractor.ExportObj(objFileName);
+	StaticMesh exported(objFileName, nullptr);
+	std::remove(objFileName);
+	bool exportOk = exported.GetNumVertices() == static_cast<int>(vertices.size()) && exported.GetNumIndices() == static_cast<int>(indices.size());
+	out << "OBJ export: " << exported.GetNumVertices() << " vertices, " << exported.GetNumIndices() / 3 << " triangles read back " << Verdict(exportOk) << std::endl;
+
+	// Jittered blobs at goo density, extracted at several resolutions
+	out << "threads: " << jobSystem.GetNumThreads() << std::endl;
+	RandomGenerator generator(5);
+	const int particleCounts[] = { 1000, 10000, 50000 };
+	const float cellSizes[] = { 0.2f, 0.1f, 0.05f };
+	const float spacing = 0.3f;
+	for (int numParticles : particleCounts)
+	{
+		std::vector<DirectX::XMFLOAT3> velocities;
+		DirectX::XMFLOAT3 boundsMin, boundsMax;
+		SetupDamBreak(numParticles, spacing, particles, velocities, boundsMin, boundsMax);
+		for (DirectX::XMFLOAT3& p : particles)
+		{
+			p.x += generator.NextFloat(-0.3f, 0.3f) * spacing;
+			p.y += generator.NextFloat(-0.3f, 0.3f) * spacing;
+			p.z += generator.NextFloat(-0.3f, 0.3f) * spacing;
+		}
+
+		for (float cellSize : cellSizes)
+		{
+			extractor.m_settings.cellSize = cellSize;
+			extractor.Extract(particles);
+
+			const int runs = 3;
+			long long start = Profiler::GetTimestamp();
+			for (int i = 0; i < runs; i++)
+				extractor.Extract(particles);
+			double extractMs = GetElapsedMs(start, Profiler::GetTimestamp()) / runs;
+
+			numOpenEdges = CountOpenEdges(extractor.GetIndices());
+			out << numParticles << " particles at " << cellSize << " m cells: " << extractMs << " ms, " << extractor.GetNumActiveBlocks() << " blocks, "
+				<< extractor.GetVertices().size() << " vertices, " << extractor.GetIndices().size() / 3 << " triangles, " << numOpenEdges << " open edges "
+				<< Verdict(numOpenEdges == 0) << std::endl;
+		}
+	}
+}
+
+void Benchmark::DensityCache(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	out << "threads: " << jobSystem.GetNumThreads() << std::endl;
+
+	RandomGenerator generator(3);
+	const int particleCounts[] = { 1000, 10000 };
+	const float voxelSizes[] = { 0.1f, 0.05f };
+	const float spacing = 0.3f;
+	SparseDensityGrid grid;
+	std::vector<DirectX::XMFLOAT3> particles;
+	std::vector<DirectX::XMFLOAT3> velocities;
+	for (int numParticles : particleCounts)
+	{
+		DirectX::XMFLOAT3 boundsMin, boundsMax;
+		SetupDamBreak(numParticles, spacing, particles, velocities, boundsMin, boundsMax);
+		boundsMax = boundsMin;
+		for (DirectX::XMFLOAT3& p : particles)
+		{
+			p.x += generator.NextFloat(-0.3f, 0.3f) * spacing;
+			p.y += generator.NextFloat(-0.3f, 0.3f) * spacing;
+			p.z += generator.NextFloat(-0.3f, 0.3f) * spacing;
+			boundsMax = DirectX::XMFLOAT3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+		}
+
+		// Query points around the blob, reference values by summing over every particle
+		const int numChecked = 2000;
+		std::vector<DirectX::XMFLOAT3> queries(numChecked);
+		for (DirectX::XMFLOAT3& q : queries)
+			q = DirectX::XMFLOAT3(generator.NextFloat(-0.5f, boundsMax.x + 0.5f), generator.NextFloat(-0.5f, boundsMax.y + 0.5f), generator.NextFloat(-0.5f, boundsMax.z + 0.5f));
+
+		for (float voxelSize : voxelSizes)
+		{
+			grid.m_settings.voxelSize = voxelSize;
+			grid.Splat(particles);
+
+			const int runs = 3;
+			long long start = Profiler::GetTimestamp();
+			for (int i = 0; i < runs; i++)
+				grid.Splat(particles);
+			double splatMs = GetElapsedMs(start, Profiler::GetTimestamp()) / runs;
+
+			// Errors near the iso surface matter for rendering, deep inside only the sign does.
+			// Within 10% of the 0.5 iso value passes.
+			float maxError = 0.0f;
+			float maxSurfaceError = 0.0f;
+			float maxAngle = 0.0f;
+			double errorSum = 0.0;
+			start = Profiler::GetTimestamp();
+			for (const DirectX::XMFLOAT3& q : queries)
+			{
+				float direct = grid.EvaluateDirect(particles, q);
+				float error = std::fabs(grid.Sample(q) - direct);
+				maxError = std::max(maxError, error);
+				errorSum += error;
+				if (direct < 0.25f || direct > 1.0f)
+					continue;
+
+				maxSurfaceError = std::max(maxSurfaceError, error);
+				DirectX::XMVECTOR directGradient = DirectX::XMVectorZero();
+				for (const DirectX::XMFLOAT3& p : particles)
+				{
+					DirectX::XMVECTOR offset = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&q), DirectX::XMLoadFloat3(&p));
+					float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(offset));
+					if (distance > 0.0f && distance < grid.m_settings.cutoffRadius)
+						directGradient = DirectX::XMVectorAdd(directGradient, DirectX::XMVectorScale(offset, -grid.m_settings.fieldFalloff * std::exp(-grid.m_settings.fieldFalloff * distance) / distance));
+				}
+				DirectX::XMFLOAT3 cachedGradient = grid.SampleGradient(q);
+				float cosine = DirectX::XMVectorGetX(DirectX::XMVector3Dot(DirectX::XMVector3Normalize(directGradient), DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&cachedGradient))));
+				maxAngle = std::max(maxAngle, std::acos(std::min(1.0f, cosine)) * 57.29578f);
+			}
+			double directNs = GetElapsedMs(start, Profiler::GetTimestamp()) * 1000000.0 / numChecked;
+
+			const int numQueries = 1000000;
+			volatile float sink = 0.0f;
+			float sum = 0.0f;
+			start = Profiler::GetTimestamp();
+			for (int i = 0; i < numQueries; i++)
+				sum += grid.Sample(queries[i % numChecked]);
+			double sampleNs = GetElapsedMs(start, Profiler::GetTimestamp()) * 1000000.0 / numQueries;
+			sink = sink + sum;
+
+			bool errorOk = maxSurfaceError < 0.05f && maxAngle < 10.0f;
+			out << numParticles << " particles at " << voxelSize << " m voxels: splat " << splatMs << " ms, " << grid.GetNumBricks() << " bricks, "
+				<< grid.GetMemoryUsage() / 1024 << " KB (" << grid.GetMemoryUsage() / std::max(1, grid.GetNumBricks()) << " bytes per brick)" << std::endl;
+			out << "  error vs direct sum: max " << maxError << ", mean " << errorSum / numChecked << ", near the surface max " << maxSurfaceError
+				<< " and " << maxAngle << " degrees gradient " << Verdict(errorOk) << std::endl;
+			out << "  Sample: " << sampleNs << " ns/query, direct sum with gradient check: " << directNs / 1000.0 << " us/query" << std::endl;
+		}
+	}
+}
+
+void Benchmark::SimulationRecording(std::ostream& out)
+{
+	// Ballistic spray from an emitter with a floor, dying particles drop out in place and new ones are appended
+	const int numParticles = 10000;
+	const int numFrames = 480;
+	const float deltaTime = 1.0f / 240.0f;
+	const DirectX::XMFLOAT3 emitter = { 0.0f, 5.0f, 0.0f };
+	const DirectX::XMFLOAT3 boundsMin = { emitter.x - 20.0f, emitter.y - 10.0f, emitter.z - 20.0f };
+	const DirectX::XMFLOAT3 boundsMax = { emitter.x + 30.0f, emitter.y + 40.0f, emitter.z + 20.0f };
+	const float maxSpeed = 30.0f;
+	const char* fileName = "BenchmarkRecording.rec";
+
+	RandomGenerator generator(11);
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> velocities;
+	std::vector<float> timesToLive;
+	std::vector<uint32_t> sourceIds;
+	uint32_t nextSourceId = 0;
+	auto spawn = [&](float age)
+	{
+		DirectX::XMFLOAT3 velocity = { 7.0f + generator.NextFloat(-1.0f, 1.0f), 2.0f + generator.NextFloat(-1.0f, 1.0f), generator.NextFloat(-1.0f, 1.0f) };
+		positions.push_back(DirectX::XMFLOAT3(emitter.x + velocity.x * age, emitter.y + velocity.y * age, emitter.z + velocity.z * age));
+		velocities.push_back(velocity);
+		timesToLive.push_back(generator.NextFloat(1.2f, 1.8f) - age);
+		sourceIds.push_back(nextSourceId++);
+	};
+	for (int i = 0; i < numParticles; i++)
+		spawn(generator.NextFloat(0.0f, 1.2f));
+
+	// Ground truth of every 40th frame for the replay checks, with the frame it became in the file
+	// and its time. A frame dropped because the writer was behind is not checked.
+	const int checkInterval = 40;
+	std::vector<std::vector<DirectX::XMFLOAT3>> checkedPositions;
+	std::vector<std::vector<DirectX::XMFLOAT3>> checkedVelocities;
+	std::vector<std::vector<uint32_t>> checkedSourceIds;
+	std::vector<int> checkedFrames;
+	std::vector<float> checkedTimes;
+
+	SimulationRecorder recorder;
+	if (!recorder.Open(fileName, boundsMin, boundsMax, maxSpeed))
+	{
+		out << "could not open " << fileName << " " << Verdict(false) << std::endl;
+		return;
+	}
+
+	// Paced like a 240 Hz frame loop, so the writer has the rest of the frame to encode
+	double recordMsSum = 0.0;
+	double recordMsMax = 0.0;
+	long long frameStart = Profiler::GetTimestamp();
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		int numAlive = 0;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			timesToLive[i] -= deltaTime;
+			if (timesToLive[i] <= 0.0f)
+				continue;
+
+			velocities[i].y -= 9.81f * deltaTime;
+			positions[i].x += velocities[i].x * deltaTime;
+			positions[i].y += velocities[i].y * deltaTime;
+			positions[i].z += velocities[i].z * deltaTime;
+			if (positions[i].y < 0.0f)
+			{
+				positions[i].y = -positions[i].y;
+				velocities[i].y *= -0.5f;
+			}
+
+			positions[numAlive] = positions[i];
+			velocities[numAlive] = velocities[i];
+			timesToLive[numAlive] = timesToLive[i];
+			sourceIds[numAlive] = sourceIds[i];
+			numAlive++;
+		}
+		positions.resize(numAlive);
+		velocities.resize(numAlive);
+		timesToLive.resize(numAlive);
+		sourceIds.resize(numAlive);
+		while (positions.size() < numParticles)
+			spawn(generator.NextFloat(0.0f, deltaTime));
+
+		int numDropped = recorder.GetNumDroppedFrames();
+		long long start = Profiler::GetTimestamp();
+		recorder.RecordFrame((frame + 1) * deltaTime, positions, velocities, sourceIds);
+		double recordMs = GetElapsedMs(start, Profiler::GetTimestamp());
+		recordMsSum += recordMs;
+		recordMsMax = std::max(recordMsMax, recordMs);
+
+		if (frame % checkInterval == 0 && recorder.GetNumDroppedFrames() == numDropped)
+		{
+			checkedPositions.push_back(positions);
+			checkedVelocities.push_back(velocities);
+			checkedSourceIds.push_back(sourceIds);
+			checkedFrames.push_back(recorder.GetNumFrames() - 1);
+			checkedTimes.push_back((frame + 1) * deltaTime);
+		}
+
+		long long frameEnd = frameStart + static_cast<long long>(deltaTime * 1e9);
+		while (Profiler::GetTimestamp() < frameEnd)
+			std::this_thread::yield();
+		frameStart = frameEnd;
+	}
+
+	recorder.Close();
+	int numRecorded = recorder.GetNumFrames();
+	double recordMs = recordMsSum / numFrames;
+	uint64_t fileSize = recorder.GetNumBytesWritten();
+	out << numParticles << " particles, " << numFrames << " frames at 240 Hz: RecordFrame avg " << recordMs << " ms, max " << recordMsMax << " ms "
+		<< Verdict(recordMs < 0.2) << std::endl;
+	out << "  " << recorder.GetNumDroppedFrames() << " frames dropped while the writer was behind" << std::endl;
+	out << "  file: " << fileSize / 1024 << " KB, " << static_cast<double>(fileSize) / std::max(1, numRecorded) / numParticles << " bytes per particle and frame (raw floats: 24)" << std::endl;
+
+	// Half a quantization step per axis
+	float positionTolerance = 0.0f;
+	positionTolerance = std::max(positionTolerance, 0.5f * (boundsMax.x - boundsMin.x) / 65535.0f);
+	positionTolerance = std::max(positionTolerance, 0.5f * (boundsMax.y - boundsMin.y) / 65535.0f);
+	positionTolerance = std::max(positionTolerance, 0.5f * (boundsMax.z - boundsMin.z) / 65535.0f);
+	positionTolerance *= 1.01f;
+	float velocityTolerance = 0.5f * maxSpeed / 32767.0f * 1.01f;
+
+	SimulationReplayer replayer;
+	if (!replayer.Open(fileName))
+	{
+		out << "could not replay " << fileName << " " << Verdict(false) << std::endl;
+		return;
+	}
+
+	auto getError = [&](int check, const std::vector<DirectX::XMFLOAT3>& replayedPositions, const std::vector<DirectX::XMFLOAT3>& replayedVelocities, float& positionError, float& velocityError)
+	{
+		if (replayedPositions.size() != checkedPositions[check].size())
+			return false;
+		for (size_t i = 0; i < replayedPositions.size(); i++)
+		{
+			const DirectX::XMFLOAT3& p = checkedPositions[check][i];
+			const DirectX::XMFLOAT3& v = checkedVelocities[check][i];
+			positionError = std::max(positionError, std::max(std::fabs(replayedPositions[i].x - p.x), std::max(std::fabs(replayedPositions[i].y - p.y), std::fabs(replayedPositions[i].z - p.z))));
+			velocityError = std::max(velocityError, std::max(std::fabs(replayedVelocities[i].x - v.x), std::max(std::fabs(replayedVelocities[i].y - v.y), std::fabs(replayedVelocities[i].z - v.z))));
+		}
+		return true;
+	};
+
+	std::vector<DirectX::XMFLOAT3> replayedPositions;
+	std::vector<DirectX::XMFLOAT3> replayedVelocities;
+	std::vector<uint32_t> replayedIds;
+	std::vector<std::vector<uint32_t>> checkedReplayedIds;
+	float positionError = 0.0f;
+	float velocityError = 0.0f;
+	bool sizesMatch = replayer.GetNumFrames() == numRecorded;
+	long long start = Profiler::GetTimestamp();
+	size_t nextCheck = 0;
+	for (int frame = 0; frame < replayer.GetNumFrames(); frame++)
+	{
+		sizesMatch &= replayer.ReadFrame(frame, replayedPositions, replayedVelocities, replayedIds);
+		if (nextCheck < checkedFrames.size() && checkedFrames[nextCheck] == frame)
+		{
+			sizesMatch &= getError(static_cast<int>(nextCheck), replayedPositions, replayedVelocities, positionError, velocityError);
+			checkedReplayedIds.push_back(replayedIds);
+			nextCheck++;
+		}
+	}
+	sizesMatch &= nextCheck == checkedFrames.size();
+	double readMs = GetElapsedMs(start, Profiler::GetTimestamp()) / std::max(1, replayer.GetNumFrames());
+	bool replayOk = sizesMatch && positionError <= positionTolerance && velocityError <= velocityTolerance;
+	out << "  sequential replay: " << readMs << " ms per frame, max error " << positionError * 1000.0f << " mm, " << velocityError * 1000.0f << " mm/s "
+		<< Verdict(replayOk) << std::endl;
+
+	// Replayed ids must follow the simulated particles across the keyframes between two checks: a
+	// surviving particle keeps its id and a new one gets an id not seen before
+	int numIdMismatches = 0;
+	int numSurvivors = 0;
+	for (size_t check = 1; check < checkedReplayedIds.size(); check++)
+	{
+		std::unordered_map<uint32_t, uint32_t> replayedOfSource;
+		std::unordered_set<uint32_t> previousReplayed(checkedReplayedIds[check - 1].begin(), checkedReplayedIds[check - 1].end());
+		for (size_t i = 0; i < checkedSourceIds[check - 1].size() && i < checkedReplayedIds[check - 1].size(); i++)
+			replayedOfSource[checkedSourceIds[check - 1][i]] = checkedReplayedIds[check - 1][i];
+		for (size_t i = 0; i < checkedSourceIds[check].size() && i < checkedReplayedIds[check].size(); i++)
+		{
+			auto survivor = replayedOfSource.find(checkedSourceIds[check][i]);
+			bool isSurvivor = survivor != replayedOfSource.end();
+			numSurvivors += isSurvivor ? 1 : 0;
+			bool isSame = isSurvivor ? survivor->second == checkedReplayedIds[check][i] : previousReplayed.count(checkedReplayedIds[check][i]) == 0;
+			numIdMismatches += isSame ? 0 : 1;
+		}
+	}
+	out << "  replayed ids: " << numSurvivors << " survivors between checks, " << numIdMismatches << " mismatches "
+		<< Verdict(checkedReplayedIds.size() == checkedFrames.size() && numSurvivors > 0 && numIdMismatches == 0) << std::endl;
+
+	// A replaying particle system keeps the particle of every surviving id and takes the new ones
+	// from the spawner's recycled particles. After the first frame only the free list grows now and
+	// then, allocating every born particle would be dozens per frame.
+	{
+		NullRenderDevice device;
+		ParticleSystem replaySystem(emitter, &device, L"GooShader.hlsl", true);
+		replaySystem.SetReplaying(true);
+		std::unordered_map<uint32_t, uint32_t> systemIdOfReplayed;
+		std::vector<DirectX::XMFLOAT3> systemPositions;
+		std::vector<DirectX::XMFLOAT3> systemVelocities;
+		std::vector<uint32_t> systemIds;
+		int numKept = 0;
+		int numLost = 0;
+		uint64_t numAllocations = 0;
+		bool wasTracking = HeapTracker::IsTracking();
+		for (int frame = 0; frame < replayer.GetNumFrames(); frame++)
+		{
+			replayer.ReadFrame(frame, replayedPositions, replayedVelocities, replayedIds);
+			HeapTracker::SetTracking(frame > 0);
+			uint64_t allocationsBefore = HeapTracker::GetNumAllocations();
+			replaySystem.SetParticleStates(replayedPositions, replayedVelocities, replayedIds);
+			numAllocations += HeapTracker::GetNumAllocations() - allocationsBefore;
+			HeapTracker::SetTracking(wasTracking);
+
+			replaySystem.GetParticleStates(systemPositions, systemVelocities, systemIds);
+			for (size_t i = 0; i < replayedIds.size(); i++)
+			{
+				auto previous = systemIdOfReplayed.find(replayedIds[i]);
+				if (previous == systemIdOfReplayed.end())
+					continue;
+				numKept += previous->second == systemIds[i] ? 1 : 0;
+				numLost += previous->second == systemIds[i] ? 0 : 1;
+			}
+			systemIdOfReplayed.clear();
+			for (size_t i = 0; i < replayedIds.size(); i++)
+				systemIdOfReplayed[replayedIds[i]] = systemIds[i];
+		}
+		out << "  replaying particle system: " << numKept << " particles kept, " << numLost << " replaced while alive, " << numAllocations << " allocations "
+			<< Verdict(numKept > 0 && numLost == 0 && numAllocations < static_cast<uint64_t>(replayer.GetNumFrames()) / 10) << std::endl;
+	}
+
+	// Seek by time in random order, every seek decodes from its chunk's keyframe
+	int numChecks = static_cast<int>(checkedPositions.size());
+	positionError = 0.0f;
+	velocityError = 0.0f;
+	sizesMatch = true;
+	double seekMsMax = 0.0;
+	for (int i = 0; i < numChecks; i++)
+	{
+		int check = (i * 7) % numChecks;
+		int frame = replayer.FindFrame(checkedTimes[check] + 0.25f * deltaTime);
+		sizesMatch &= frame == checkedFrames[check];
+
+		start = Profiler::GetTimestamp();
+		sizesMatch &= replayer.ReadFrame(frame, replayedPositions, replayedVelocities, replayedIds);
+		seekMsMax = std::max(seekMsMax, GetElapsedMs(start, Profiler::GetTimestamp()));
+		sizesMatch &= getError(check, replayedPositions, replayedVelocities, positionError, velocityError);
+	}
+	bool seekOk = sizesMatch && positionError <= positionTolerance && velocityError <= velocityTolerance;
+	out << "  random seeks: max " << seekMsMax << " ms (at most " << SimulationRecorder::FRAMES_PER_CHUNK << " frames decoded) " << Verdict(seekOk) << std::endl;
+	replayer.Close();
+
+	// A recording cut off by a crash has no index, everything up to the last complete frame is recovered
+	const char* truncatedName = "BenchmarkRecordingTruncated.rec";
+	{
+		std::ifstream source(fileName, std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+		std::ofstream truncated(truncatedName, std::ios::binary);
+		truncated.write(bytes.data(), bytes.size() * 2 / 3);
+	}
+	bool recovered = replayer.Open(truncatedName) && replayer.GetNumFrames() > 0 && replayer.GetNumFrames() < numRecorded;
+	recovered = recovered && replayer.ReadFrame(replayer.GetNumFrames() - 1, replayedPositions, replayedVelocities, replayedIds) && replayedPositions.size() == numParticles;
+	out << "  truncated file: recovered " << replayer.GetNumFrames() << " of " << numRecorded << " frames " << Verdict(recovered) << std::endl;
+	replayer.Close();
+
+	// Frames handed over faster than the writer encodes them are dropped instead of waited for, the
+	// ones written still replay
+	{
+		SimulationRecorder burstRecorder;
+		const int numBurstFrames = 200;
+		double burstMsMax = 0.0;
+		bool burstOk = burstRecorder.Open(fileName, boundsMin, boundsMax, maxSpeed);
+		for (int frame = 0; burstOk && frame < numBurstFrames; frame++)
+		{
+			long long start = Profiler::GetTimestamp();
+			burstRecorder.RecordFrame(frame * deltaTime, positions, velocities, sourceIds);
+			burstMsMax = std::max(burstMsMax, GetElapsedMs(start, Profiler::GetTimestamp()));
+		}
+		burstRecorder.Close();
+		int numBurstRecorded = burstRecorder.GetNumFrames();
+		burstOk = burstOk && numBurstRecorded + burstRecorder.GetNumDroppedFrames() == numBurstFrames && replayer.Open(fileName) && replayer.GetNumFrames() == numBurstRecorded;
+		for (int frame = 0; burstOk && frame < replayer.GetNumFrames(); frame++)
+			burstOk = replayer.ReadFrame(frame, replayedPositions, replayedVelocities, replayedIds) && replayedPositions.size() == positions.size();
+		replayer.Close();
+		out << "  " << numBurstFrames << " frames back to back: " << burstRecorder.GetNumDroppedFrames() << " dropped, RecordFrame max " << burstMsMax << " ms "
+			<< Verdict(burstOk) << std::endl;
+	}
+
+	std::remove(fileName);
+	std::remove(truncatedName);
+}
+
+void Benchmark::SharedParticleExport(std::ostream& out)
+{
+	// The reader is another process started with -sharedcheck and only shares the name. Every value
+	// of a frame encodes its frame number, so a torn frame that passed Release would show up there.
+	const int numParticles = 10000;
+	const double maxSeconds = 60.0;
+	const std::string name = "Local\\FluidEffectParticlesBenchmark";
+
+	SharedParticleExporter exporter;
+	if (!exporter.Open(name, numParticles))
+	{
+		out << "could not create " << name << " " << Verdict(false) << std::endl;
+		return;
+	}
+
+	std::remove("SharedCheck.txt");
+	ProcessHandle reader;
+	if (!StartProcessOfSelf({ "-sharedcheck", name }, reader))
+	{
+		out << "could not start the reader process " << Verdict(false) << std::endl;
+		return;
+	}
+
+	// As fast as possible to provoke overwrites while the reader is still reading, until it has seen enough
+	std::vector<DirectX::XMFLOAT3> positions(numParticles);
+	std::vector<DirectX::XMFLOAT3> velocities(numParticles);
+	double publishMsSum = 0.0;
+	double publishMsMax = 0.0;
+	int numFrames = 0;
+	int readerExitCode = 1;
+	bool readerExited = false;
+	long long startTime = Profiler::GetTimestamp();
+	while (!readerExited && GetElapsedMs(startTime, Profiler::GetTimestamp()) < maxSeconds * 1000.0)
+	{
+		float value = static_cast<float>(numFrames);
+		for (int i = 0; i < numParticles; i++)
+		{
+			positions[i] = DirectX::XMFLOAT3(value, static_cast<float>(i), -value);
+			velocities[i] = DirectX::XMFLOAT3(value * 0.5f, value + 1.0f, value - 1.0f);
+		}
+
+		long long start = Profiler::GetTimestamp();
+		exporter.Publish(numFrames * 0.01f, positions, velocities);
+		double publishMs = GetElapsedMs(start, Profiler::GetTimestamp());
+		publishMsSum += publishMs;
+		publishMsMax = std::max(publishMsMax, publishMs);
+		numFrames++;
+
+		if (numFrames % 100 == 0)
+		{
+			std::this_thread::yield();
+			readerExited = HasProcessExited(reader, readerExitCode);
+		}
+	}
+
+	// Closing unlinks the name, a reader that is still waiting for frames gives up on its own
+	exporter.Close();
+	while (!readerExited)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		readerExited = HasProcessExited(reader, readerExitCode);
+	}
+
+	std::string readerReport;
+	std::ifstream reportFile("SharedCheck.txt");
+	std::getline(reportFile, readerReport);
+	reportFile.close();
+	std::remove("SharedCheck.txt");
+
+	out << numParticles << " particles, " << numFrames << " frames: Publish avg " << publishMsSum / std::max(numFrames, 1) << " ms, max " << publishMsMax << " ms" << std::endl;
+	out << "  reader process: " << (readerReport.empty() ? "no report" : readerReport) << " " << Verdict(readerExitCode == 0) << std::endl;
+}
+
+int Benchmark::RunSharedParticleCheck(const std::string& name, std::ostream& out)
+{
+	const int numFramesToRead = 1000;
+	const double maxOpenMs = 10000.0;
+	const double maxIdleMs = 2000.0;
+
+	SharedParticleReader reader;
+	long long startTime = Profiler::GetTimestamp();
+	while (!reader.Open(name))
+	{
+		if (GetElapsedMs(startTime, Profiler::GetTimestamp()) > maxOpenMs)
+		{
+			out << "could not open " << name << std::endl;
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	// Stops early when the exporter goes quiet
+	uint64_t lastFrame = ~0ull;
+	int numRead = 0;
+	int numOverwritten = 0;
+	int numTorn = 0;
+	long long lastReadTime = Profiler::GetTimestamp();
+	SharedParticleFrame frame;
+	while (numRead < numFramesToRead && GetElapsedMs(lastReadTime, Profiler::GetTimestamp()) < maxIdleMs)
+	{
+		if (!reader.AcquireLatest(frame) || frame.frame == lastFrame)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		bool isConsistent = frame.numParticles > 0;
+		float expected = static_cast<float>(frame.frame);
+		for (int i = 0; i < frame.numParticles; i++)
+		{
+			isConsistent &= frame.arrays[SHARED_POSITION_X][i] == expected && frame.arrays[SHARED_POSITION_Y][i] == static_cast<float>(i);
+			isConsistent &= frame.arrays[SHARED_POSITION_Z][i] == -expected && frame.arrays[SHARED_VELOCITY_X][i] == expected * 0.5f;
+			isConsistent &= frame.arrays[SHARED_VELOCITY_Y][i] == expected + 1.0f && frame.arrays[SHARED_VELOCITY_Z][i] == expected - 1.0f;
+		}
+
+		if (!reader.Release(frame))
+		{
+			numOverwritten++;
+			continue;
+		}
+
+		numTorn += isConsistent ? 0 : 1;
+		numRead++;
+		lastFrame = frame.frame;
+		lastReadTime = Profiler::GetTimestamp();
+	}
+
+	out << numRead << " frames read, " << numOverwritten << " overwritten while reading, " << numTorn << " torn" << std::endl;
+	return numRead == numFramesToRead && numTorn == 0 ? 0 : 1;
+}
+
+void Benchmark::NeighborCacheReuse(std::ostream& out)
+{
+	// The emitter of EngineMain.cpp at its default spawn rate, the highest one reachable with E and a stress rate
+	const float spawnRates[] = { 6.0f, 40.0f, 1000.0f };
+	const float skins[] = { 0.0f, 0.25f, 0.5f, 1.0f };
+	const int numSkins = sizeof(skins) / sizeof(skins[0]);
+	const float deltaTime = 1.0f / 60.0f;
+	const int numFrames = 600;
+	const int warmupFrames = 120;
+	const int maxNeighbors = MAX_NEARBY_PARTICLES - 1;
+
+	for (float spawnRate : spawnRates)
+	{
+		std::vector<Particle*> particles;
+		ParticleSpawner spawner({ -6.0f, 7.5f, 0.0f }, particles, nullptr);
+		spawner.m_timeToLive = 1.5f;
+		spawner.m_spawnRate = spawnRate;
+		spawner.m_srVariance = 0.5f;
+		spawner.m_direction = { 1.0f, 0.25f, 0.0f };
+		spawner.m_dVariance = 0.1f;
+		spawner.m_vVariance = 0.3f;
+		spawner.m_velocity = 7.0f;
+
+		// Skin 0 rebuilds every frame
+		NeighborCache caches[numSkins];
+		double cacheMs[numSkins] = {};
+		uint64_t cacheEvals[numSkins] = {};
+		int rebuildsAfterWarmup[numSkins] = {};
+		int directFrames[numSkins] = {};
+		for (int s = 0; s < numSkins; s++)
+		{
+			caches[s].m_settings.skin = skins[s];
+			caches[s].m_settings.maxNeighbors = maxNeighbors;
+		}
+
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<uint32_t> ids;
+		std::vector<std::pair<float, int>> sorted;
+		int neighbors[NeighborCache::MAX_NEIGHBORS];
+		double allPairsMs = 0.0;
+		int numAllPairsFrames = 0;
+		int numMismatches = 0;
+		int numChecked = 0;
+		int maxParticles = 0;
+
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			for (size_t i = 0; i < particles.size();)
+			{
+				particles[i]->Update(deltaTime);
+				if (particles[i]->GetTimeToLive() <= 0.0f)
+				{
+					delete particles[i];
+					particles.erase(particles.begin() + i);
+				}
+				else
+				{
+					i++;
+				}
+			}
+			spawner.Update(deltaTime);
+
+			int numParticles = static_cast<int>(particles.size());
+			maxParticles = std::max(maxParticles, numParticles);
+			positions.resize(numParticles);
+			ids.resize(numParticles);
+			for (int i = 0; i < numParticles; i++)
+			{
+				positions[i] = particles[i]->GetPosition();
+				ids[i] = particles[i]->GetId();
+			}
+
+			if (frame == warmupFrames)
+			{
+				for (int s = 0; s < numSkins; s++)
+					rebuildsAfterWarmup[s] = caches[s].GetNumRebuilds();
+			}
+
+			for (int s = 0; s < numSkins; s++)
+			{
+				uint64_t numEvals = 0;
+				long long start = Profiler::GetTimestamp();
+				caches[s].Update(positions, ids);
+				for (int i = 0; i < numParticles; i++)
+					caches[s].FindNearest(i, maxNeighbors, neighbors, numEvals);
+				if (frame >= warmupFrames)
+				{
+					cacheMs[s] += GetElapsedMs(start, Profiler::GetTimestamp());
+					cacheEvals[s] += numEvals;
+					directFrames[s] += caches[s].IsDirect() ? 1 : 0;
+				}
+			}
+
+			// The previous search scanned all particles for every particle, only sampled at high counts
+			if (frame >= warmupFrames && (numParticles <= 200 || frame % 30 == 0))
+			{
+				long long start = Profiler::GetTimestamp();
+				float sink = 0.0f;
+				for (int i = 0; i < numParticles; i++)
+				{
+					float nearestSq[MAX_NEARBY_PARTICLES];
+					for (int j = 0; j < numParticles; j++)
+					{
+						float dx = positions[j].x - positions[i].x, dy = positions[j].y - positions[i].y, dz = positions[j].z - positions[i].z;
+						float distanceSq = dx * dx + dy * dy + dz * dz;
+						if (j < MAX_NEARBY_PARTICLES)
+						{
+							nearestSq[j] = distanceSq;
+							continue;
+						}
+						int furthest = 0;
+						for (int k = 1; k < MAX_NEARBY_PARTICLES; k++)
+							furthest = nearestSq[k] > nearestSq[furthest] ? k : furthest;
+						if (distanceSq < nearestSq[furthest])
+							nearestSq[furthest] = distanceSq;
+					}
+					sink += nearestSq[0];
+				}
+				allPairsMs += GetElapsedMs(start, Profiler::GetTimestamp());
+				numAllPairsFrames++;
+				volatile float keep = sink;
+				(void)keep;
+			}
+
+			// Cached lists must give exactly the nearest particles within the radius (equally far ones in any order)
+			for (int s = 1; s < numSkins; s++)
+			{
+				for (int i = 0; i < numParticles; i += std::max(1, numParticles / 50))
+				{
+					uint64_t unused = 0;
+					int numFound = caches[s].FindNearest(i, maxNeighbors, neighbors, unused);
+					float radiusSq = caches[s].m_settings.radius * caches[s].m_settings.radius;
+					sorted.clear();
+					for (int j = 0; j < numParticles; j++)
+					{
+						float dx = positions[j].x - positions[i].x, dy = positions[j].y - positions[i].y, dz = positions[j].z - positions[i].z;
+						float distanceSq = dx * dx + dy * dy + dz * dz;
+						if (j != i && distanceSq <= radiusSq)
+							sorted.push_back(std::make_pair(distanceSq, j));
+					}
+					std::sort(sorted.begin(), sorted.end());
+					int numReference = std::min(static_cast<int>(sorted.size()), maxNeighbors);
+
+					bool isSame = numFound == numReference;
+					for (int k = 0; k < numReference && isSame; k++)
+					{
+						const DirectX::XMFLOAT3& p = positions[neighbors[k]];
+						float dx = p.x - positions[i].x, dy = p.y - positions[i].y, dz = p.z - positions[i].z;
+						isSame = dx * dx + dy * dy + dz * dz == sorted[k].first;
+					}
+					numMismatches += isSame ? 0 : 1;
+					numChecked++;
+				}
+			}
+		}
+
+		// The skin must not cost more than rebuilding every frame, with a margin for timer noise
+		int measuredFrames = numFrames - warmupFrames;
+		double everyFrameMs = cacheMs[0] / measuredFrames;
+		out << spawnRate << " particles/s (up to " << maxParticles << " alive), previous all pairs search " << allPairsMs / std::max(1, numAllPairsFrames)
+			<< " ms, rebuilding every frame " << everyFrameMs << " ms (" << cacheEvals[0] / measuredFrames << " distances)" << std::endl;
+		for (int s = 1; s < numSkins; s++)
+		{
+			double rebuildRate = static_cast<double>(caches[s].GetNumRebuilds() - rebuildsAfterWarmup[s]) / measuredFrames;
+			double ms = cacheMs[s] / measuredFrames;
+			out << "  skin " << skins[s] << " m: rebuilt on " << rebuildRate * 100.0 << "% of frames, direct on " << directFrames[s] * 100 / measuredFrames
+				<< "%, " << ms << " ms (" << cacheEvals[s] / measuredFrames << " distances), saves " << everyFrameMs - ms << " ms per frame "
+				<< Verdict(ms <= 1.15 * everyFrameMs + 0.05) << std::endl;
+		}
+		out << "  " << numChecked << " queries against the exact nearest particles: " << numMismatches << " mismatches " << Verdict(numMismatches == 0) << std::endl;
+
+		for (Particle* particle : particles)
+			delete particle;
+	}
+}
+
+void Benchmark::MortonReorder(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	const int numParticles = 100000;
+	const int numSearches = 10;
+	const int numSteps = 10;
+
+	// A settled dam break in random order, like particles that were spawned over a while
+	SphSolver settler;
+	std::vector<DirectX::XMFLOAT3> settledPositions;
+	std::vector<DirectX::XMFLOAT3> settledVelocities;
+	SetupDamBreak(settler, settledPositions, settledVelocities, numParticles);
+	for (int i = 0; i < 20; i++)
+		settler.Substep(settledPositions, settledVelocities, settler.m_settings.maxTimeStep);
+
+	RandomGenerator generator(17);
+	for (int i = numParticles - 1; i > 0; i--)
+	{
+		int j = static_cast<int>(generator.NextUInt() % static_cast<uint32_t>(i + 1));
+		std::swap(settledPositions[i], settledPositions[j]);
+		std::swap(settledVelocities[i], settledVelocities[j]);
+	}
+
+	// Reorder pass as ParticleSystem runs it
+	RadixSort radixSort;
+	std::vector<uint32_t> codes;
+	std::vector<uint64_t> wideCodes;
+	std::vector<int> order;
+	std::vector<DirectX::XMFLOAT3> sortedPositions(numParticles);
+	std::vector<DirectX::XMFLOAT3> sortedVelocities(numParticles);
+	const int numSorts = 10;
+	double sortMs[2] = { 0.0, 0.0 };
+	for (int wide = 0; wide < 2; wide++)
+	{
+		for (int i = 0; i < numSorts; i++)
+		{
+			long long start = Profiler::GetTimestamp();
+			MortonBounds bounds = ComputeMortonBounds(settledPositions.data(), numParticles);
+			if (wide)
+			{
+				ComputeMortonCodes(settledPositions.data(), numParticles, bounds, wideCodes);
+				radixSort.Sort(wideCodes.data(), numParticles, order);
+			}
+			else
+			{
+				ComputeMortonCodes(settledPositions.data(), numParticles, bounds, codes);
+				radixSort.Sort(codes.data(), numParticles, order);
+			}
+			for (int j = 0; j < numParticles; j++)
+			{
+				sortedPositions[j] = settledPositions[order[j]];
+				sortedVelocities[j] = settledVelocities[order[j]];
+			}
+			sortMs[wide] += GetElapsedMs(start, Profiler::GetTimestamp()) / numSorts;
+		}
+	}
+
+	// Has to match a stable comparison sort, also for keys that only differ in their upper bits
+	std::vector<uint64_t> testKeys(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		testKeys[i] = (static_cast<uint64_t>(generator.NextUInt() % 64) << 56) | (generator.NextUInt() % 4);
+	std::vector<int> expected(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		expected[i] = i;
+	std::stable_sort(expected.begin(), expected.end(), [&](int a, int b) { return testKeys[a] < testKeys[b]; });
+	std::vector<int> testOrder;
+	radixSort.Sort(testKeys.data(), numParticles, testOrder);
+	bool sortMatches = testOrder == expected;
+
+	std::vector<int> codeOrder(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		codeOrder[i] = i;
+	std::stable_sort(codeOrder.begin(), codeOrder.end(), [&](int a, int b) { return codes[a] < codes[b]; });
+	sortMatches = sortMatches && codeOrder == order;
+
+	out << "threads: " << jobSystem.GetNumThreads() << ", " << numParticles << " particles" << std::endl;
+	out << "reorder pass: " << sortMs[0] << " ms with 30 bit codes, " << sortMs[1] << " ms with 63 bit codes, matches std::stable_sort "
+		<< Verdict(sortMatches) << std::endl;
+
+	const char* orderNames[2] = { "spawn order", "Morton order" };
+	const std::vector<DirectX::XMFLOAT3>* orderPositions[2] = { &settledPositions, &sortedPositions };
+	const std::vector<DirectX::XMFLOAT3>* orderVelocities[2] = { &settledVelocities, &sortedVelocities };
+	double searchMs[2] = { 0.0, 0.0 };
+	double stepMs[2] = { 0.0, 0.0 };
+	long long numNeighbors[2] = { 0, 0 };
+	float radius = settler.m_settings.smoothingRadius;
+	for (int o = 0; o < 2; o++)
+	{
+		const std::vector<DirectX::XMFLOAT3>& positions = *orderPositions[o];
+
+		// Neighbor search alone: grid build and gathering everybody within the smoothing radius
+		NeighborGrid grid;
+		std::vector<long long> chunkNeighbors(jobSystem.GetNumThreads());
+		long long start = Profiler::GetTimestamp();
+		for (int s = 0; s < numSearches; s++)
+		{
+			grid.Build(positions.data(), numParticles, radius);
+			std::fill(chunkNeighbors.begin(), chunkNeighbors.end(), 0);
+			jobSystem.ParallelFor(numParticles, [&](int begin, int end, int chunk)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					grid.ForEachCandidate(positions[i], [&](int j)
+					{
+						float dx = positions[j].x - positions[i].x;
+						float dy = positions[j].y - positions[i].y;
+						float dz = positions[j].z - positions[i].z;
+						chunkNeighbors[chunk] += dx * dx + dy * dy + dz * dz < radius * radius ? 1 : 0;
+					});
+				}
+			}, 256);
+		}
+		searchMs[o] = GetElapsedMs(start, Profiler::GetTimestamp()) / numSearches;
+		for (long long count : chunkNeighbors)
+			numNeighbors[o] += count;
+
+		// Full SPH steps, density and forces gather over the same neighbors
+		SphSolver solver;
+		solver.m_settings = settler.m_settings;
+		std::vector<DirectX::XMFLOAT3> stepPositions = positions;
+		std::vector<DirectX::XMFLOAT3> stepVelocities = *orderVelocities[o];
+		start = Profiler::GetTimestamp();
+		for (int s = 0; s < numSteps; s++)
+			solver.Substep(stepPositions, stepVelocities, solver.m_settings.maxTimeStep);
+		stepMs[o] = GetElapsedMs(start, Profiler::GetTimestamp()) / numSteps;
+
+		out << orderNames[o] << ": neighbor search " << searchMs[o] << " ms (" << numNeighbors[o] << " pairs), SPH step " << stepMs[o] << " ms" << std::endl;
+	}
+
+	out << "Morton order speedup: neighbor search " << searchMs[0] / searchMs[1] << "x, SPH step " << stepMs[0] / stepMs[1]
+		<< "x, same neighbors " << Verdict(numNeighbors[0] == numNeighbors[1]) << std::endl;
+}
+
+void Benchmark::DepthSort(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// Particles in a 20 m cube, the camera orbits it by half a degree per frame
+	const int particleCounts[] = { 10000, 100000, 1000000 };
+	const int numFrames = 10;
+	const float orbitRadius = 30.0f;
+	const float orbitStep = 0.5f * DirectX::XM_PI / 180.0f;
+
+	auto getCamera = [&](int frame, DirectX::XMFLOAT3& eye, DirectX::XMFLOAT3& forward)
+	{
+		float angle = frame * orbitStep;
+		eye = DirectX::XMFLOAT3(orbitRadius * std::sin(angle), 5.0f, -orbitRadius * std::cos(angle));
+		float length = std::sqrt(eye.x * eye.x + eye.y * eye.y + eye.z * eye.z);
+		forward = DirectX::XMFLOAT3(-eye.x / length, -eye.y / length, -eye.z / length);
+	};
+
+	// Far to near means the depth along forward never grows
+	auto isBackToFront = [](const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<int>& order, const DirectX::XMFLOAT3& eye, const DirectX::XMFLOAT3& forward)
+	{
+		if (order.size() != positions.size())
+			return false;
+
+		std::vector<uint8_t> seen(positions.size(), 0);
+		float previousDepth = FLT_MAX;
+		for (int index : order)
+		{
+			if (index < 0 || index >= static_cast<int>(positions.size()) || seen[index])
+				return false;
+			seen[index] = 1;
+
+			const DirectX::XMFLOAT3& p = positions[index];
+			float depth = (p.x - eye.x) * forward.x + (p.y - eye.y) * forward.y + (p.z - eye.z) * forward.z;
+			if (depth > previousDepth)
+				return false;
+			previousDepth = depth;
+		}
+		return true;
+	};
+
+	out << "threads: " << jobSystem.GetNumThreads() << ", " << numFrames << " frames of a camera orbiting " << orbitStep * 180.0f / DirectX::XM_PI << " degrees per frame" << std::endl;
+
+	RandomGenerator generator(23);
+	bool allSorted = true;
+	for (int numParticles : particleCounts)
+	{
+		std::vector<DirectX::XMFLOAT3> positions(numParticles);
+		std::vector<uint32_t> ids(numParticles);
+		for (int i = 0; i < numParticles; i++)
+		{
+			positions[i] = DirectX::XMFLOAT3(generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f));
+			ids[i] = static_cast<uint32_t>(i);
+		}
+
+		DirectX::XMFLOAT3 eye;
+		DirectX::XMFLOAT3 forward;
+		std::vector<float> depths(numParticles);
+		std::vector<int> order(numParticles);
+
+		double stdSortMs = 0.0;
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			getCamera(frame, eye, forward);
+			long long start = Profiler::GetTimestamp();
+			for (int i = 0; i < numParticles; i++)
+				depths[i] = (positions[i].x - eye.x) * forward.x + (positions[i].y - eye.y) * forward.y + (positions[i].z - eye.z) * forward.z;
+			for (int i = 0; i < numParticles; i++)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), [&](int a, int b) { return depths[a] > depths[b]; });
+			stdSortMs += GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+		}
+		allSorted = allSorted && isBackToFront(positions, order, eye, forward);
+
+		double sorterMs[2] = { 0.0, 0.0 };
+		int numReused = 0;
+		for (int reuse = 0; reuse < 2; reuse++)
+		{
+			DepthSorter sorter;
+			sorter.m_useTemporalReuse = reuse != 0;
+
+			// The first frame has nothing to reuse
+			getCamera(0, eye, forward);
+			sorter.Sort(positions.data(), ids.data(), numParticles, eye, forward, order);
+			for (int frame = 1; frame <= numFrames; frame++)
+			{
+				getCamera(frame, eye, forward);
+				long long start = Profiler::GetTimestamp();
+				sorter.Sort(positions.data(), ids.data(), numParticles, eye, forward, order);
+				sorterMs[reuse] += GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+				numReused += sorter.WasReused() ? 1 : 0;
+			}
+			allSorted = allSorted && isBackToFront(positions, order, eye, forward);
+		}
+
+		// Static camera and particles jittering by a tenth of a millimeter, the order hardly changes
+		std::vector<DirectX::XMFLOAT3> drifting = positions;
+		double stillMs = 0.0;
+		int numStillReused = 0;
+		{
+			DepthSorter sorter;
+			sorter.m_useTemporalReuse = true;
+			getCamera(0, eye, forward);
+			sorter.Sort(drifting.data(), ids.data(), numParticles, eye, forward, order);
+			for (int frame = 1; frame <= numFrames; frame++)
+			{
+				for (DirectX::XMFLOAT3& p : drifting)
+				{
+					p.x += generator.NextFloat(-0.0001f, 0.0001f);
+					p.y += generator.NextFloat(-0.0001f, 0.0001f);
+					p.z += generator.NextFloat(-0.0001f, 0.0001f);
+				}
+
+				long long start = Profiler::GetTimestamp();
+				sorter.Sort(drifting.data(), ids.data(), numParticles, eye, forward, order);
+				stillMs += GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+				numStillReused += sorter.WasReused() ? 1 : 0;
+			}
+			allSorted = allSorted && isBackToFront(drifting, order, eye, forward);
+		}
+
+		out << numParticles << " particles: std::sort " << stdSortMs << " ms, radix sort " << sorterMs[0] << " ms ("
+			<< stdSortMs / sorterMs[0] << "x), temporal reuse " << sorterMs[1] << " ms (" << stdSortMs / sorterMs[1] << "x, refined "
+			<< numReused << " of " << numFrames << " frames), static camera with temporal reuse " << stillMs << " ms (refined "
+			<< numStillReused << " of " << numFrames << " frames)" << std::endl;
+	}
+
+	// Births, deaths and a Morton reorder shuffling the indices in front of a static camera, the
+	// order has to stay exact
+	const int numParticles = 20000;
+	std::vector<DirectX::XMFLOAT3> positions(numParticles);
+	std::vector<uint32_t> ids(numParticles);
+	uint32_t nextId = 0;
+	for (int i = 0; i < numParticles; i++)
+	{
+		positions[i] = DirectX::XMFLOAT3(generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f));
+		ids[i] = nextId++;
+	}
+
+	DepthSorter sorter;
+	sorter.m_useTemporalReuse = true;
+	std::vector<int> order;
+	int numReused = 0;
+	bool churnSorted = true;
+	for (int frame = 0; frame < 60; frame++)
+	{
+		for (int i = 0; i < 50; i++)
+		{
+			int index = static_cast<int>(generator.NextUInt() % numParticles);
+			positions[index] = DirectX::XMFLOAT3(generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f), generator.NextFloat(-10.0f, 10.0f));
+			ids[index] = nextId++;
+		}
+		if (frame % 20 == 10)
+		{
+			for (int i = numParticles - 1; i > 0; i--)
+			{
+				int j = static_cast<int>(generator.NextUInt() % static_cast<uint32_t>(i + 1));
+				std::swap(positions[i], positions[j]);
+				std::swap(ids[i], ids[j]);
+			}
+		}
+
+		DirectX::XMFLOAT3 eye;
+		DirectX::XMFLOAT3 forward;
+		getCamera(0, eye, forward);
+		sorter.Sort(positions.data(), ids.data(), numParticles, eye, forward, order);
+		numReused += sorter.WasReused() ? 1 : 0;
+		churnSorted = churnSorted && isBackToFront(positions, order, eye, forward);
+	}
+
+	out << "back to front order of every sort: " << Verdict(allSorted) << std::endl;
+	out << "with births, deaths and shuffles: refined " << numReused << " of 60 frames " << Verdict(churnSorted) << std::endl;
+}
+
+void Benchmark::NullDeviceFrames(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// The scene of the window, drawn on the recording device for 5 seconds at 60 Hz
+	const int numFrames = 300;
+	const float deltaTime = 1.0f / 60.0f;
+	NullRenderDevice device;
+	device.SetRecording(true);
+
+	{
+		Camera camera(1920.0f, 1080.0f, { 3.0f, 5.0f, -15.0f }, { 0.0f, 0.0f, 0.0f });
+
+		StaticMesh floorMesh("Floor.obj", &device);
+		floorMesh.SetColor(&device, { 0.2f, 0.2f, 0.2f });
+		floorMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+		GameObject floorObj;
+		floorObj.SetMesh(&floorMesh);
+		floorObj.SetRotation({ 0.0f, 90.0f, 0.0f });
+
+		StaticMesh pipeMesh("Pipe.obj", &device);
+		pipeMesh.SetColor(&device, { 0.8f, 0.4f, 0.2f });
+		pipeMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+		GameObject pipeObj;
+		pipeObj.SetMesh(&pipeMesh);
+		pipeObj.SetPosition({ -8.0f, 0.0f, 0.0f });
+		pipeObj.SetRotation({ 0.0f, -90.0f, 0.0f });
+
+		ParticleSystem particleSystem({ -6.0f, 7.5f, 0.0f }, &device, L"GooShader.hlsl", true);
+		particleSystem.GetParticleSpawner()->m_timeToLive = 1.5f;
+		particleSystem.GetParticleSpawner()->m_spawnRate = 40;
+		particleSystem.GetParticleSpawner()->m_direction = { 1.0f, 0.25f, 0.0f };
+		particleSystem.GetParticleSpawner()->m_velocity = 7.0f;
+		AssetManager::GetInstance().Wait();
+
+		// Every frame has to hold one indexed draw per mesh and one draw per live particle, each
+		// after the buffers it reads were bound
+		RenderQueue queue;
+		std::vector<DirectX::XMFLOAT3> positions;
+		double frameMs = 0.0;
+		uint64_t numDraws = 0;
+		uint64_t numCommands = 0;
+		uint64_t numBytesMapped = 0;
+		uint64_t numStateChanges = 0;
+		uint64_t numRedundant = 0;
+		bool drawsMatch = true;
+		bool drawsBound = true;
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			long long start = Profiler::GetTimestamp();
+			particleSystem.Update(deltaTime);
+			float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			device.Clear(clearColor);
+			floorObj.Submit(queue, camera);
+			pipeObj.Submit(queue, camera);
+			particleSystem.Submit(queue, camera);
+			queue.Execute(&device);
+			device.Present();
+			frameMs += GetElapsedMs(start, Profiler::GetTimestamp());
+
+			particleSystem.GetParticlePositions(positions);
+			const RenderFrameStats& frameStats = device.GetLastFrameStats();
+			drawsMatch = drawsMatch && frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED] == 2 && frameStats.numCommands[RENDER_COMMAND_DRAW] == positions.size();
+
+			uint32_t boundVertexBuffer = 0;
+			uint32_t boundProgram = 0;
+			for (const RenderCommand& command : device.GetLastFrameCommands())
+			{
+				if (command.type == RENDER_COMMAND_SET_VERTEX_BUFFER)
+					boundVertexBuffer = command.resource;
+				else if (command.type == RENDER_COMMAND_SET_SHADER_PROGRAM)
+					boundProgram = command.resource;
+				else if (command.type == RENDER_COMMAND_DRAW || command.type == RENDER_COMMAND_DRAW_INDEXED)
+					drawsBound = drawsBound && boundVertexBuffer != 0 && boundProgram != 0;
+			}
+
+			numDraws += frameStats.numCommands[RENDER_COMMAND_DRAW] + frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED];
+			numCommands += device.GetLastFrameCommands().size();
+			numBytesMapped += frameStats.numBytesMapped;
+			numStateChanges += queue.GetLastStats().numStateChanges;
+			numRedundant += queue.GetLastStats().numRedundant;
+		}
+
+		out << numFrames << " frames: " << frameMs / numFrames << " ms per frame, " << static_cast<double>(numDraws) / numFrames << " draws, "
+			<< static_cast<double>(numCommands) / numFrames << " commands, " << static_cast<double>(numBytesMapped) / numFrames << " bytes mapped per frame, "
+			<< positions.size() << " particles in the last frame" << std::endl;
+		out << "state changes per frame: " << static_cast<double>(numStateChanges) / numFrames << ", " << static_cast<double>(numRedundant) / numFrames
+			<< " redundant ones filtered out by the render queue" << std::endl;
+		out << "live buffers " << device.GetNumLiveBuffers() << " (" << device.GetNumLiveBufferBytes() << " bytes), shader programs " << device.GetNumLivePrograms() << std::endl;
+		out << "one draw per mesh and particle: " << Verdict(drawsMatch) << std::endl;
+		out << "every draw after its buffers and shaders were bound: " << Verdict(drawsBound) << std::endl;
+	}
+	out << "left alive after the scene was destroyed: " << device.GetNumLiveBuffers() << " buffers, " << device.GetNumLivePrograms() << " shader programs" << std::endl;
+}
+
+void Benchmark::SoftwareRasterizer(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	int numThreads = jobSystem.GetNumThreads();
+
+	// Floor and pipe of the window scene with its lights at full HD
+	const int width = 1920;
+	const int height = 1080;
+	const int numFrames = 10;
+	SoftwareRenderDevice device(width, height);
+	Camera camera(static_cast<float>(width), static_cast<float>(height), { 3.0f, 5.0f, -15.0f }, { 0.0f, 0.0f, 0.0f });
+
+	PointLight lights[5] = {
+		{{7.0f, 2.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 10.0f},
+		{{-7.0f, 5.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 4.0f},
+		{{0.0f, 15.0f, 0.0f}, {1.0f, 1.0f, 0.7f}, 5.0f},
+	};
+	LightClusters lightClusters;
+	lightClusters.Update(lights, 5, camera);
+	lightClusters.Upload(&device);
+
+	StaticMesh floorMesh("Floor.obj", &device);
+	floorMesh.SetColor(&device, { 0.2f, 0.2f, 0.2f });
+	floorMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+	GameObject floorObj;
+	floorObj.SetMesh(&floorMesh);
+	floorObj.SetRotation({ 0.0f, 90.0f, 0.0f });
+
+	StaticMesh pipeMesh("Pipe.obj", &device);
+	pipeMesh.SetColor(&device, { 0.8f, 0.4f, 0.2f });
+	pipeMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+	GameObject pipeObj;
+	pipeObj.SetMesh(&pipeMesh);
+	pipeObj.SetPosition({ -8.0f, 0.0f, 0.0f });
+	pipeObj.SetRotation({ 0.0f, -90.0f, 0.0f });
+	AssetManager::GetInstance().Wait();
+
+	RenderQueue queue;
+	std::vector<uint32_t> images[2];
+	int threadCounts[] = { 1, numThreads };
+	for (int run = 0; run < 2; run++)
+	{
+		jobSystem.Initialize(threadCounts[run]);
+		double frameMs = 0.0;
+		double setupMs = 0.0;
+		double rasterMs = 0.0;
+		for (int frame = 0; frame <= numFrames; frame++)
+		{
+			long long start = Profiler::GetTimestamp();
+			float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			device.Clear(clearColor);
+			floorObj.Submit(queue, camera);
+			pipeObj.Submit(queue, camera);
+			queue.Execute(&device);
+			device.Present();
+
+			// The first frame allocates the triangle slots and bins
+			if (frame == 0)
+				continue;
+			frameMs += GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+			setupMs += device.GetLastRasterStats().setupMs / numFrames;
+			rasterMs += device.GetLastRasterStats().rasterMs / numFrames;
+		}
+		images[run] = device.GetColorBuffer();
+
+		const SoftwareRasterStats& stats = device.GetLastRasterStats();
+		out << width << "x" << height << " with " << threadCounts[run] << " threads: " << frameMs << " ms per frame (setup and binning " << setupMs
+			<< " ms, tiles " << rasterMs << " ms), " << stats.numTriangles << " triangles, " << stats.numCulled << " culled, "
+			<< stats.numBinned << " tile bins, " << stats.numPixelsShaded << " pixels shaded" << std::endl;
+	}
+
+	int numCovered = 0;
+	for (uint32_t color : images[1])
+		numCovered += (color & 0xFFFFFF) != 0 ? 1 : 0;
+	out << "pixels covered by the scene: " << 100.0 * numCovered / (width * height) << "%" << std::endl;
+	out << "same image for every thread count: " << Verdict(images[0] == images[1]) << std::endl;
+	out << "saved SoftwareFrame.bmp: " << Verdict(device.SaveBitmap("SoftwareFrame.bmp")) << std::endl;
+}
+
+void Benchmark::AssetLoading(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// The startup of the window scene on the recording device, where compiling a shader costs
+	// nothing, so only the mesh parsing and the collider baking are timed
+	AssetManager& assets = AssetManager::GetInstance();
+	DirectX::XMFLOAT4X4 floorWorld;
+	DirectX::XMStoreFloat4x4(&floorWorld, DirectX::XMMatrixRotationY(DirectX::XMConvertToRadians(90.0f)));
+	DirectX::XMFLOAT4X4 pipeWorld;
+	DirectX::XMStoreFloat4x4(&pipeWorld, DirectX::XMMatrixRotationY(DirectX::XMConvertToRadians(-90.0f)) * DirectX::XMMatrixTranslation(-8.0f, 0.0f, 0.0f));
+
+	struct SceneAssets
+	{
+		AssetHandle<StaticMesh> floorMesh;
+		AssetHandle<StaticMesh> pipeMesh;
+		AssetHandle<RenderShaderProgram> gooShader;
+		AssetHandle<SignedDistanceField> floorField;
+		AssetHandle<SignedDistanceField> pipeField;
+	};
+
+	NullRenderDevice device;
+	auto requestScene = [&](SceneAssets& scene)
+	{
+		AssetHandle<StaticMesh> floorMesh = assets.LoadMesh(&device, "Floor.obj", { 0.2f, 0.2f, 0.2f }, L"BlinnPhongShader.hlsl");
+		AssetHandle<StaticMesh> pipeMesh = assets.LoadMesh(&device, "Pipe.obj", { 0.8f, 0.4f, 0.2f }, L"BlinnPhongShader.hlsl");
+		scene.floorMesh = floorMesh;
+		scene.pipeMesh = pipeMesh;
+		scene.gooShader = assets.LoadShaderProgram(&device, L"GooShader.hlsl", true);
+		scene.floorField = assets.Load<SignedDistanceField>("Floor.sdf", [floorMesh, floorWorld]()
+		{
+			std::vector<DirectX::XMFLOAT3> vertices;
+			std::vector<unsigned int> indices;
+			floorMesh.Get()->GetTriangles(DirectX::XMLoadFloat4x4(&floorWorld), vertices, indices);
+			SignedDistanceField* field = new SignedDistanceField();
+			field->Bake(vertices, indices, 0.1f, 0.3f);
+			return field;
+		});
+		scene.pipeField = assets.Load<SignedDistanceField>("Pipe.sdf", [pipeMesh, pipeWorld]()
+		{
+			std::vector<DirectX::XMFLOAT3> vertices;
+			std::vector<unsigned int> indices;
+			pipeMesh.Get()->GetTriangles(DirectX::XMLoadFloat4x4(&pipeWorld), vertices, indices);
+			SignedDistanceField* field = new SignedDistanceField();
+			field->Bake(vertices, indices, 0.05f, 0.2f);
+			return field;
+		});
+	};
+
+	// Before, everything was loaded before the first frame. Now the first frame only waits for
+	// the requests to be queued.
+	double blockingMs = 0.0;
+	int numPrograms = 0;
+	{
+		SceneAssets scene;
+		long long start = Profiler::GetTimestamp();
+		requestScene(scene);
+		assets.Wait();
+		blockingMs = GetElapsedMs(start, Profiler::GetTimestamp());
+		numPrograms = device.GetNumLivePrograms();
+	}
+	bool isFreed = assets.GetNumAssets() == 0 && device.GetNumLiveBuffers() == 0 && device.GetNumLivePrograms() == 0;
+
+	SceneAssets scene;
+	long long start = Profiler::GetTimestamp();
+	requestScene(scene);
+	double requestMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	bool isPending = assets.GetNumPending() > 0;
+	assets.Wait();
+	double loadedMs = GetElapsedMs(start, Profiler::GetTimestamp());
+
+	out << "threads: " << jobSystem.GetNumThreads() << std::endl;
+	out << "time to first frame, loading first: " << blockingMs << " ms" << std::endl;
+	out << "time to first frame, loading in the background: " << requestMs << " ms, " << (isPending ? "still loading then" : "already loaded") << ", everything loaded after " << loadedMs << " ms" << std::endl;
+	assets.WriteReport(out);
+
+	// A second object with the same mesh gets the same buffers, the old vertex buffer of SetColor is released
+	int numBuffers = device.GetNumLiveBuffers();
+	AssetHandle<StaticMesh> pipeAgain = assets.LoadMesh(&device, "Pipe.obj", { 0.8f, 0.4f, 0.2f }, L"BlinnPhongShader.hlsl");
+	out << "one program per shader file, " << numPrograms << " for 3 requests: " << Verdict(numPrograms == 2) << std::endl;
+	out << "requesting a loaded mesh again shares it: " << Verdict(pipeAgain.Get() == scene.pipeMesh.Get() && device.GetNumLiveBuffers() == numBuffers) << std::endl;
+	out << "3 buffers per mesh: " << Verdict(numBuffers == 6) << std::endl;
+	out << "everything freed with the last handle: " << Verdict(isFreed) << std::endl;
+}
+
+void Benchmark::RenderQueueSorting(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// 10k draws of 64 meshes with 4 shaders in random order, then 1k particles with their own
+	// buffers, submitted every frame on the recording device
+	const int numOpaque = 10000;
+	const int numTransparent = 1000;
+	const int numMeshes = 64;
+	const int numPrograms = 4;
+	const int numFrames = 20;
+	NullRenderDevice device;
+
+	// The device numbers its resources from 1 in creation order
+	std::unordered_map<const void*, uint32_t> ids;
+	uint32_t nextId = 1;
+	std::vector<RenderShaderProgram*> programs(numPrograms + 1);
+	for (RenderShaderProgram*& program : programs)
+	{
+		device.CreateShaderProgram(RenderShaderProgramDesc::FromFile(L"DefaultShader.hlsl", false), &program);
+		ids[program] = nextId++;
+	}
+
+	std::vector<RenderBuffer*> buffers;
+	auto createBuffer = [&](RenderBufferType type, UINT byteWidth, bool isDynamic)
+	{
+		RenderBufferDesc desc = { type, byteWidth, 0, isDynamic };
+		RenderBuffer* buffer = nullptr;
+		device.CreateBuffer(desc, nullptr, &buffer);
+		ids[buffer] = nextId++;
+		buffers.push_back(buffer);
+		return buffer;
+	};
+
+	RandomGenerator generator(45);
+	std::vector<RenderDrawPacket> packets(numOpaque + numTransparent, RenderDrawPacket());
+	std::vector<RenderDrawPacket> meshes(numMeshes, RenderDrawPacket());
+	for (int i = 0; i < numMeshes; i++)
+	{
+		RenderDrawPacket& mesh = meshes[i];
+		RenderBuffer* constantBuffer = createBuffer(RENDER_BUFFER_CONSTANT, sizeof(ConstantBuffer), true);
+		mesh.pass = RENDER_PASS_OPAQUE;
+		mesh.program = programs[i % numPrograms];
+		mesh.vertexBuffer = createBuffer(RENDER_BUFFER_VERTEX, 3 * sizeof(Vertex), false);
+		mesh.vertexStride = sizeof(Vertex);
+		mesh.indexBuffer = createBuffer(RENDER_BUFFER_INDEX, 3 * sizeof(UINT), false);
+		mesh.constantBuffers[RENDER_STAGE_VERTEX][0] = constantBuffer;
+		mesh.constantBuffers[RENDER_STAGE_PIXEL][0] = constantBuffer;
+		mesh.topology = RENDER_TOPOLOGY_TRIANGLE_LIST;
+		mesh.numElements = 3;
+	}
+
+	for (int i = 0; i < numOpaque + numTransparent; i++)
+	{
+		RenderDrawPacket& packet = packets[i];
+		if (i < numOpaque)
+		{
+			packet = meshes[generator.NextUInt() % numMeshes];
+		}
+		else
+		{
+			RenderBuffer* constantBuffer = createBuffer(RENDER_BUFFER_CONSTANT, sizeof(ConstantBuffer), true);
+			packet.pass = RENDER_PASS_TRANSPARENT;
+			packet.program = programs[numPrograms];
+			packet.vertexBuffer = createBuffer(RENDER_BUFFER_VERTEX, sizeof(Vertex), false);
+			packet.vertexStride = sizeof(Vertex);
+			packet.constantBuffers[RENDER_STAGE_VERTEX][0] = constantBuffer;
+			packet.constantBuffers[RENDER_STAGE_GEOMETRY][0] = constantBuffer;
+			packet.topology = RENDER_TOPOLOGY_POINT_LIST;
+			packet.numElements = 1;
+		}
+		packet.depth = generator.NextFloat(1.0f, 100.0f);
+	}
+
+	// Particles are submitted far to near, the queue has to keep that order. Draws tell their
+	// packet by the first index or vertex.
+	std::stable_sort(packets.begin() + numOpaque, packets.end(), [](const RenderDrawPacket& a, const RenderDrawPacket& b) { return a.depth > b.depth; });
+	for (int i = 0; i < numOpaque + numTransparent; i++)
+		packets[i].first = i;
+
+	// Without sorting and filtering every draw binds all of its state, like before the queue
+	const char* modeNames[3] = { "submission order, every binding", "submission order, filtered", "sorted, filtered" };
+	RenderQueue queue;
+	RenderQueueStats modeStats[3];
+	for (int mode = 0; mode < 3; mode++)
+	{
+		queue.m_isSorting = mode == 2;
+		queue.m_isFiltering = mode > 0;
+		double submitMs = 0.0;
+		double frameMs = 0.0;
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			long long start = Profiler::GetTimestamp();
+			for (const RenderDrawPacket& packet : packets)
+				queue.Submit(packet);
+			long long submitted = Profiler::GetTimestamp();
+			queue.Execute(&device);
+			device.Present();
+			submitMs += GetElapsedMs(start, submitted) / numFrames;
+			frameMs += GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+		}
+
+		const RenderQueueStats& stats = queue.GetLastStats();
+		modeStats[mode] = stats;
+		out << modeNames[mode] << ": " << stats.numStateChanges << " state changes (" << stats.numProgramChanges << " shader programs), "
+			<< stats.numRedundant << " filtered, " << frameMs << " ms per frame (submit " << submitMs << ", sort " << stats.sortMs << ", execute " << stats.executeMs << ")" << std::endl;
+	}
+
+	// Replays the recorded commands of a sorted frame
+	device.SetRecording(true);
+	for (const RenderDrawPacket& packet : packets)
+		queue.Submit(packet);
+	queue.Execute(&device);
+	device.Present();
+	device.SetRecording(false);
+
+	uint32_t boundProgram = 0;
+	uint32_t boundVertexBuffer = 0;
+	uint32_t boundIndexBuffer = 0;
+	uint32_t boundTopology = ~0u;
+	uint32_t boundConstantBuffers[RENDER_STAGE_COUNT][MAX_PACKET_CONSTANT_SLOTS] = {};
+	std::vector<uint8_t> isDrawn(packets.size(), 0);
+	std::unordered_map<const void*, int> programIndex;
+	std::unordered_map<const void*, int> meshIndex;
+	for (int i = 0; i < numMeshes; i++)
+	{
+		programIndex[meshes[i].program] = i % numPrograms;
+		meshIndex[meshes[i].vertexBuffer] = i;
+	}
+	std::vector<uint8_t> isProgramDone(numPrograms, 0);
+	std::vector<uint8_t> isMeshDone(numMeshes, 0);
+	const RenderDrawPacket* previous = nullptr;
+	bool isEachDrawnOnce = true;
+	bool isBound = true;
+	bool isChange = true;
+	bool isOrdered = true;
+	auto bind = [&](uint32_t& bound, uint32_t value)
+	{
+		isChange = isChange && bound != value;
+		bound = value;
+	};
+	for (const RenderCommand& command : device.GetLastFrameCommands())
+	{
+		switch (command.type)
+		{
+		case RENDER_COMMAND_SET_SHADER_PROGRAM: bind(boundProgram, command.resource); break;
+		case RENDER_COMMAND_SET_VERTEX_BUFFER: bind(boundVertexBuffer, command.resource); break;
+		case RENDER_COMMAND_SET_INDEX_BUFFER: bind(boundIndexBuffer, command.resource); break;
+		case RENDER_COMMAND_SET_CONSTANT_BUFFER: bind(boundConstantBuffers[command.stage][command.slot], command.resource); break;
+		case RENDER_COMMAND_SET_TOPOLOGY: bind(boundTopology, command.stage); break;
+		case RENDER_COMMAND_DRAW:
+		case RENDER_COMMAND_DRAW_INDEXED:
+		{
+			if (command.first >= packets.size() || isDrawn[command.first])
+			{
+				isEachDrawnOnce = false;
+				break;
+			}
+			isDrawn[command.first] = 1;
+
+			const RenderDrawPacket& packet = packets[command.first];
+			isBound = isBound && boundProgram == ids[packet.program] && boundVertexBuffer == ids[packet.vertexBuffer] && boundTopology == packet.topology;
+			isBound = isBound && (command.type == RENDER_COMMAND_DRAW_INDEXED) == (packet.indexBuffer != nullptr);
+			isBound = isBound && (!packet.indexBuffer || boundIndexBuffer == ids[packet.indexBuffer]);
+			for (int stage = 0; stage < RENDER_STAGE_COUNT; stage++)
+			{
+				for (int slot = 0; slot < MAX_PACKET_CONSTANT_SLOTS; slot++)
+				{
+					RenderBuffer* buffer = packet.constantBuffers[stage][slot];
+					isBound = isBound && (!buffer || boundConstantBuffers[stage][slot] == ids[buffer]);
+				}
+			}
+
+			// Opaque draws come first, every shader and mesh once in a row, near to far within a
+			// mesh. Particles follow in the order they were submitted.
+			if (previous && previous->pass > packet.pass)
+				isOrdered = false;
+			if (previous && previous->pass == packet.pass && packet.pass == RENDER_PASS_TRANSPARENT && previous->first > packet.first)
+				isOrdered = false;
+			if (packet.pass == RENDER_PASS_OPAQUE && previous)
+			{
+				if (previous->program != packet.program)
+				{
+					isOrdered = isOrdered && !isProgramDone[programIndex[packet.program]];
+					isProgramDone[programIndex[previous->program]] = 1;
+				}
+				if (previous->vertexBuffer != packet.vertexBuffer)
+				{
+					isOrdered = isOrdered && !isMeshDone[meshIndex[packet.vertexBuffer]];
+					isMeshDone[meshIndex[previous->vertexBuffer]] = 1;
+				}
+				else if (previous->depth > packet.depth)
+				{
+					isOrdered = false;
+				}
+			}
+			previous = &packet;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	isEachDrawnOnce = isEachDrawnOnce && std::count(isDrawn.begin(), isDrawn.end(), 1) == static_cast<int>(packets.size());
+
+	out << "state changes with sorting and filtering: " << 100.0 * modeStats[2].numStateChanges / modeStats[0].numStateChanges << "% of drawing every binding" << std::endl;
+	out << "every packet drawn once: " << Verdict(isEachDrawnOnce) << std::endl;
+	out << "every draw after the bindings of its packet: " << Verdict(isBound) << std::endl;
+	out << "no binding repeats the bound one: " << Verdict(isChange) << std::endl;
+	out << "opaque grouped by shader and mesh near to far, then particles in their far to near submission order: " << Verdict(isOrdered) << std::endl;
+	out << "one shader program change per shader: " << Verdict(modeStats[2].numProgramChanges == numPrograms + 1) << std::endl;
+
+	for (RenderBuffer* buffer : buffers)
+		buffer->Release();
+	for (RenderShaderProgram* program : programs)
+		program->Release();
+}
+
+void Benchmark::InstancedPipes(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	int numThreads = jobSystem.GetNumThreads();
+
+	// 10k pipes sharing one mesh and shader on the recording device, submitted per object and
+	// instanced. Submit is the CPU time of the batcher, execute the one of the render queue.
+	const int gridSize = 100;
+	const int numPipes = gridSize * gridSize;
+	const int numFrames = 20;
+	NullRenderDevice device;
+	device.SetRecording(true);
+	{
+		Camera camera(1920.0f, 1080.0f, { 0.0f, 200.0f, -500.0f }, { 20.0f, 0.0f, 0.0f });
+		StaticMesh pipeMesh("Pipe.obj", &device);
+		pipeMesh.SetColor(&device, { 0.8f, 0.4f, 0.2f });
+		pipeMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+		std::vector<GameObject> pipes;
+		PlacePipes(pipes, gridSize, 8.0f, &pipeMesh);
+		std::vector<GameObject*> objects;
+		for (GameObject& pipe : pipes)
+			objects.push_back(&pipe);
+
+		// The first instanced submit requests the instanced shader
+		InstanceBatcher batcher;
+		RenderQueue queue;
+		batcher.Submit(queue, objects, camera);
+		queue.Execute(&device);
+		device.Present();
+		AssetManager::GetInstance().Wait();
+
+		const char* modeNames[2] = { "per object", "instanced" };
+		int threadCounts[2] = { 1, numThreads };
+		double submitMs[2] = {};
+		bool isInstanced = true;
+		bool isPerObject = true;
+		for (int mode = 0; mode < 2; mode++)
+		{
+			batcher.m_isEnabled = mode == 1;
+			for (int run = 0; run < 2; run++)
+			{
+				jobSystem.Initialize(threadCounts[run]);
+				double frameSubmitMs = 0.0;
+				double buildMs = 0.0;
+				double executeMs = 0.0;
+				uint64_t numDraws = 0;
+				uint64_t numBytesMapped = 0;
+				uint64_t numStateChanges = 0;
+				for (int frame = 0; frame < numFrames; frame++)
+				{
+					long long start = Profiler::GetTimestamp();
+					batcher.Submit(queue, objects, camera);
+					long long submitted = Profiler::GetTimestamp();
+					queue.Execute(&device);
+					long long executed = Profiler::GetTimestamp();
+					device.Present();
+
+					frameSubmitMs += GetElapsedMs(start, submitted) / numFrames;
+					executeMs += GetElapsedMs(submitted, executed) / numFrames;
+					buildMs += batcher.GetLastStats().buildMs / numFrames;
+					const RenderFrameStats& frameStats = device.GetLastFrameStats();
+					numDraws += frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED] + frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED_INSTANCED];
+					numBytesMapped += frameStats.numBytesMapped;
+					numStateChanges += queue.GetLastStats().numStateChanges;
+				}
+				submitMs[mode] = frameSubmitMs;
+
+				out << modeNames[mode] << " with " << threadCounts[run] << " threads: submit " << frameSubmitMs << " ms (grouping and transforms " << buildMs
+					<< " ms), execute " << executeMs << " ms per frame, " << static_cast<double>(numDraws) / numFrames << " draws, "
+					<< static_cast<double>(numBytesMapped) / numFrames << " bytes mapped, " << static_cast<double>(numStateChanges) / numFrames
+					<< " state changes per frame" << std::endl;
+			}
+
+			const RenderFrameStats& frameStats = device.GetLastFrameStats();
+			if (mode == 0)
+			{
+				isPerObject = frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED] == numPipes && frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED_INSTANCED] == 0;
+				continue;
+			}
+
+			int numInstancedDraws = 0;
+			for (const RenderCommand& command : device.GetLastFrameCommands())
+			{
+				if (command.type == RENDER_COMMAND_DRAW_INDEXED_INSTANCED)
+					isInstanced = isInstanced && command.numInstances == static_cast<uint32_t>(numPipes) && command.count == static_cast<uint32_t>(pipeMesh.GetNumIndices());
+				numInstancedDraws += command.type == RENDER_COMMAND_DRAW_INDEXED_INSTANCED ? 1 : 0;
+			}
+			isInstanced = isInstanced && numInstancedDraws == 1 && frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED] == 0;
+		}
+
+		out << "submit speedup of instancing: " << submitMs[0] / submitMs[1] << "x" << std::endl;
+		out << "one indexed draw per pipe without instancing: " << Verdict(isPerObject) << std::endl;
+		out << "one instanced draw of all " << numPipes << " pipes: " << Verdict(isInstanced) << std::endl;
+	}
+
+	// A few pipes on the software rasterizer, the instanced vertex stage has to place them like the per object one
+	const int width = 640;
+	const int height = 360;
+	SoftwareRenderDevice softwareDevice(width, height);
+	PointLight lights[5] = {
+		{{7.0f, 2.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 10.0f},
+		{{-7.0f, 5.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 4.0f},
+		{{0.0f, 15.0f, 0.0f}, {1.0f, 1.0f, 0.7f}, 5.0f},
+	};
+	{
+		Camera camera(static_cast<float>(width), static_cast<float>(height), { 0.0f, 15.0f, -40.0f }, { 20.0f, 0.0f, 0.0f });
+		LightClusters lightClusters;
+		lightClusters.Update(lights, 5, camera);
+		lightClusters.Upload(&softwareDevice);
+		StaticMesh pipeMesh("Pipe.obj", &softwareDevice);
+		pipeMesh.SetColor(&softwareDevice, { 0.8f, 0.4f, 0.2f });
+		pipeMesh.SetShader(&softwareDevice, L"BlinnPhongShader.hlsl", false);
+		std::vector<GameObject> pipes;
+		PlacePipes(pipes, 4, 8.0f, &pipeMesh);
+		std::vector<GameObject*> objects;
+		for (GameObject& pipe : pipes)
+			objects.push_back(&pipe);
+
+		InstanceBatcher batcher;
+		RenderQueue queue;
+		std::vector<uint32_t> images[2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			batcher.m_isEnabled = mode == 1;
+			for (int frame = 0; frame < 2; frame++)
+			{
+				float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+				softwareDevice.Clear(clearColor);
+				batcher.Submit(queue, objects, camera);
+				queue.Execute(&softwareDevice);
+				softwareDevice.Present();
+				AssetManager::GetInstance().Wait();
+			}
+			images[mode] = softwareDevice.GetColorBuffer();
+		}
+
+		int numCovered = 0;
+		for (uint32_t color : images[1])
+			numCovered += (color & 0xFFFFFF) != 0 ? 1 : 0;
+		bool isDrawnInstanced = batcher.GetLastStats().numInstancedDraws == 1;
+		out << "software raster of " << pipes.size() << " pipes covers " << 100.0 * numCovered / (width * height) << "% of the image" << std::endl;
+		out << "same image instanced and per object: " << Verdict(isDrawnInstanced && numCovered > 0 && images[0] == images[1]) << std::endl;
+	}
+}
+
+void Benchmark::LightClusterAssignment(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	int numThreads = jobSystem.GetNumThreads();
+
+	// Lights moving around a 120 x 120 area in front of a full HD camera, assigned to the default
+	// 16 x 9 x 24 clusters every frame
+	const int maxLights = 1024;
+	const int numFrames = 50;
+	Camera camera(1920.0f, 1080.0f, { 0.0f, 15.0f, -60.0f }, { 10.0f, 0.0f, 0.0f });
+	RandomGenerator random(5);
+	std::vector<PointLight> baseLights(maxLights);
+	for (PointLight& light : baseLights)
+	{
+		light.position = { random.NextFloat(-60.0f, 60.0f), random.NextFloat(0.0f, 20.0f), random.NextFloat(-40.0f, 80.0f) };
+		light.color = { random.NextFloat(0.2f, 1.0f), random.NextFloat(0.2f, 1.0f), random.NextFloat(0.2f, 1.0f) };
+		light.power = random.NextFloat(0.5f, 4.0f);
+	}
+
+	LightClusters clusters;
+	std::vector<PointLight> lights(maxLights);
+	int lightCounts[2] = { 256, maxLights };
+	int threadCounts[2] = { 1, numThreads };
+	bool isSameForThreads = true;
+	for (int numLights : lightCounts)
+	{
+		std::vector<ClusterLightRange> ranges[2];
+		std::vector<uint32_t> indices[2];
+		for (int run = 0; run < 2; run++)
+		{
+			jobSystem.Initialize(threadCounts[run]);
+			double transformMs = 0.0;
+			double assignMs = 0.0;
+			for (int frame = 0; frame < numFrames; frame++)
+			{
+				for (int i = 0; i < numLights; i++)
+				{
+					lights[i] = baseLights[i];
+					lights[i].position.x += 5.0f * std::sin(0.1f * frame + i);
+					lights[i].position.z += 5.0f * std::cos(0.1f * frame + i);
+				}
+
+				clusters.Update(lights.data(), numLights, camera);
+				transformMs += clusters.GetLastStats().transformMs / numFrames;
+				assignMs += clusters.GetLastStats().assignMs / numFrames;
+			}
+			ranges[run] = clusters.GetClusterRanges();
+			indices[run] = clusters.GetLightIndices();
+
+			const LightClusterStats& stats = clusters.GetLastStats();
+			out << numLights << " lights with " << threadCounts[run] << " threads: " << transformMs + assignMs << " ms per frame (view space " << transformMs
+				<< " ms, assignment " << assignMs << " ms), " << stats.numVisibleLights << " visible, " << static_cast<double>(stats.numIndices) / clusters.GetClusterRanges().size()
+				<< " lights per cluster on average, at most " << stats.maxLightsPerCluster << std::endl;
+		}
+
+		isSameForThreads = isSameForThreads && indices[0] == indices[1] && ranges[0].size() == ranges[1].size()
+			&& std::equal(ranges[0].begin(), ranges[0].end(), ranges[1].begin(), [](const ClusterLightRange& a, const ClusterLightRange& b)
+		{
+			return a.offset == b.offset && a.numLights == b.numLights;
+		});
+	}
+
+	// Every light reaching a point has to be in the cluster the shaders look up for it. Points are
+	// taken at random pixels and depths, lights reaching them only at their very edge are left out.
+	const ClusterConstants& constants = clusters.GetConstants();
+	const std::vector<ClusterLight>& clusterLights = clusters.GetLights();
+	const std::vector<ClusterLightRange>& ranges = clusters.GetClusterRanges();
+	const std::vector<uint32_t>& indices = clusters.GetLightIndices();
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMStoreFloat4x4(&projection, camera.GetProjectionMatrix());
+	const int numPoints = 20000;
+	int numMissing = 0;
+	uint64_t numReaching = 0;
+	uint64_t numClusterLights = 0;
+	std::vector<uint8_t> isInCluster(maxLights);
+	for (int p = 0; p < numPoints; p++)
+	{
+		float pixelX = random.NextFloat(0.0f, 1920.0f);
+		float pixelY = random.NextFloat(0.0f, 1080.0f);
+		float depth = camera.GetNearPlane() * std::pow(200.0f / camera.GetNearPlane(), random.NextFloat());
+		DirectX::XMFLOAT3 point((pixelX / 1920.0f * 2.0f - 1.0f) * depth / projection.m[0][0], (1.0f - pixelY / 1080.0f * 2.0f) * depth / projection.m[1][1], depth);
+
+		const ClusterLightRange& range = ranges[LightClusters::GetClusterIndex(constants, pixelX, pixelY, depth)];
+		std::fill(isInCluster.begin(), isInCluster.end(), 0);
+		for (uint32_t i = 0; i < range.numLights; i++)
+			isInCluster[indices[range.offset + i]] = 1;
+		numClusterLights += range.numLights;
+
+		for (int i = 0; i < maxLights; i++)
+		{
+			const ClusterLight& light = clusterLights[i];
+			float dx = light.viewPosition.x - point.x;
+			float dy = light.viewPosition.y - point.y;
+			float dz = light.viewPosition.z - point.z;
+			float reach = light.range * 0.999f;
+			if (dx * dx + dy * dy + dz * dz >= reach * reach)
+				continue;
+
+			numReaching++;
+			numMissing += isInCluster[i] ? 0 : 1;
+		}
+	}
+	out << "lights looped over per pixel: " << static_cast<double>(numClusterLights) / numPoints << " of the cluster instead of " << maxLights
+		<< ", " << static_cast<double>(numReaching) / numPoints << " of them reach the pixel" << std::endl;
+	out << "every light reaching a point is in its cluster: " << Verdict(numMissing == 0) << " (" << numMissing << " missing)" << std::endl;
+	out << "same clusters for every thread count: " << Verdict(isSameForThreads) << std::endl;
+
+	// The clusters are written to the pixel shader slots the clustered shaders read
+	NullRenderDevice device;
+	device.SetRecording(true);
+	{
+		LightClusters deviceClusters;
+		deviceClusters.Update(lights.data(), maxLights, camera);
+		deviceClusters.Upload(&device);
+		device.Present();
+
+		int numBound = 0;
+		for (const RenderCommand& command : device.GetLastFrameCommands())
+		{
+			bool isResource = command.type == RENDER_COMMAND_SET_SHADER_RESOURCE && command.resource != 0 && command.stage == RENDER_STAGE_PIXEL
+				&& (command.slot == CLUSTER_LIGHT_SLOT || command.slot == CLUSTER_RANGE_SLOT || command.slot == CLUSTER_INDEX_SLOT);
+			bool isConstants = command.type == RENDER_COMMAND_SET_CONSTANT_BUFFER && command.resource != 0 && command.stage == RENDER_STAGE_PIXEL
+				&& command.slot == CLUSTER_CONSTANT_SLOT;
+			numBound += isResource || isConstants ? 1 : 0;
+		}
+		out << "upload of " << maxLights << " lights: " << device.GetLastFrameStats().numBytesMapped << " bytes mapped, lights, clusters, indices and constants bound: "
+			<< Verdict(numBound == 4) << std::endl;
+	}
+}
+
+void Benchmark::SimulationThreadFrames(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+
+	// Every value written encodes its number, so a slot handed over while it was written, or an older
+	// value after a newer one, shows up as a mismatch
+	{
+		const int numValues = 200000;
+		TripleBuffer<std::vector<uint32_t>> values;
+		std::atomic<bool> isDone(false);
+		std::thread writer([&]()
+		{
+			for (uint32_t value = 1; value <= numValues; value++)
+			{
+				values.GetWriteBuffer().assign(64, value);
+				values.Publish();
+			}
+			isDone.store(true, std::memory_order_release);
+		});
+
+		int numRead = 0;
+		int numTorn = 0;
+		int numOlder = 0;
+		uint32_t lastValue = 0;
+		while (true)
+		{
+			bool wasDone = isDone.load(std::memory_order_acquire);
+			if (!values.Update())
+			{
+				if (wasDone)
+					break;
+				std::this_thread::yield();
+				continue;
+			}
+
+			const std::vector<uint32_t>& value = values.GetReadBuffer();
+			numTorn += value.size() == 64 && std::all_of(value.begin(), value.end(), [&](uint32_t v) { return v == value[0]; }) ? 0 : 1;
+			numOlder += value[0] > lastValue ? 0 : 1;
+			lastValue = value[0];
+			numRead++;
+		}
+		writer.join();
+		out << "triple buffer: " << numRead << " of " << numValues << " values read, newest one last: " << Verdict(lastValue == numValues)
+			<< ", never torn or older: " << Verdict(numTorn == 0 && numOlder == 0) << std::endl;
+	}
+
+	{
+		const uint32_t numItems = 1000000;
+		SpscQueue<uint32_t, 256> queue;
+		std::thread producer([&]()
+		{
+			for (uint32_t item = 0; item < numItems; item++)
+			{
+				while (!queue.Push(item))
+					std::this_thread::yield();
+			}
+		});
+
+		uint32_t expected = 0;
+		int numOutOfOrder = 0;
+		long long start = Profiler::GetTimestamp();
+		while (expected < numItems)
+		{
+			uint32_t item;
+			if (!queue.Pop(item))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			numOutOfOrder += item == expected ? 0 : 1;
+			expected = item + 1;
+		}
+		double queueMs = GetElapsedMs(start, Profiler::GetTimestamp());
+		producer.join();
+		out << "queue: " << numItems << " items in " << queueMs << " ms, all in order: " << Verdict(numOutOfOrder == 0) << std::endl;
+	}
+
+	// A burst of PBF goo drawn on the null device, simulated on the frame loop and then on its
+	// own thread a step ahead. Every 10th frame sends a key nothing is bound to, its latency runs
+	// until a step that saw it was presented.
+	const int numFrames = 120;
+	const float deltaTime = 1.0f / 60.0f;
+	Camera camera(1920.0f, 1080.0f, { 3.0f, 5.0f, -15.0f }, { 0.0f, 0.0f, 0.0f });
+	NullRenderDevice device;
+	const char* modeNames[2] = { "frame loop", "own thread" };
+	double frameMs[2] = {};
+	std::vector<DirectX::XMFLOAT3> finalPositions[2];
+	bool isStepAsExpected[2] = { true, true };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		ParticleSystem particleSystem({ -6.0f, 7.5f, 0.0f }, &device, L"GooShader.hlsl", true);
+		particleSystem.GetParticleSpawner()->m_timeToLive = 10.0f;
+		particleSystem.GetParticleSpawner()->m_spawnRate = 40;
+		particleSystem.GetParticleSpawner()->m_direction = { 1.0f, 0.25f, 0.0f };
+		particleSystem.GetParticleSpawner()->m_velocity = 7.0f;
+		particleSystem.GetParticleSpawner()->AddBurst(1000, 0.0f);
+		particleSystem.SetIntegrator(INTEGRATOR_PBF);
+		PbfSettings& pbfSettings = particleSystem.GetPbfSolver().m_settings;
+		pbfSettings = PbfSettings::ForParticleSpacing(0.5f);
+		pbfSettings.boundsMin = { -10.0f, 0.25f, -5.0f };
+		pbfSettings.boundsMax = { 10.0f, 50.0f, 5.0f };
+		AssetManager::GetInstance().Wait();
+
+		// Both modes draw from the same random numbers, whichever thread simulates
+		bool isSeeded = false;
+		SimulationThread simulation;
+		simulation.Start([&](const SimulationEvent& event)
+		{
+			particleSystem.OnKeyPressed(event.key, event.isShiftHeld);
+		}, [&](float stepDeltaTime, SimulationFrame& frame)
+		{
+			if (!isSeeded)
+				RandomValues::SetSeed(7);
+			isSeeded = true;
+			particleSystem.Update(stepDeltaTime);
+			frame.particleSystems.resize(1);
+			particleSystem.WriteFrame(frame.particleSystems[0]);
+		}, mode == 1);
+
+		RenderQueue queue;
+		std::vector<double> latencies;
+		int64_t keyTimestamp = 0;
+		double stepMs = 0.0;
+		long long start = Profiler::GetTimestamp();
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			if (keyTimestamp == 0 && frame % 10 == 0)
+			{
+				keyTimestamp = Profiler::GetTimestamp();
+				simulation.SendKey(0, false, keyTimestamp);
+			}
+
+			const SimulationFrame* simulationFrame = simulation.Step(deltaTime, true);
+			uint64_t expectedStep = mode == 1 ? frame : frame + 1;
+			isStepAsExpected[mode] = isStepAsExpected[mode] && (simulationFrame ? simulationFrame->step : 0) == expectedStep;
+
+			float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			device.Clear(clearColor);
+			if (simulationFrame)
+			{
+				particleSystem.Submit(queue, camera, simulationFrame->particleSystems[0]);
+				stepMs += simulationFrame->stepMs;
+			}
+			queue.Execute(&device);
+			device.Present();
+
+			if (keyTimestamp != 0 && simulationFrame && simulationFrame->inputTimestamp >= keyTimestamp)
+			{
+				latencies.push_back(GetElapsedMs(keyTimestamp, Profiler::GetTimestamp()));
+				keyTimestamp = 0;
+			}
+		}
+		simulation.Wait();
+		frameMs[mode] = GetElapsedMs(start, Profiler::GetTimestamp()) / numFrames;
+		simulation.Stop();
+		particleSystem.GetParticlePositions(finalPositions[mode]);
+
+		double totalLatency = 0.0;
+		for (double latency : latencies)
+			totalLatency += latency;
+		out << "simulated on the " << modeNames[mode] << ": " << frameMs[mode] << " ms per frame, step " << stepMs / numFrames << " ms, "
+			<< finalPositions[mode].size() << " particles, input to present " << (latencies.empty() ? 0.0 : totalLatency / latencies.size())
+			<< " ms over " << latencies.size() << " keys" << std::endl;
+	}
+
+	bool isSame = finalPositions[0].size() == finalPositions[1].size() && std::equal(finalPositions[0].begin(), finalPositions[0].end(), finalPositions[1].begin(),
+		[](const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; });
+	out << "frame time speedup of the simulation thread: " << frameMs[0] / frameMs[1] << "x with " << jobSystem.GetNumThreads() << " job threads" << std::endl;
+	out << "frames draw the step just simulated on the frame loop, the step before on the thread: "
+		<< Verdict(isStepAsExpected[0] && isStepAsExpected[1]) << std::endl;
+	out << "same particles on the frame loop and the thread: " << Verdict(isSame) << std::endl;
+
+	// A paused thread leaves a sent step alone until Resume
+	{
+		std::atomic<int> numSteps(0);
+		SimulationThread simulation;
+		simulation.Start([](const SimulationEvent&) {}, [&](float, SimulationFrame&) { numSteps++; }, true);
+		simulation.Pause();
+		simulation.Step(1.0f / 60.0f, false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		bool isHeld = numSteps.load() == 0;
+		simulation.Resume();
+		simulation.Wait();
+		bool isResumed = numSteps.load() == 1;
+		simulation.Stop();
+		out << "paused thread holds a step sent: " << Verdict(isHeld) << ", runs it after Resume: " << Verdict(isResumed) << std::endl;
+	}
+}
+
+void Benchmark::TaskGraphScheduling(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	int numThreads = jobSystem.GetNumThreads();
+
+	// Readers wait for the last writer, writers for the last writer and the readers since
+	{
+		TaskGraph graph;
+		int a = graph.AddTask("a", []() {}, {}, { "x" });
+		int b = graph.AddTask("b", []() {}, { "x" }, {});
+		int c = graph.AddTask("c", []() {}, { "x" }, { "y" });
+		int d = graph.AddTask("d", []() {}, {}, { "x" });
+		int e = graph.AddTask("e", []() {}, { "z" }, {});
+		int f = graph.AddTask("f", []() {}, { "y" }, {});
+		auto isAfter = [&](int task, std::vector<int> expected)
+		{
+			std::vector<int> dependencies = graph.GetDependencies(task);
+			std::sort(dependencies.begin(), dependencies.end());
+			return dependencies == expected;
+		};
+		bool isInferred = isAfter(a, {}) && isAfter(b, { a }) && isAfter(c, { a }) && isAfter(d, { a, b, c }) && isAfter(e, {}) && isAfter(f, { c });
+		out << "dependencies from reads and writes: " << Verdict(isInferred) << std::endl;
+	}
+
+	// The stages of a frame with made up costs: input, then camera, game objects and simulation in
+	// parallel, culling and particle preparation next to each other, then queue, execute and present
+	// on the main thread
+	struct Stage
+	{
+		const char* name;
+		double ms;
+		std::initializer_list<const char*> reads;
+		std::initializer_list<const char*> writes;
+		bool isMainThread;
+	};
+	const Stage stages[] =
+	{
+		{ "Input", 0.2, {}, { "input" }, true },
+		{ "Simulation", 3.0, { "input" }, { "simulationFrame" }, false },
+		{ "Camera", 0.1, { "input" }, { "camera" }, false },
+		{ "GameObjects", 0.5, {}, { "gameObjects" }, false },
+		{ "Clear", 0.1, {}, { "device" }, true },
+		{ "LightAssignment", 1.0, { "camera" }, { "lights" }, false },
+		{ "LightUpload", 0.2, { "lights" }, { "device" }, true },
+		{ "RenderObjects", 1.5, { "camera", "gameObjects" }, { "renderQueue" }, false },
+		{ "ParticlePrepare", 2.0, { "camera", "simulationFrame" }, { "particleDraws" }, false },
+		{ "RenderParticles", 0.5, { "camera", "particleDraws" }, { "renderQueue" }, false },
+		{ "RenderQueue", 1.0, {}, { "renderQueue", "device" }, true },
+		{ "Present", 0.2, {}, { "device" }, true },
+	};
+	const int numStages = sizeof(stages) / sizeof(stages[0]);
+	const int numFrames = 50;
+	std::thread::id mainThread = std::this_thread::get_id();
+	std::vector<std::thread::id> ranOn(numStages);
+	TaskGraph graph;
+	double sequentialMs = 0.0;
+	for (int i = 0; i < numStages; i++)
+	{
+		const Stage& stage = stages[i];
+		graph.AddTask(stage.name, [&, i]()
+		{
+			Spin(stages[i].ms);
+			ranOn[i] = std::this_thread::get_id();
+		}, stage.reads, stage.writes, stage.isMainThread);
+		sequentialMs += stage.ms;
+	}
+
+	// Every task has to start after the ones it depends on ended, main thread tasks on the main thread
+	bool isOrdered = true;
+	bool isOnMainThread = true;
+	double frameMs[2] = {};
+	int threadCounts[2] = { 1, numThreads };
+	for (int run = 0; run < 2; run++)
+	{
+		jobSystem.Initialize(threadCounts[run]);
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			graph.Run();
+			frameMs[run] += graph.GetLastRunMs() / numFrames;
+			for (int i = 0; i < numStages; i++)
+			{
+				for (int dependency : graph.GetDependencies(i))
+					isOrdered = isOrdered && graph.GetTaskStartMs(i) >= graph.GetTaskEndMs(dependency);
+				isOnMainThread = isOnMainThread && (!stages[i].isMainThread || ranOn[i] == mainThread);
+			}
+		}
+		out << threadCounts[run] << " threads: " << frameMs[run] << " ms per frame for " << sequentialMs << " ms of stages, critical path "
+			<< graph.GetCriticalPathMs() << " ms" << std::endl;
+	}
+	out << "speedup of " << numThreads << " threads: " << frameMs[0] / frameMs[1] << "x" << std::endl;
+	out << "every task after its dependencies: " << Verdict(isOrdered) << std::endl;
+	out << "main thread tasks on the main thread: " << Verdict(isOnMainThread) << std::endl;
+
+	// On one thread nothing overlaps, so the longest chain is known: input, simulation, particle
+	// preparation, particle submission, queue and present
+	jobSystem.Initialize(1);
+	graph.Run();
+	std::vector<std::string> criticalPath;
+	for (int task : graph.GetCriticalPath())
+		criticalPath.push_back(graph.GetTaskName(task));
+	std::vector<std::string> expectedPath = { "Input", "Simulation", "ParticlePrepare", "RenderParticles", "RenderQueue", "Present" };
+	out << "critical path through the slowest chain: " << Verdict(criticalPath == expectedPath) << std::endl;
+	graph.WriteCriticalPath(out);
+	jobSystem.Initialize(numThreads);
+
+	// A long background job, like an SDF bake, is left to the workers while a frame waits on its tasks
+	std::atomic<bool> isBackgroundDone(false);
+	std::thread::id backgroundThread;
+	jobSystem.SubmitBackground([&]()
+	{
+		backgroundThread = std::this_thread::get_id();
+		Spin(50.0);
+		isBackgroundDone.store(true, std::memory_order_release);
+	});
+	long long start = Profiler::GetTimestamp();
+	graph.Run();
+	double waitingFrameMs = GetElapsedMs(start, Profiler::GetTimestamp());
+	while (!isBackgroundDone.load(std::memory_order_acquire))
+		std::this_thread::yield();
+	out << "frame next to a 50 ms background job: " << waitingFrameMs << " ms, background job off the main thread: "
+		<< Verdict(backgroundThread != mainThread) << std::endl;
+}
+
+void Benchmark::FrameArenaScratch(std::ostream& out)
+{
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	if (jobSystem.GetNumThreads() == 1)
+		jobSystem.Initialize();
+	FrameArena& frameArena = FrameArena::GetInstance();
+	bool wasTracking = HeapTracker::IsTracking();
+
+	// A Scope gives back what was allocated in it, so the next one starts at the same address
+	{
+		void* first;
+		void* second;
+		{
+			FrameArena::Scope scope;
+			first = frameArena.Allocate(1000, 16);
+		}
+		{
+			FrameArena::Scope scope;
+			second = frameArena.Allocate(1000, 16);
+		}
+		out << "scope rewinds the arena: " << Verdict(first == second) << std::endl;
+	}
+
+	{
+		FrameArena::Scope scope;
+		bool isAligned = true;
+		for (size_t alignment = 1; alignment <= 256; alignment *= 2)
+		{
+			frameArena.Allocate(3, 1);
+			isAligned = isAligned && reinterpret_cast<uintptr_t>(frameArena.Allocate(8, alignment)) % alignment == 0;
+		}
+		// Bigger than a block gets a block of its own
+		char* big = static_cast<char*>(frameArena.Allocate(3 * FrameArena::BLOCK_SIZE, 64));
+		big[0] = 1;
+		big[3 * FrameArena::BLOCK_SIZE - 1] = 1;
+		out << "allocations aligned: " << Verdict(isAligned && reinterpret_cast<uintptr_t>(big) % 64 == 0) << std::endl;
+	}
+
+	{
+		FrameArena::Scope scope;
+		FrameVector<int> values;
+		long long sum = 0;
+		for (int i = 0; i < 100000; i++)
+		{
+			values.push_back(i);
+			sum += i;
+		}
+		FrameUnorderedMap<int, int> squares;
+		for (int i = 0; i < 1000; i++)
+			squares[i] = i * i;
+		long long vectorSum = 0;
+		for (int value : values)
+			vectorSum += value;
+		out << "containers on the arena: " << Verdict(vectorSum == sum && squares.size() == 1000 && squares[999] == 999 * 999) << std::endl;
+	}
+
+	// Every chunk fills its scratch with its number and looks again after the others had the chance
+	// to run, a sub-arena shared between threads would have been overwritten
+	{
+		const int numChunks = 256;
+		std::atomic<int> numOverwritten(0);
+		jobSystem.ParallelFor(numChunks, [&](int begin, int end, int)
+		{
+			for (int chunk = begin; chunk < end; chunk++)
+			{
+				FrameArena::Scope scope;
+				FrameVector<int> scratch(4096, chunk);
+				std::this_thread::yield();
+				for (int value : scratch)
+				{
+					if (value != chunk)
+					{
+						numOverwritten++;
+						break;
+					}
+				}
+			}
+		}, 1);
+		out << "scratch of " << frameArena.GetNumThreadArenas() << " threads never overlaps: " << Verdict(numOverwritten == 0) << std::endl;
+	}
+
+	// Without a Scope memory lasts until the frame ends, the next one starts over
+	{
+		frameArena.Reset();
+		void* first = frameArena.Allocate(64, 16);
+		frameArena.Allocate(FrameArena::BLOCK_SIZE, 16);
+		frameArena.Reset();
+		void* second = frameArena.Allocate(64, 16);
+		out << "reset starts over: " << Verdict(first == second) << std::endl;
+	}
+
+	// Scratch vectors as in the neighbor queries, on the heap and on the arena
+	{
+		const int numRounds = 200000;
+		const int numValues = 48;
+		double scratchMs[2] = {};
+		uint64_t numAllocations[2] = {};
+		long long checksum[2] = {};
+		HeapTracker::SetTracking(true);
+		for (int mode = 0; mode < 2; mode++)
+		{
+			uint64_t allocationsBefore = HeapTracker::GetNumAllocations();
+			long long start = Profiler::GetTimestamp();
+			for (int round = 0; round < numRounds; round++)
+			{
+				if (mode == 0)
+				{
+					std::vector<int> values;
+					values.reserve(numValues);
+					for (int i = 0; i < numValues; i++)
+						values.push_back(i ^ round);
+					checksum[mode] += values[round % numValues];
+				}
+				else
+				{
+					FrameArena::Scope scope;
+					FrameVector<int> values;
+					values.reserve(numValues);
+					for (int i = 0; i < numValues; i++)
+						values.push_back(i ^ round);
+					checksum[mode] += values[round % numValues];
+				}
+			}
+			scratchMs[mode] = GetElapsedMs(start, Profiler::GetTimestamp());
+			numAllocations[mode] = HeapTracker::GetNumAllocations() - allocationsBefore;
+		}
+		HeapTracker::SetTracking(wasTracking);
+		out << numRounds << " scratch vectors of " << numValues << " values: heap " << scratchMs[0] << " ms with " << numAllocations[0] << " allocations, arena "
+			<< scratchMs[1] << " ms with " << numAllocations[1] << " allocations" << std::endl;
+		out << "speedup of the arena: " << scratchMs[0] / scratchMs[1] << "x" << std::endl;
+		out << "scoped scratch does not allocate: " << Verdict(numAllocations[1] == 0 && checksum[0] == checksum[1]) << std::endl;
+	}
+
+	// The frame of EngineMain on the null device, the goo simulated on the frame loop and then on its
+	// own thread. Once the goo comes and goes at the same rate the frames must not allocate at all.
+	const int numWarmupFrames = 300;
+	const int numCheckedFrames = 300;
+	const float deltaTime = 1.0f / 60.0f;
+	NullRenderDevice device;
+	Camera camera(1920.0f, 1080.0f, { 3.0f, 5.0f, -15.0f }, { 0.0f, 0.0f, 0.0f });
+	PointLight lights[5] = {
+		{{7.0f, 2.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 10.0f},
+		{{-7.0f, 5.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 4.0f},
+		{{0.0f, 15.0f, 0.0f}, {1.0f, 1.0f, 0.7f}, 5.0f},
+	};
+	StaticMesh floorMesh("Floor.obj", &device);
+	floorMesh.SetColor(&device, { 0.2f, 0.2f, 0.2f });
+	floorMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+	StaticMesh pipeMesh("Pipe.obj", &device);
+	pipeMesh.SetColor(&device, { 0.8f, 0.4f, 0.2f });
+	pipeMesh.SetShader(&device, L"BlinnPhongShader.hlsl", false);
+	GameObject floor;
+	floor.SetMesh(&floorMesh);
+	std::vector<GameObject> pipes;
+	PlacePipes(pipes, 3, 8.0f, &pipeMesh);
+	std::vector<GameObject*> objects = { &floor };
+	for (GameObject& pipe : pipes)
+		objects.push_back(&pipe);
+
+	const char* modeNames[2] = { "frame loop", "own thread" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		ParticleSystem particleSystem({ -6.0f, 7.5f, 0.0f }, &device, L"GooShader.hlsl", true);
+		ParticleSpawner* spawner = particleSystem.GetParticleSpawner();
+		spawner->m_timeToLive = 1.5f;
+		spawner->m_spawnRate = 200;
+		spawner->m_srVariance = 0.5f;
+		spawner->m_direction = { 1.0f, 0.25f, 0.0f };
+		spawner->m_dVariance = 0.1f;
+		spawner->m_velocity = 7.0f;
+		spawner->m_vVariance = 0.3f;
+		AssetManager::GetInstance().Wait();
+
+		SimulationThread simulation;
+		simulation.Start([&](const SimulationEvent& event)
+		{
+			particleSystem.OnKeyPressed(event.key, event.isShiftHeld);
+		}, [&](float stepDeltaTime, SimulationFrame& frame)
+		{
+			particleSystem.Update(stepDeltaTime);
+			frame.particleSystems.resize(1);
+			particleSystem.WriteFrame(frame.particleSystems[0]);
+		}, mode == 1);
+
+		LightClusters lightClusters;
+		InstanceBatcher batcher;
+		RenderQueue queue;
+		const SimulationFrame* simulationFrame = nullptr;
+		TaskGraph frameGraph;
+		frameGraph.AddTask("Simulation", [&]() { simulationFrame = simulation.Step(deltaTime, true); }, {}, { "simulationFrame" });
+		frameGraph.AddTask("Camera", [&]() { camera.Update(deltaTime); }, {}, { "camera" });
+		frameGraph.AddTask("GameObjects", [&]()
+		{
+			for (GameObject* object : objects)
+				object->Update(deltaTime);
+		}, {}, { "gameObjects" });
+		frameGraph.AddTask("Clear", [&]()
+		{
+			float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			device.Clear(clearColor);
+		}, {}, { "device" }, true);
+		frameGraph.AddTask("LightAssignment", [&]() { lightClusters.Update(lights, 5, camera); }, { "camera" }, { "lights" });
+		frameGraph.AddTask("LightUpload", [&]() { lightClusters.Upload(&device); }, { "lights" }, { "device" }, true);
+		frameGraph.AddTask("RenderObjects", [&]() { batcher.Submit(queue, objects, camera); }, { "camera", "gameObjects" }, { "renderQueue" });
+		frameGraph.AddTask("ParticlePrepare", [&]()
+		{
+			if (simulationFrame)
+				particleSystem.Prepare(camera, simulationFrame->particleSystems[0]);
+		}, { "camera", "simulationFrame" }, { "particleDraws" });
+		frameGraph.AddTask("RenderParticles", [&]()
+		{
+			if (simulationFrame)
+				particleSystem.SubmitPrepared(queue, camera, simulationFrame->particleSystems[0]);
+		}, { "camera", "simulationFrame", "particleDraws" }, { "renderQueue" });
+		frameGraph.AddTask("RenderQueue", [&]() { queue.Execute(&device); }, {}, { "renderQueue", "device" }, true);
+		frameGraph.AddTask("Present", [&]() { device.Present(); }, {}, { "device" }, true);
+
+		uint64_t numAllocations = 0;
+		uint64_t numBytes = 0;
+		int numAllocatingFrames = 0;
+		HeapTracker::SetTracking(true);
+		for (int frame = 0; frame < numWarmupFrames + numCheckedFrames; frame++)
+		{
+			uint64_t allocationsBefore = HeapTracker::GetNumAllocations();
+			uint64_t bytesBefore = HeapTracker::GetNumBytes();
+			frameGraph.Run();
+			frameArena.Reset();
+			if (frame >= numWarmupFrames)
+			{
+				uint64_t numFrameAllocations = HeapTracker::GetNumAllocations() - allocationsBefore;
+				numAllocations += numFrameAllocations;
+				numBytes += HeapTracker::GetNumBytes() - bytesBefore;
+				numAllocatingFrames += numFrameAllocations > 0 ? 1 : 0;
+			}
+		}
+		HeapTracker::SetTracking(wasTracking);
+		size_t numParticles = simulationFrame ? simulationFrame->particleSystems[0].positions.size() : 0;
+		simulation.Stop();
+
+		out << "simulated on the " << modeNames[mode] << ": " << numParticles << " particles, " << numAllocations << " allocations ("
+			<< numBytes << " bytes) in " << numAllocatingFrames << " of " << numCheckedFrames << " frames after " << numWarmupFrames
+			<< " warm up frames: " << Verdict(numAllocations == 0) << std::endl;
+	}
+	out << "frame arena: " << frameArena.GetNumThreadArenas() << " threads, at most " << frameArena.GetPeakBytes() << " bytes in use, "
+		<< frameArena.GetNumBytesReserved() << " bytes reserved" << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <ostream>
+#include <string>
+
+class Benchmark
+{
+public:
+	// Runs every benchmark whose name contains filter (all of them if filter is empty). Returns 0
+	// if one ran and none of its checks failed.
+	static int Run(const std::string& filter, std::ostream& out);
+	// The reader process the shared_memory benchmark starts with "-sharedcheck <name>". Checks the
+	// frames published to name until enough were read and returns 0 if none was torn.
+	static int RunSharedParticleCheck(const std::string& name, std::ostream& out);
+
+private:
+	static double GetElapsedMs(long long startNs, long long endNs);
+	// "PASS" or "FAIL" for a check, counting the failures
+	static const char* Verdict(bool isPassed);
+
+	static int s_numFailed;
+
+	static void ProfilerOverhead(std::ostream& out);
+	static void RandomStatistics(std::ostream& out);
+	static void RandomThroughput(std::ostream& out);
+	static void SpawnerEmissionRate(std::ostream& out);
+	static void SphDamBreak(std::ostream& out);
+	static void PbfIterations(std::ostream& out);
+	static void SdfBakeAndQuery(std::ostream& out);
+	static void BvhBuildAndQuery(std::ostream& out);
+	static void IsoSurfaceExtraction(std::ostream& out);
+	static void DensityCache(std::ostream& out);
+	static void SimulationRecording(std::ostream& out);
+	static void SharedParticleExport(std::ostream& out);
+	static void NeighborCacheReuse(std::ostream& out);
+	static void MortonReorder(std::ostream& out);
+	static void DepthSort(std::ostream& out);
+	static void NullDeviceFrames(std::ostream& out);
+	static void SoftwareRasterizer(std::ostream& out);
+	static void AssetLoading(std::ostream& out);
+	static void RenderQueueSorting(std::ostream& out);
+	static void InstancedPipes(std::ostream& out);
+	static void LightClusterAssignment(std::ostream& out);
+	static void SimulationThreadFrames(std::ostream& out);
+	static void TaskGraphScheduling(std::ostream& out);
+	static void FrameArenaScratch(std::ostream& out);
+};
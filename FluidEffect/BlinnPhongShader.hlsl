@@ -10,16 +10,51 @@ cbuffer ConstantBuffer : register(b0)
     matrix InverseProjection;
 }
 
-struct PointLight
+#ifdef INSTANCED
+// Mirrors InstanceData, world comes per instance and World, WorldView and WorldViewProj are unused
+struct InstanceData
 {
-    float3 position;
+    matrix world;
+};
+
+StructuredBuffer<InstanceData> instances : register(t1);
+#endif
+
+// Lights in view space, sorted into a froxel grid by LightClusters
+struct ClusterLight
+{
+    float3 viewPosition;
+    float range;
     float3 color;
     float power;
 };
 
-StructuredBuffer<PointLight> lights : register(t0);
+struct ClusterLightRange
+{
+    uint offset;
+    uint numLights;
+};
 
-static const int MAX_NUM_OF_LIGHTS = 5;
+StructuredBuffer<ClusterLight> lights : register(t0);
+StructuredBuffer<ClusterLightRange> clusters : register(t1);
+StructuredBuffer<uint> lightIndices : register(t2);
+
+cbuffer ClusterConstants : register(b2)
+{
+    uint3 numClusters;
+    uint numLights;
+    float2 tileSize;
+    float sliceScale;
+    float sliceBias;
+}
+
+ClusterLightRange GetCluster(float2 pixel, float viewDepth)
+{
+    uint3 cluster;
+    cluster.xy = min(uint2(pixel / tileSize), numClusters.xy - 1);
+    cluster.z = min(uint(max(log(viewDepth) * sliceScale + sliceBias, 0.0f)), numClusters.z - 1);
+    return clusters[(cluster.z * numClusters.y + cluster.y) * numClusters.x + cluster.x];
+}
 
 struct VS_INPUT
 {
@@ -27,6 +62,9 @@ struct VS_INPUT
     float3 normal : NORMAL;
     float2 uv : TEXCOORD;
     float3 color : COLOR;
+#ifdef INSTANCED
+    uint instanceID : SV_InstanceID;
+#endif
 };
 
 struct VS_OUTPUT
@@ -40,9 +78,16 @@ struct VS_OUTPUT
 VS_OUTPUT VSMain(VS_INPUT input)
 {
     VS_OUTPUT output;
+#ifdef INSTANCED
+    matrix world = instances[input.instanceID].world;
+    output.viewPos = mul(View, mul(world, float4(input.position, 1.0f)));
+    output.position = mul(Projection, output.viewPos);
+    output.normal = normalize(mul((float3x3) View, mul((float3x3) world, input.normal)));
+#else
     output.position = mul(WorldViewProj, float4(input.position, 1.0f));
     output.viewPos = mul(WorldView, float4(input.position, 1.0f));
     output.normal = normalize(mul((float3x3) WorldView, input.normal));
+#endif
     output.color = input.color;
     return output;
 }
@@ -55,21 +100,18 @@ struct PS_OUTPUT
 };
 
 
-float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal)
+float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal, float2 pixel)
 {
     float shininess = 20.0f;
     float screenGamma = 2.2f;
     float3 ambientColor = float3(0.0f, 0.02f, 0.05f);
-    float3 linearColor;
+    float3 linearColor = float3(0.0f, 0.0f, 0.0f);
     
-    for (int i = 0; i < MAX_NUM_OF_LIGHTS; i++)
+    ClusterLightRange cluster = GetCluster(pixel, vertPos.z);
+    for (uint i = 0; i < cluster.numLights; i++)
     {
-        if(lights[i].power == 0.0f)
-            continue;
-        
-        float4 lightPosView = mul(View, float4(lights[i].position, 1.0f));
-        lightPosView /= lightPosView.w;
-        float3 lightDir = lightPosView.xyz - vertPos;
+        ClusterLight light = lights[lightIndices[cluster.offset + i]];
+        float3 lightDir = light.viewPosition - vertPos;
         float distance = length(lightDir);
         distance *= distance;
         lightDir = normalize(lightDir);
@@ -86,8 +128,10 @@ float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal)
             specular = pow(specAngle, shininess);
         }
         
-        linearColor += diffuseColor * lambertian * lights[i].color * lights[i].power / distance +
-                         specular * lights[i].color * lights[i].power / distance;
+        // Fades to 0 at the range of the light, beyond it the light is in no cluster
+        float intensity = light.power * max(1.0f / distance - 1.0f / (light.range * light.range), 0.0f);
+        linearColor += diffuseColor * lambertian * light.color * intensity +
+                         specular * light.color * intensity;
         
     }
     float3 gammaCorrectedColor = pow(linearColor, 1.0f / screenGamma);
@@ -98,7 +142,7 @@ float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal)
 PS_OUTPUT PSMain(VS_OUTPUT input) : SV_TARGET
 {
     PS_OUTPUT output;
-    float3 color = BlinnPhong(input.viewPos.xyz, input.color, input.normal);
+    float3 color = BlinnPhong(input.viewPos.xyz, input.color, input.normal, input.position.xy);
     output.color = float4(color, 1.0f);
     return output;
 }
\ No newline at end of file
@@ -148,6 +148,12 @@ void Camera::SetRotation(DirectX::XMFLOAT3 rotation)
 	 return upFloat;
  }
 
+ float Camera::GetViewDepth(const DirectX::XMFLOAT3& position) const
+ {
+	 DirectX::XMFLOAT3 forward = GetForwardVector();
+	 return (position.x - m_position.x) * forward.x + (position.y - m_position.y) * forward.y + (position.z - m_position.z) * forward.z;
+ }
+
  float Camera::GetScreenWidth() const
  {
 	 return m_screenWidth;
@@ -158,6 +164,16 @@ void Camera::SetRotation(DirectX::XMFLOAT3 rotation)
 	 return m_screenHeight;
  }
 
+ float Camera::GetNearPlane() const
+ {
+	 return m_nearPlane;
+ }
+
+ float Camera::GetFarPlane() const
+ {
+	 return m_farPlane;
+ }
+
  DirectX::XMFLOAT3 Camera::DegToRad(const DirectX::XMFLOAT3& r) const
  {
 	 DirectX::XMFLOAT3 rad;
@@ -24,9 +24,13 @@ public:
 	DirectX::XMFLOAT3 GetForwardVector() const;
 	DirectX::XMFLOAT3 GetRightVector() const;
 	DirectX::XMFLOAT3 GetUpVector() const;
+	// Distance in front of the camera along the forward vector
+	float GetViewDepth(const DirectX::XMFLOAT3& position) const;
 
 	float GetScreenWidth() const;
 	float GetScreenHeight() const;
+	float GetNearPlane() const;
+	float GetFarPlane() const;
 
 private:
 	DirectX::XMFLOAT3 DegToRad(const DirectX::XMFLOAT3& r) const;
@@ -11,4 +11,12 @@ struct alignas(16) ConstantBuffer
 	DirectX::XMMATRIX inverseWorld;
 	DirectX::XMMATRIX inverseView;
 	DirectX::XMMATRIX inverseProjection;
-};
\ No newline at end of file
+};
+
+// Per instance of an instanced draw, read from a structured buffer at vertex shader slot INSTANCE_BUFFER_SLOT
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 world;
+};
+
+const int INSTANCE_BUFFER_SLOT = 1;
\ No newline at end of file
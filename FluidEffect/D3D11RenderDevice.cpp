@@ -0,0 +1,306 @@
+#include <iostream>
+#include <vector>
+#include "D3D11RenderDevice.h"
+#include "Shader.h"
+
+namespace
+{
+	class D3D11RenderBuffer : public RenderBuffer
+	{
+	public:
+		D3D11RenderBuffer(const RenderBufferDesc& desc) : RenderBuffer(desc)
+		{
+			buffer = nullptr;
+			view = nullptr;
+		}
+
+		void Release() override
+		{
+			if (view)
+				view->Release();
+			if (buffer)
+				buffer->Release();
+			delete this;
+		}
+
+		ID3D11Buffer* buffer;
+		ID3D11ShaderResourceView* view;
+	};
+
+	class D3D11ShaderProgram : public RenderShaderProgram
+	{
+	public:
+		D3D11ShaderProgram()
+		{
+			vertexShader = nullptr;
+			geometryShader = nullptr;
+			pixelShader = nullptr;
+			inputLayout = nullptr;
+		}
+
+		void Release() override
+		{
+			if (vertexShader)
+				vertexShader->Release();
+			if (geometryShader)
+				geometryShader->Release();
+			if (pixelShader)
+				pixelShader->Release();
+			if (inputLayout)
+				inputLayout->Release();
+			delete this;
+		}
+
+		void AddBytes(ID3D10Blob* shaderBlob)
+		{
+			m_numBytes += static_cast<UINT>(shaderBlob->GetBufferSize());
+		}
+
+		ID3D11VertexShader* vertexShader;
+		ID3D11GeometryShader* geometryShader;
+		ID3D11PixelShader* pixelShader;
+		ID3D11InputLayout* inputLayout;
+	};
+
+	ID3D11Buffer* GetBuffer(RenderBuffer* buffer)
+	{
+		return buffer ? static_cast<D3D11RenderBuffer*>(buffer)->buffer : nullptr;
+	}
+}
+
+D3D11RenderDevice::D3D11RenderDevice(ID3D11Device* device, ID3D11DeviceContext* deviceContext, IDXGISwapChain* swapChain, ID3D11RenderTargetView* renderTargetView, ID3D11DepthStencilView* depthStencilView)
+{
+	m_device = device;
+	m_deviceContext = deviceContext;
+	m_swapChain = swapChain;
+	m_renderTargetView = renderTargetView;
+	m_depthStencilView = depthStencilView;
+}
+
+HRESULT D3D11RenderDevice::CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer)
+{
+	const UINT bindFlags[RENDER_BUFFER_TYPE_COUNT] = { D3D11_BIND_VERTEX_BUFFER, D3D11_BIND_INDEX_BUFFER, D3D11_BIND_CONSTANT_BUFFER, D3D11_BIND_SHADER_RESOURCE };
+
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+	bufferDesc.Usage = desc.isDynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = desc.byteWidth;
+	bufferDesc.BindFlags = bindFlags[desc.type];
+	bufferDesc.CPUAccessFlags = desc.isDynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+	if (desc.type == RENDER_BUFFER_STRUCTURED)
+	{
+		bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = desc.structureStride;
+	}
+
+	D3D11_SUBRESOURCE_DATA bufferData = {};
+	bufferData.pSysMem = initialData;
+
+	D3D11RenderBuffer* renderBuffer = new D3D11RenderBuffer(desc);
+	HRESULT hr = m_device->CreateBuffer(&bufferDesc, initialData ? &bufferData : nullptr, &renderBuffer->buffer);
+	if (SUCCEEDED(hr) && desc.type == RENDER_BUFFER_STRUCTURED)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+		ZeroMemory(&srvDesc, sizeof(srvDesc));
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = desc.structureStride > 0 ? desc.byteWidth / desc.structureStride : 0;
+		hr = m_device->CreateShaderResourceView(renderBuffer->buffer, &srvDesc, &renderBuffer->view);
+	}
+
+	if (FAILED(hr))
+	{
+		renderBuffer->Release();
+		*buffer = nullptr;
+		return hr;
+	}
+
+	*buffer = renderBuffer;
+	return S_OK;
+}
+
+HRESULT D3D11RenderDevice::CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program)
+{
+	HRESULT hr;
+	ID3D10Blob* shaderBlob = nullptr;
+	D3D11ShaderProgram* shaderProgram = new D3D11ShaderProgram();
+	*program = nullptr;
+
+	// Null terminated like the compiler expects it
+	std::vector<D3D_SHADER_MACRO> defines;
+	for (const RenderShaderDefine& define : desc.defines)
+		defines.push_back({ define.name.c_str(), define.value.c_str() });
+	defines.push_back({ nullptr, nullptr });
+	const WCHAR* fileName = desc.fileName.c_str();
+
+	//Compile Vertex Shader
+	hr = Shader::CompileShaderFromFile(fileName, desc.vertexEntryPoint.c_str(), "vs_5_0", &shaderBlob, defines.data());
+	if (FAILED(hr))
+	{
+		std::cout << "Compiling Vertex Shader failed." << std::endl;
+		shaderProgram->Release();
+		return hr;
+	}
+
+	hr = m_device->CreateVertexShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &shaderProgram->vertexShader);
+	shaderProgram->AddBytes(shaderBlob);
+	if (FAILED(hr))
+	{
+		std::cout << "Creating Vertex Shader failed." << std::endl;
+		shaderBlob->Release();
+		shaderProgram->Release();
+		return hr;
+	}
+
+	//Create Input Layout
+	D3D11_INPUT_ELEMENT_DESC layout[] =
+	{
+		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0}
+	};
+	UINT numElements = ARRAYSIZE(layout);
+
+	hr = m_device->CreateInputLayout(layout, numElements, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), &shaderProgram->inputLayout);
+	shaderBlob->Release();
+	if (FAILED(hr))
+	{
+		std::cout << "Creating Input Layout failed." << std::endl;
+		shaderProgram->Release();
+		return hr;
+	}
+
+	//Compile Geometry Shader if used
+	if (!desc.geometryEntryPoint.empty())
+	{
+		hr = Shader::CompileShaderFromFile(fileName, desc.geometryEntryPoint.c_str(), "gs_5_0", &shaderBlob, defines.data());
+		if (FAILED(hr))
+		{
+			std::cout << "Compiling Geometry Shader failed." << std::endl;
+			shaderProgram->Release();
+			return hr;
+		}
+
+		hr = m_device->CreateGeometryShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &shaderProgram->geometryShader);
+		shaderProgram->AddBytes(shaderBlob);
+		shaderBlob->Release();
+		if (FAILED(hr))
+		{
+			std::cout << "Creating Geometry Shader failed." << std::endl;
+			shaderProgram->Release();
+			return hr;
+		}
+	}
+
+	//Compile Pixel Shader
+	hr = Shader::CompileShaderFromFile(fileName, desc.pixelEntryPoint.c_str(), "ps_5_0", &shaderBlob, defines.data());
+	if (FAILED(hr))
+	{
+		std::cout << "Compiling Pixel Shader failed." << std::endl;
+		shaderProgram->Release();
+		return hr;
+	}
+
+	hr = m_device->CreatePixelShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &shaderProgram->pixelShader);
+	shaderProgram->AddBytes(shaderBlob);
+	shaderBlob->Release();
+	if (FAILED(hr))
+	{
+		std::cout << "Creating Pixel Shader failed." << std::endl;
+		shaderProgram->Release();
+		return hr;
+	}
+
+	*program = shaderProgram;
+	return S_OK;
+}
+
+void* D3D11RenderDevice::Map(RenderBuffer* buffer)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(m_deviceContext->Map(GetBuffer(buffer), NULL, D3D11_MAP_WRITE_DISCARD, NULL, &mappedResource)))
+		return nullptr;
+
+	return mappedResource.pData;
+}
+
+void D3D11RenderDevice::Unmap(RenderBuffer* buffer)
+{
+	m_deviceContext->Unmap(GetBuffer(buffer), NULL);
+}
+
+void D3D11RenderDevice::SetShaderProgram(RenderShaderProgram* program)
+{
+	D3D11ShaderProgram* shaderProgram = static_cast<D3D11ShaderProgram*>(program);
+	m_deviceContext->VSSetShader(shaderProgram ? shaderProgram->vertexShader : nullptr, nullptr, 0);
+	m_deviceContext->GSSetShader(shaderProgram ? shaderProgram->geometryShader : nullptr, nullptr, 0);
+	m_deviceContext->PSSetShader(shaderProgram ? shaderProgram->pixelShader : nullptr, nullptr, 0);
+	m_deviceContext->IASetInputLayout(shaderProgram ? shaderProgram->inputLayout : nullptr);
+}
+
+void D3D11RenderDevice::SetVertexBuffer(RenderBuffer* buffer, UINT stride)
+{
+	ID3D11Buffer* vertexBuffer = GetBuffer(buffer);
+	UINT offset = 0;
+	m_deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+}
+
+void D3D11RenderDevice::SetIndexBuffer(RenderBuffer* buffer)
+{
+	m_deviceContext->IASetIndexBuffer(GetBuffer(buffer), DXGI_FORMAT_R32_UINT, 0);
+}
+
+void D3D11RenderDevice::SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	ID3D11Buffer* constantBuffer = GetBuffer(buffer);
+	if (stage == RENDER_STAGE_VERTEX)
+		m_deviceContext->VSSetConstantBuffers(slot, 1, &constantBuffer);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		m_deviceContext->GSSetConstantBuffers(slot, 1, &constantBuffer);
+	else
+		m_deviceContext->PSSetConstantBuffers(slot, 1, &constantBuffer);
+}
+
+void D3D11RenderDevice::SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	ID3D11ShaderResourceView* view = buffer ? static_cast<D3D11RenderBuffer*>(buffer)->view : nullptr;
+	if (stage == RENDER_STAGE_VERTEX)
+		m_deviceContext->VSSetShaderResources(slot, 1, &view);
+	else if (stage == RENDER_STAGE_GEOMETRY)
+		m_deviceContext->GSSetShaderResources(slot, 1, &view);
+	else
+		m_deviceContext->PSSetShaderResources(slot, 1, &view);
+}
+
+void D3D11RenderDevice::SetTopology(RenderTopology topology)
+{
+	m_deviceContext->IASetPrimitiveTopology(topology == RENDER_TOPOLOGY_POINT_LIST ? D3D11_PRIMITIVE_TOPOLOGY_POINTLIST : D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void D3D11RenderDevice::Draw(UINT numVertices, UINT firstVertex)
+{
+	m_deviceContext->Draw(numVertices, firstVertex);
+}
+
+void D3D11RenderDevice::DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex)
+{
+	m_deviceContext->DrawIndexed(numIndices, firstIndex, baseVertex);
+}
+
+void D3D11RenderDevice::DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex)
+{
+	m_deviceContext->DrawIndexedInstanced(numIndices, numInstances, firstIndex, baseVertex, 0);
+}
+
+void D3D11RenderDevice::Clear(const float color[4])
+{
+	m_deviceContext->ClearDepthStencilView(m_depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	m_deviceContext->ClearRenderTargetView(m_renderTargetView, color);
+}
+
+HRESULT D3D11RenderDevice::Present()
+{
+	return m_swapChain->Present(0, 0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <d3d11.h>
+#include <dxgi.h>
+#include "RenderDevice.h"
+
+// RenderDevice on top of the device, swap chain and back buffer DirectX11Helper created, which
+// stay owned by the helper
+class D3D11RenderDevice : public RenderDevice
+{
+public:
+	D3D11RenderDevice(ID3D11Device* device, ID3D11DeviceContext* deviceContext, IDXGISwapChain* swapChain, ID3D11RenderTargetView* renderTargetView, ID3D11DepthStencilView* depthStencilView);
+
+	HRESULT CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) override;
+	HRESULT CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program) override;
+
+	void* Map(RenderBuffer* buffer) override;
+	void Unmap(RenderBuffer* buffer) override;
+
+	void SetShaderProgram(RenderShaderProgram* program) override;
+	void SetVertexBuffer(RenderBuffer* buffer, UINT stride) override;
+	void SetIndexBuffer(RenderBuffer* buffer) override;
+	void SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetTopology(RenderTopology topology) override;
+	void Draw(UINT numVertices, UINT firstVertex) override;
+	void DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex) override;
+
+	void Clear(const float color[4]) override;
+	HRESULT Present() override;
+
+private:
+	ID3D11Device* m_device;
+	ID3D11DeviceContext* m_deviceContext;
+	IDXGISwapChain* m_swapChain;
+	ID3D11RenderTargetView* m_renderTargetView;
+	ID3D11DepthStencilView* m_depthStencilView;
+};
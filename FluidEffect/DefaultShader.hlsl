@@ -10,12 +10,25 @@ cbuffer ConstantBuffer : register(b0)
     matrix InverseProjection;
 }
 
+#ifdef INSTANCED
+// Mirrors InstanceData, world comes per instance and World, WorldView and WorldViewProj are unused
+struct InstanceData
+{
+    matrix world;
+};
+
+StructuredBuffer<InstanceData> instances : register(t1);
+#endif
+
 struct VS_INPUT
 {
     float3 position : POSITION;
     float3 normal : NORMAL;
     float2 uv : TEXCOORD;
     float3 color : COLOR;
+#ifdef INSTANCED
+    uint instanceID : SV_InstanceID;
+#endif
 };
 
 struct VS_OUTPUT
@@ -26,7 +39,12 @@ struct VS_OUTPUT
 VS_OUTPUT VSMain( VS_INPUT input )
 {
     VS_OUTPUT output;
+#ifdef INSTANCED
+    float4 worldPos = mul(instances[input.instanceID].world, float4(input.position, 1.0f));
+    output.position = mul(Projection, mul(View, worldPos));
+#else
     output.position = mul(WorldViewProj, float4(input.position, 1.0f));
+#endif
 	return output;
 }
 
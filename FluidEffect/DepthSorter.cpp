@@ -0,0 +1,158 @@
+#include <algorithm>
+#include "DepthSorter.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+DepthSorter::DepthSorter()
+{
+	m_useTemporalReuse = false;
+	m_maxShiftsPerParticle = 2;
+	m_wasReused = false;
+	m_numFramesToSkip = 0;
+	m_numSkippedAfterFailure = 0;
+}
+
+void DepthSorter::Sort(const DirectX::XMFLOAT3* positions, const uint32_t* ids, int numParticles, const DirectX::XMFLOAT3& eye, const DirectX::XMFLOAT3& forward, std::vector<int>& order)
+{
+	PROFILE_SCOPE("DepthSort");
+
+	// Negated view depth, so ascending keys are back to front
+	m_depths.resize(numParticles);
+	JobSystem::GetInstance().ParallelFor(numParticles, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			m_depths[i] = -((positions[i].x - eye.x) * forward.x + (positions[i].y - eye.y) * forward.y + (positions[i].z - eye.z) * forward.z);
+		}
+	}, 4096);
+
+	bool isTrying = m_useTemporalReuse && m_numFramesToSkip == 0;
+	m_wasReused = isTrying && Refine(ids, numParticles, order);
+	if (!m_wasReused)
+		m_radixSort.Sort(m_depths.data(), numParticles, order);
+
+	if (!m_useTemporalReuse)
+		return;
+
+	// After a failure the next tries are put off for twice as many frames as before, so a camera
+	// that keeps turning costs the radix sort alone. Only the frame before a try keeps its order.
+	if (isTrying)
+	{
+		m_numSkippedAfterFailure = m_wasReused ? 0 : std::min(std::max(1, 2 * m_numSkippedAfterFailure), MAX_SKIPPED_FRAMES);
+		m_numFramesToSkip = m_numSkippedAfterFailure;
+	}
+	else
+	{
+		m_numFramesToSkip--;
+	}
+
+	if (m_numFramesToSkip == 0)
+		RememberOrder(ids, order);
+}
+
+bool DepthSorter::Refine(const uint32_t* ids, int numParticles, std::vector<int>& order)
+{
+	if (m_previousIds.empty() || numParticles == 0)
+		return false;
+
+	// Pairs spread over last frame's order whose particles kept their index tell how far the order
+	// is off before anything is gathered, so a turned camera costs next to nothing
+	const int numSamples = 1024;
+	int numSampled = 0;
+	int numSampledDescents = 0;
+	size_t sampleStep = std::max<size_t>(1, m_previousIds.size() / numSamples);
+	for (size_t k = 0; k + 1 < m_previousIds.size(); k += sampleStep)
+	{
+		int a = m_previousOrder[k];
+		int b = m_previousOrder[k + 1];
+		if (a >= numParticles || b >= numParticles || ids[a] != m_previousIds[k] || ids[b] != m_previousIds[k + 1])
+			continue;
+
+		numSampled++;
+		numSampledDescents += m_depths[a] > m_depths[b] ? 1 : 0;
+	}
+	if (numSampled >= numSamples / 4 && numSampledDescents * 16 > numSampled)
+		return false;
+
+	// Ids come from the emission counter, so the live ones usually form a dense range
+	uint32_t minId = *std::min_element(ids, ids + numParticles);
+	uint32_t maxId = *std::max_element(ids, ids + numParticles);
+	if (maxId - minId >= 4u * numParticles + 1024u)
+		return false;
+
+	m_indexOfId.assign(maxId - minId + 1, -1);
+	for (int i = 0; i < numParticles; i++)
+		m_indexOfId[ids[i] - minId] = i;
+
+	// Survivors in last frame's order. Once more than one in 16 neighboring pairs is out of order
+	// the camera turned and the insertion sort would only run into its limit, so that is given up
+	// on while gathering.
+	order.clear();
+	m_sortedDepths.clear();
+	m_isPlaced.assign(numParticles, 0);
+	long long numDescents = 0;
+	long long maxDescents = numParticles / 16;
+	for (uint32_t id : m_previousIds)
+	{
+		uint32_t offset = id - minId;
+		int index = offset < m_indexOfId.size() ? m_indexOfId[offset] : -1;
+		if (index < 0)
+			continue;
+
+		float depth = m_depths[index];
+		if (!m_sortedDepths.empty() && m_sortedDepths.back() > depth && ++numDescents > maxDescents)
+			return false;
+
+		order.push_back(index);
+		m_sortedDepths.push_back(depth);
+		m_isPlaced[index] = 1;
+	}
+
+	// Insertion sort, bounded by about the moves of one radix pass so giving up costs little
+	long long maxShifts = static_cast<long long>(m_maxShiftsPerParticle) * numParticles;
+	long long numShifts = 0;
+	for (size_t i = 1; i < order.size(); i++)
+	{
+		float depth = m_sortedDepths[i];
+		int index = order[i];
+		size_t j = i;
+		while (j > 0 && m_sortedDepths[j - 1] > depth)
+		{
+			m_sortedDepths[j] = m_sortedDepths[j - 1];
+			order[j] = order[j - 1];
+			j--;
+		}
+		m_sortedDepths[j] = depth;
+		order[j] = index;
+
+		numShifts += i - j;
+		if (numShifts > maxShifts)
+			return false;
+	}
+
+	// Particles born since last frame are sorted on their own and merged in
+	m_births.clear();
+	for (int i = 0; i < numParticles; i++)
+	{
+		if (!m_isPlaced[i])
+			m_births.push_back(i);
+	}
+
+	if (!m_births.empty())
+	{
+		std::stable_sort(m_births.begin(), m_births.end(), [&](int a, int b) { return m_depths[a] < m_depths[b]; });
+		m_merged.resize(numParticles);
+		std::merge(order.begin(), order.end(), m_births.begin(), m_births.end(), m_merged.begin(), [&](int a, int b) { return m_depths[a] < m_depths[b]; });
+		order.swap(m_merged);
+	}
+
+	return true;
+}
+
+void DepthSorter::RememberOrder(const uint32_t* ids, const std::vector<int>& order)
+{
+	m_previousIds.resize(order.size());
+	m_previousOrder.assign(order.begin(), order.end());
+	for (size_t i = 0; i < order.size(); i++)
+		m_previousIds[i] = ids[order[i]];
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "RadixSort.h"
+
+// Back to front draw order for alpha blended particles. Depths are radix sorted, or with temporal
+// reuse last frame's order is looked up by particle id and refined with an insertion sort, which
+// falls back to the radix sort once more than one in 16 pairs of last frame's order is out of order,
+// or once it needs more than m_maxShiftsPerParticle shifts per particle. Failed tries back off.
+class DepthSorter
+{
+public:
+	DepthSorter();
+
+	// ids have to be unique among the current particles, order gets the particle indices far to near
+	void Sort(const DirectX::XMFLOAT3* positions, const uint32_t* ids, int numParticles, const DirectX::XMFLOAT3& eye, const DirectX::XMFLOAT3& forward, std::vector<int>& order);
+
+	// False if the last Sort ran the radix sort
+	bool WasReused() const { return m_wasReused; }
+
+	bool m_useTemporalReuse;
+	int m_maxShiftsPerParticle;
+
+private:
+	static const int MAX_SKIPPED_FRAMES = 32;
+
+	bool Refine(const uint32_t* ids, int numParticles, std::vector<int>& order);
+	void RememberOrder(const uint32_t* ids, const std::vector<int>& order);
+
+	RadixSort m_radixSort;
+	std::vector<float> m_depths;
+	std::vector<float> m_sortedDepths;
+	std::vector<int> m_births;
+	std::vector<int> m_merged;
+	std::vector<uint8_t> m_isPlaced;
+
+	// Ids and indices in last frame's order
+	std::vector<uint32_t> m_previousIds;
+	std::vector<int> m_previousOrder;
+	std::vector<int> m_indexOfId;
+	bool m_wasReused;
+	int m_numFramesToSkip;
+	int m_numSkippedAfterFailure;
+};
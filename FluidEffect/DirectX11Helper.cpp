@@ -8,6 +8,7 @@ DirectX11Helper::DirectX11Helper()
 	m_device = nullptr;
 	m_deviceContext = nullptr;
 	m_swapChain = nullptr;
+	m_renderDevice = nullptr;
 }
 
 HRESULT DirectX11Helper::InitDirectX11(HWND hWnd)
@@ -142,6 +143,8 @@ HRESULT DirectX11Helper::InitDirectX11(HWND hWnd)
 	viewport.TopLeftY = 0;
 
 	m_deviceContext->RSSetViewports(1, &viewport);
+
+	m_renderDevice = new D3D11RenderDevice(m_device, m_deviceContext, m_swapChain, m_renderTargetView, m_depthStencilView);
 	return hr;
 }
 
@@ -149,6 +152,12 @@ HRESULT DirectX11Helper::CleanUpDirectX11()
 {
 	HRESULT hr = S_OK;
 
+	if (m_renderDevice)
+	{
+		delete m_renderDevice;
+		m_renderDevice = nullptr;
+	}
+
 	if (m_rasterizerState)
 	{
 		m_rasterizerState->Release();
@@ -211,46 +220,6 @@ HRESULT DirectX11Helper::CleanUpDirectX11()
 	return hr;
 }
 
-void DirectX11Helper::ClearTargetViewAndDepthBuffer()
-{
-	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-	m_deviceContext->ClearDepthStencilView(m_depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
-	m_deviceContext->ClearRenderTargetView(m_renderTargetView, clearColor);
-	return;
-}
-
-HRESULT DirectX11Helper::RenderObjects(std::vector<GameObject*>& gameObjects, const Camera& camera)
-{
-	HRESULT hr;
-	for (int i = 0; i < gameObjects.size(); i++)
-	{
-		hr = gameObjects[i]->Render(m_deviceContext, camera);
-		if (FAILED(hr))
-		{
-			std::cout << "Rendering of a GameObject failed." << std::endl;
-			return hr;
-		}
-	}
-
-	return S_OK;
-}
-
-HRESULT DirectX11Helper::RenderParticles(std::vector<ParticleSystem*>& particleSystems, const Camera& camera)
-{
-	HRESULT hr;
-	for (int i = 0; i < particleSystems.size(); i++)
-	{
-		hr = particleSystems[i]->Render(m_deviceContext, camera);
-		if (FAILED(hr))
-		{
-			std::cout << "Rendering of a GameObject failed." << std::endl;
-			return hr;
-		}
-	}
-
-	return S_OK;
-}
-
 ID3D11Device* DirectX11Helper::GetDevice()
 {
 	return m_device;
@@ -261,7 +230,7 @@ ID3D11DeviceContext* DirectX11Helper::GetDeviceContext()
 	return m_deviceContext;
 }
 
-HRESULT DirectX11Helper::DisplayFrame()
+RenderDevice* DirectX11Helper::GetRenderDevice()
 {
-	return m_swapChain->Present(0, 0);
+	return m_renderDevice;
 }
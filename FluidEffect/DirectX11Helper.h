@@ -1,10 +1,7 @@
 #pragma once
 #include <d3d11.h>
 #include <dxgi.h>
-#include <vector>
-#include "GameObject.h"
-#include "ParticleSystem.h"
-#include "Camera.h"
+#include "D3D11RenderDevice.h"
 
 class DirectX11Helper
 {
@@ -12,14 +9,13 @@ public:
 	DirectX11Helper();
 	HRESULT InitDirectX11(HWND hWnd);
 	HRESULT CleanUpDirectX11();
-	void ClearTargetViewAndDepthBuffer();
-	HRESULT RenderObjects(std::vector<GameObject*>& gameObjects, const Camera& camera);
-	HRESULT RenderParticles(std::vector<ParticleSystem*>& particleSystems, const Camera& camera);
 	ID3D11Device* GetDevice();
 	ID3D11DeviceContext* GetDeviceContext();
-	HRESULT DisplayFrame();
+	// Draws to the window's back buffer, valid after InitDirectX11
+	RenderDevice* GetRenderDevice();
 
 private:
+	D3D11RenderDevice* m_renderDevice;
 	ID3D11Device* m_device;
 	ID3D11DeviceContext* m_deviceContext;
 	IDXGISwapChain* m_swapChain;
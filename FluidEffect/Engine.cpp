@@ -0,0 +1,765 @@
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <thread>
+#include "Engine.h"
+#include "NullRenderDevice.h"
+#include "SoftwareRenderDevice.h"
+#include "AssetManager.h"
+#include "Mesh.h"
+#include "StaticMesh.h"
+#include "GameObject.h"
+#include "RenderQueue.h"
+#include "InstanceBatcher.h"
+#include "Camera.h"
+#include "Particle.h"
+#include "ParticleSystem.h"
+#include "SimulationThread.h"
+#include "TaskGraph.h"
+#include "InputSystem.h"
+#include "PointLight.h"
+#include "LightClusters.h"
+#include "Profiler.h"
+#include "EngineStats.h"
+#include "FrameArena.h"
+#include "HeapTracker.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "SignedDistanceField.h"
+#include "IsoSurfaceExtractor.h"
+#include "SimulationRecorder.h"
+#include "SimulationReplayer.h"
+#include "SharedParticleExporter.h"
+#include "SharedParticleReader.h"
+
+namespace
+{
+	const int FRAME_WIDTH = 1920;
+	const int FRAME_HEIGHT = 1080;
+}
+
+int RunFrameLoop(const std::string& commandLine, const EngineWindowFactory& createWindow);
+HRESULT RenderObjects(RenderQueue& queue, InstanceBatcher& batcher, std::vector<GameObject*>& gameObjects, const Camera& camera);
+void PrepareParticles(std::vector<ParticleSystem*>& particleSystems, const SimulationFrame* frame, const Camera& camera);
+HRESULT RenderParticles(RenderQueue& queue, std::vector<ParticleSystem*>& particleSystems, const SimulationFrame* frame, const Camera& camera);
+void WriteHeadlessReport(const std::vector<float>& frameTimes, const RenderFrameStats& frameStats, const RenderQueueStats& queueStats, const NullRenderDevice& device, std::ostream& out);
+void WriteLatencyReport(const SimulationThread& simulation, const std::vector<float>& stepTimes, const std::vector<float>& inputLatencies, std::ostream& out);
+int RunSharedParticleReader(float seconds, std::ostream& out);
+
+int RunEngine(const std::string& commandLine, const EngineWindowFactory& createWindow)
+{
+	// "-benchmark [filter]" runs the CPU benchmarks without opening a window
+	if (commandLine.find("-benchmark") == 0)
+	{
+		std::string filter = commandLine.size() > 11 ? commandLine.substr(11) : "";
+		std::ofstream benchmarkFile("Benchmark.txt");
+		JobSystem::GetInstance().Initialize();
+		return Benchmark::Run(filter, benchmarkFile);
+	}
+
+	// "-sharedcheck <name>" is the reader process of the shared_memory benchmark
+	if (commandLine.find("-sharedcheck") == 0)
+	{
+		std::string name = commandLine.size() > 13 ? commandLine.substr(13) : "";
+		std::ofstream checkFile("SharedCheck.txt");
+		return Benchmark::RunSharedParticleCheck(name, checkFile);
+	}
+
+	// "-sharedreader [seconds]" is a sample external tool reading the particles shared with U
+	if (commandLine.find("-sharedreader") == 0)
+	{
+		float seconds = commandLine.size() > 14 ? std::stof(commandLine.substr(14)) : 10.0f;
+		std::ofstream readerFile("SharedReader.txt");
+		return RunSharedParticleReader(seconds, readerFile);
+	}
+
+	return RunFrameLoop(commandLine, createWindow);
+}
+
+int RunFrameLoop(const std::string& commandLine, const EngineWindowFactory& createWindow)
+{
+	auto launchTime = std::chrono::high_resolution_clock::now();
+
+	// "-headless [frames]" runs the frame loop without a window on the null render device, with
+	// fixed time steps, and writes the CPU frame cost and the submitted commands to Headless.txt.
+	// "-software [frames]" does the same on the CPU rasterizer and saves the last frame to SoftwareFrame.bmp
+	bool isSoftware = commandLine.find("-software") == 0;
+	bool isHeadless = isSoftware || commandLine.find("-headless") == 0;
+	int numHeadlessFrames = isHeadless && commandLine.size() > 10 && std::isdigit(static_cast<unsigned char>(commandLine[10])) ? std::stoi(commandLine.substr(10)) : 600;
+	const float headlessDeltaTime = 1.0f / 60.0f;
+	// "-simthread" after the other arguments simulates on a thread of its own, a step ahead of drawing.
+	// Headless frames then still simulate one step each, and every 30th frame sends a key nothing is
+	// bound to, to measure how long until a step that saw it is presented.
+	bool isSimulationThreaded = commandLine.find("-simthread") != std::string::npos;
+	const int headlessInputInterval = 30;
+	// "-heapcheck" after the other arguments counts the heap allocations of every frame. Frames from
+	// 300 after the assets loaded on must not allocate. Debug builds assert that, so the debugger
+	// stops in the allocating frame. The headless report tells whether they did and fails the run if
+	// so, which is what release runs like CI go by.
+	bool isHeapChecked = commandLine.find("-heapcheck") != std::string::npos;
+	const int heapCheckWarmupFrames = 300;
+	HeapTracker::SetTracking(isHeapChecked);
+
+	JobSystem::GetInstance().Initialize();
+
+	// Declared before the scene, so they outlive the buffers the scene releases
+	std::unique_ptr<NullRenderDevice> headlessDevice;
+	std::unique_ptr<EngineWindow> window;
+	SoftwareRenderDevice* softwareDevice = nullptr;
+	if (isSoftware)
+		headlessDevice.reset(softwareDevice = new SoftwareRenderDevice(FRAME_WIDTH, FRAME_HEIGHT));
+	else if (isHeadless)
+		headlessDevice.reset(new NullRenderDevice());
+	else
+		window = createWindow(FRAME_WIDTH, FRAME_HEIGHT);
+	if (!isHeadless && !window)
+		return 1;
+	RenderDevice* renderDevice = isHeadless ? headlessDevice.get() : window->GetRenderDevice();
+
+	InputSystem& input = InputSystem::GetInstance();
+	input.ObserveKey('W');
+	input.ObserveKey('S');
+	input.ObserveKey('A');
+	input.ObserveKey('D');
+	input.ObserveKey('Q');
+	input.ObserveKey('E');
+	input.ObserveKey('X');
+	input.ObserveKey('Y');
+	input.ObserveKey('1');
+	input.ObserveKey('2');
+	input.ObserveKey('3');
+	input.ObserveKey('P');
+	input.ObserveKey('O');
+	input.ObserveKey('L');
+	input.ObserveKey('K');
+	input.ObserveKey('I');
+	input.ObserveKey('M');
+	input.ObserveKey('R');
+	input.ObserveKey('T');
+	input.ObserveKey('U');
+	input.ObserveKey('G');
+	input.ObserveKey(VK_RBUTTON);
+	input.ObserveKey(VK_SHIFT);
+
+	Camera camera = Camera(static_cast<float>(FRAME_WIDTH), static_cast<float>(FRAME_HEIGHT), { 3.0f, 5.0f, -15.0f }, {0.0f, 0.0f, 0.0f});
+
+	const int maxNumOfLights = 5;
+	PointLight lights[maxNumOfLights] = {
+		{{7.0f, 2.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 10.0f},
+		{{-7.0f, 5.0f, -5.0f}, {1.0f, 1.0f, 0.7f}, 4.0f},
+		{{0.0f, 15.0f, 0.0f}, {1.0f, 1.0f, 0.7f}, 5.0f},
+	};
+	LightClusters lightClusters;
+
+	// Meshes, shaders and colliders load in the background, the window shows up right away and
+	// everything is drawn once it is ready
+	AssetManager& assets = AssetManager::GetInstance();
+	AssetHandle<StaticMesh> floorMesh = assets.LoadMesh(renderDevice, "Floor.obj", { 0.2f, 0.2f, 0.2f }, L"BlinnPhongShader.hlsl");
+	GameObject floorObj;
+	floorObj.SetMesh(floorMesh);
+	floorObj.SetPosition({ 0.0f, 0.0f, 0.0f });
+	floorObj.SetRotation({ 0.0f, 90.0f, 0.0f });
+
+	AssetHandle<StaticMesh> pipeMesh = assets.LoadMesh(renderDevice, "Pipe.obj", { 0.8f, 0.4f, 0.2f }, L"BlinnPhongShader.hlsl");
+	GameObject pipeObj;
+	pipeObj.SetMesh(pipeMesh);
+	pipeObj.SetPosition({ -8.0f, 0.0f, 0.0f });
+	pipeObj.SetRotation({ 0.0f, -90.0f, 0.0f });
+
+	std::vector<GameObject*> gameObjectList;
+	gameObjectList.push_back(&floorObj);
+	gameObjectList.push_back(&pipeObj);
+
+	ParticleSystem particleSystem = ParticleSystem({ -6.0f, 7.5f, 0.0f }, renderDevice, L"GooShader.hlsl", true);
+	particleSystem.GetParticleSpawner()->m_timeToLive = 1.5f;
+	particleSystem.GetParticleSpawner()->m_spawnRate = 6;
+	particleSystem.GetParticleSpawner()->m_srVariance = 0.5f;
+	particleSystem.GetParticleSpawner()->m_direction = { 1.0f, 0.25f, 0.0f };
+	particleSystem.GetParticleSpawner()->m_dVariance = 0.1f;
+	particleSystem.GetParticleSpawner()->m_vVariance = 0.3f;
+	particleSystem.GetParticleSpawner()->m_velocity = 7.0f;
+
+	// Keep fluid particles on top of the floor
+	SphSettings& sphSettings = particleSystem.GetSphSolver().m_settings;
+	sphSettings = SphSettings::ForParticleSpacing(0.5f);
+	sphSettings.boundsMin = { -10.0f, 0.25f, -5.0f };
+	sphSettings.boundsMax = { 10.0f, 50.0f, 5.0f };
+
+	PbfSettings& pbfSettings = particleSystem.GetPbfSolver().m_settings;
+	pbfSettings = PbfSettings::ForParticleSpacing(0.5f);
+	pbfSettings.boundsMin = sphSettings.boundsMin;
+	pbfSettings.boundsMax = sphSettings.boundsMax;
+
+	// Distance fields of the static scene for particle collisions, cached next to the meshes
+	DirectX::XMFLOAT4X4 floorWorld;
+	DirectX::XMStoreFloat4x4(&floorWorld, floorObj.GetWorldMatrix());
+	AssetHandle<SignedDistanceField> floorField = assets.Load<SignedDistanceField>("Floor.sdf", [floorMesh, floorWorld]()
+	{
+		std::vector<DirectX::XMFLOAT3> colliderVertices;
+		std::vector<unsigned int> colliderIndices;
+		floorMesh.Get()->GetTriangles(DirectX::XMLoadFloat4x4(&floorWorld), colliderVertices, colliderIndices);
+		SignedDistanceField* field = new SignedDistanceField();
+		field->LoadOrBake("Floor.sdf", colliderVertices, colliderIndices, 0.1f, 0.3f);
+		return field;
+	});
+
+	DirectX::XMFLOAT4X4 pipeWorld;
+	DirectX::XMStoreFloat4x4(&pipeWorld, pipeObj.GetWorldMatrix());
+	AssetHandle<SignedDistanceField> pipeField = assets.Load<SignedDistanceField>("Pipe.sdf", [pipeMesh, pipeWorld]()
+	{
+		std::vector<DirectX::XMFLOAT3> colliderVertices;
+		std::vector<unsigned int> colliderIndices;
+		pipeMesh.Get()->GetTriangles(DirectX::XMLoadFloat4x4(&pipeWorld), colliderVertices, colliderIndices);
+		SignedDistanceField* field = new SignedDistanceField();
+		field->LoadOrBake("Pipe.sdf", colliderVertices, colliderIndices, 0.05f, 0.2f);
+		return field;
+	});
+
+	// The pipe walls are thinner than a particle moves per frame, so it also gets swept tests
+	AssetHandle<TriangleBvh> pipeBvh = assets.Load<TriangleBvh>("Pipe.bvh", [pipeMesh, pipeWorld]()
+	{
+		std::vector<DirectX::XMFLOAT3> colliderVertices;
+		std::vector<unsigned int> colliderIndices;
+		pipeMesh.Get()->GetTriangles(DirectX::XMLoadFloat4x4(&pipeWorld), colliderVertices, colliderIndices);
+		TriangleBvh* bvh = new TriangleBvh();
+		bvh->Build(colliderVertices, colliderIndices);
+		return bvh;
+	});
+
+	// The goo only starts to flow once it can collide with the scene
+	bool areCollidersAdded = false;
+
+	std::vector<ParticleSystem*> particleSystemList;
+	particleSystemList.push_back(&particleSystem);
+
+	// Objects and particles queue their draws, which go to the device sorted by state
+	RenderQueue renderQueue;
+	InstanceBatcher instanceBatcher;
+
+	// CPU copy of the goo surface, only extracted on request
+	IsoSurfaceExtractor gooSurface;
+	std::vector<DirectX::XMFLOAT3> gooParticles;
+
+	// Particle states are quantized relative to the bounds around the emitter
+	DirectX::XMFLOAT3 emitterPosition = particleSystem.GetParticleSpawner()->m_position;
+	DirectX::XMFLOAT3 recordingBoundsMin = { emitterPosition.x - 20.0f, emitterPosition.y - 10.0f, emitterPosition.z - 20.0f };
+	DirectX::XMFLOAT3 recordingBoundsMax = { emitterPosition.x + 30.0f, emitterPosition.y + 40.0f, emitterPosition.z + 20.0f };
+	const float recordingMaxSpeed = 30.0f;
+	SimulationRecorder recorder;
+	SimulationReplayer replayer;
+	std::vector<DirectX::XMFLOAT3> recordedPositions;
+	std::vector<DirectX::XMFLOAT3> recordedVelocities;
+	std::vector<uint32_t> recordedIds;
+	float recordingTime = 0.0f;
+	float replayTime = 0.0f;
+	SharedParticleExporter sharedParticles;
+	const int maxSharedParticles = 65536;
+
+	// "-replay <file>" starts with the recording instead of the simulation
+	if (commandLine.find("-replay ") == 0)
+	{
+		if (replayer.Open(commandLine.substr(8)))
+			particleSystem.SetReplaying(true);
+	}
+
+	// Keys and steps of the simulation, on the simulation thread if it has one. Drawing only reads
+	// the particle frames the steps write.
+	auto onSimulationKey = [&](const SimulationEvent& event)
+	{
+		switch (event.key)
+		{
+		case 'M':
+			particleSystem.GetParticlePositions(gooParticles);
+			gooSurface.Extract(gooParticles);
+			gooSurface.ExportObj("GooSurface.obj");
+			break;
+
+		case 'R':
+			if (particleSystem.IsReplaying())
+				break;
+			if (recorder.IsOpen())
+				recorder.Close();
+			else if (recorder.Open("Recording.rec", recordingBoundsMin, recordingBoundsMax, recordingMaxSpeed))
+				recordingTime = 0.0f;
+			break;
+
+		case 'T':
+			if (particleSystem.IsReplaying())
+			{
+				replayer.Close();
+				particleSystem.SetReplaying(false);
+			}
+			else
+			{
+				recorder.Close();
+				if (replayer.Open("Recording.rec"))
+					particleSystem.SetReplaying(true);
+			}
+			replayTime = 0.0f;
+			break;
+
+		case 'U':
+			if (sharedParticles.IsOpen())
+				sharedParticles.Close();
+			else
+				sharedParticles.Open(SHARED_PARTICLES_NAME, maxSharedParticles);
+			break;
+
+		default:
+			for (ParticleSystem* particleSystem : particleSystemList)
+				particleSystem->OnKeyPressed(event.key, event.isShiftHeld);
+			break;
+		}
+	};
+
+	auto onSimulationStep = [&](float deltaTime, SimulationFrame& frame)
+	{
+		if (!areCollidersAdded && floorField.IsReady() && pipeField.IsReady() && pipeBvh.IsReady())
+		{
+			particleSystem.AddCollider(floorField.Get());
+			particleSystem.AddCollider(pipeField.Get());
+			particleSystem.AddCollider(pipeBvh.Get());
+			areCollidersAdded = true;
+		}
+
+		if (areCollidersAdded)
+		{
+			PROFILE_SCOPE("ParticleSystems");
+			for (ParticleSystem* particleSystem : particleSystemList)
+				particleSystem->Update(deltaTime);
+		}
+
+		recordingTime += deltaTime;
+		if (recorder.IsOpen() || sharedParticles.IsOpen())
+		{
+			particleSystem.GetParticleStates(recordedPositions, recordedVelocities, recordedIds);
+			recorder.RecordFrame(recordingTime, recordedPositions, recordedVelocities, recordedIds);
+			sharedParticles.Publish(recordingTime, recordedPositions, recordedVelocities);
+		}
+
+		if (particleSystem.IsReplaying())
+		{
+			PROFILE_SCOPE("Replay");
+			replayTime += deltaTime;
+			if (replayTime > replayer.GetDuration())
+				replayTime = 0.0f;
+			if (replayer.ReadFrame(replayer.FindFrame(replayTime), recordedPositions, recordedVelocities, recordedIds))
+				particleSystem.SetParticleStates(recordedPositions, recordedVelocities, recordedIds);
+		}
+
+		frame.particleSystems.resize(particleSystemList.size());
+		for (size_t i = 0; i < particleSystemList.size(); i++)
+			particleSystemList[i]->WriteFrame(frame.particleSystems[i]);
+	};
+
+	SimulationThread simulation;
+	simulation.Start(onSimulationKey, onSimulationStep, isSimulationThreaded);
+	const int simulationKeys[] = { 'E', 'Q', 'X', 'Y', 'I', 'K', 'M', 'R', 'T', 'U' };
+	std::vector<float> headlessStepTimes;
+	std::vector<float> headlessInputLatencies;
+	int64_t headlessInputTimestamp = 0;
+
+	if (window)
+		window->Show();
+	bool isWindowOpen = true;
+
+	HRESULT hr = S_OK;
+	float deltaTime = 0.0f;
+	Profiler& profiler = Profiler::GetInstance();
+	const int profiledFramesToDump = 120;
+	EngineStats& stats = EngineStats::GetInstance();
+	std::vector<float> headlessFrameTimes;
+	RenderFrameStats headlessFrameStats = RenderFrameStats();
+	RenderQueueStats headlessQueueStats = RenderQueueStats();
+	// Since launch, -1 until it happened
+	float timeToFirstFrame = -1.0f;
+	float timeToAssetsLoaded = -1.0f;
+	int numFramesSinceLoaded = 0;
+	uint64_t numHeapCheckedFrames = 0;
+	uint64_t numAllocatingFrames = 0;
+	uint64_t numFrameAllocations = 0;
+	uint64_t numFrameAllocationBytes = 0;
+	// The frame as tasks on the JobSystem, ordered by what they read and write. Window and device
+	// context stay with the main thread.
+	const SimulationFrame* simulationFrame = nullptr;
+	HRESULT objectsHr = S_OK;
+	HRESULT particlesHr = S_OK;
+	TaskGraph frameGraph;
+	frameGraph.AddTask("Input", [&]()
+	{
+		if (window)
+			isWindowOpen = window->HandleMessage();
+
+		input.Update(deltaTime, window && window->IsInFocus());
+
+		int64_t inputTimestamp = Profiler::GetTimestamp();
+		for (int key : simulationKeys)
+		{
+			if (input.Pressed(key))
+				simulation.SendKey(key, input.Held(VK_SHIFT), inputTimestamp);
+		}
+
+		if (isHeadless && headlessInputTimestamp == 0 && headlessFrameTimes.size() % headlessInputInterval == 0 && simulation.SendKey(0, false, inputTimestamp))
+			headlessInputTimestamp = inputTimestamp;
+
+		if (input.Pressed('P'))
+			profiler.SetEnabled(!Profiler::IsEnabled());
+
+		if (input.Pressed('L'))
+			stats.ExportCsv("FrameStats.csv");
+	}, {}, { "input" }, true);
+
+	frameGraph.AddTask("ShaderSwitch", [&]()
+	{
+		if (input.Pressed('1'))
+			particleSystem.SetShader(renderDevice, L"PointShader.hlsl", true);
+
+		if (input.Pressed('2'))
+			particleSystem.SetShader(renderDevice, L"QuadShader.hlsl", true);
+
+		if (input.Pressed('3'))
+			particleSystem.SetShader(renderDevice, L"GooShader.hlsl", true);
+	}, { "input" }, { "particleShader" });
+
+	frameGraph.AddTask("Simulation", [&]()
+	{
+		simulationFrame = simulation.Step(deltaTime, isHeadless);
+	}, { "input" }, { "simulationFrame" });
+
+	frameGraph.AddTask("Camera", [&]()
+	{
+		camera.Update(deltaTime);
+	}, { "input" }, { "camera" });
+
+	frameGraph.AddTask("GameObjects", [&]()
+	{
+		for (GameObject* gameObject : gameObjectList)
+			gameObject->Update(deltaTime);
+	}, {}, { "gameObjects" });
+
+	frameGraph.AddTask("Clear", [&]()
+	{
+		float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		renderDevice->Clear(clearColor);
+	}, {}, { "device" }, true);
+
+	frameGraph.AddTask("LightAssignment", [&]()
+	{
+		lightClusters.Update(lights, maxNumOfLights, camera);
+	}, { "camera" }, { "lights" });
+
+	frameGraph.AddTask("LightUpload", [&]()
+	{
+		lightClusters.Upload(renderDevice);
+	}, { "lights" }, { "device" }, true);
+
+	frameGraph.AddTask("RenderObjects", [&]()
+	{
+		objectsHr = RenderObjects(renderQueue, instanceBatcher, gameObjectList, camera);
+	}, { "camera", "gameObjects" }, { "renderQueue" });
+
+	frameGraph.AddTask("ParticlePrepare", [&]()
+	{
+		PrepareParticles(particleSystemList, simulationFrame, camera);
+	}, { "camera", "simulationFrame", "particleShader" }, { "particleDraws" });
+
+	frameGraph.AddTask("RenderParticles", [&]()
+	{
+		particlesHr = RenderParticles(renderQueue, particleSystemList, simulationFrame, camera);
+	}, { "camera", "simulationFrame", "particleDraws" }, { "renderQueue" });
+
+	frameGraph.AddTask("RenderQueue", [&]()
+	{
+		renderQueue.Execute(renderDevice);
+	}, {}, { "renderQueue", "device" }, true);
+
+	frameGraph.AddTask("Present", [&]()
+	{
+		renderDevice->Present();
+	}, {}, { "device" }, true);
+
+	while (isHeadless ? static_cast<int>(headlessFrameTimes.size()) < numHeadlessFrames : isWindowOpen || FAILED(hr))
+	{
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		profiler.BeginFrame();
+
+		uint64_t allocationsBefore = HeapTracker::GetNumAllocations();
+		uint64_t allocationBytesBefore = HeapTracker::GetNumBytes();
+		frameGraph.Run();
+		// No task runs between frames, so the scratch of this one can be given back
+		FrameArena::GetInstance().Reset();
+		hr = FAILED(objectsHr) ? objectsHr : particlesHr;
+
+		if (isHeapChecked && numFramesSinceLoaded >= heapCheckWarmupFrames)
+		{
+			uint64_t numAllocations = HeapTracker::GetNumAllocations() - allocationsBefore;
+#ifdef _DEBUG
+			assert(numAllocations == 0 && "A frame in a steady state allocated from the heap");
+#endif
+			numHeapCheckedFrames++;
+			numAllocatingFrames += numAllocations > 0 ? 1 : 0;
+			numFrameAllocations += numAllocations;
+			numFrameAllocationBytes += HeapTracker::GetNumBytes() - allocationBytesBefore;
+		}
+
+		// The trace and the critical path only hold finished frames. The simulation thread writes
+		// its profiler ring while it steps, so it is paused for the dump.
+		if (input.Pressed('O'))
+		{
+			simulation.Pause();
+			profiler.DumpChromeTrace("FrameTrace.json", profiledFramesToDump);
+			simulation.Resume();
+		}
+
+		if (input.Pressed('G'))
+		{
+			std::ofstream frameGraphFile("FrameGraph.txt");
+			frameGraph.WriteCriticalPath(frameGraphFile);
+		}
+
+		// Photons of the key are out once a step that saw it was presented
+		if (headlessInputTimestamp != 0 && simulationFrame && simulationFrame->inputTimestamp >= headlessInputTimestamp)
+		{
+			headlessInputLatencies.push_back(static_cast<float>(Profiler::GetTimestamp() - headlessInputTimestamp) / 1000000.0f);
+			headlessInputTimestamp = 0;
+		}
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		float frameTime = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - startTime).count();
+		deltaTime = isHeadless ? headlessDeltaTime : frameTime;
+		stats.EndFrame(frameTime * 1000.0f);
+
+		float timeSinceLaunch = std::chrono::duration_cast<std::chrono::duration<float>>(endTime - launchTime).count();
+		if (timeToFirstFrame < 0.0f)
+			timeToFirstFrame = timeSinceLaunch;
+		if (timeToAssetsLoaded < 0.0f && assets.GetNumPending() == 0)
+			timeToAssetsLoaded = timeSinceLaunch;
+		else if (timeToAssetsLoaded >= 0.0f)
+			numFramesSinceLoaded++;
+
+		if (isHeadless)
+		{
+			const RenderFrameStats& lastFrameStats = headlessDevice->GetLastFrameStats();
+			for (int i = 0; i < RENDER_COMMAND_COUNT; i++)
+				headlessFrameStats.numCommands[i] += lastFrameStats.numCommands[i];
+			headlessFrameStats.numVertices += lastFrameStats.numVertices;
+			headlessFrameStats.numBytesMapped += lastFrameStats.numBytesMapped;
+			const RenderQueueStats& queueStats = renderQueue.GetLastStats();
+			headlessQueueStats.numPackets += queueStats.numPackets;
+			headlessQueueStats.numStateChanges += queueStats.numStateChanges;
+			headlessQueueStats.numRedundant += queueStats.numRedundant;
+			headlessQueueStats.numProgramChanges += queueStats.numProgramChanges;
+			headlessQueueStats.sortMs += queueStats.sortMs;
+			headlessQueueStats.executeMs += queueStats.executeMs;
+			headlessFrameTimes.push_back(frameTime * 1000.0f);
+			if (simulationFrame)
+				headlessStepTimes.push_back(static_cast<float>(simulationFrame->stepMs));
+		}
+	}
+	simulation.Stop();
+
+	if (isHeadless)
+	{
+		std::ofstream headlessFile("Headless.txt");
+		WriteHeadlessReport(headlessFrameTimes, headlessFrameStats, headlessQueueStats, *headlessDevice, headlessFile);
+		WriteLatencyReport(simulation, headlessStepTimes, headlessInputLatencies, headlessFile);
+		headlessFile << "frame graph:" << std::endl;
+		frameGraph.WriteCriticalPath(headlessFile);
+		headlessFile << "time to first frame: " << timeToFirstFrame * 1000.0f << " ms, assets loaded after ";
+		if (timeToAssetsLoaded < 0.0f)
+			headlessFile << "the last frame" << std::endl;
+		else
+			headlessFile << timeToAssetsLoaded * 1000.0f << " ms" << std::endl;
+		headlessFile << "assets: " << assets.GetNumAssets() << " using " << assets.GetNumBytes() << " bytes" << std::endl;
+		assets.WriteReport(headlessFile);
+		const LightClusterStats& lightStats = lightClusters.GetLastStats();
+		headlessFile << "light clusters of the last frame: " << lightStats.numVisibleLights << " of " << lightStats.numLights << " lights visible, "
+			<< lightStats.numIndices << " light indices, at most " << lightStats.maxLightsPerCluster << " per cluster, "
+			<< lightStats.transformMs + lightStats.assignMs << " ms" << std::endl;
+		FrameArena& frameArena = FrameArena::GetInstance();
+		headlessFile << "frame arena: " << frameArena.GetNumThreadArenas() << " threads, at most " << frameArena.GetPeakBytes() << " bytes in use, "
+			<< frameArena.GetNumBytesReserved() << " bytes reserved" << std::endl;
+
+		// Without a frame checked the run was too short, which fails as well
+		bool isHeapCheckPassed = numHeapCheckedFrames > 0 && numFrameAllocations == 0;
+		if (isHeapChecked)
+		{
+			headlessFile << "heap check from " << heapCheckWarmupFrames << " frames after the assets loaded: " << numFrameAllocations << " allocations ("
+				<< numFrameAllocationBytes << " bytes) in " << numAllocatingFrames << " of " << numHeapCheckedFrames << " frames: "
+				<< (isHeapCheckPassed ? "PASS" : "FAIL") << std::endl;
+		}
+		if (softwareDevice)
+		{
+			const SoftwareRasterStats& rasterStats = softwareDevice->GetLastRasterStats();
+			headlessFile << "software raster of the last frame: setup " << rasterStats.setupMs << " ms, raster " << rasterStats.rasterMs << " ms, "
+				<< rasterStats.numTriangles << " triangles, " << rasterStats.numCulled << " culled, " << rasterStats.numPixelsShaded << " pixels shaded" << std::endl;
+			softwareDevice->SaveBitmap("SoftwareFrame.bmp");
+		}
+		return FAILED(hr) || (isHeapChecked && !isHeapCheckPassed) ? 1 : 0;
+	}
+	return 0;
+}
+
+HRESULT RenderObjects(RenderQueue& queue, InstanceBatcher& batcher, std::vector<GameObject*>& gameObjects, const Camera& camera)
+{
+	HRESULT hr = batcher.Submit(queue, gameObjects, camera);
+	if (FAILED(hr))
+	{
+		std::cout << "Rendering of a GameObject failed." << std::endl;
+		return hr;
+	}
+
+	return S_OK;
+}
+
+void PrepareParticles(std::vector<ParticleSystem*>& particleSystems, const SimulationFrame* frame, const Camera& camera)
+{
+	if (!frame)
+		return;
+
+	for (size_t i = 0; i < particleSystems.size() && i < frame->particleSystems.size(); i++)
+		particleSystems[i]->Prepare(camera, frame->particleSystems[i]);
+}
+
+HRESULT RenderParticles(RenderQueue& queue, std::vector<ParticleSystem*>& particleSystems, const SimulationFrame* frame, const Camera& camera)
+{
+	if (!frame)
+		return S_OK;
+
+	HRESULT hr;
+	for (size_t i = 0; i < particleSystems.size() && i < frame->particleSystems.size(); i++)
+	{
+		hr = particleSystems[i]->SubmitPrepared(queue, camera, frame->particleSystems[i]);
+		if (FAILED(hr))
+		{
+			std::cout << "Rendering of a ParticleSystem failed." << std::endl;
+			return hr;
+		}
+	}
+
+	return S_OK;
+}
+
+void WriteHeadlessReport(const std::vector<float>& frameTimes, const RenderFrameStats& frameStats, const RenderQueueStats& queueStats, const NullRenderDevice& device, std::ostream& out)
+{
+	int numFrames = static_cast<int>(frameTimes.size());
+	if (numFrames == 0)
+		return;
+
+	std::vector<float> sortedTimes = frameTimes;
+	std::sort(sortedTimes.begin(), sortedTimes.end());
+	float totalTime = 0.0f;
+	for (float frameTime : frameTimes)
+		totalTime += frameTime;
+
+	double perFrame = 1.0 / numFrames;
+	out << "frames: " << numFrames << std::endl;
+	out << "cpu frame ms: avg " << totalTime / numFrames << ", p95 " << sortedTimes[(numFrames - 1) * 95 / 100] << ", max " << sortedTimes.back() << std::endl;
+	out << "draw calls per frame: " << (frameStats.numCommands[RENDER_COMMAND_DRAW] + frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED]
+		+ frameStats.numCommands[RENDER_COMMAND_DRAW_INDEXED_INSTANCED]) * perFrame << std::endl;
+	out << "vertices per frame: " << frameStats.numVertices * perFrame << std::endl;
+	out << "maps per frame: " << frameStats.numCommands[RENDER_COMMAND_MAP] * perFrame << ", bytes " << frameStats.numBytesMapped * perFrame << std::endl;
+	out << "state changes per frame: " << queueStats.numStateChanges * perFrame << " (" << queueStats.numProgramChanges * perFrame << " shader programs), "
+		<< queueStats.numRedundant * perFrame << " redundant ones filtered out, " << queueStats.numPackets * perFrame << " draw packets" << std::endl;
+	out << "render queue ms per frame: sort " << queueStats.sortMs * perFrame << ", execute " << queueStats.executeMs * perFrame << std::endl;
+	out << "live buffers: " << device.GetNumLiveBuffers() << ", bytes " << device.GetNumLiveBufferBytes() << ", live shader programs " << device.GetNumLivePrograms() << std::endl;
+	out << "commands per frame:" << std::endl;
+	for (int i = 0; i < RENDER_COMMAND_COUNT; i++)
+		out << "  " << NullRenderDevice::GetCommandName(static_cast<RenderCommandType>(i)) << ": " << frameStats.numCommands[i] * perFrame << std::endl;
+}
+
+void WriteLatencyReport(const SimulationThread& simulation, const std::vector<float>& stepTimes, const std::vector<float>& inputLatencies, std::ostream& out)
+{
+	float totalStepTime = 0.0f;
+	for (float stepTime : stepTimes)
+		totalStepTime += stepTime;
+
+	out << "simulation: " << (simulation.IsThreaded() ? "own thread" : "frame loop") << ", " << simulation.GetNumStepsSent() << " steps, "
+		<< simulation.GetNumStepsMerged() << " merged, step ms avg " << (stepTimes.empty() ? 0.0f : totalStepTime / stepTimes.size()) << std::endl;
+
+	int numLatencies = static_cast<int>(inputLatencies.size());
+	if (numLatencies == 0)
+		return;
+
+	std::vector<float> sortedLatencies = inputLatencies;
+	std::sort(sortedLatencies.begin(), sortedLatencies.end());
+	float totalLatency = 0.0f;
+	for (float latency : inputLatencies)
+		totalLatency += latency;
+	out << "input to present ms over " << numLatencies << " keys: avg " << totalLatency / numLatencies << ", max " << sortedLatencies.back() << std::endl;
+}
+
+int RunSharedParticleReader(float seconds, std::ostream& out)
+{
+	SharedParticleReader reader;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	auto elapsedSeconds = [&]() { return std::chrono::duration_cast<std::chrono::duration<float>>(std::chrono::high_resolution_clock::now() - startTime).count(); };
+
+	while (!reader.Open(SHARED_PARTICLES_NAME))
+	{
+		if (elapsedSeconds() > seconds)
+		{
+			out << "No particles are shared, press U in FluidEffect first" << std::endl;
+			return 1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	// Reads the arrays in place, the exporter never waits for this process
+	uint64_t lastFrame = 0;
+	int numRead = 0;
+	int numMissed = 0;
+	int numOverwritten = 0;
+	float nextReport = 1.0f;
+	SharedParticleFrame frame;
+	while (elapsedSeconds() < seconds)
+	{
+		if (reader.GetNumPublished() == lastFrame || !reader.AcquireLatest(frame))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		DirectX::XMFLOAT3 center = { 0.0f, 0.0f, 0.0f };
+		float maxSpeedSq = 0.0f;
+		for (int i = 0; i < frame.numParticles; i++)
+		{
+			center.x += frame.arrays[SHARED_POSITION_X][i];
+			center.y += frame.arrays[SHARED_POSITION_Y][i];
+			center.z += frame.arrays[SHARED_POSITION_Z][i];
+			float vx = frame.arrays[SHARED_VELOCITY_X][i];
+			float vy = frame.arrays[SHARED_VELOCITY_Y][i];
+			float vz = frame.arrays[SHARED_VELOCITY_Z][i];
+			maxSpeedSq = std::max(maxSpeedSq, vx * vx + vy * vy + vz * vz);
+		}
+
+		if (!reader.Release(frame))
+		{
+			numOverwritten++;
+			continue;
+		}
+
+		numMissed += lastFrame > 0 && frame.frame > lastFrame ? static_cast<int>(frame.frame - lastFrame) : 0;
+		lastFrame = frame.frame + 1;
+		numRead++;
+
+		if (elapsedSeconds() > nextReport)
+		{
+			float scale = frame.numParticles > 0 ? 1.0f / frame.numParticles : 0.0f;
+			out << "frame " << frame.frame << " at " << frame.time << " s: " << frame.numParticles << " particles, center (" << center.x * scale << ", "
+				<< center.y * scale << ", " << center.z * scale << "), max speed " << std::sqrt(maxSpeedSq) << " m/s" << std::endl;
+			nextReport += 1.0f;
+		}
+	}
+
+	out << "read " << numRead << " frames, missed " << numMissed << ", overwritten while reading " << numOverwritten << std::endl;
+	return 0;
+}
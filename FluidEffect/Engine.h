@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include "RenderDevice.h"
+
+// Window and swap chain of an interactive run, one implementation per platform
+class EngineWindow
+{
+public:
+	virtual ~EngineWindow() {}
+
+	// Draws to the window's back buffer
+	virtual RenderDevice* GetRenderDevice() = 0;
+	virtual void Show() = 0;
+	// Handles the next pending message, false once the window was closed
+	virtual bool HandleMessage() = 0;
+	virtual bool IsInFocus() const = 0;
+};
+
+typedef std::function<std::unique_ptr<EngineWindow>(int width, int height)> EngineWindowFactory;
+
+// Entry point shared by the platform mains, which only convert their arguments and know how to
+// open a window. Runs the benchmarks, the tools or the frame loop the command line asks for, see
+// README.txt. Headless runs never call createWindow.
+int RunEngine(const std::string& commandLine, const EngineWindowFactory& createWindow);
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "EngineStats.h"
+
+EngineStats::EngineStats()
+{
+	Reset();
+}
+
+EngineStats& EngineStats::GetInstance()
+{
+	static EngineStats stats;
+	return stats;
+}
+
+void EngineStats::EndFrame(float frameTimeMs)
+{
+	FrameStats& frame = m_history[m_numFramesRecorded % HISTORY_SIZE];
+	for (int i = 0; i < STAT_COUNT; i++)
+		frame.counters[i] = m_current[i].exchange(0, std::memory_order_relaxed);
+
+	frame.frameTimeMs = frameTimeMs;
+	m_numFramesRecorded++;
+}
+
+void EngineStats::Reset()
+{
+	for (int i = 0; i < STAT_COUNT; i++)
+		m_current[i].store(0, std::memory_order_relaxed);
+
+	m_numFramesRecorded = 0;
+}
+
+int EngineStats::GetNumFrames() const
+{
+	return static_cast<int>(std::min<uint64_t>(m_numFramesRecorded, HISTORY_SIZE));
+}
+
+const FrameStats& EngineStats::GetFrame(int framesAgo) const
+{
+	return m_history[(m_numFramesRecorded - 1 - framesAgo) % HISTORY_SIZE];
+}
+
+StatSummary EngineStats::GetSummary(StatCounter counter) const
+{
+	double values[HISTORY_SIZE];
+	int numFrames = GetNumFrames();
+	for (int i = 0; i < numFrames; i++)
+		values[i] = static_cast<double>(GetFrame(i).counters[counter]);
+
+	return Summarize(values, numFrames);
+}
+
+StatSummary EngineStats::GetFrameTimeSummary() const
+{
+	double values[HISTORY_SIZE];
+	int numFrames = GetNumFrames();
+	for (int i = 0; i < numFrames; i++)
+		values[i] = GetFrame(i).frameTimeMs;
+
+	return Summarize(values, numFrames);
+}
+
+StatSummary EngineStats::Summarize(double* values, int numValues) const
+{
+	StatSummary summary = { 0.0, 0.0, 0.0 };
+	if (numValues == 0)
+		return summary;
+
+	double sum = 0.0;
+	summary.min = values[0];
+	for (int i = 0; i < numValues; i++)
+	{
+		summary.min = std::min(summary.min, values[i]);
+		sum += values[i];
+	}
+	summary.avg = sum / numValues;
+
+	int p99Index = std::min(numValues - 1, (numValues * 99) / 100);
+	std::nth_element(values, values + p99Index, values + numValues);
+	summary.p99 = values[p99Index];
+
+	return summary;
+}
+
+bool EngineStats::ExportCsv(const std::string& fileName) const
+{
+	std::ofstream csvFile(fileName);
+	if (!csvFile.is_open())
+	{
+		std::cerr << "Failed to open file: " << fileName << std::endl;
+		return false;
+	}
+
+	csvFile << "frame,frameTimeMs";
+	for (int i = 0; i < STAT_COUNT; i++)
+		csvFile << "," << GetCounterName(static_cast<StatCounter>(i));
+	csvFile << "\n";
+
+	// Oldest frame first
+	int numFrames = GetNumFrames();
+	for (int framesAgo = numFrames - 1; framesAgo >= 0; framesAgo--)
+	{
+		const FrameStats& frame = GetFrame(framesAgo);
+		csvFile << (m_numFramesRecorded - 1 - framesAgo) << "," << frame.frameTimeMs;
+		for (int i = 0; i < STAT_COUNT; i++)
+			csvFile << "," << frame.counters[i];
+		csvFile << "\n";
+	}
+
+	// Summary rows over the whole history
+	StatSummary frameTime = GetFrameTimeSummary();
+	StatSummary summaries[STAT_COUNT];
+	for (int i = 0; i < STAT_COUNT; i++)
+		summaries[i] = GetSummary(static_cast<StatCounter>(i));
+
+	csvFile << "min," << frameTime.min;
+	for (int i = 0; i < STAT_COUNT; i++)
+		csvFile << "," << summaries[i].min;
+	csvFile << "\navg," << frameTime.avg;
+	for (int i = 0; i < STAT_COUNT; i++)
+		csvFile << "," << summaries[i].avg;
+	csvFile << "\np99," << frameTime.p99;
+	for (int i = 0; i < STAT_COUNT; i++)
+		csvFile << "," << summaries[i].p99;
+	csvFile << "\n";
+
+	csvFile.close();
+	std::cout << "Exported " << numFrames << " frames of statistics to " << fileName << std::endl;
+	return true;
+}
+
+const char* EngineStats::GetCounterName(StatCounter counter)
+{
+	switch (counter)
+	{
+	case STAT_LIVE_PARTICLES:			return "liveParticles";
+	case STAT_SPAWNS:					return "spawns";
+	case STAT_DEATHS:					return "deaths";
+	case STAT_NEIGHBOR_DISTANCE_EVALS:	return "neighborDistanceEvals";
+	case STAT_NEIGHBOR_REBUILDS:		return "neighborRebuilds";
+	case STAT_MAP_UNMAPS:				return "mapUnmaps";
+	case STAT_DRAW_CALLS:				return "drawCalls";
+	case STAT_BYTES_UPLOADED:			return "bytesUploaded";
+	case STAT_TRIANGLES_SUBMITTED:		return "trianglesSubmitted";
+	case STAT_STATE_CHANGES:			return "stateChanges";
+	default:							return "unknown";
+	}
+}
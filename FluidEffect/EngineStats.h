@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum StatCounter
+{
+	STAT_LIVE_PARTICLES,
+	STAT_SPAWNS,
+	STAT_DEATHS,
+	STAT_NEIGHBOR_DISTANCE_EVALS,
+	STAT_NEIGHBOR_REBUILDS,
+	STAT_MAP_UNMAPS,
+	STAT_DRAW_CALLS,
+	STAT_BYTES_UPLOADED,
+	STAT_TRIANGLES_SUBMITTED,
+	STAT_STATE_CHANGES,
+	STAT_COUNT
+};
+
+struct FrameStats
+{
+	uint64_t counters[STAT_COUNT];
+	float frameTimeMs;
+};
+
+struct StatSummary
+{
+	double min;
+	double avg;
+	double p99;
+};
+
+class EngineStats
+{
+public:
+	static EngineStats& GetInstance();
+
+	void Add(StatCounter counter, uint64_t value) { m_current[counter].fetch_add(value, std::memory_order_relaxed); }
+	uint64_t GetCurrent(StatCounter counter) const { return m_current[counter].load(std::memory_order_relaxed); }
+
+	// Closes the running frame: its counters are pushed into the history ring and reset to zero
+	void EndFrame(float frameTimeMs);
+	void Reset();
+
+	int GetNumFrames() const;
+	const FrameStats& GetFrame(int framesAgo) const;
+
+	StatSummary GetSummary(StatCounter counter) const;
+	StatSummary GetFrameTimeSummary() const;
+	bool ExportCsv(const std::string& fileName) const;
+
+	static const char* GetCounterName(StatCounter counter);
+
+	static const int HISTORY_SIZE = 600;
+
+private:
+	EngineStats();
+	StatSummary Summarize(double* values, int numValues) const;
+
+	std::atomic<uint64_t> m_current[STAT_COUNT];
+	FrameStats m_history[HISTORY_SIZE];
+	uint64_t m_numFramesRecorded;
+};
@@ -0,0 +1,147 @@
+#include "FrameArena.h"
+
+FrameArena::FrameArena() : m_numFrames(0)
+{
+}
+
+FrameArena& FrameArena::GetInstance()
+{
+	static FrameArena frameArena;
+	return frameArena;
+}
+
+FrameArena::ThreadArena* FrameArena::GetThreadArena()
+{
+	thread_local ThreadArena* threadArena = nullptr;
+
+	if (!threadArena)
+	{
+		std::lock_guard<std::mutex> lock(m_registryMutex);
+
+		std::unique_ptr<ThreadArena> arena(new ThreadArena());
+		arena->block = 0;
+		arena->offset = 0;
+		arena->numBytesBefore = 0;
+		arena->scopeDepth = 0;
+		arena->frame = GetNumFrames();
+		arena->peakBytes.store(0);
+		arena->numBytesReserved.store(0);
+
+		threadArena = arena.get();
+		m_threadArenas.push_back(std::move(arena));
+	}
+
+	return threadArena;
+}
+
+void* FrameArena::Allocate(size_t numBytes, size_t alignment)
+{
+	ThreadArena& arena = *GetThreadArena();
+	if (arena.scopeDepth == 0 && arena.frame != GetNumFrames())
+		StartOver(arena);
+
+	while (true)
+	{
+		if (arena.block < arena.blocks.size())
+		{
+			Block& block = arena.blocks[arena.block];
+			uintptr_t begin = reinterpret_cast<uintptr_t>(block.data.get());
+			uintptr_t address = (begin + arena.offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			if (address + numBytes <= begin + block.size)
+			{
+				arena.offset = address + numBytes - begin;
+				size_t numBytesUsed = arena.numBytesBefore + arena.offset;
+				if (numBytesUsed > arena.peakBytes.load(std::memory_order_relaxed))
+					arena.peakBytes.store(numBytesUsed, std::memory_order_relaxed);
+				return reinterpret_cast<void*>(address);
+			}
+
+			// The rest of the block stays unused until the sub-arena is rewound
+			arena.numBytesBefore += block.size;
+			arena.block++;
+			arena.offset = 0;
+			continue;
+		}
+
+		size_t blockSize = BLOCK_SIZE;
+		AddBlock(arena, numBytes + alignment > blockSize ? numBytes + alignment : blockSize);
+	}
+}
+
+void FrameArena::Reset()
+{
+	m_numFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameArena::StartOver(ThreadArena& arena)
+{
+	// Whatever the last frame needed fits into one block from now on
+	if (arena.blocks.size() > 1)
+	{
+		size_t size = 0;
+		for (const Block& block : arena.blocks)
+			size += block.size;
+		arena.blocks.clear();
+		arena.numBytesReserved.store(0, std::memory_order_relaxed);
+		AddBlock(arena, size);
+	}
+
+	arena.block = 0;
+	arena.offset = 0;
+	arena.numBytesBefore = 0;
+	arena.frame = GetNumFrames();
+}
+
+void FrameArena::AddBlock(ThreadArena& arena, size_t size)
+{
+	Block block;
+	block.data.reset(new char[size]);
+	block.size = size;
+	arena.blocks.push_back(std::move(block));
+	arena.numBytesReserved.fetch_add(size, std::memory_order_relaxed);
+}
+
+int FrameArena::GetNumThreadArenas()
+{
+	std::lock_guard<std::mutex> lock(m_registryMutex);
+	return static_cast<int>(m_threadArenas.size());
+}
+
+size_t FrameArena::GetPeakBytes()
+{
+	std::lock_guard<std::mutex> lock(m_registryMutex);
+	size_t numBytes = 0;
+	for (const std::unique_ptr<ThreadArena>& arena : m_threadArenas)
+		numBytes += arena->peakBytes.load(std::memory_order_relaxed);
+	return numBytes;
+}
+
+size_t FrameArena::GetNumBytesReserved()
+{
+	std::lock_guard<std::mutex> lock(m_registryMutex);
+	size_t numBytes = 0;
+	for (const std::unique_ptr<ThreadArena>& arena : m_threadArenas)
+		numBytes += arena->numBytesReserved.load(std::memory_order_relaxed);
+	return numBytes;
+}
+
+FrameArena::Scope::Scope()
+{
+	FrameArena& frameArena = GetInstance();
+	m_arena = frameArena.GetThreadArena();
+	if (m_arena->scopeDepth == 0 && m_arena->frame != frameArena.GetNumFrames())
+		frameArena.StartOver(*m_arena);
+
+	m_arena->scopeDepth++;
+	m_block = m_arena->block;
+	m_offset = m_arena->offset;
+	m_numBytesBefore = m_arena->numBytesBefore;
+}
+
+FrameArena::Scope::~Scope()
+{
+	m_arena->block = m_block;
+	m_arena->offset = m_offset;
+	m_arena->numBytesBefore = m_numBytesBefore;
+	m_arena->scopeDepth--;
+}
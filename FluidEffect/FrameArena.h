@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bump allocator for the scratch data of a frame. Every thread allocates from a sub-arena of its
+// own, so allocating takes no lock, and nothing is freed on its own. A Scope gives back what its
+// thread allocated since the Scope began, Reset ends the frame and every sub-arena starts over the
+// next time its thread uses it outside a Scope. So threads never touch each other's sub-arenas and
+// a thread in the middle of a step, like the simulation thread, keeps what it has. Blocks are kept
+// and a sub-arena that needed more than one is merged into one, so once the frames are alike the
+// arena does not allocate either.
+class FrameArena
+{
+	struct ThreadArena;
+
+public:
+	// Rewinds the sub-arena of the calling thread when it goes out of scope. Containers using the
+	// arena have to be declared after it, so they are gone by then.
+	class Scope
+	{
+	public:
+		Scope();
+		~Scope();
+
+	private:
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		ThreadArena* m_arena;
+		size_t m_block;
+		size_t m_offset;
+		size_t m_numBytesBefore;
+	};
+
+	static const size_t BLOCK_SIZE = 256 * 1024;
+
+	static FrameArena& GetInstance();
+
+	// Valid until its Scope ends, without one until the thread uses the arena after the next Reset
+	void* Allocate(size_t numBytes, size_t alignment);
+	void Reset();
+
+	uint64_t GetNumFrames() const { return m_numFrames.load(std::memory_order_relaxed); }
+	int GetNumThreadArenas();
+	// Over all sub-arenas, the most bytes each had in use at once and what its blocks hold
+	size_t GetPeakBytes();
+	size_t GetNumBytesReserved();
+
+private:
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+
+	struct ThreadArena
+	{
+		std::vector<Block> blocks;
+		size_t block;
+		size_t offset;
+		size_t numBytesBefore;		// In the blocks before the current one
+		int scopeDepth;
+		uint64_t frame;
+		std::atomic<size_t> peakBytes;
+		std::atomic<size_t> numBytesReserved;
+	};
+
+	FrameArena();
+
+	ThreadArena* GetThreadArena();
+	void StartOver(ThreadArena& arena);
+	void AddBlock(ThreadArena& arena, size_t size);
+
+	std::atomic<uint64_t> m_numFrames;
+	std::mutex m_registryMutex;
+	std::vector<std::unique_ptr<ThreadArena>> m_threadArenas;
+};
+
+// STL allocator on the FrameArena, deallocating does nothing
+template <typename T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator()
+	{
+	}
+
+	template <typename U>
+	FrameAllocator(const FrameAllocator<U>&)
+	{
+	}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(FrameArena::GetInstance().Allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, size_t)
+	{
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>&, const FrameAllocator<U>&)
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>&, const FrameAllocator<U>&)
+{
+	return false;
+}
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+template <typename Key, typename Value>
+using FrameUnorderedMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, FrameAllocator<std::pair<const Key, Value>>>;
@@ -1,4 +1,5 @@
 #include "GameObject.h"
+#include "StaticMesh.h"
 
 GameObject::GameObject()
 {
@@ -8,9 +9,13 @@ GameObject::GameObject()
 	m_mesh = nullptr;
 }
 
-HRESULT GameObject::Render(ID3D11DeviceContext* deviceContext, const Camera& camera)
+HRESULT GameObject::Submit(RenderQueue& queue, const Camera& camera)
 {
-	HRESULT hr = m_mesh->Render(deviceContext, camera, GetWorldMatrix());
+	Mesh* mesh = TryGetMesh();
+	if (!mesh)
+		return S_OK;
+
+	HRESULT hr = mesh->Submit(queue, camera, GetWorldMatrix());
 	return hr;
 }
 
@@ -38,6 +43,18 @@ void GameObject::SetScale(const DirectX::XMFLOAT3& scale)
 void GameObject::SetMesh(Mesh* mesh)
 {
 	m_mesh = mesh;
+	m_loadingMesh = AssetHandle<StaticMesh>();
+}
+
+void GameObject::SetMesh(const AssetHandle<StaticMesh>& mesh)
+{
+	m_mesh = nullptr;
+	m_loadingMesh = mesh;
+}
+
+bool GameObject::IsMeshReady() const
+{
+	return m_mesh || m_loadingMesh.TryGet();
 }
 
 const DirectX::XMFLOAT3& GameObject::GetPosition() const
@@ -60,6 +77,13 @@ Mesh& GameObject::GetMesh()
 	return *m_mesh;
 }
 
+Mesh* GameObject::TryGetMesh()
+{
+	if (!m_mesh)
+		m_mesh = m_loadingMesh.TryGet();
+	return m_mesh;
+}
+
 DirectX::XMMATRIX GameObject::GetWorldMatrix() const
 {
 	DirectX::XMMATRIX translation = DirectX::XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
@@ -1,15 +1,20 @@
 #pragma once
 #include <DirectXMath.h>
-#include <d3d11.h>
+#include "RenderDevice.h"
+#include "RenderQueue.h"
 #include "Mesh.h"
 #include "Camera.h"
+#include "AssetManager.h"
+
+class StaticMesh;
 
 class GameObject
 {
 public:
 	GameObject();
 
-	HRESULT Render(ID3D11DeviceContext* deviceContext, const Camera& camera);
+	// Queues nothing while the mesh is still loading
+	HRESULT Submit(RenderQueue& queue, const Camera& camera);
 
 	void Update(float deltaTime);
 
@@ -17,12 +22,16 @@ public:
 	void SetRotation(const DirectX::XMFLOAT3& rotation);
 	void SetScale(const DirectX::XMFLOAT3& scale);
 	void SetMesh(Mesh* mesh);
+	void SetMesh(const AssetHandle<StaticMesh>& mesh);
+	bool IsMeshReady() const;
 
 	const DirectX::XMFLOAT3& GetPosition() const;
 	const DirectX::XMFLOAT3& GetRotation() const;
 	const DirectX::XMFLOAT3& GetScale() const;
 
 	Mesh& GetMesh();
+	// nullptr while the mesh is still loading
+	Mesh* TryGetMesh();
 
 	DirectX::XMMATRIX GetWorldMatrix() const;
 private:
@@ -33,5 +42,6 @@ private:
 	DirectX::XMFLOAT3 m_gravity = DirectX::XMFLOAT3(0.0f, -9.81f, 0.0f);
 
 	Mesh* m_mesh;
+	AssetHandle<StaticMesh> m_loadingMesh;
 };
 
@@ -0,0 +1,31 @@
+#include <cmath>
+#include "GooKernel.h"
+
+GooKernel::GooKernel()
+{
+	m_tableScale = 0.0f;
+	m_cutoffRadiusSq = 0.0f;
+}
+
+void GooKernel::Initialize(float falloff, float cutoffRadius)
+{
+	m_cutoffRadiusSq = cutoffRadius * cutoffRadius;
+	m_tableScale = TABLE_SIZE / m_cutoffRadiusSq;
+	m_table.resize(TABLE_SIZE + 2);
+	for (int i = 0; i < TABLE_SIZE + 2; i++)
+		m_table[i] = EvaluateExact(std::sqrt(m_cutoffRadiusSq * i / TABLE_SIZE), falloff, cutoffRadius);
+}
+
+float GooKernel::EvaluateExact(float distance, float falloff, float cutoffRadius)
+{
+	if (distance >= cutoffRadius)
+		return 0.0f;
+
+	float fadeStart = 0.75f * cutoffRadius;
+	float value = std::exp(-falloff * distance);
+	if (distance <= fadeStart)
+		return value;
+
+	float t = (distance - fadeStart) / (cutoffRadius - fadeStart);
+	return value * (1.0f - t * t * (3.0f - 2.0f * t));
+}
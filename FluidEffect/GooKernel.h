@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+
+// Contribution of one particle to the goo field, exp(-k * d) as in GooShader.hlsl. It fades out
+// over the outer quarter of the cutoff, so the truncated field stays smooth for interpolation.
+class GooKernel
+{
+public:
+	GooKernel();
+
+	// Tabulates the kernel over squared distance, which saves the square root as well
+	void Initialize(float falloff, float cutoffRadius);
+
+	float Evaluate(float distanceSq) const
+	{
+		if (distanceSq >= m_cutoffRadiusSq)
+			return 0.0f;
+
+		float position = distanceSq * m_tableScale;
+		int index = static_cast<int>(position);
+		float fraction = position - index;
+		return m_table[index] + (m_table[index + 1] - m_table[index]) * fraction;
+	}
+
+	static float EvaluateExact(float distance, float falloff, float cutoffRadius);
+
+private:
+	static const int TABLE_SIZE = 4096;
+
+	std::vector<float> m_table;
+	float m_tableScale;
+	float m_cutoffRadiusSq;
+};
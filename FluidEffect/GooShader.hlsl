@@ -20,16 +20,41 @@ cbuffer NearbyParticleBuffer : register(b1)
     float4 particlePos[MAX_NEARBY_PARTICLES];
 };
 
-struct PointLight
+// Lights in view space, sorted into a froxel grid by LightClusters
+struct ClusterLight
 {
-    float3 position;
+    float3 viewPosition;
+    float range;
     float3 color;
     float power;
 };
 
-StructuredBuffer<PointLight> lights : register(t0);
+struct ClusterLightRange
+{
+    uint offset;
+    uint numLights;
+};
+
+StructuredBuffer<ClusterLight> lights : register(t0);
+StructuredBuffer<ClusterLightRange> clusters : register(t1);
+StructuredBuffer<uint> lightIndices : register(t2);
+
+cbuffer ClusterConstants : register(b2)
+{
+    uint3 numClusters;
+    uint numLights;
+    float2 tileSize;
+    float sliceScale;
+    float sliceBias;
+}
 
-static const int MAX_NUM_OF_LIGHTS = 5;
+ClusterLightRange GetCluster(float2 pixel, float viewDepth)
+{
+    uint3 cluster;
+    cluster.xy = min(uint2(pixel / tileSize), numClusters.xy - 1);
+    cluster.z = min(uint(max(log(viewDepth) * sliceScale + sliceBias, 0.0f)), numClusters.z - 1);
+    return clusters[(cluster.z * numClusters.y + cluster.y) * numClusters.x + cluster.x];
+}
 
 struct VS_INPUT
 {
@@ -116,21 +141,18 @@ float3 GetNormal(float3 hitPoint)
     return normal;
 }
 
-float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal)
+float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal, float2 pixel)
 {
     float shininess = 500.0f;
     float screenGamma = 2.2f;
     float3 ambientColor = float3(0.0f, 0.02f, 0.05f);
-    float3 linearColor;
+    float3 linearColor = float3(0.0f, 0.0f, 0.0f);
     
-    for (int i = 0; i < MAX_NUM_OF_LIGHTS; i++)
+    ClusterLightRange cluster = GetCluster(pixel, vertPos.z);
+    for (uint i = 0; i < cluster.numLights; i++)
     {
-        if (lights[i].power == 0.0f)
-            continue;
-        
-        float4 lightPosView = mul(View, float4(lights[i].position, 1.0f));
-        lightPosView /= lightPosView.w;
-        float3 lightDir = lightPosView.xyz - vertPos;
+        ClusterLight light = lights[lightIndices[cluster.offset + i]];
+        float3 lightDir = light.viewPosition - vertPos;
         float distance = length(lightDir);
         distance *= distance;
         lightDir = normalize(lightDir);
@@ -147,8 +169,10 @@ float3 BlinnPhong(float3 vertPos, float3 diffuseColor, float3 normal)
             specular = pow(specAngle, shininess);
         }
         
-        linearColor += diffuseColor * lambertian * lights[i].color * lights[i].power / distance +
-                       specular * lights[i].color * lights[i].power / distance;
+        // Fades to 0 at the range of the light, beyond it the light is in no cluster
+        float intensity = light.power * max(1.0f / distance - 1.0f / (light.range * light.range), 0.0f);
+        linearColor += diffuseColor * lambertian * light.color * intensity +
+                       specular * light.color * intensity;
         
     }
     
@@ -198,7 +222,7 @@ PS_OUTPUT PSMain(GS_OUTPUT input)
     
     float3 normal = GetNormal(ray);
     
-    float3 color = BlinnPhong(ray, input.color, normal);
+    float3 color = BlinnPhong(ray, input.color, normal, input.position.xy);
     
     output.color = float4(color, 1.0f);
     return output;
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifndef _WIN32
+#include <stdlib.h>
+#endif
+#include "HeapTracker.h"
+
+std::atomic<bool> HeapTracker::s_isTracking(false);
+std::atomic<uint64_t> HeapTracker::s_numAllocations(0);
+std::atomic<uint64_t> HeapTracker::s_numBytes(0);
+
+void HeapTracker::SetTracking(bool isTracking)
+{
+	s_isTracking.store(isTracking, std::memory_order_relaxed);
+}
+
+void HeapTracker::OnAllocation(size_t size)
+{
+	s_numAllocations.fetch_add(1, std::memory_order_relaxed);
+	s_numBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+namespace
+{
+	void* Allocate(size_t size)
+	{
+		if (HeapTracker::IsTracking())
+			HeapTracker::OnAllocation(size);
+
+		// The standard operator new loops on the new handler, one that returns null gives up
+		while (true)
+		{
+			void* memory = std::malloc(size == 0 ? 1 : size);
+			if (memory)
+				return memory;
+
+			std::new_handler handler = std::get_new_handler();
+			if (!handler)
+				return nullptr;
+			handler();
+		}
+	}
+
+#ifdef __cpp_aligned_new
+	void* AllocateAligned(size_t size, std::align_val_t alignment)
+	{
+		if (HeapTracker::IsTracking())
+			HeapTracker::OnAllocation(size);
+
+		while (true)
+		{
+#ifdef _WIN32
+			void* memory = _aligned_malloc(size == 0 ? 1 : size, static_cast<size_t>(alignment));
+#else
+			void* memory = nullptr;
+			if (posix_memalign(&memory, std::max(static_cast<size_t>(alignment), sizeof(void*)), size == 0 ? 1 : size) != 0)
+				memory = nullptr;
+#endif
+			if (memory)
+				return memory;
+
+			std::new_handler handler = std::get_new_handler();
+			if (!handler)
+				return nullptr;
+			handler();
+		}
+	}
+
+	void FreeAligned(void* memory)
+	{
+#ifdef _WIN32
+		_aligned_free(memory);
+#else
+		std::free(memory);
+#endif
+	}
+#endif
+}
+
+// Replaces the global operators of the whole program, the standard library containers included
+void* operator new(size_t size)
+{
+	void* memory = Allocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	std::free(memory);
+}
+
+// Over-aligned types go through these, memory of _aligned_malloc can not be given to free
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* memory = AllocateAligned(size, alignment);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+	FreeAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+	FreeAligned(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept
+{
+	FreeAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept
+{
+	FreeAligned(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	FreeAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	FreeAligned(memory);
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counts the allocations of the global operator new, the over-aligned ones included, while tracking
+// is on, to check that frames in a steady state do not touch the heap. The counts are over all
+// threads. While tracking is off the only cost of an allocation is this load and the branch on it.
+class HeapTracker
+{
+public:
+	static bool IsTracking() { return s_isTracking.load(std::memory_order_relaxed); }
+	static void SetTracking(bool isTracking);
+
+	static uint64_t GetNumAllocations() { return s_numAllocations.load(std::memory_order_relaxed); }
+	static uint64_t GetNumBytes() { return s_numBytes.load(std::memory_order_relaxed); }
+
+	static void OnAllocation(size_t size);
+
+private:
+	static std::atomic<bool> s_isTracking;
+	static std::atomic<uint64_t> s_numAllocations;
+	static std::atomic<uint64_t> s_numBytes;
+};
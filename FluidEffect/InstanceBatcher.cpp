@@ -0,0 +1,115 @@
+#include "InstanceBatcher.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+InstanceBatcher::InstanceBatcher()
+{
+	m_isEnabled = true;
+	m_minInstances = 2;
+	m_lastStats = InstanceBatcherStats();
+}
+
+HRESULT InstanceBatcher::Submit(RenderQueue& queue, std::vector<GameObject*>& gameObjects, const Camera& camera)
+{
+	PROFILE_SCOPE("InstanceBatcher");
+	InstanceBatcherStats stats = InstanceBatcherStats();
+	int numObjects = static_cast<int>(gameObjects.size());
+	stats.numObjects = numObjects;
+	int64_t start = Profiler::GetTimestamp();
+
+	if (!m_isEnabled)
+	{
+		for (GameObject* gameObject : gameObjects)
+		{
+			HRESULT hr = gameObject->Submit(queue, camera);
+			if (FAILED(hr))
+				return hr;
+		}
+		stats.submitMs = static_cast<double>(Profiler::GetTimestamp() - start) / 1000000.0;
+		m_lastStats = stats;
+		return S_OK;
+	}
+
+	// Count the objects of every mesh
+	FrameArena::Scope scope;
+	FrameUnorderedMap<Mesh*, int> batchIndices;
+	m_batches.clear();
+	m_objectBatches.resize(numObjects);
+	for (int i = 0; i < numObjects; i++)
+	{
+		Mesh* mesh = gameObjects[i]->TryGetMesh();
+		if (!mesh)
+		{
+			m_objectBatches[i] = -1;
+			continue;
+		}
+
+		auto found = batchIndices.find(mesh);
+		if (found == batchIndices.end())
+		{
+			found = batchIndices.emplace(mesh, static_cast<int>(m_batches.size())).first;
+			m_batches.push_back({ mesh, 0, 0 });
+		}
+		m_objectBatches[i] = found->second;
+		m_batches[found->second].numInstances++;
+	}
+
+	// Consecutive slots per mesh, in the order the objects came
+	int numSlots = 0;
+	m_cursors.resize(m_batches.size());
+	for (int i = 0; i < static_cast<int>(m_batches.size()); i++)
+	{
+		m_batches[i].first = numSlots;
+		m_cursors[i] = numSlots;
+		numSlots += m_batches[i].numInstances;
+	}
+
+	m_slots.resize(numSlots);
+	for (int i = 0; i < numObjects; i++)
+	{
+		if (m_objectBatches[i] >= 0)
+			m_slots[m_cursors[m_objectBatches[i]]++] = gameObjects[i];
+	}
+
+	m_instances.resize(numSlots);
+	JobSystem::GetInstance().ParallelFor(numSlots, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			DirectX::XMStoreFloat4x4(&m_instances[i].world, m_slots[i]->GetWorldMatrix());
+		}
+	}, 1024);
+	int64_t built = Profiler::GetTimestamp();
+
+	for (const Batch& batch : m_batches)
+	{
+		const InstanceData* instances = m_instances.data() + batch.first;
+		if (batch.numInstances >= m_minInstances)
+		{
+			HRESULT hr = batch.mesh->SubmitInstances(queue, camera, instances, batch.numInstances);
+			if (FAILED(hr))
+				return hr;
+
+			if (hr == S_OK)
+			{
+				stats.numInstancedDraws++;
+				stats.numInstances += batch.numInstances;
+				continue;
+			}
+		}
+
+		for (int i = 0; i < batch.numInstances; i++)
+		{
+			HRESULT hr = batch.mesh->Submit(queue, camera, DirectX::XMLoadFloat4x4(&instances[i].world));
+			if (FAILED(hr))
+				return hr;
+		}
+	}
+
+	stats.numBatches = static_cast<int>(m_batches.size());
+	stats.buildMs = static_cast<double>(built - start) / 1000000.0;
+	stats.submitMs = static_cast<double>(Profiler::GetTimestamp() - built) / 1000000.0;
+	m_lastStats = stats;
+	return S_OK;
+}
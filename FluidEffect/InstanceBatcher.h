@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include "GameObject.h"
+#include "RenderQueue.h"
+#include "ConstantBuffer.h"
+
+struct InstanceBatcherStats
+{
+	int numObjects;
+	int numBatches;			// Meshes among the objects
+	int numInstancedDraws;
+	int numInstances;		// Objects drawn by the instanced draws
+	double buildMs;			// Grouping and the transform stream
+	double submitMs;
+};
+
+// Submits game objects sharing a mesh, and with it the shader, as one instanced draw. The objects
+// are grouped by mesh, counted, given consecutive slots by a prefix sum over the groups and their
+// world matrices are written to the slots in parallel. Groups smaller than m_minInstances, and
+// meshes not ready to draw instanced, are submitted per object.
+class InstanceBatcher
+{
+public:
+	InstanceBatcher();
+
+	HRESULT Submit(RenderQueue& queue, std::vector<GameObject*>& gameObjects, const Camera& camera);
+
+	const InstanceBatcherStats& GetLastStats() const { return m_lastStats; }
+
+	// Disabled every object is submitted on its own
+	bool m_isEnabled;
+	int m_minInstances;
+
+private:
+	struct Batch
+	{
+		Mesh* mesh;
+		int first;			// Slot of the first instance
+		int numInstances;
+	};
+
+	std::vector<Batch> m_batches;
+	std::vector<int> m_objectBatches;	// Per game object, -1 while its mesh is loading
+	std::vector<int> m_cursors;
+	std::vector<GameObject*> m_slots;
+	std::vector<InstanceData> m_instances;
+	InstanceBatcherStats m_lastStats;
+};
@@ -0,0 +1,450 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include "IsoSurfaceExtractor.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+namespace
+{
+	// Corner i of a cell sits at (i & 1, (i >> 1) & 1, (i >> 2) & 1).
+	// Edges 0-3 run along x, 4-7 along y, 8-11 along z, the first corner is the lower one.
+	const int EDGE_CORNERS[12][2] =
+	{
+		{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+		{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+	};
+
+	const int MAX_CASE_TRIANGLES = 10;
+	const int LATTICE_COORD_OFFSET = 1 << 19;
+	const uint64_t BORDER_KEY_FLAG = 1ull << 63;
+
+	struct CaseTable
+	{
+		int numTriangles[256];
+		int edges[256][MAX_CASE_TRIANGLES * 3];
+	};
+
+	int FindEdge(int cornerA, int cornerB)
+	{
+		for (int edge = 0; edge < 12; edge++)
+		{
+			if ((EDGE_CORNERS[edge][0] == cornerA && EDGE_CORNERS[edge][1] == cornerB) ||
+				(EDGE_CORNERS[edge][0] == cornerB && EDGE_CORNERS[edge][1] == cornerA))
+				return edge;
+		}
+		return -1;
+	}
+
+	DirectX::XMFLOAT3 GetEdgeMidpoint(int edge)
+	{
+		int a = EDGE_CORNERS[edge][0];
+		int b = EDGE_CORNERS[edge][1];
+		return DirectX::XMFLOAT3(
+			0.5f * ((a & 1) + (b & 1)),
+			0.5f * (((a >> 1) & 1) + ((b >> 1) & 1)),
+			0.5f * (((a >> 2) & 1) + ((b >> 2) & 1)));
+	}
+
+	// Traces the surface loops over the six cube faces instead of hardcoding the classic table.
+	// Ambiguous faces always separate the inside corners, which only depends on the face itself,
+	// so neighbouring cells agree and the mesh has no cracks.
+	CaseTable BuildCaseTable()
+	{
+		CaseTable table;
+
+		for (int cubeCase = 0; cubeCase < 256; cubeCase++)
+		{
+			int next[12];
+			std::fill(next, next + 12, -1);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				int u = (axis + 1) % 3;
+				int v = (axis + 2) % 3;
+				for (int side = 0; side < 2; side++)
+				{
+					// Counter-clockwise seen from outside the cube
+					const int faceU[4] = { 0, 1, 1, 0 };
+					const int faceV[4] = { 0, 0, 1, 1 };
+					int cycle[4];
+					for (int i = 0; i < 4; i++)
+					{
+						int k = side == 1 ? i : 3 - i;
+						cycle[i] = (side << axis) | (faceU[k] << u) | (faceV[k] << v);
+					}
+
+					int crossingEdges[4];
+					bool crossingEnters[4];
+					int numCrossings = 0;
+					for (int i = 0; i < 4; i++)
+					{
+						bool insideA = (cubeCase >> cycle[i] & 1) != 0;
+						bool insideB = (cubeCase >> cycle[(i + 1) % 4] & 1) != 0;
+						if (insideA == insideB)
+							continue;
+						crossingEdges[numCrossings] = FindEdge(cycle[i], cycle[(i + 1) % 4]);
+						crossingEnters[numCrossings] = insideB;
+						numCrossings++;
+					}
+
+					// Crossings alternate, so each entering one is followed by the matching leaving one
+					for (int i = 0; i < numCrossings; i++)
+					{
+						if (crossingEnters[i])
+							next[crossingEdges[i]] = crossingEdges[(i + 1) % numCrossings];
+					}
+				}
+			}
+
+			int numTriangles = 0;
+			bool visited[12] = {};
+			for (int start = 0; start < 12; start++)
+			{
+				if (next[start] < 0 || visited[start])
+					continue;
+
+				int loop[12];
+				int loopLength = 0;
+				for (int edge = start; !visited[edge]; edge = next[edge])
+				{
+					visited[edge] = true;
+					loop[loopLength++] = edge;
+				}
+
+				for (int i = 1; i + 1 < loopLength; i++)
+				{
+					table.edges[cubeCase][numTriangles * 3 + 0] = loop[0];
+					table.edges[cubeCase][numTriangles * 3 + 1] = loop[i];
+					table.edges[cubeCase][numTriangles * 3 + 2] = loop[i + 1];
+					numTriangles++;
+				}
+			}
+			table.numTriangles[cubeCase] = numTriangles;
+		}
+
+		// The loop direction depends on the face orientation convention, so check it on the
+		// single corner case and flip everything to counter-clockwise around the outward normal
+		const int* corner0 = table.edges[1];
+		DirectX::XMFLOAT3 a = GetEdgeMidpoint(corner0[0]);
+		DirectX::XMFLOAT3 b = GetEdgeMidpoint(corner0[1]);
+		DirectX::XMFLOAT3 c = GetEdgeMidpoint(corner0[2]);
+		DirectX::XMFLOAT3 ab(b.x - a.x, b.y - a.y, b.z - a.z);
+		DirectX::XMFLOAT3 ac(c.x - a.x, c.y - a.y, c.z - a.z);
+		float outward = (ab.y * ac.z - ab.z * ac.y) + (ab.z * ac.x - ab.x * ac.z) + (ab.x * ac.y - ab.y * ac.x);
+		if (outward < 0.0f)
+		{
+			for (int cubeCase = 0; cubeCase < 256; cubeCase++)
+			{
+				for (int t = 0; t < table.numTriangles[cubeCase]; t++)
+					std::swap(table.edges[cubeCase][t * 3 + 1], table.edges[cubeCase][t * 3 + 2]);
+			}
+		}
+
+		return table;
+	}
+
+	const CaseTable& GetCaseTable()
+	{
+		static const CaseTable table = BuildCaseTable();
+		return table;
+	}
+
+	inline uint64_t GetLatticeEdgeKey(int x, int y, int z, int axis)
+	{
+		return BORDER_KEY_FLAG |
+			(static_cast<uint64_t>(x + LATTICE_COORD_OFFSET) << 42) |
+			(static_cast<uint64_t>(y + LATTICE_COORD_OFFSET) << 22) |
+			(static_cast<uint64_t>(z + LATTICE_COORD_OFFSET) << 2) |
+			static_cast<uint64_t>(axis);
+	}
+}
+
+IsoSurfaceExtractor::IsoSurfaceExtractor()
+{
+	m_settings.fieldFalloff = 3.0f;
+	m_settings.isoValue = 0.5f;
+	m_settings.cellSize = 0.1f;
+	// The shader only sums the 32 nearest particles, which in a dense blob all lie within about 0.6 units
+	m_settings.cutoffRadius = 1.0f;
+}
+
+void IsoSurfaceExtractor::Extract(const std::vector<DirectX::XMFLOAT3>& particles)
+{
+	PROFILE_SCOPE("IsoSurfaceExtract");
+
+	m_vertices.clear();
+	m_indices.clear();
+	m_densityGrid.m_settings.fieldFalloff = m_settings.fieldFalloff;
+	m_densityGrid.m_settings.voxelSize = m_settings.cellSize;
+	m_densityGrid.m_settings.cutoffRadius = m_settings.cutoffRadius;
+	m_densityGrid.Allocate(particles);
+	if (particles.empty())
+		return;
+
+	// Bricks deep inside the goo or in the margin around it have every sample on one side
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	int numBricks = m_densityGrid.GetNumBricks();
+	m_isSurfaceBrick.resize(numBricks);
+	jobSystem.ParallelFor(numBricks, [&](int begin, int end, int chunk)
+	{
+		for (int brick = begin; brick < end; brick++)
+		{
+			float lowerBound, upperBound;
+			m_densityGrid.GetFieldBounds(brick, lowerBound, upperBound);
+			m_isSurfaceBrick[brick] = lowerBound <= m_settings.isoValue && upperBound > m_settings.isoValue ? 1 : 0;
+		}
+	}, 16);
+
+	// Normals on the brick boundary need one more sample from the neighbours
+	m_surfaceBricks.clear();
+	m_splatBricks.clear();
+	m_isSplatNeeded.assign(numBricks, 0);
+	for (int brick = 0; brick < numBricks; brick++)
+	{
+		if (!m_isSurfaceBrick[brick])
+			continue;
+
+		m_surfaceBricks.push_back(brick);
+		int x, y, z;
+		m_densityGrid.GetBrickCoords(brick, x, y, z);
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int neighbour = m_densityGrid.FindBrickIndex(x + dx, y + dy, z + dz);
+					if (neighbour >= 0 && !m_isSplatNeeded[neighbour])
+					{
+						m_isSplatNeeded[neighbour] = 1;
+						m_splatBricks.push_back(neighbour);
+					}
+				}
+			}
+		}
+	}
+	m_densityGrid.SplatBricks(m_splatBricks);
+
+	int numBlocks = static_cast<int>(m_surfaceBricks.size());
+	if (static_cast<int>(m_blockOutputs.size()) < numBlocks)
+		m_blockOutputs.resize(numBlocks);
+
+	jobSystem.ParallelFor(numBlocks, [&](int begin, int end, int chunk)
+	{
+		BlockScratch scratch;
+		for (int block = begin; block < end; block++)
+			ExtractBlock(m_surfaceBricks[block], scratch, m_blockOutputs[block]);
+	}, 4);
+
+	// Weld the vertices blocks share on their boundaries, interior ones are unique already
+	size_t totalVertices = 0;
+	size_t totalIndices = 0;
+	size_t borderVertices = 0;
+	for (int block = 0; block < numBlocks; block++)
+	{
+		totalVertices += m_blockOutputs[block].vertices.size();
+		totalIndices += m_blockOutputs[block].indices.size();
+		for (uint64_t key : m_blockOutputs[block].borderKeys)
+			borderVertices += key != 0 ? 1 : 0;
+	}
+	m_vertices.reserve(totalVertices);
+	m_indices.reserve(totalIndices);
+
+	std::unordered_map<uint64_t, unsigned int> weldedVertices;
+	weldedVertices.reserve(borderVertices);
+	std::vector<unsigned int> remap;
+	for (int block = 0; block < numBlocks; block++)
+	{
+		const BlockOutput& output = m_blockOutputs[block];
+		remap.resize(output.vertices.size());
+		for (size_t i = 0; i < output.vertices.size(); i++)
+		{
+			unsigned int index = static_cast<unsigned int>(m_vertices.size());
+			if (output.borderKeys[i] != 0)
+			{
+				auto inserted = weldedVertices.insert(std::make_pair(output.borderKeys[i], index));
+				if (!inserted.second)
+				{
+					remap[i] = inserted.first->second;
+					continue;
+				}
+			}
+			remap[i] = index;
+			m_vertices.push_back(output.vertices[i]);
+		}
+
+		for (unsigned int index : output.indices)
+			m_indices.push_back(remap[index]);
+	}
+}
+
+void IsoSurfaceExtractor::ExtractBlock(int brick, BlockScratch& scratch, BlockOutput& output) const
+{
+	const CaseTable& caseTable = GetCaseTable();
+	const int blockSize = SparseDensityGrid::BRICK_SIZE;
+	const int brickSamples = SparseDensityGrid::BRICK_SAMPLES;
+	int stride = blockSize + 3;
+	int corners = blockSize + 1;
+	float cellSize = m_settings.cellSize;
+	float iso = m_settings.isoValue;
+
+	int blockX, blockY, blockZ;
+	m_densityGrid.GetBrickCoords(brick, blockX, blockY, blockZ);
+	int firstX = blockX * blockSize;
+	int firstY = blockY * blockSize;
+	int firstZ = blockZ * blockSize;
+
+	output.vertices.clear();
+	output.borderKeys.clear();
+	output.indices.clear();
+
+	// Samples run from -1 to blockSize + 1 so normals on the block boundary have both neighbours.
+	// The outer ones come from the neighbouring bricks, a missing brick means no particle reaches it.
+	const float* neighbours[27];
+	for (int i = 0; i < 27; i++)
+	{
+		int neighbour = m_densityGrid.FindBrickIndex(blockX + i % 3 - 1, blockY + i / 3 % 3 - 1, blockZ + i / 9 - 1);
+		neighbours[i] = neighbour >= 0 ? m_densityGrid.GetBrickSamples(neighbour) : nullptr;
+	}
+
+	scratch.samples.resize(stride * stride * stride);
+	for (int z = -1; z <= blockSize + 1; z++)
+	{
+		int nz = z < 0 ? 0 : (z > blockSize ? 2 : 1);
+		int localZ = z - (nz - 1) * blockSize;
+		for (int y = -1; y <= blockSize + 1; y++)
+		{
+			int ny = y < 0 ? 0 : (y > blockSize ? 2 : 1);
+			int localY = y - (ny - 1) * blockSize;
+			for (int x = -1; x <= blockSize + 1; x++)
+			{
+				int nx = x < 0 ? 0 : (x > blockSize ? 2 : 1);
+				int localX = x - (nx - 1) * blockSize;
+				const float* source = neighbours[(nz * 3 + ny) * 3 + nx];
+				scratch.samples[((z + 1) * stride + (y + 1)) * stride + (x + 1)] =
+					source ? source[(localZ * brickSamples + localY) * brickSamples + localX] : 0.0f;
+			}
+		}
+	}
+	const std::vector<float>& samples = scratch.samples;
+
+	scratch.edgeVertices.assign(3 * corners * corners * corners, -1);
+
+	auto sampleAt = [&](int x, int y, int z)
+	{
+		return samples[((z + 1) * stride + (y + 1)) * stride + (x + 1)];
+	};
+
+	float cornerValue[8];
+	for (int z = 0; z < blockSize; z++)
+	{
+		for (int y = 0; y < blockSize; y++)
+		{
+			for (int x = 0; x < blockSize; x++)
+			{
+				int cubeCase = 0;
+				for (int c = 0; c < 8; c++)
+				{
+					cornerValue[c] = sampleAt(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1));
+					if (cornerValue[c] > iso)
+						cubeCase |= 1 << c;
+				}
+				if (cubeCase == 0 || cubeCase == 255)
+					continue;
+
+				for (int t = 0; t < caseTable.numTriangles[cubeCase] * 3; t++)
+				{
+					int edge = caseTable.edges[cubeCase][t];
+					int axis = edge / 4;
+					int lower = EDGE_CORNERS[edge][0];
+					int upper = EDGE_CORNERS[edge][1];
+					int ex = x + (lower & 1);
+					int ey = y + ((lower >> 1) & 1);
+					int ez = z + ((lower >> 2) & 1);
+
+					int& vertexIndex = scratch.edgeVertices[((axis * corners + ez) * corners + ey) * corners + ex];
+					if (vertexIndex < 0)
+					{
+						float s0 = cornerValue[lower];
+						float s1 = cornerValue[upper];
+						float t0 = (iso - s0) / (s1 - s0);
+
+						int fx = ex + (axis == 0 ? 1 : 0);
+						int fy = ey + (axis == 1 ? 1 : 0);
+						int fz = ez + (axis == 2 ? 1 : 0);
+
+						// Central difference gradients at both ends, the field grows inwards
+						DirectX::XMFLOAT3 g0(
+							sampleAt(ex + 1, ey, ez) - sampleAt(ex - 1, ey, ez),
+							sampleAt(ex, ey + 1, ez) - sampleAt(ex, ey - 1, ez),
+							sampleAt(ex, ey, ez + 1) - sampleAt(ex, ey, ez - 1));
+						DirectX::XMFLOAT3 g1(
+							sampleAt(fx + 1, fy, fz) - sampleAt(fx - 1, fy, fz),
+							sampleAt(fx, fy + 1, fz) - sampleAt(fx, fy - 1, fz),
+							sampleAt(fx, fy, fz + 1) - sampleAt(fx, fy, fz - 1));
+						DirectX::XMFLOAT3 normal(
+							-(g0.x + (g1.x - g0.x) * t0),
+							-(g0.y + (g1.y - g0.y) * t0),
+							-(g0.z + (g1.z - g0.z) * t0));
+						float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+						if (length > 0.0f)
+						{
+							normal.x /= length;
+							normal.y /= length;
+							normal.z /= length;
+						}
+
+						Vertex vertex(DirectX::XMFLOAT3(
+							(firstX + ex + (axis == 0 ? t0 : 0.0f)) * cellSize,
+							(firstY + ey + (axis == 1 ? t0 : 0.0f)) * cellSize,
+							(firstZ + ez + (axis == 2 ? t0 : 0.0f)) * cellSize));
+						vertex.normal = normal;
+
+						// Edges lying in a boundary face are also produced by the neighbouring block
+						bool onBorder = false;
+						if (axis != 0 && (ex == 0 || ex == blockSize))
+							onBorder = true;
+						if (axis != 1 && (ey == 0 || ey == blockSize))
+							onBorder = true;
+						if (axis != 2 && (ez == 0 || ez == blockSize))
+							onBorder = true;
+
+						vertexIndex = static_cast<int>(output.vertices.size());
+						output.vertices.push_back(vertex);
+						output.borderKeys.push_back(onBorder ? GetLatticeEdgeKey(firstX + ex, firstY + ey, firstZ + ez, axis) : 0);
+					}
+					output.indices.push_back(static_cast<unsigned int>(vertexIndex));
+				}
+			}
+		}
+	}
+}
+
+bool IsoSurfaceExtractor::ExportObj(const std::string& fileName) const
+{
+	std::ofstream file(fileName);
+	if (!file)
+	{
+		std::cout << "Failed to write surface mesh: " << fileName << std::endl;
+		return false;
+	}
+
+	file << "# Goo surface, " << m_vertices.size() << " vertices, " << m_indices.size() / 3 << " triangles\n";
+	for (const Vertex& vertex : m_vertices)
+		file << "v " << vertex.position.x << " " << vertex.position.y << " " << vertex.position.z << "\n";
+	for (const Vertex& vertex : m_vertices)
+		file << "vn " << vertex.normal.x << " " << vertex.normal.y << " " << vertex.normal.z << "\n";
+	for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+	{
+		file << "f";
+		for (int k = 0; k < 3; k++)
+			file << " " << m_indices[i + k] + 1 << "//" << m_indices[i + k] + 1;
+		file << "\n";
+	}
+
+	return static_cast<bool>(file);
+}
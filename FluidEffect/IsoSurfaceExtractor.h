@@ -0,0 +1,62 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SparseDensityGrid.h"
+#include "Vertex.h"
+
+struct IsoSurfaceSettings
+{
+	float fieldFalloff;		// k in exp(-k * d), as in GooShader.hlsl
+	float isoValue;
+	float cellSize;
+	float cutoffRadius;		// Particles further away do not contribute to the field
+};
+
+// Extracts the goo surface on the CPU with marching cubes. The field is the same sum of
+// exp(-k * d) the goo shader raymarches, but limited by GooKernel's cutoff instead of to the 32
+// nearest particles. The field comes from a SparseDensityGrid, whose bricks are the marched blocks,
+// and only the bricks the surface may pass through and their neighbours are splatted.
+class IsoSurfaceExtractor
+{
+public:
+	IsoSurfaceExtractor();
+
+	void Extract(const std::vector<DirectX::XMFLOAT3>& particles);
+
+	// Welded triangle list with outward normals and counter-clockwise winding like the OBJ meshes
+	const std::vector<Vertex>& GetVertices() const { return m_vertices; }
+	const std::vector<unsigned int>& GetIndices() const { return m_indices; }
+	int GetNumActiveBlocks() const { return m_densityGrid.GetNumBricks(); }
+
+	bool ExportObj(const std::string& fileName) const;
+
+	IsoSurfaceSettings m_settings;
+
+private:
+	struct BlockOutput
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint64_t> borderKeys;	// Edge key for vertices on the block boundary, 0 inside the block
+		std::vector<unsigned int> indices;
+	};
+
+	struct BlockScratch
+	{
+		std::vector<float> samples;
+		std::vector<int> edgeVertices;
+	};
+
+	void ExtractBlock(int brick, BlockScratch& scratch, BlockOutput& output) const;
+
+	SparseDensityGrid m_densityGrid;
+	std::vector<uint8_t> m_isSurfaceBrick;
+	std::vector<uint8_t> m_isSplatNeeded;
+	std::vector<int> m_surfaceBricks;
+	std::vector<int> m_splatBricks;
+	std::vector<BlockOutput> m_blockOutputs;
+
+	std::vector<Vertex> m_vertices;
+	std::vector<unsigned int> m_indices;
+};
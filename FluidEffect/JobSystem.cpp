@@ -0,0 +1,262 @@
+#include <algorithm>
+#include "JobSystem.h"
+
+namespace
+{
+	thread_local bool insideParallelFor = false;
+}
+
+JobSystem::JobSystem()
+{
+	m_shuttingDown = false;
+	m_numThreads = 1;
+	m_jobs.firstJob = 0;
+	m_jobs.numJobs = 0;
+	m_backgroundJobs.firstJob = 0;
+	m_backgroundJobs.numJobs = 0;
+	m_numBackgroundRunning = 0;
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+JobSystem& JobSystem::GetInstance()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+void JobSystem::Initialize(int numThreads)
+{
+	Shutdown();
+
+	if (numThreads <= 0)
+		numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	m_shuttingDown = false;
+	m_numThreads = numThreads;
+
+	for (int i = 1; i < numThreads; i++)
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shuttingDown = true;
+	}
+	m_jobAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+
+	m_workers.clear();
+	m_numThreads = 1;
+}
+
+int JobSystem::GetNumThreads() const
+{
+	return m_numThreads;
+}
+
+int JobSystem::GetChunkCount(int count, int numThreads, int minChunkSize)
+{
+	if (count <= 0)
+		return 0;
+
+	int maxChunks = (count + std::max(1, minChunkSize) - 1) / std::max(1, minChunkSize);
+	return std::max(1, std::min(numThreads, maxChunks));
+}
+
+void JobSystem::RunParallelFor(int count, ChunkFunction function, const void* body, int minChunkSize)
+{
+	int numChunks = GetChunkCount(count, insideParallelFor ? 1 : m_numThreads, minChunkSize);
+	if (numChunks == 0)
+		return;
+
+	if (numChunks == 1)
+	{
+		function(body, 0, count, 0);
+		return;
+	}
+
+	ParallelForBatch batch;
+	batch.function = function;
+	batch.body = body;
+	batch.count = count;
+	batch.numChunks = numChunks;
+	batch.chunksLeft.store(numChunks - 1, std::memory_order_relaxed);
+
+	if (m_workers.empty())
+	{
+		for (int chunk = 1; chunk < numChunks; chunk++)
+			RunChunk(batch, chunk);
+		batch.chunksLeft.store(0, std::memory_order_relaxed);
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Job job;
+			job.batch = &batch;
+			for (int chunk = 1; chunk < numChunks; chunk++)
+			{
+				job.chunk = chunk;
+				PushJob(m_jobs, job);
+			}
+		}
+		m_jobAvailable.notify_all();
+	}
+
+	RunChunk(batch, 0);
+
+	// Help with queued work instead of idling until the other chunks are done
+	while (batch.chunksLeft.load(std::memory_order_acquire) > 0)
+	{
+		if (!RunPendingJob())
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::RunChunk(ParallelForBatch& batch, int chunk)
+{
+	bool wasInside = insideParallelFor;
+	insideParallelFor = true;
+	int begin = static_cast<int>(static_cast<long long>(batch.count) * chunk / batch.numChunks);
+	int end = static_cast<int>(static_cast<long long>(batch.count) * (chunk + 1) / batch.numChunks);
+	batch.function(batch.body, begin, end, chunk);
+	insideParallelFor = wasInside;
+}
+
+void JobSystem::Submit(const std::function<void()>& job)
+{
+	if (m_workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Job queued;
+		queued.function = job;
+		queued.batch = nullptr;
+		queued.chunk = 0;
+		PushJob(m_jobs, queued);
+	}
+	m_jobAvailable.notify_one();
+}
+
+void JobSystem::SubmitBackground(const std::function<void()>& job)
+{
+	if (m_workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Job queued;
+		queued.function = job;
+		queued.batch = nullptr;
+		queued.chunk = 0;
+		PushJob(m_backgroundJobs, queued);
+	}
+	m_jobAvailable.notify_one();
+}
+
+void JobSystem::PushJob(JobQueue& queue, Job& job)
+{
+	if (queue.numJobs == queue.jobs.size())
+	{
+		// Unwrap into a ring twice the size
+		std::vector<Job> jobs(std::max<size_t>(64, 2 * queue.jobs.size()));
+		for (size_t i = 0; i < queue.numJobs; i++)
+			jobs[i] = std::move(queue.jobs[(queue.firstJob + i) % queue.jobs.size()]);
+		queue.jobs.swap(jobs);
+		queue.firstJob = 0;
+	}
+
+	queue.jobs[(queue.firstJob + queue.numJobs) % queue.jobs.size()] = std::move(job);
+	queue.numJobs++;
+}
+
+bool JobSystem::PopJob(JobQueue& queue, Job& job)
+{
+	if (queue.numJobs == 0)
+		return false;
+
+	job = std::move(queue.jobs[queue.firstJob]);
+	queue.firstJob = (queue.firstJob + 1) % queue.jobs.size();
+	queue.numJobs--;
+	return true;
+}
+
+bool JobSystem::CanRunBackgroundJob() const
+{
+	int maxRunning = std::max(1, static_cast<int>(m_workers.size()) - 1);
+	return m_backgroundJobs.numJobs > 0 && m_numBackgroundRunning < maxRunning;
+}
+
+void JobSystem::RunJob(Job& job)
+{
+	if (!job.batch)
+	{
+		job.function();
+		return;
+	}
+
+	ParallelForBatch& batch = *job.batch;
+	RunChunk(batch, job.chunk);
+	batch.chunksLeft.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool JobSystem::RunPendingJob()
+{
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!PopJob(m_jobs, job))
+			return false;
+	}
+
+	RunJob(job);
+	return true;
+}
+
+void JobSystem::WorkerLoop()
+{
+	while (true)
+	{
+		Job job;
+		bool isBackground = false;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return m_shuttingDown || m_jobs.numJobs > 0 || CanRunBackgroundJob(); });
+
+			if (!PopJob(m_jobs, job))
+			{
+				// Left over background jobs still run on shutdown
+				isBackground = PopJob(m_backgroundJobs, job);
+				if (!isBackground)
+					return;
+				m_numBackgroundRunning++;
+			}
+		}
+
+		RunJob(job);
+
+		if (isBackground)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_numBackgroundRunning--;
+			}
+			m_jobAvailable.notify_one();
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+	static JobSystem& GetInstance();
+
+	// numThreads counts the calling thread as well, 0 picks the number of hardware threads
+	void Initialize(int numThreads = 0);
+	void Shutdown();
+
+	int GetNumThreads() const;
+
+	// Splits [0, count) into at most GetNumThreads() contiguous chunks of at least minChunkSize items
+	// and blocks until all of them ran. The split only depends on count and the thread count, so
+	// per-chunk results are deterministic for a fixed thread count. Nested calls run inline. body is
+	// called as body(begin, end, chunk) and only referenced, so queuing chunks does not allocate.
+	template <typename Body>
+	void ParallelFor(int count, const Body& body, int minChunkSize = 256)
+	{
+		RunParallelFor(count, &CallBody<Body>, &body, minChunkSize);
+	}
+
+	void Submit(const std::function<void()>& job);
+	// For long jobs off the frame path like asset loads. Workers only take them when no other job is
+	// queued, and leave one worker free for frame jobs if there is more than one.
+	void SubmitBackground(const std::function<void()>& job);
+	// Runs one queued job on the calling thread, false if there was none. For threads waiting on jobs,
+	// so background jobs are never run here.
+	bool RunPendingJob();
+
+	static int GetChunkCount(int count, int numThreads, int minChunkSize);
+
+private:
+	typedef void (*ChunkFunction)(const void* body, int begin, int end, int chunk);
+
+	// The chunks of one ParallelFor, on the stack of the thread that called it
+	struct ParallelForBatch
+	{
+		ChunkFunction function;
+		const void* body;
+		int count;
+		int numChunks;
+		std::atomic<int> chunksLeft;
+	};
+
+	// A submitted function, or a chunk of a batch if batch is set
+	struct Job
+	{
+		std::function<void()> function;
+		ParallelForBatch* batch;
+		int chunk;
+	};
+
+	// Ring of queued jobs, only grows when it is full so a steady load queues without allocating
+	struct JobQueue
+	{
+		std::vector<Job> jobs;
+		size_t firstJob;
+		size_t numJobs;
+	};
+
+	JobSystem();
+	~JobSystem();
+
+	template <typename Body>
+	static void CallBody(const void* body, int begin, int end, int chunk)
+	{
+		(*static_cast<const Body*>(body))(begin, end, chunk);
+	}
+
+	void RunParallelFor(int count, ChunkFunction function, const void* body, int minChunkSize);
+	static void RunChunk(ParallelForBatch& batch, int chunk);
+	// Callers hold m_mutex
+	static void PushJob(JobQueue& queue, Job& job);
+	static bool PopJob(JobQueue& queue, Job& job);
+	bool CanRunBackgroundJob() const;
+	void RunJob(Job& job);
+	void WorkerLoop();
+
+	std::vector<std::thread> m_workers;
+	JobQueue m_jobs;
+	JobQueue m_backgroundJobs;
+	int m_numBackgroundRunning;
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	bool m_shuttingDown;
+	int m_numThreads;
+};
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "EngineStats.h"
+
+const float LightClusters::LIGHT_CUTOFF = 0.01f;
+
+namespace
+{
+	bool IsSphereInBox(const DirectX::XMFLOAT3& center, float radius, const DirectX::XMFLOAT3& min, const DirectX::XMFLOAT3& max)
+	{
+		float dx = std::max(std::max(min.x - center.x, center.x - max.x), 0.0f);
+		float dy = std::max(std::max(min.y - center.y, center.y - max.y), 0.0f);
+		float dz = std::max(std::max(min.z - center.z, center.z - max.z), 0.0f);
+		return dx * dx + dy * dy + dz * dz <= radius * radius;
+	}
+}
+
+LightClusters::LightClusters(int numClustersX, int numClustersY, int numClustersZ)
+{
+	m_numClustersX = numClustersX;
+	m_numClustersY = numClustersY;
+	m_numClustersZ = numClustersZ;
+	m_nearPlane = 0.0f;
+	m_farPlane = 0.0f;
+	m_projectionScaleX = 0.0f;
+	m_projectionScaleY = 0.0f;
+	m_screenWidth = 0.0f;
+	m_screenHeight = 0.0f;
+	m_constants = ClusterConstants();
+
+	m_slicePairs.resize(numClustersZ);
+	m_sliceIndices.resize(numClustersZ);
+	m_clusterRanges.resize(numClustersX * numClustersY * numClustersZ);
+
+	m_lightBuffer = nullptr;
+	m_rangeBuffer = nullptr;
+	m_indexBuffer = nullptr;
+	m_constantBuffer = nullptr;
+	m_lastStats = LightClusterStats();
+}
+
+LightClusters::~LightClusters()
+{
+	RenderBuffer* buffers[] = { m_lightBuffer, m_rangeBuffer, m_indexBuffer, m_constantBuffer };
+	for (RenderBuffer* buffer : buffers)
+	{
+		if (buffer)
+			buffer->Release();
+	}
+}
+
+void LightClusters::Update(const PointLight* lights, int numLights, const Camera& camera)
+{
+	PROFILE_SCOPE("LightClusters");
+	LightClusterStats stats = LightClusterStats();
+	stats.numLights = numLights;
+	int64_t start = Profiler::GetTimestamp();
+	UpdateClusterBounds(camera);
+
+	// View space and the clusters each light may reach
+	DirectX::XMMATRIX view = camera.GetViewMatrix();
+	m_lights.resize(numLights);
+	m_lightBounds.resize(numLights);
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	jobSystem.ParallelFor(numLights, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			ClusterLight& light = m_lights[i];
+			DirectX::XMStoreFloat3(&light.viewPosition, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&lights[i].position), view));
+			light.color = lights[i].color;
+			light.power = lights[i].power;
+			light.range = lights[i].power > 0.0f ? std::sqrt(lights[i].power / LIGHT_CUTOFF) : 0.0f;
+
+			LightBounds& bounds = m_lightBounds[i];
+			bounds.minZ = 1;
+			bounds.maxZ = 0;
+			const DirectX::XMFLOAT3& center = light.viewPosition;
+			float nearZ = std::max(center.z - light.range, m_nearPlane);
+			float farZ = std::min(center.z + light.range, m_farPlane);
+			if (light.range <= 0.0f || nearZ > farZ)
+				continue;
+
+			// x / z and y / z of the box around the sphere are extreme at its corners
+			float minNdcX = std::min((center.x - light.range) / nearZ, (center.x - light.range) / farZ) * m_projectionScaleX;
+			float maxNdcX = std::max((center.x + light.range) / nearZ, (center.x + light.range) / farZ) * m_projectionScaleX;
+			float minNdcY = std::min((center.y - light.range) / nearZ, (center.y - light.range) / farZ) * m_projectionScaleY;
+			float maxNdcY = std::max((center.y + light.range) / nearZ, (center.y + light.range) / farZ) * m_projectionScaleY;
+			if (minNdcX > 1.0f || maxNdcX < -1.0f || minNdcY > 1.0f || maxNdcY < -1.0f)
+				continue;
+
+			auto toTile = [](float pixel, float tileSize, int numTiles)
+			{
+				return std::min(std::max(static_cast<int>(std::floor(pixel / tileSize)), 0), numTiles - 1);
+			};
+			bounds.minX = toTile((minNdcX * 0.5f + 0.5f) * m_screenWidth, m_constants.tileWidth, m_numClustersX);
+			bounds.maxX = toTile((maxNdcX * 0.5f + 0.5f) * m_screenWidth, m_constants.tileWidth, m_numClustersX);
+			bounds.minY = toTile((0.5f - maxNdcY * 0.5f) * m_screenHeight, m_constants.tileHeight, m_numClustersY);
+			bounds.maxY = toTile((0.5f - minNdcY * 0.5f) * m_screenHeight, m_constants.tileHeight, m_numClustersY);
+			bounds.minZ = GetSlice(nearZ);
+			bounds.maxZ = GetSlice(farZ);
+		}
+	}, 256);
+	int64_t transformed = Profiler::GetTimestamp();
+
+	// Every job owns whole depth slices, so the light lists are written without locks and come out
+	// in light order
+	int numClustersPerSlice = m_numClustersX * m_numClustersY;
+	jobSystem.ParallelFor(m_numClustersZ, [&](int begin, int end, int chunk)
+	{
+		for (int z = begin; z < end; z++)
+		{
+			std::vector<uint64_t>& pairs = m_slicePairs[z];
+			pairs.clear();
+			for (int i = 0; i < numLights; i++)
+			{
+				const LightBounds& bounds = m_lightBounds[i];
+				if (z < bounds.minZ || z > bounds.maxZ)
+					continue;
+
+				for (int y = bounds.minY; y <= bounds.maxY; y++)
+				{
+					for (int x = bounds.minX; x <= bounds.maxX; x++)
+					{
+						int cluster = y * m_numClustersX + x;
+						const ClusterBounds& box = m_clusterBounds[z * numClustersPerSlice + cluster];
+						if (IsSphereInBox(m_lights[i].viewPosition, m_lights[i].range, box.min, box.max))
+							pairs.push_back(static_cast<uint64_t>(cluster) << 32 | static_cast<uint32_t>(i));
+					}
+				}
+			}
+
+			// Counting sort of the pairs by cluster
+			ClusterLightRange* ranges = m_clusterRanges.data() + z * numClustersPerSlice;
+			for (int cluster = 0; cluster < numClustersPerSlice; cluster++)
+				ranges[cluster] = ClusterLightRange();
+			for (uint64_t pair : pairs)
+				ranges[pair >> 32].numLights++;
+
+			uint32_t offset = 0;
+			for (int cluster = 0; cluster < numClustersPerSlice; cluster++)
+			{
+				ranges[cluster].offset = offset;
+				offset += ranges[cluster].numLights;
+			}
+
+			std::vector<uint32_t>& indices = m_sliceIndices[z];
+			indices.resize(pairs.size());
+			for (uint64_t pair : pairs)
+			{
+				ClusterLightRange& range = ranges[pair >> 32];
+				indices[range.offset++] = static_cast<uint32_t>(pair);
+			}
+			for (int cluster = 0; cluster < numClustersPerSlice; cluster++)
+				ranges[cluster].offset -= ranges[cluster].numLights;
+		}
+	}, 1);
+
+	// The slices one after another in a single list
+	uint32_t numIndices = 0;
+	for (int z = 0; z < m_numClustersZ; z++)
+	{
+		ClusterLightRange* ranges = m_clusterRanges.data() + z * numClustersPerSlice;
+		for (int cluster = 0; cluster < numClustersPerSlice; cluster++)
+		{
+			ranges[cluster].offset += numIndices;
+			stats.maxLightsPerCluster = std::max(stats.maxLightsPerCluster, static_cast<int>(ranges[cluster].numLights));
+		}
+		numIndices += static_cast<uint32_t>(m_sliceIndices[z].size());
+	}
+
+	m_lightIndices.resize(numIndices);
+	uint32_t offset = 0;
+	for (int z = 0; z < m_numClustersZ; z++)
+	{
+		if (!m_sliceIndices[z].empty())
+			std::memcpy(m_lightIndices.data() + offset, m_sliceIndices[z].data(), m_sliceIndices[z].size() * sizeof(uint32_t));
+		offset += static_cast<uint32_t>(m_sliceIndices[z].size());
+	}
+
+	for (const LightBounds& bounds : m_lightBounds)
+		stats.numVisibleLights += bounds.minZ <= bounds.maxZ ? 1 : 0;
+	stats.numIndices = static_cast<int>(numIndices);
+	m_constants.numLights = static_cast<uint32_t>(numLights);
+
+	int64_t end = Profiler::GetTimestamp();
+	stats.transformMs = static_cast<double>(transformed - start) / 1000000.0;
+	stats.assignMs = static_cast<double>(end - transformed) / 1000000.0;
+	m_lastStats = stats;
+}
+
+HRESULT LightClusters::Upload(RenderDevice* device)
+{
+	PROFILE_SCOPE("LightUpload");
+	HRESULT hr = Write(device, RENDER_BUFFER_STRUCTURED, sizeof(ClusterLight), m_lights.data(), static_cast<UINT>(m_lights.size() * sizeof(ClusterLight)), m_lightBuffer);
+	if (SUCCEEDED(hr))
+		hr = Write(device, RENDER_BUFFER_STRUCTURED, sizeof(ClusterLightRange), m_clusterRanges.data(), static_cast<UINT>(m_clusterRanges.size() * sizeof(ClusterLightRange)), m_rangeBuffer);
+	if (SUCCEEDED(hr))
+		hr = Write(device, RENDER_BUFFER_STRUCTURED, sizeof(uint32_t), m_lightIndices.data(), static_cast<UINT>(m_lightIndices.size() * sizeof(uint32_t)), m_indexBuffer);
+	if (SUCCEEDED(hr))
+		hr = Write(device, RENDER_BUFFER_CONSTANT, 0, &m_constants, sizeof(ClusterConstants), m_constantBuffer);
+	if (FAILED(hr))
+	{
+		std::cout << "Uploading the light clusters failed." << std::endl;
+		return hr;
+	}
+
+	device->SetShaderResource(RENDER_STAGE_PIXEL, CLUSTER_LIGHT_SLOT, m_lightBuffer);
+	device->SetShaderResource(RENDER_STAGE_PIXEL, CLUSTER_RANGE_SLOT, m_rangeBuffer);
+	device->SetShaderResource(RENDER_STAGE_PIXEL, CLUSTER_INDEX_SLOT, m_indexBuffer);
+	device->SetConstantBuffer(RENDER_STAGE_PIXEL, CLUSTER_CONSTANT_SLOT, m_constantBuffer);
+	return S_OK;
+}
+
+int LightClusters::GetClusterIndex(const ClusterConstants& constants, float pixelX, float pixelY, float viewDepth)
+{
+	int x = std::min(static_cast<int>(std::max(pixelX / constants.tileWidth, 0.0f)), static_cast<int>(constants.numClustersX) - 1);
+	int y = std::min(static_cast<int>(std::max(pixelY / constants.tileHeight, 0.0f)), static_cast<int>(constants.numClustersY) - 1);
+	float slice = viewDepth > 0.0f ? std::log(viewDepth) * constants.sliceScale + constants.sliceBias : 0.0f;
+	int z = std::min(static_cast<int>(std::max(slice, 0.0f)), static_cast<int>(constants.numClustersZ) - 1);
+	return (z * static_cast<int>(constants.numClustersY) + y) * static_cast<int>(constants.numClustersX) + x;
+}
+
+void LightClusters::UpdateClusterBounds(const Camera& camera)
+{
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMStoreFloat4x4(&projection, camera.GetProjectionMatrix());
+	bool isSame = m_nearPlane == camera.GetNearPlane() && m_farPlane == camera.GetFarPlane() && m_projectionScaleX == projection.m[0][0]
+		&& m_projectionScaleY == projection.m[1][1] && m_screenWidth == camera.GetScreenWidth() && m_screenHeight == camera.GetScreenHeight();
+	if (isSame)
+		return;
+
+	m_nearPlane = camera.GetNearPlane();
+	m_farPlane = camera.GetFarPlane();
+	m_projectionScaleX = projection.m[0][0];
+	m_projectionScaleY = projection.m[1][1];
+	m_screenWidth = camera.GetScreenWidth();
+	m_screenHeight = camera.GetScreenHeight();
+
+	// Slice z starts at near * (far / near) ^ (z / numClustersZ)
+	float logDepthRange = std::log(m_farPlane / m_nearPlane);
+	m_constants.numClustersX = static_cast<uint32_t>(m_numClustersX);
+	m_constants.numClustersY = static_cast<uint32_t>(m_numClustersY);
+	m_constants.numClustersZ = static_cast<uint32_t>(m_numClustersZ);
+	m_constants.tileWidth = std::ceil(m_screenWidth / m_numClustersX);
+	m_constants.tileHeight = std::ceil(m_screenHeight / m_numClustersY);
+	m_constants.sliceScale = m_numClustersZ / logDepthRange;
+	m_constants.sliceBias = -m_numClustersZ * std::log(m_nearPlane) / logDepthRange;
+
+	// The box around the corners of every froxel in view space
+	m_clusterBounds.resize(m_clusterRanges.size());
+	for (int z = 0; z < m_numClustersZ; z++)
+	{
+		float depths[2] = { m_nearPlane * std::pow(m_farPlane / m_nearPlane, static_cast<float>(z) / m_numClustersZ),
+			m_nearPlane * std::pow(m_farPlane / m_nearPlane, static_cast<float>(z + 1) / m_numClustersZ) };
+		for (int y = 0; y < m_numClustersY; y++)
+		{
+			float ndcY[2] = { 1.0f - 2.0f * y * m_constants.tileHeight / m_screenHeight, 1.0f - 2.0f * (y + 1) * m_constants.tileHeight / m_screenHeight };
+			for (int x = 0; x < m_numClustersX; x++)
+			{
+				float ndcX[2] = { 2.0f * x * m_constants.tileWidth / m_screenWidth - 1.0f, 2.0f * (x + 1) * m_constants.tileWidth / m_screenWidth - 1.0f };
+				ClusterBounds& bounds = m_clusterBounds[(z * m_numClustersY + y) * m_numClustersX + x];
+				bounds.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, depths[0]);
+				bounds.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, depths[1]);
+				for (float depth : depths)
+				{
+					for (int k = 0; k < 2; k++)
+					{
+						bounds.min.x = std::min(bounds.min.x, ndcX[k] * depth / m_projectionScaleX);
+						bounds.max.x = std::max(bounds.max.x, ndcX[k] * depth / m_projectionScaleX);
+						bounds.min.y = std::min(bounds.min.y, ndcY[k] * depth / m_projectionScaleY);
+						bounds.max.y = std::max(bounds.max.y, ndcY[k] * depth / m_projectionScaleY);
+					}
+				}
+			}
+		}
+	}
+}
+
+int LightClusters::GetSlice(float viewDepth) const
+{
+	float slice = std::log(viewDepth) * m_constants.sliceScale + m_constants.sliceBias;
+	return std::min(std::max(static_cast<int>(slice), 0), m_numClustersZ - 1);
+}
+
+HRESULT LightClusters::Write(RenderDevice* device, RenderBufferType type, UINT structureStride, const void* data, UINT numBytes, RenderBuffer*& buffer)
+{
+	// Empty buffers can not be created, so there is always room for one element
+	UINT byteWidth = std::max(numBytes, type == RENDER_BUFFER_CONSTANT ? numBytes : structureStride);
+	if (!buffer || buffer->GetDesc().byteWidth < byteWidth)
+	{
+		if (buffer)
+		{
+			buffer->Release();
+			buffer = nullptr;
+		}
+
+		// Grown by half again so a changing number of lights does not recreate it every frame
+		if (type != RENDER_BUFFER_CONSTANT)
+			byteWidth = std::max(byteWidth, byteWidth / structureStride * 3 / 2 * structureStride);
+		RenderBufferDesc desc = { type, byteWidth, structureStride, true };
+		HRESULT hr = device->CreateBuffer(desc, nullptr, &buffer);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	void* mapped = device->Map(buffer);
+	if (!mapped)
+		return E_FAIL;
+
+	if (numBytes > 0)
+		std::memcpy(mapped, data, numBytes);
+	device->Unmap(buffer);
+	EngineStats::GetInstance().Add(STAT_MAP_UNMAPS, 1);
+	EngineStats::GetInstance().Add(STAT_BYTES_UPLOADED, numBytes);
+	return S_OK;
+}
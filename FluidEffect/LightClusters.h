@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "RenderDevice.h"
+#include "PointLight.h"
+#include "Camera.h"
+
+// Pixel shader slots the clustered shaders read the lights from
+const int CLUSTER_LIGHT_SLOT = 0;
+const int CLUSTER_RANGE_SLOT = 1;
+const int CLUSTER_INDEX_SLOT = 2;
+const int CLUSTER_CONSTANT_SLOT = 2;
+
+// A point light moved to view space, mirrored by ClusterLight in the shaders
+struct ClusterLight
+{
+	DirectX::XMFLOAT3 viewPosition;
+	float range;		// The light fades to nothing there
+	DirectX::XMFLOAT3 color;
+	float power;
+};
+
+// Where the light indices of one cluster start in the index list
+struct ClusterLightRange
+{
+	uint32_t offset;
+	uint32_t numLights;
+};
+
+// How the shaders find the cluster of a pixel, see LightClusters::GetClusterIndex
+struct alignas(16) ClusterConstants
+{
+	uint32_t numClustersX;
+	uint32_t numClustersY;
+	uint32_t numClustersZ;
+	uint32_t numLights;
+	float tileWidth;		// Pixels
+	float tileHeight;
+	float sliceScale;		// Depth slice = log(view depth) * sliceScale + sliceBias
+	float sliceBias;
+};
+
+struct LightClusterStats
+{
+	int numLights;
+	int numVisibleLights;	// Reaching into the view frustum
+	int numIndices;			// Light and cluster pairs
+	int maxLightsPerCluster;
+	double transformMs;
+	double assignMs;
+};
+
+// Clustered forward lighting. The view frustum is cut into a grid of froxels, screen tiles times
+// exponentially deeper depth slices. Once per frame the lights are moved to view space and every
+// light is added to the clusters its sphere of influence touches, so a pixel only loops over the
+// lights of its cluster instead of every light. The depth slices are filled in parallel.
+class LightClusters
+{
+public:
+	// Below this intensity, power over squared distance, a light is cut off
+	static const float LIGHT_CUTOFF;
+
+	LightClusters(int numClustersX = 16, int numClustersY = 9, int numClustersZ = 24);
+	~LightClusters();
+
+	// Lights without power are skipped
+	void Update(const PointLight* lights, int numLights, const Camera& camera);
+	// Writes the lights and clusters to buffers on device and binds them for the pixel shaders.
+	// The buffers belong to the first device Upload was called with.
+	HRESULT Upload(RenderDevice* device);
+
+	// Cluster of the pixel at (pixelX, pixelY) with a view depth of viewDepth, like the shaders find it
+	static int GetClusterIndex(const ClusterConstants& constants, float pixelX, float pixelY, float viewDepth);
+
+	const ClusterConstants& GetConstants() const { return m_constants; }
+	const std::vector<ClusterLight>& GetLights() const { return m_lights; }
+	const std::vector<ClusterLightRange>& GetClusterRanges() const { return m_clusterRanges; }
+	const std::vector<uint32_t>& GetLightIndices() const { return m_lightIndices; }
+	const LightClusterStats& GetLastStats() const { return m_lastStats; }
+
+private:
+	// Clusters a light may touch, empty if minZ > maxZ
+	struct LightBounds
+	{
+		int minX;
+		int maxX;
+		int minY;
+		int maxY;
+		int minZ;
+		int maxZ;
+	};
+
+	struct ClusterBounds
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	void UpdateClusterBounds(const Camera& camera);
+	int GetSlice(float viewDepth) const;
+	// Grows buffer to hold numBytes, written with data
+	HRESULT Write(RenderDevice* device, RenderBufferType type, UINT structureStride, const void* data, UINT numBytes, RenderBuffer*& buffer);
+
+	int m_numClustersX;
+	int m_numClustersY;
+	int m_numClustersZ;
+	float m_nearPlane;
+	float m_farPlane;
+	float m_projectionScaleX;
+	float m_projectionScaleY;
+	float m_screenWidth;
+	float m_screenHeight;
+
+	ClusterConstants m_constants;
+	std::vector<ClusterBounds> m_clusterBounds;
+	std::vector<ClusterLight> m_lights;
+	std::vector<LightBounds> m_lightBounds;
+	// Per depth slice, written by the job of that slice
+	std::vector<std::vector<uint64_t>> m_slicePairs;
+	std::vector<std::vector<uint32_t>> m_sliceIndices;
+	std::vector<ClusterLightRange> m_clusterRanges;
+	std::vector<uint32_t> m_lightIndices;
+
+	RenderBuffer* m_lightBuffer;
+	RenderBuffer* m_rangeBuffer;
+	RenderBuffer* m_indexBuffer;
+	RenderBuffer* m_constantBuffer;
+	LightClusterStats m_lastStats;
+};
@@ -1,10 +1,15 @@
 #pragma once
-#include <d3d11.h>
+#include "RenderDevice.h"
+#include "RenderQueue.h"
 #include "Camera.h"
 #include "ConstantBuffer.h"
 
 class Mesh {
 public:
-	virtual HRESULT Render(ID3D11DeviceContext* deviceContext, const Camera& camera, DirectX::XMMATRIX worldMatrix) = 0;
-	virtual HRESULT SetShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader) = 0;
+	virtual ~Mesh() {}
+
+	virtual HRESULT Submit(RenderQueue& queue, const Camera& camera, DirectX::XMMATRIX worldMatrix) = 0;
+	// One draw for all instances, S_FALSE if the mesh can not draw them instanced (yet)
+	virtual HRESULT SubmitInstances(RenderQueue& queue, const Camera& camera, const InstanceData* instances, int numInstances) = 0;
+	virtual HRESULT SetShader(RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cfloat>
+#include "MortonCode.h"
+#include "JobSystem.h"
+
+namespace
+{
+	template <typename Code, typename Encoder>
+	void ComputeCodes(const DirectX::XMFLOAT3* positions, int numPositions, const MortonBounds& bounds, uint32_t numCells, std::vector<Code>& codes, Encoder encode)
+	{
+		codes.resize(numPositions);
+		float scale = bounds.extent > 0.0f ? numCells / bounds.extent : 0.0f;
+		float maxCell = static_cast<float>(numCells - 1);
+
+		JobSystem::GetInstance().ParallelFor(numPositions, [&](int begin, int end, int chunk)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				// The upper bound and NaNs are clamped into the last and first cell
+				float x = std::min(std::max((positions[i].x - bounds.origin.x) * scale, 0.0f), maxCell);
+				float y = std::min(std::max((positions[i].y - bounds.origin.y) * scale, 0.0f), maxCell);
+				float z = std::min(std::max((positions[i].z - bounds.origin.z) * scale, 0.0f), maxCell);
+				codes[i] = encode(static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(z));
+			}
+		}, 4096);
+	}
+}
+
+MortonBounds ComputeMortonBounds(const DirectX::XMFLOAT3* positions, int numPositions)
+{
+	DirectX::XMFLOAT3 minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+	DirectX::XMFLOAT3 maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < numPositions; i++)
+	{
+		minimum.x = std::min(minimum.x, positions[i].x);
+		minimum.y = std::min(minimum.y, positions[i].y);
+		minimum.z = std::min(minimum.z, positions[i].z);
+		maximum.x = std::max(maximum.x, positions[i].x);
+		maximum.y = std::max(maximum.y, positions[i].y);
+		maximum.z = std::max(maximum.z, positions[i].z);
+	}
+
+	MortonBounds bounds;
+	if (numPositions == 0)
+	{
+		bounds.origin = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+		bounds.extent = 0.0f;
+		return bounds;
+	}
+
+	bounds.origin = minimum;
+	bounds.extent = std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z));
+	return bounds;
+}
+
+void ComputeMortonCodes(const DirectX::XMFLOAT3* positions, int numPositions, const MortonBounds& bounds, std::vector<uint32_t>& codes)
+{
+	ComputeCodes(positions, numPositions, bounds, 1u << 10, codes, EncodeMorton30);
+}
+
+void ComputeMortonCodes(const DirectX::XMFLOAT3* positions, int numPositions, const MortonBounds& bounds, std::vector<uint64_t>& codes)
+{
+	ComputeCodes(positions, numPositions, bounds, 1u << 21, codes, EncodeMorton63);
+}
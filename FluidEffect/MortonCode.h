@@ -0,0 +1,52 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Spreads the lowest 10 bits of value to every third bit
+inline uint32_t SpreadMortonBits10(uint32_t value)
+{
+	value &= 0x3ff;
+	value = (value | (value << 16)) & 0x030000ff;
+	value = (value | (value << 8)) & 0x0300f00f;
+	value = (value | (value << 4)) & 0x030c30c3;
+	value = (value | (value << 2)) & 0x09249249;
+	return value;
+}
+
+// Spreads the lowest 21 bits of value to every third bit
+inline uint64_t SpreadMortonBits21(uint64_t value)
+{
+	value &= 0x1fffff;
+	value = (value | (value << 32)) & 0x001f00000000ffffULL;
+	value = (value | (value << 16)) & 0x001f0000ff0000ffULL;
+	value = (value | (value << 8)) & 0x100f00f00f00f00fULL;
+	value = (value | (value << 4)) & 0x10c30c30c30c30c3ULL;
+	value = (value | (value << 2)) & 0x1249249249249249ULL;
+	return value;
+}
+
+// Interleaves 10 bits per axis, x ends up in the lowest bit
+inline uint32_t EncodeMorton30(uint32_t x, uint32_t y, uint32_t z)
+{
+	return SpreadMortonBits10(x) | (SpreadMortonBits10(y) << 1) | (SpreadMortonBits10(z) << 2);
+}
+
+// Interleaves 21 bits per axis, x ends up in the lowest bit
+inline uint64_t EncodeMorton63(uint32_t x, uint32_t y, uint32_t z)
+{
+	return SpreadMortonBits21(x) | (SpreadMortonBits21(y) << 1) | (SpreadMortonBits21(z) << 2);
+}
+
+// Cube around a set of positions, every code width splits it into equal cells per axis
+struct MortonBounds
+{
+	DirectX::XMFLOAT3 origin;
+	float extent;
+};
+
+MortonBounds ComputeMortonBounds(const DirectX::XMFLOAT3* positions, int numPositions);
+// 1024 cells per axis
+void ComputeMortonCodes(const DirectX::XMFLOAT3* positions, int numPositions, const MortonBounds& bounds, std::vector<uint32_t>& codes);
+// 2^21 cells per axis
+void ComputeMortonCodes(const DirectX::XMFLOAT3* positions, int numPositions, const MortonBounds& bounds, std::vector<uint64_t>& codes);
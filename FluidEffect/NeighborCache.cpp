@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cmath>
+#include "NeighborCache.h"
+#include "JobSystem.h"
+#include "EngineStats.h"
+#include "Profiler.h"
+
+namespace
+{
+	float GetDistanceSq(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		float dx = a.x - b.x;
+		float dy = a.y - b.y;
+		float dz = a.z - b.z;
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	// Twice the room needed and at least 256, so particle counts going up and down settle without reallocating
+	template <typename T>
+	void Reserve(std::vector<T>& values, size_t size)
+	{
+		if (values.capacity() < size)
+			values.reserve(std::max<size_t>(2 * size, 256));
+	}
+}
+
+NeighborCache::NeighborCache()
+{
+	m_settings.radius = 2.5f;
+	m_settings.skin = 0.5f;
+	m_settings.maxNeighbors = 32;
+	m_drift = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	m_minBuildId = 0;
+	m_wasRebuilt = false;
+	m_numRebuilds = 0;
+	m_isDirect = false;
+	m_isModeChanged = false;
+	m_isProbing = false;
+	m_probeInterval = PROBE_INTERVAL;
+	m_windowsSinceProbe = 0;
+	m_modeCosts[0] = -1.0;
+	m_modeCosts[1] = -1.0;
+	m_windowEvals = 0;
+	m_windowParticles = 0;
+	m_numWindowUpdates = 0;
+}
+
+void NeighborCache::Update(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<uint32_t>& ids)
+{
+	PROFILE_SCOPE("NeighborCacheUpdate");
+	ChooseMode();
+
+	int numParticles = static_cast<int>(positions.size());
+	Reserve(m_positions, numParticles);
+	Reserve(m_buildOfCurrent, numParticles);
+	m_positions = positions;
+	m_wasRebuilt = false;
+
+	m_buildOfCurrent.resize(numParticles);
+	m_currentOfBuild.assign(m_buildPositions.size(), -1);
+	m_births.clear();
+
+	DirectX::XMFLOAT3 drift = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < numParticles; i++)
+	{
+		int build = FindBuildIndex(ids[i]);
+		m_buildOfCurrent[i] = build;
+		if (build < 0)
+		{
+			m_births.push_back(i);
+			continue;
+		}
+
+		m_currentOfBuild[build] = i;
+		drift.x += positions[i].x - m_buildPositions[build].x;
+		drift.y += positions[i].y - m_buildPositions[build].y;
+		drift.z += positions[i].z - m_buildPositions[build].z;
+	}
+
+	// Only relative movement changes who is near whom, so the movement all particles share is taken out
+	int numTracked = numParticles - static_cast<int>(m_births.size());
+	float invTracked = numTracked > 0 ? 1.0f / numTracked : 0.0f;
+	m_drift = DirectX::XMFLOAT3(drift.x * invTracked, drift.y * invTracked, drift.z * invTracked);
+
+	float maxMoveSq = 0.25f * GetSkin() * GetSkin();
+	bool needsRebuild = numParticles > 0 && (m_buildPositions.empty() || m_isDirect || m_isModeChanged);
+	for (int i = 0; i < numParticles && !needsRebuild; i++)
+	{
+		int build = m_buildOfCurrent[i];
+		if (build < 0)
+			continue;
+
+		DirectX::XMFLOAT3 shifted(m_buildPositions[build].x + m_drift.x, m_buildPositions[build].y + m_drift.y, m_buildPositions[build].z + m_drift.z);
+		needsRebuild = GetDistanceSq(positions[i], shifted) > maxMoveSq;
+	}
+
+	// New particles are checked by every query, so only a few of them may pile up
+	int maxPendingBirths = std::min(static_cast<int>(MAX_PENDING_BIRTHS), numParticles / 8 + 1);
+	uint64_t numRebuildEvals = 0;
+	if (needsRebuild || static_cast<int>(m_births.size()) > maxPendingBirths)
+	{
+		Rebuild(ids);
+		for (uint64_t chunkEvals : m_chunkEvals)
+			numRebuildEvals += chunkEvals;
+	}
+
+	// Queries evaluate their candidates and the births since the rebuild
+	m_windowEvals += numRebuildEvals + m_candidates.size() + static_cast<uint64_t>(numParticles) * m_births.size();
+	m_windowParticles += numParticles;
+	m_numWindowUpdates++;
+
+	int other = m_isDirect ? 0 : 1;
+	if (m_isProbing && m_numWindowUpdates >= COST_WINDOW / 4 && m_windowEvals > m_modeCosts[other] * m_windowParticles)
+		m_numWindowUpdates = COST_WINDOW;
+}
+
+void NeighborCache::ChooseMode()
+{
+	m_isModeChanged = false;
+	if (m_numWindowUpdates < COST_WINDOW)
+		return;
+
+	int mode = m_isDirect ? 1 : 0;
+	m_modeCosts[mode] = m_windowParticles > 0 ? static_cast<double>(m_windowEvals) / m_windowParticles : 0.0;
+	m_windowEvals = 0;
+	m_windowParticles = 0;
+	m_numWindowUpdates = 0;
+
+	int other = 1 - mode;
+	if (m_isProbing)
+	{
+		bool hasLost = m_modeCosts[mode] >= m_modeCosts[other];
+		m_probeInterval = hasLost ? std::min(2 * m_probeInterval, static_cast<int>(MAX_PROBE_INTERVAL)) : PROBE_INTERVAL;
+		m_windowsSinceProbe = 0;
+	}
+	else
+	{
+		m_windowsSinceProbe++;
+	}
+
+	m_isProbing = m_modeCosts[other] < 0.0 || m_windowsSinceProbe >= m_probeInterval;
+	bool isDirect = m_isProbing ? other == 1 : m_modeCosts[1] < m_modeCosts[0];
+	m_isModeChanged = isDirect != m_isDirect;
+	m_isDirect = isDirect;
+}
+
+int NeighborCache::FindNearest(int particle, int maxNeighbors, int* neighbors, uint64_t& numDistanceEvals) const
+{
+	maxNeighbors = std::min(maxNeighbors, std::min(m_settings.maxNeighbors, static_cast<int>(MAX_NEIGHBORS)));
+	if (maxNeighbors <= 0)
+		return 0;
+
+	const DirectX::XMFLOAT3& position = m_positions[particle];
+	float radiusSq = m_settings.radius * m_settings.radius;
+	float distancesSq[MAX_NEIGHBORS];
+	int numFound = 0;
+
+	// Insertion into the sorted result, candidate lists are short
+	auto consider = [&](int other)
+	{
+		if (other < 0 || other == particle)
+			return;
+
+		numDistanceEvals++;
+		float distanceSq = GetDistanceSq(m_positions[other], position);
+		if (distanceSq > radiusSq || (numFound == maxNeighbors && distanceSq >= distancesSq[numFound - 1]))
+			return;
+
+		int k = numFound < maxNeighbors ? numFound++ : numFound - 1;
+		while (k > 0 && distancesSq[k - 1] > distanceSq)
+		{
+			distancesSq[k] = distancesSq[k - 1];
+			neighbors[k] = neighbors[k - 1];
+			k--;
+		}
+		distancesSq[k] = distanceSq;
+		neighbors[k] = other;
+	};
+
+	int build = m_buildOfCurrent[particle];
+	int numDead = 0;
+	if (build >= 0)
+	{
+		for (int i = m_candidateStart[build]; i < m_candidateStart[build + 1]; i++)
+		{
+			int other = m_currentOfBuild[m_candidates[i]];
+			numDead += other < 0 ? 1 : 0;
+			consider(other);
+		}
+	}
+
+	if (build < 0 || numDead > DEATH_MARGIN)
+	{
+		numFound = 0;
+
+		// Born after the last rebuild or too many candidates died: nobody moved more than half the
+		// skin against the drift and the grid cells are radius + skin wide
+		DirectX::XMFLOAT3 buildSpacePosition(position.x - m_drift.x, position.y - m_drift.y, position.z - m_drift.z);
+		m_grid.ForEachCandidate(buildSpacePosition, [&](int candidate)
+		{
+			consider(m_currentOfBuild[candidate]);
+		});
+	}
+
+	for (int birth : m_births)
+		consider(birth);
+
+	return numFound;
+}
+
+void NeighborCache::Rebuild(const std::vector<uint32_t>& ids)
+{
+	PROFILE_SCOPE("NeighborCacheRebuild");
+
+	// Candidates per particle of the last rebuild, so the chunks can make room up front
+	size_t candidatesPerParticle = m_buildPositions.empty() ? 0 : m_candidates.size() / m_buildPositions.size() + 1;
+
+	int numParticles = static_cast<int>(m_positions.size());
+	Reserve(m_buildPositions, numParticles);
+	Reserve(m_currentOfBuild, numParticles);
+	Reserve(m_candidateStart, numParticles + 1);
+	m_buildPositions = m_positions;
+	m_buildOfCurrent.resize(numParticles);
+	m_currentOfBuild.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		m_buildOfCurrent[i] = i;
+		m_currentOfBuild[i] = i;
+	}
+	m_births.clear();
+	m_drift = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	// Ids come from the emission counter, so the live ones usually form a dense range
+	m_buildIndexOfId.clear();
+	if (numParticles > 0)
+	{
+		uint32_t minId = *std::min_element(ids.begin(), ids.end());
+		uint32_t maxId = *std::max_element(ids.begin(), ids.end());
+		if (maxId - minId < 4u * numParticles + 1024u)
+		{
+			m_minBuildId = minId;
+			Reserve(m_buildIndexOfId, maxId - minId + 1);
+			m_buildIndexOfId.assign(maxId - minId + 1, -1);
+			for (int i = 0; i < numParticles; i++)
+				m_buildIndexOfId[ids[i] - minId] = i;
+		}
+	}
+
+	m_grid.Build(m_buildPositions.data(), numParticles, m_settings.radius + GetSkin());
+	m_fineGrid.Build(m_buildPositions.data(), numParticles, 0.5f * (m_settings.radius + GetSkin()));
+
+	// Chunks collect their lists separately and are appended in order, independent of the thread count
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	m_chunkCandidates.resize(jobSystem.GetNumThreads());
+	m_chunkEvals.assign(jobSystem.GetNumThreads(), 0);
+	m_candidateStart.assign(numParticles + 1, 0);
+	jobSystem.ParallelFor(numParticles, [&](int begin, int end, int chunk)
+	{
+		std::vector<int>& chunkCandidates = m_chunkCandidates[chunk];
+		chunkCandidates.clear();
+		Reserve(chunkCandidates, (end - begin) * candidatesPerParticle);
+		FrameArena::Scope scope;
+		FrameVector<int> candidates;
+		FrameVector<float> distancesSq;
+		FrameVector<float> sortedSq;
+		uint64_t numEvals = 0;
+		for (int i = begin; i < end; i++)
+		{
+			FindCandidates(i, candidates, distancesSq, sortedSq, numEvals);
+			chunkCandidates.insert(chunkCandidates.end(), candidates.begin(), candidates.end());
+			m_candidateStart[i + 1] = static_cast<int>(candidates.size());
+		}
+		m_chunkEvals[chunk] = numEvals;
+	}, 128);
+
+	for (int i = 0; i < numParticles; i++)
+		m_candidateStart[i + 1] += m_candidateStart[i];
+
+	m_candidates.clear();
+	Reserve(m_candidates, m_candidateStart[numParticles]);
+	int numChunks = JobSystem::GetChunkCount(numParticles, jobSystem.GetNumThreads(), 128);
+	for (int chunk = 0; chunk < numChunks; chunk++)
+		m_candidates.insert(m_candidates.end(), m_chunkCandidates[chunk].begin(), m_chunkCandidates[chunk].end());
+
+	m_wasRebuilt = true;
+	m_numRebuilds++;
+	EngineStats::GetInstance().Add(STAT_NEIGHBOR_REBUILDS, 1);
+}
+
+void NeighborCache::FindCandidates(int particle, FrameVector<int>& candidates, FrameVector<float>& distancesSq, FrameVector<float>& sortedSq, uint64_t& numEvals) const
+{
+	float skin = GetSkin();
+	// While everybody stays within half the skin and at most DEATH_MARGIN of them die, the current
+	// k nearest are at most the (k + DEATH_MARGIN)-th nearest distance + skin away, and were at most
+	// that + skin away at the rebuild
+	int k = std::min(m_settings.maxNeighbors, static_cast<int>(MAX_NEIGHBORS)) + DEATH_MARGIN;
+	const DirectX::XMFLOAT3& position = m_buildPositions[particle];
+
+	// The fine grid is enough if the kept radius stays within its cells, otherwise the full radius is searched
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const NeighborGrid& grid = pass == 0 ? m_fineGrid : m_grid;
+		float searchRadius = pass == 0 ? m_fineGrid.GetCellSize() : m_settings.radius + skin;
+		float searchRadiusSq = searchRadius * searchRadius;
+		candidates.clear();
+		distancesSq.clear();
+		grid.ForEachCandidate(position, [&](int other)
+		{
+			numEvals++;
+			float distanceSq = GetDistanceSq(m_buildPositions[other], position);
+			if (other != particle && distanceSq <= searchRadiusSq)
+			{
+				candidates.push_back(other);
+				distancesSq.push_back(distanceSq);
+			}
+		});
+
+		if (static_cast<int>(candidates.size()) < k)
+			continue;
+
+		sortedSq = distancesSq;
+		std::nth_element(sortedSq.begin(), sortedSq.begin() + (k - 1), sortedSq.end());
+		float keepRadius = std::min(m_settings.radius, std::sqrt(sortedSq[k - 1]) + skin) + skin;
+		if (keepRadius > searchRadius)
+			continue;
+
+		float keepRadiusSq = keepRadius * keepRadius;
+		int numKept = 0;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			if (distancesSq[i] <= keepRadiusSq)
+				candidates[numKept++] = candidates[i];
+		}
+		candidates.resize(numKept);
+		return;
+	}
+}
+
+int NeighborCache::FindBuildIndex(uint32_t id) const
+{
+	uint32_t offset = id - m_minBuildId;
+	return offset < m_buildIndexOfId.size() ? m_buildIndexOfId[offset] : -1;
+}
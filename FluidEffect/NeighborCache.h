@@ -0,0 +1,90 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "FrameArena.h"
+#include "NeighborGrid.h"
+
+struct NeighborCacheSettings
+{
+	float radius;			// Particles further away are no neighbors
+	float skin;				// Extra search distance, the cached lists stay valid until particles moved half of it
+	int maxNeighbors;		// Most neighbors a query asks for, at most MAX_NEIGHBORS
+};
+
+// Verlet lists for the nearest particle queries of the goo shader. Every particle caches the
+// candidates that can become one of its nearest neighbors before any particle moved half the skin
+// relative to the common drift of all particles, queries only re-rank them with the current
+// positions. Particles are tracked by id, a list only falls back to the grid once more than
+// DEATH_MARGIN of its candidates died. Particles born since the last rebuild are checked by every
+// query until an eighth of the particles (at most MAX_PENDING_BIRTHS) are new.
+// When particles move so fast that the lists are rebuilt on most frames, long candidate lists cost
+// more than they save. The cache counts its distance evaluations per particle over windows of
+// COST_WINDOW updates, with the skin and in direct mode, which rebuilds every update without a skin
+// and so is a plain grid query per particle. It keeps the cheaper one and measures the other again
+// after PROBE_INTERVAL windows, waiting twice as long after each probe that lost (at most
+// MAX_PROBE_INTERVAL windows). A probe ends early once it has cost more than the other mode.
+class NeighborCache
+{
+public:
+	static const int MAX_NEIGHBORS = 64;
+	static const int MAX_PENDING_BIRTHS = 64;
+	static const int DEATH_MARGIN = 8;
+	static const int COST_WINDOW = 32;
+	static const int PROBE_INTERVAL = 4;
+	static const int MAX_PROBE_INTERVAL = 64;
+
+	NeighborCache();
+
+	// ids have to be unique among the current particles
+	void Update(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<uint32_t>& ids);
+
+	// Writes the indices of the up to maxNeighbors nearest other particles within the radius, nearest first
+	int FindNearest(int particle, int maxNeighbors, int* neighbors, uint64_t& numDistanceEvals) const;
+
+	bool WasRebuilt() const { return m_wasRebuilt; }
+	int GetNumRebuilds() const { return m_numRebuilds; }
+	int GetNumCandidates() const { return static_cast<int>(m_candidates.size()); }
+	bool IsDirect() const { return m_isDirect; }
+
+	NeighborCacheSettings m_settings;
+
+private:
+	void Rebuild(const std::vector<uint32_t>& ids);
+	// The vectors are scratch of the calling chunk, numEvals counts the distances computed
+	void FindCandidates(int particle, FrameVector<int>& candidates, FrameVector<float>& distancesSq, FrameVector<float>& sortedSq, uint64_t& numEvals) const;
+	int FindBuildIndex(uint32_t id) const;
+	float GetSkin() const { return m_isDirect ? 0.0f : m_settings.skin; }
+	// Ends a cost window after COST_WINDOW updates and picks the mode of the next one
+	void ChooseMode();
+
+	std::vector<DirectX::XMFLOAT3> m_positions;
+	std::vector<int> m_buildOfCurrent;
+	std::vector<int> m_currentOfBuild;
+	std::vector<int> m_births;
+	DirectX::XMFLOAT3 m_drift;		// Average movement since the last rebuild
+
+	std::vector<DirectX::XMFLOAT3> m_buildPositions;
+	NeighborGrid m_grid;
+	NeighborGrid m_fineGrid;		// Half the cell size, enough for the lists in dense regions
+	std::vector<int> m_candidateStart;
+	std::vector<int> m_candidates;
+	std::vector<std::vector<int>> m_chunkCandidates;
+	// Build index of every id in [m_minBuildId, m_minBuildId + size), empty if the ids are too spread out
+	uint32_t m_minBuildId;
+	std::vector<int> m_buildIndexOfId;
+
+	bool m_wasRebuilt;
+	int m_numRebuilds;
+
+	bool m_isDirect;
+	bool m_isModeChanged;
+	bool m_isProbing;
+	int m_probeInterval;
+	int m_windowsSinceProbe;
+	double m_modeCosts[2];		// Distance evaluations per particle and update with the skin and direct, negative until measured
+	std::vector<uint64_t> m_chunkEvals;
+	uint64_t m_windowEvals;
+	uint64_t m_windowParticles;
+	int m_numWindowUpdates;
+};
@@ -0,0 +1,47 @@
+#include "NeighborGrid.h"
+#include "JobSystem.h"
+
+NeighborGrid::NeighborGrid()
+{
+	m_cellSize = 1.0f;
+	m_invCellSize = 1.0f;
+	m_tableMask = 0;
+}
+
+void NeighborGrid::Build(const DirectX::XMFLOAT3* positions, int numPositions, float cellSize)
+{
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / cellSize;
+
+	// Twice as many buckets as particles keeps collisions rare
+	uint32_t tableSize = 1;
+	while (tableSize < static_cast<uint32_t>(numPositions) * 2)
+		tableSize <<= 1;
+	m_tableMask = tableSize - 1;
+
+	m_particleHashes.resize(numPositions);
+	m_sortedIndices.resize(numPositions);
+	m_bucketStart.assign(tableSize + 1, 0);
+
+	JobSystem::GetInstance().ParallelFor(numPositions, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			int x = static_cast<int>(std::floor(positions[i].x * m_invCellSize));
+			int y = static_cast<int>(std::floor(positions[i].y * m_invCellSize));
+			int z = static_cast<int>(std::floor(positions[i].z * m_invCellSize));
+			m_particleHashes[i] = GetCellHash(x, y, z);
+		}
+	}, 4096);
+
+	// Stable counting sort by bucket
+	for (int i = 0; i < numPositions; i++)
+		m_bucketStart[m_particleHashes[i] + 1]++;
+
+	for (uint32_t i = 0; i < tableSize; i++)
+		m_bucketStart[i + 1] += m_bucketStart[i];
+
+	m_writeOffsets.assign(m_bucketStart.begin(), m_bucketStart.end() - 1);
+	for (int i = 0; i < numPositions; i++)
+		m_sortedIndices[m_writeOffsets[m_particleHashes[i]]++] = i;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Spatially hashed uniform grid. Particles are counting-sorted by cell hash, so every hash bucket
+// is a contiguous run of particle indices in ascending order and queries are deterministic.
+class NeighborGrid
+{
+public:
+	NeighborGrid();
+
+	void Build(const DirectX::XMFLOAT3* positions, int numPositions, float cellSize);
+
+	// Calls visit(index) for every particle in the 27 cells around position. Buckets can hold
+	// particles of colliding cells, so callers still have to test the distance.
+	template <typename Visitor>
+	void ForEachCandidate(const DirectX::XMFLOAT3& position, Visitor visit) const;
+
+	float GetCellSize() const { return m_cellSize; }
+	const std::vector<int>& GetSortedIndices() const { return m_sortedIndices; }
+
+private:
+	uint32_t GetCellHash(int x, int y, int z) const;
+
+	float m_cellSize;
+	float m_invCellSize;
+	uint32_t m_tableMask;
+	std::vector<uint32_t> m_particleHashes;
+	std::vector<uint32_t> m_bucketStart;
+	std::vector<int> m_sortedIndices;
+	std::vector<uint32_t> m_writeOffsets;
+};
+
+inline uint32_t NeighborGrid::GetCellHash(int x, int y, int z) const
+{
+	uint32_t hash = (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u) ^ (static_cast<uint32_t>(z) * 83492791u);
+	return hash & m_tableMask;
+}
+
+template <typename Visitor>
+void NeighborGrid::ForEachCandidate(const DirectX::XMFLOAT3& position, Visitor visit) const
+{
+	if (m_sortedIndices.empty())
+		return;
+
+	int cellX = static_cast<int>(std::floor(position.x * m_invCellSize));
+	int cellY = static_cast<int>(std::floor(position.y * m_invCellSize));
+	int cellZ = static_cast<int>(std::floor(position.z * m_invCellSize));
+
+	uint32_t visited[27];
+	int numVisited = 0;
+
+	for (int z = cellZ - 1; z <= cellZ + 1; z++)
+	{
+		for (int y = cellY - 1; y <= cellY + 1; y++)
+		{
+			for (int x = cellX - 1; x <= cellX + 1; x++)
+			{
+				uint32_t hash = GetCellHash(x, y, z);
+
+				bool alreadyVisited = false;
+				for (int i = 0; i < numVisited; i++)
+					alreadyVisited = alreadyVisited || visited[i] == hash;
+
+				if (alreadyVisited)
+					continue;
+
+				visited[numVisited++] = hash;
+
+				for (uint32_t i = m_bucketStart[hash]; i < m_bucketStart[hash + 1]; i++)
+					visit(m_sortedIndices[i]);
+			}
+		}
+	}
+}
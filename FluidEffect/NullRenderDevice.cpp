@@ -0,0 +1,202 @@
+#include <cstring>
+#include "NullRenderDevice.h"
+
+class NullRenderBuffer : public RenderBuffer
+{
+public:
+	NullRenderBuffer(NullRenderDevice* device, const RenderBufferDesc& desc, uint32_t id) : RenderBuffer(desc), m_device(device), m_id(id), m_data(desc.byteWidth)
+	{
+		m_device->m_numLiveBuffers++;
+		m_device->m_numLiveBufferBytes += desc.byteWidth;
+	}
+
+	void Release() override
+	{
+		m_device->m_numLiveBuffers--;
+		m_device->m_numLiveBufferBytes -= m_desc.byteWidth;
+		delete this;
+	}
+
+	NullRenderDevice* m_device;
+	uint32_t m_id;
+	std::vector<uint8_t> m_data;
+};
+
+class NullShaderProgram : public RenderShaderProgram
+{
+public:
+	NullShaderProgram(NullRenderDevice* device, uint32_t id) : m_device(device), m_id(id)
+	{
+		m_device->m_numLivePrograms++;
+	}
+
+	void Release() override
+	{
+		m_device->m_numLivePrograms--;
+		delete this;
+	}
+
+	NullRenderDevice* m_device;
+	uint32_t m_id;
+};
+
+namespace
+{
+	uint32_t GetId(RenderBuffer* buffer)
+	{
+		return buffer ? static_cast<NullRenderBuffer*>(buffer)->m_id : 0;
+	}
+}
+
+NullRenderDevice::NullRenderDevice()
+{
+	m_isRecording = false;
+	m_frameStats = RenderFrameStats();
+	m_lastFrameStats = RenderFrameStats();
+	m_numFrames = 0;
+	m_nextResourceId = 1;
+	m_numLiveBuffers = 0;
+	m_numLiveBufferBytes = 0;
+	m_numLivePrograms = 0;
+	m_numBytesCreated = 0;
+}
+
+NullRenderDevice::~NullRenderDevice()
+{
+}
+
+HRESULT NullRenderDevice::CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer)
+{
+	NullRenderBuffer* nullBuffer = new NullRenderBuffer(this, desc, m_nextResourceId++);
+	if (initialData)
+		std::memcpy(nullBuffer->m_data.data(), initialData, desc.byteWidth);
+
+	m_numBytesCreated += desc.byteWidth;
+	*buffer = nullBuffer;
+	return S_OK;
+}
+
+HRESULT NullRenderDevice::CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program)
+{
+	*program = new NullShaderProgram(this, m_nextResourceId++);
+	return S_OK;
+}
+
+void* NullRenderDevice::Map(RenderBuffer* buffer)
+{
+	if (!buffer || !buffer->GetDesc().isDynamic)
+		return nullptr;
+
+	NullRenderBuffer* nullBuffer = static_cast<NullRenderBuffer*>(buffer);
+	Record(RENDER_COMMAND_MAP, nullBuffer->m_id, 0, 0, buffer->GetDesc().byteWidth, 0);
+	m_frameStats.numBytesMapped += buffer->GetDesc().byteWidth;
+	return nullBuffer->m_data.data();
+}
+
+void NullRenderDevice::Unmap(RenderBuffer* buffer)
+{
+}
+
+void NullRenderDevice::SetShaderProgram(RenderShaderProgram* program)
+{
+	Record(RENDER_COMMAND_SET_SHADER_PROGRAM, program ? static_cast<NullShaderProgram*>(program)->m_id : 0, 0, 0, 0, 0);
+}
+
+void NullRenderDevice::SetVertexBuffer(RenderBuffer* buffer, UINT stride)
+{
+	Record(RENDER_COMMAND_SET_VERTEX_BUFFER, GetId(buffer), 0, 0, stride, 0);
+}
+
+void NullRenderDevice::SetIndexBuffer(RenderBuffer* buffer)
+{
+	Record(RENDER_COMMAND_SET_INDEX_BUFFER, GetId(buffer), 0, 0, 0, 0);
+}
+
+void NullRenderDevice::SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	Record(RENDER_COMMAND_SET_CONSTANT_BUFFER, GetId(buffer), stage, slot, 0, 0);
+}
+
+void NullRenderDevice::SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	Record(RENDER_COMMAND_SET_SHADER_RESOURCE, GetId(buffer), stage, slot, 0, 0);
+}
+
+void NullRenderDevice::SetTopology(RenderTopology topology)
+{
+	Record(RENDER_COMMAND_SET_TOPOLOGY, 0, topology, 0, 0, 0);
+}
+
+void NullRenderDevice::Draw(UINT numVertices, UINT firstVertex)
+{
+	Record(RENDER_COMMAND_DRAW, 0, 0, 0, numVertices, firstVertex);
+	m_frameStats.numVertices += numVertices;
+}
+
+void NullRenderDevice::DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex)
+{
+	Record(RENDER_COMMAND_DRAW_INDEXED, 0, 0, 0, numIndices, firstIndex);
+	m_frameStats.numVertices += numIndices;
+}
+
+void NullRenderDevice::DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex)
+{
+	Record(RENDER_COMMAND_DRAW_INDEXED_INSTANCED, 0, 0, 0, numIndices, firstIndex, numInstances);
+	m_frameStats.numVertices += static_cast<uint64_t>(numIndices) * numInstances;
+}
+
+void NullRenderDevice::Clear(const float color[4])
+{
+	Record(RENDER_COMMAND_CLEAR, 0, 0, 0, 0, 0);
+}
+
+HRESULT NullRenderDevice::Present()
+{
+	m_lastFrameStats = m_frameStats;
+	m_frameStats = RenderFrameStats();
+	m_lastFrameCommands.swap(m_commands);
+	m_commands.clear();
+	m_numFrames++;
+	return S_OK;
+}
+
+uint8_t* NullRenderDevice::GetBufferData(RenderBuffer* buffer)
+{
+	return buffer ? static_cast<NullRenderBuffer*>(buffer)->m_data.data() : nullptr;
+}
+
+const char* NullRenderDevice::GetCommandName(RenderCommandType type)
+{
+	switch (type)
+	{
+	case RENDER_COMMAND_MAP: return "map";
+	case RENDER_COMMAND_SET_SHADER_PROGRAM: return "setShaderProgram";
+	case RENDER_COMMAND_SET_VERTEX_BUFFER: return "setVertexBuffer";
+	case RENDER_COMMAND_SET_INDEX_BUFFER: return "setIndexBuffer";
+	case RENDER_COMMAND_SET_CONSTANT_BUFFER: return "setConstantBuffer";
+	case RENDER_COMMAND_SET_SHADER_RESOURCE: return "setShaderResource";
+	case RENDER_COMMAND_SET_TOPOLOGY: return "setTopology";
+	case RENDER_COMMAND_DRAW: return "draw";
+	case RENDER_COMMAND_DRAW_INDEXED: return "drawIndexed";
+	case RENDER_COMMAND_DRAW_INDEXED_INSTANCED: return "drawIndexedInstanced";
+	case RENDER_COMMAND_CLEAR: return "clear";
+	default: return "unknown";
+	}
+}
+
+void NullRenderDevice::Record(RenderCommandType type, uint32_t resource, uint32_t stage, uint32_t slot, uint32_t count, uint32_t first, uint32_t numInstances)
+{
+	m_frameStats.numCommands[type]++;
+	if (!m_isRecording)
+		return;
+
+	RenderCommand command;
+	command.type = type;
+	command.resource = resource;
+	command.stage = stage;
+	command.slot = slot;
+	command.count = count;
+	command.first = first;
+	command.numInstances = numInstances;
+	m_commands.push_back(command);
+}
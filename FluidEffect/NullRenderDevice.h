@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "RenderDevice.h"
+
+enum RenderCommandType
+{
+	RENDER_COMMAND_MAP,
+	RENDER_COMMAND_SET_SHADER_PROGRAM,
+	RENDER_COMMAND_SET_VERTEX_BUFFER,
+	RENDER_COMMAND_SET_INDEX_BUFFER,
+	RENDER_COMMAND_SET_CONSTANT_BUFFER,
+	RENDER_COMMAND_SET_SHADER_RESOURCE,
+	RENDER_COMMAND_SET_TOPOLOGY,
+	RENDER_COMMAND_DRAW,
+	RENDER_COMMAND_DRAW_INDEXED,
+	RENDER_COMMAND_DRAW_INDEXED_INSTANCED,
+	RENDER_COMMAND_CLEAR,
+	RENDER_COMMAND_COUNT
+};
+
+// Resources are numbered from 1 in creation order, 0 is none
+struct RenderCommand
+{
+	RenderCommandType type;
+	uint32_t resource;
+	uint32_t stage;		// Stage and slot of bindings, topology of SET_TOPOLOGY
+	uint32_t slot;
+	uint32_t count;		// Vertices or indices of draws, bytes of maps
+	uint32_t first;
+	uint32_t numInstances;	// 1 except for instanced draws
+};
+
+struct RenderFrameStats
+{
+	uint64_t numCommands[RENDER_COMMAND_COUNT];
+	uint64_t numVertices;		// Drawn vertices and indices of all instances
+	uint64_t numBytesMapped;
+};
+
+// Records commands and byte counts instead of drawing. Buffers get real memory, so mapping and
+// writing them costs what it costs the renderer on the CPU side.
+class NullRenderDevice : public RenderDevice
+{
+public:
+	NullRenderDevice();
+	~NullRenderDevice();
+
+	HRESULT CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) override;
+	HRESULT CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program) override;
+
+	void* Map(RenderBuffer* buffer) override;
+	void Unmap(RenderBuffer* buffer) override;
+
+	void SetShaderProgram(RenderShaderProgram* program) override;
+	void SetVertexBuffer(RenderBuffer* buffer, UINT stride) override;
+	void SetIndexBuffer(RenderBuffer* buffer) override;
+	void SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetTopology(RenderTopology topology) override;
+	void Draw(UINT numVertices, UINT firstVertex) override;
+	void DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex) override;
+
+	void Clear(const float color[4]) override;
+	// Ends the frame, its commands and stats move to the last frame
+	HRESULT Present() override;
+
+	// Off by default, the stats are counted either way
+	void SetRecording(bool isRecording) { m_isRecording = isRecording; }
+	const std::vector<RenderCommand>& GetCommands() const { return m_commands; }
+	const std::vector<RenderCommand>& GetLastFrameCommands() const { return m_lastFrameCommands; }
+	const RenderFrameStats& GetFrameStats() const { return m_frameStats; }
+	const RenderFrameStats& GetLastFrameStats() const { return m_lastFrameStats; }
+
+	uint64_t GetNumFrames() const { return m_numFrames; }
+	// Resources created and not released yet, with the bytes of the buffers
+	int GetNumLiveBuffers() const { return m_numLiveBuffers; }
+	uint64_t GetNumLiveBufferBytes() const { return m_numLiveBufferBytes; }
+	int GetNumLivePrograms() const { return m_numLivePrograms; }
+	uint64_t GetNumBytesCreated() const { return m_numBytesCreated; }
+
+	static const char* GetCommandName(RenderCommandType type);
+
+protected:
+	// Memory behind a buffer of this device, for backends that read what was drawn
+	static uint8_t* GetBufferData(RenderBuffer* buffer);
+
+private:
+	friend class NullRenderBuffer;
+	friend class NullShaderProgram;
+
+	void Record(RenderCommandType type, uint32_t resource, uint32_t stage, uint32_t slot, uint32_t count, uint32_t first, uint32_t numInstances = 1);
+
+	bool m_isRecording;
+	std::vector<RenderCommand> m_commands;
+	std::vector<RenderCommand> m_lastFrameCommands;
+	RenderFrameStats m_frameStats;
+	RenderFrameStats m_lastFrameStats;
+	uint64_t m_numFrames;
+
+	// Resources are also created by loading jobs
+	std::atomic<uint32_t> m_nextResourceId;
+	std::atomic<int> m_numLiveBuffers;
+	std::atomic<uint64_t> m_numLiveBufferBytes;
+	std::atomic<int> m_numLivePrograms;
+	std::atomic<uint64_t> m_numBytesCreated;
+};
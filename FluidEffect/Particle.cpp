@@ -1,49 +1,39 @@
+#include <cstring>
 #include <iostream>
 #include "Particle.h"
-#include "ConstantBuffer.h"
+#include "Profiler.h"
+#include "EngineStats.h"
 #include "Vertex.h"
 #include "RandomValues.h"
 
-Particle::Particle(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+Particle::Particle(RenderDevice* device)
 {
 	m_position = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
 	m_velocity = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
 	m_timeToLive = 1.0f;
+	m_id = 0;
 	m_nearbyParticles = NearbyParticleConstantBuffer();
+	m_vertexBuffer = nullptr;
+	m_constantBuffer = nullptr;
+	m_nearbyParticleBuffer = nullptr;
+
+	// Without a device the particle is simulation-only (used by the benchmarks)
+	if (!device)
+		return;
 
-	D3D11_BUFFER_DESC vertexBufferDesc;
-	ZeroMemory(&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(Vertex);
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	
 	DirectX::XMFLOAT3 vertexColor = { 0.0f, 0.3f, 1.0f };
 	DirectX::XMFLOAT3 vertexPosition = { 0.0f, 0.0f, 0.0f };
 
 	Vertex vertexData(vertexPosition, vertexColor);
-	D3D11_SUBRESOURCE_DATA vertexBufferData = {};
-	vertexBufferData.pSysMem = &vertexData;
-	device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_vertexBuffer);
-
-	D3D11_BUFFER_DESC constantBufferDesc;
-	ZeroMemory(&constantBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	constantBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	constantBufferDesc.ByteWidth = sizeof(ConstantBuffer);
-	constantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	constantBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	constantBufferDesc.MiscFlags = 0;
-	constantBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&constantBufferDesc, NULL, &m_constantBuffer);
-
-	D3D11_BUFFER_DESC nearbyParticleBufferDesc;
-	ZeroMemory(&nearbyParticleBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	nearbyParticleBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	nearbyParticleBufferDesc.ByteWidth = sizeof(NearbyParticleConstantBuffer);
-	nearbyParticleBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	nearbyParticleBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	nearbyParticleBufferDesc.MiscFlags = 0;
-	nearbyParticleBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&nearbyParticleBufferDesc, NULL, &m_nearbyParticleBuffer);
+	RenderBufferDesc vertexBufferDesc = { RENDER_BUFFER_VERTEX, sizeof(Vertex), 0, false };
+	device->CreateBuffer(vertexBufferDesc, &vertexData, &m_vertexBuffer);
+	EngineStats::GetInstance().Add(STAT_BYTES_UPLOADED, sizeof(Vertex));
+
+	RenderBufferDesc constantBufferDesc = { RENDER_BUFFER_CONSTANT, sizeof(ConstantBuffer), 0, true };
+	device->CreateBuffer(constantBufferDesc, nullptr, &m_constantBuffer);
+
+	RenderBufferDesc nearbyParticleBufferDesc = { RENDER_BUFFER_CONSTANT, sizeof(NearbyParticleConstantBuffer), 0, true };
+	device->CreateBuffer(nearbyParticleBufferDesc, nullptr, &m_nearbyParticleBuffer);
 }
 
 Particle::~Particle()
@@ -67,44 +57,27 @@ Particle::~Particle()
 	}
 }
 
-HRESULT Particle::Render(ID3D11DeviceContext* deviceContext, const Camera& camera)
+HRESULT Particle::Submit(RenderQueue& queue, RenderShaderProgram* program, float depth)
 {
-	DirectX::XMMATRIX worldMatrix = DirectX::XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
-	
-	D3D11_MAPPED_SUBRESOURCE constantBufferSR;
-	if (SUCCEEDED(deviceContext->Map(m_constantBuffer, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &constantBufferSR)))
-	{
-		ConstantBuffer constantBuffer;
-		constantBuffer.world = worldMatrix;
-		constantBuffer.view = camera.GetViewMatrix();
-		constantBuffer.projection = camera.GetProjectionMatrix();
-		constantBuffer.worldView = constantBuffer.world * constantBuffer.view;
-		constantBuffer.worldViewProj = constantBuffer.worldView * constantBuffer.projection;
-		constantBuffer.inverseWorld = DirectX::XMMatrixInverse(nullptr, constantBuffer.world);
-		constantBuffer.inverseView = DirectX::XMMatrixInverse(nullptr, constantBuffer.view);
-		constantBuffer.inverseProjection = DirectX::XMMatrixInverse(nullptr, constantBuffer.projection);
-		memcpy(constantBufferSR.pData, &constantBuffer, sizeof(ConstantBuffer));
-		deviceContext->Unmap(m_constantBuffer, NULL);	
-	}
+	RenderDrawPacket packet = RenderDrawPacket();
+	packet.pass = RENDER_PASS_TRANSPARENT;
+	packet.depth = depth;
+	packet.program = program;
+	packet.vertexBuffer = m_vertexBuffer;
+	packet.vertexStride = sizeof(Vertex);
+	packet.constantBuffers[RENDER_STAGE_VERTEX][0] = m_constantBuffer;
+	packet.constantBuffers[RENDER_STAGE_GEOMETRY][0] = m_constantBuffer;
+	packet.constantBuffers[RENDER_STAGE_PIXEL][1] = m_nearbyParticleBuffer;
+	packet.topology = RENDER_TOPOLOGY_POINT_LIST;
+	packet.numElements = 1;
 
-	D3D11_MAPPED_SUBRESOURCE nearbyParticleBufferSR;
-	if (SUCCEEDED(deviceContext->Map(m_nearbyParticleBuffer, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &nearbyParticleBufferSR)))
 	{
-		memcpy(nearbyParticleBufferSR.pData, &m_nearbyParticles, sizeof(NearbyParticleConstantBuffer));
-		deviceContext->Unmap(m_nearbyParticleBuffer, NULL);
+		PROFILE_SCOPE("ConstantUpload");
+		queue.Upload(packet, m_constantBuffer, &m_constants, sizeof(ConstantBuffer));
+		queue.Upload(packet, m_nearbyParticleBuffer, &m_nearbyParticles, sizeof(NearbyParticleConstantBuffer));
 	}
-	unsigned int stride = sizeof(Vertex);
-	unsigned int offset = 0;
-
-	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
-	deviceContext->VSSetConstantBuffers(0, 1, &m_constantBuffer);
-	deviceContext->GSSetConstantBuffers(0, 1, &m_constantBuffer);
-
-	deviceContext->PSSetConstantBuffers(1, 1, &m_nearbyParticleBuffer);
-	
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-	deviceContext->Draw(1, 0);
 
+	queue.Submit(packet);
 	return S_OK;
 }
 
@@ -124,54 +97,29 @@ void Particle::Update(float deltaTime)
 	m_timeToLive -= deltaTime;
 }
 
-void Particle::UpdateNearestParticles(std::vector<Particle*>& particles, const Camera& camera)
+void Particle::SetNearbyParticles(const DirectX::XMFLOAT3* positions, const int* neighbors, int numNeighbors, const Camera& camera)
 {
 	m_nearbyParticles = NearbyParticleConstantBuffer();
-	DirectX::XMVECTOR thisPos = DirectX::XMLoadFloat3(&m_position);
-
-	for (int i = 0; i < particles.size(); i++)
-	{
-		DirectX::XMVECTOR otherPos = DirectX::XMLoadFloat3(&particles[i]->m_position);		
-
-		if (i < MAX_NEARBY_PARTICLES)	// Just set the Particle positions until every value in the Array has been set once
-		{
-			m_nearbyParticles.particlePos[i] = DirectX::XMFLOAT4(particles[i]->m_position.x, particles[i]->m_position.y, particles[i]->m_position.z, 1.0f);
-		}
-		else							// Then swap the furthest particle position with the current one if it is closer
-		{
-			int indexFurthest = 0;
-			float distToFurthestSq = 0.0f;
-			
-			// Calculate what the index of the currently furthest away position is
-			for (int k = 0; k < MAX_NEARBY_PARTICLES; k++)
-			{
-				DirectX::XMVECTOR furthestPos = DirectX::XMLoadFloat4(&m_nearbyParticles.particlePos[indexFurthest]);
-				DirectX::XMVECTOR currentPos = DirectX::XMLoadFloat4(&m_nearbyParticles.particlePos[k]);
-				distToFurthestSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(furthestPos, thisPos)));
-				float distToCurrentSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(currentPos, thisPos)));
-
-				if (distToCurrentSq > distToFurthestSq)
-					indexFurthest = k;
-			}
-
-			// Swap furthest position if current Particle is closer
-			float distToOtherSq = DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(DirectX::XMVectorSubtract(otherPos, thisPos)));
-			if (distToOtherSq < distToFurthestSq)
-			{
-				m_nearbyParticles.particlePos[indexFurthest] = DirectX::XMFLOAT4(particles[i]->m_position.x, particles[i]->m_position.y, particles[i]->m_position.z, 1.0f);
-			}
-		}
-	}
+	DirectX::XMMATRIX viewMatrix = camera.GetViewMatrix();
 
 	// Transform nearby particles into view space
-	for (int i = 0; i < MAX_NEARBY_PARTICLES; i++)
+	for (int i = 0; i < numNeighbors && i < MAX_NEARBY_PARTICLES; i++)
 	{
-		DirectX::XMVECTOR worldPos = DirectX::XMLoadFloat4(&m_nearbyParticles.particlePos[i]);
-		DirectX::XMVECTOR viewPos = DirectX::XMVector4Transform(worldPos, camera.GetViewMatrix());
-		DirectX::XMStoreFloat4(&m_nearbyParticles.particlePos[i], viewPos);
+		const DirectX::XMFLOAT3& position = positions[neighbors[i]];
+		DirectX::XMVECTOR worldPos = DirectX::XMVectorSet(position.x, position.y, position.z, 1.0f);
+		DirectX::XMStoreFloat4(&m_nearbyParticles.particlePos[i], DirectX::XMVector4Transform(worldPos, viewMatrix));
 	}
 }
 
+void Particle::PackConstants(const ConstantBuffer& cameraConstants)
+{
+	m_constants = cameraConstants;
+	m_constants.world = DirectX::XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
+	m_constants.worldView = m_constants.world * m_constants.view;
+	m_constants.worldViewProj = m_constants.worldView * m_constants.projection;
+	m_constants.inverseWorld = DirectX::XMMatrixTranslation(-m_position.x, -m_position.y, -m_position.z);
+}
+
 void Particle::SetPosition(DirectX::XMFLOAT3 position)
 {
 	m_position = position;
@@ -201,3 +149,13 @@ float Particle::GetTimeToLive()
 {
 	return m_timeToLive;
 }
+
+void Particle::SetId(uint32_t id)
+{
+	m_id = id;
+}
+
+uint32_t Particle::GetId() const
+{
+	return m_id;
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include <DirectXMath.h>
-#include <d3d11.h>
 #include <vector>
 #include "Camera.h"
+#include "RenderDevice.h"
+#include "RenderQueue.h"
+#include "ConstantBuffer.h"
 
 const int MAX_NEARBY_PARTICLES = 32;
 
@@ -14,13 +16,17 @@ struct alignas(16) NearbyParticleConstantBuffer
 class Particle
 {
 public:
-	Particle(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+	Particle(RenderDevice* device);
 	~Particle();
 
-	HRESULT Render(ID3D11DeviceContext* deviceContext, const Camera& camera);
+	// Queues a transparent point for the geometry shader of program to expand, with the constants packed last
+	HRESULT Submit(RenderQueue& queue, RenderShaderProgram* program, float depth);
 	void Update(float deltaTime);
 
-	void UpdateNearestParticles(std::vector<Particle*>& particles, const Camera& camera);
+	// neighbors index into positions, unused slots stay empty for the shader
+	void SetNearbyParticles(const DirectX::XMFLOAT3* positions, const int* neighbors, int numNeighbors, const Camera& camera);
+	// Takes view and projection with their inverses from cameraConstants, the rest follows from the position
+	void PackConstants(const ConstantBuffer& cameraConstants);
 
 	void SetPosition(DirectX::XMFLOAT3 position);
 	const DirectX::XMFLOAT3& GetPosition() const;
@@ -31,15 +37,21 @@ public:
 	void SetTimeToLive(float ttl);
 	float GetTimeToLive();
 
+	// Unique among the live particles, lets caches follow particles when others die
+	void SetId(uint32_t id);
+	uint32_t GetId() const;
+
 private:
 	DirectX::XMFLOAT3 m_velocity;
 	DirectX::XMFLOAT3 m_position;
 	float m_timeToLive;
+	uint32_t m_id;
 	NearbyParticleConstantBuffer m_nearbyParticles;
+	ConstantBuffer m_constants;
 
-	ID3D11Buffer* m_vertexBuffer;
-	ID3D11Buffer* m_constantBuffer;
-	ID3D11Buffer* m_nearbyParticleBuffer;
+	RenderBuffer* m_vertexBuffer;
+	RenderBuffer* m_constantBuffer;
+	RenderBuffer* m_nearbyParticleBuffer;
 
 	const DirectX::XMFLOAT3 m_gravity = { 0.0f, -9.81f, 0.0f };
 };
@@ -1,8 +1,9 @@
 #include "ParticleSpawner.h"
 #include "RandomValues.h"
+#include "EngineStats.h"
 
-ParticleSpawner::ParticleSpawner(DirectX::XMFLOAT3 position, std::vector<Particle*>& particleList, ID3D11Device* device, ID3D11DeviceContext* deviceContext)
-	: m_particleList(particleList), m_device(device), m_deviceContext(deviceContext)
+ParticleSpawner::ParticleSpawner(DirectX::XMFLOAT3 position, std::vector<Particle*>& particleList, RenderDevice* device)
+	: m_particleList(particleList), m_device(device)
 {
 	m_position = position;
 	m_pVariance = 0.0f;
@@ -15,46 +16,142 @@ ParticleSpawner::ParticleSpawner(DirectX::XMFLOAT3 position, std::vector<Particl
 	m_timeToLive = 1.0f;
 	m_ttlVariance = 0.0f;
 	m_actualSpawnTime = 0.0f;
+	m_time = 0.0f;
+	m_numEmitted = 0;
+	m_nextId = 0;
+}
+
+ParticleSpawner::~ParticleSpawner()
+{
+	for (Particle* particle : m_freeParticles)
+		delete particle;
+	m_freeParticles.clear();
 }
 
 void ParticleSpawner::Update(float deltaTime)
 {
-	m_actualSpawnTime -= deltaTime;
+	// Every particle that became due during this step is born at its exact sub-frame time and
+	// gets the remaining part of the step as its age, so slow frames neither drop nor clump particles
+	m_birthAges.clear();
+	float stepEnd = m_time + deltaTime;
 
-	if (m_actualSpawnTime <= 0.0f)
+	m_actualSpawnTime -= deltaTime;
+	while (m_actualSpawnTime <= 0.0f)
 	{
-		CreateParticle();
-		float variance = m_srVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
+		m_birthAges.push_back(-m_actualSpawnTime);
+		m_actualSpawnTime += GetNextSpawnInterval();
+	}
 
-		// Make sure that in m_actualSpawnTime calculation no div by ZERO happens and isn't negative
-		if (variance <= -m_spawnRate)
-			variance = -m_spawnRate + 0.01f;
+	for (size_t i = 0; i < m_bursts.size(); i++)
+	{
+		if (m_bursts[i].time > stepEnd)
+			continue;
 
-		m_actualSpawnTime = 1.0f / (m_spawnRate + variance);
+		float age = stepEnd - m_bursts[i].time;
+		m_birthAges.insert(m_birthAges.end(), m_bursts[i].count, age);
+		m_bursts.erase(m_bursts.begin() + i);
+		i--;
 	}
+
+	m_time = stepEnd;
+
+	if (!m_birthAges.empty())
+		CreateParticles(m_birthAges);
 }
 
-void ParticleSpawner::CreateParticle()
+void ParticleSpawner::Recycle(Particle* particle)
 {
-	Particle* particle = new Particle(m_device, m_deviceContext);
+	m_freeParticles.push_back(particle);
+}
 
-	DirectX::XMFLOAT3 actualPosition = m_position;
-	actualPosition.x += m_pVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	actualPosition.y += m_pVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	actualPosition.z += m_pVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	particle->SetPosition(actualPosition);
+Particle* ParticleSpawner::TakeParticle()
+{
+	if (m_freeParticles.empty())
+		return new Particle(m_device);
 
-	DirectX::XMFLOAT3 actualVelocity = m_direction;
-	actualVelocity.x += m_dVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	actualVelocity.y += m_dVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	actualVelocity.z += m_dVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
-	DirectX::XMVECTOR vActualVelocity = DirectX::XMLoadFloat3(&actualVelocity);
-	vActualVelocity = DirectX::XMVector3Normalize(vActualVelocity);
-	vActualVelocity = DirectX::XMVectorScale(vActualVelocity, m_velocity + m_vVariance * RandomValues::GetRandomValue(-1.0f, 1.0f));
-	DirectX::XMStoreFloat3(&actualVelocity, vActualVelocity);
-	particle->SetVelocity(actualVelocity);
+	Particle* particle = m_freeParticles.back();
+	m_freeParticles.pop_back();
+	return particle;
+}
+
+void ParticleSpawner::AddBurst(int count, float time)
+{
+	if (count > 0)
+		m_bursts.push_back({ count, time });
+}
+
+float ParticleSpawner::GetTime() const
+{
+	return m_time;
+}
+
+uint64_t ParticleSpawner::GetNumEmitted() const
+{
+	return m_numEmitted;
+}
 
-	particle->SetTimeToLive(m_timeToLive + m_ttlVariance * RandomValues::GetRandomValue(-1.0f, 1.0f));
+uint32_t ParticleSpawner::TakeId()
+{
+	return m_nextId++;
+}
+
+float ParticleSpawner::GetNextSpawnInterval()
+{
+	float variance = m_srVariance * RandomValues::GetRandomValue(-1.0f, 1.0f);
+
+	// Make sure that in m_actualSpawnTime calculation no div by ZERO happens and isn't negative
+	if (variance <= -m_spawnRate)
+		variance = -m_spawnRate + 0.01f;
+
+	return 1.0f / (m_spawnRate + variance);
+}
+
+void ParticleSpawner::CreateParticles(const std::vector<float>& ages)
+{
+	// All random values of the batch are drawn at once: per particle position, direction, speed, time to live
+	const int valuesPerParticle = 8;
+	m_randomValues.resize(ages.size() * valuesPerParticle);
+	RandomValues::FillRandomValues(m_randomValues.data(), m_randomValues.size(), -1.0f, 1.0f);
+
+	// Out of recycled particles the population grows, half again as many are made at once
+	if (m_freeParticles.size() < ages.size())
+	{
+		size_t numParticles = ages.size() + m_particleList.size() / 2;
+		while (m_freeParticles.size() < numParticles)
+			m_freeParticles.push_back(new Particle(m_device));
+	}
+
+	for (size_t i = 0; i < ages.size(); i++)
+	{
+		const float* random = &m_randomValues[i * valuesPerParticle];
+		Particle* particle = TakeParticle();
+
+		DirectX::XMFLOAT3 actualPosition = m_position;
+		actualPosition.x += m_pVariance * random[0];
+		actualPosition.y += m_pVariance * random[1];
+		actualPosition.z += m_pVariance * random[2];
+		particle->SetPosition(actualPosition);
+
+		DirectX::XMFLOAT3 actualVelocity = m_direction;
+		actualVelocity.x += m_dVariance * random[3];
+		actualVelocity.y += m_dVariance * random[4];
+		actualVelocity.z += m_dVariance * random[5];
+		DirectX::XMVECTOR vActualVelocity = DirectX::XMLoadFloat3(&actualVelocity);
+		vActualVelocity = DirectX::XMVector3Normalize(vActualVelocity);
+		vActualVelocity = DirectX::XMVectorScale(vActualVelocity, m_velocity + m_vVariance * random[6]);
+		DirectX::XMStoreFloat3(&actualVelocity, vActualVelocity);
+		particle->SetVelocity(actualVelocity);
+
+		particle->SetTimeToLive(m_timeToLive + m_ttlVariance * random[7]);
+		particle->SetId(m_nextId++);
+
+		// Advance the particle from its birth time to the end of the step
+		if (ages[i] > 0.0f)
+			particle->Update(ages[i]);
+
+		m_particleList.push_back(particle);
+	}
 
-	m_particleList.push_back(particle);
+	m_numEmitted += ages.size();
+	EngineStats::GetInstance().Add(STAT_SPAWNS, ages.size());
 }
@@ -1,16 +1,36 @@
 #pragma once
 #include <DirectXMath.h>
+#include <cstdint>
 #include <vector>
 #include "Particle.h"
 
 class ParticleSpawner
 {
 public:
-	ParticleSpawner(DirectX::XMFLOAT3 position, std::vector<Particle*>& particleList, ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+	ParticleSpawner(DirectX::XMFLOAT3 position, std::vector<Particle*>& particleList, RenderDevice* device);
+	~ParticleSpawner();
 	void Update(float deltaTime);
+	// Takes a dead particle back, later spawns reuse it instead of allocating one
+	void Recycle(Particle* particle);
+	// A recycled particle if there is one, for particles made outside of the spawner like replayed ones
+	Particle* TakeParticle();
+
+	// Emits count particles once the spawner clock reaches time (in seconds since construction)
+	void AddBurst(int count, float time);
+	float GetTime() const;
+	uint64_t GetNumEmitted() const;
+	// An id no particle of this spawner had yet, for particles made outside of it like replayed ones
+	uint32_t TakeId();
 
 private:
-	void CreateParticle();
+	struct Burst
+	{
+		int count;
+		float time;
+	};
+
+	float GetNextSpawnInterval();
+	void CreateParticles(const std::vector<float>& ages);
 
 public:
 	DirectX::XMFLOAT3 m_position;
@@ -27,7 +47,13 @@ public:
 private:
 	std::vector<Particle*>& m_particleList;
 	float m_actualSpawnTime;
-	ID3D11Device* m_device;
-	ID3D11DeviceContext* m_deviceContext;
+	float m_time;
+	uint64_t m_numEmitted;
+	uint32_t m_nextId;
+	std::vector<Burst> m_bursts;
+	std::vector<float> m_birthAges;
+	std::vector<float> m_randomValues;
+	std::vector<Particle*> m_freeParticles;
+	RenderDevice* m_device;
 };
 
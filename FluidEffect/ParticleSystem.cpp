@@ -1,221 +1,492 @@
 #include <iostream>
 #include "ParticleSystem.h"
-#include "Shader.h"
-#include "InputSystem.h"
+#include "Profiler.h"
+#include "EngineStats.h"
+#include "JobSystem.h"
+#include "MortonCode.h"
 
-ParticleSystem::ParticleSystem(DirectX::XMFLOAT3 position, ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader)
+ParticleSystem::ParticleSystem(DirectX::XMFLOAT3 position, RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader)
 {
-	SetShader(device, deviceContext, shaderFileName, hasGeometryShader);
-    m_particleSpawner = new ParticleSpawner(position, m_particles, device, deviceContext);
+	m_integrator = INTEGRATOR_BALLISTIC;
+	m_isReplaying = false;
+	m_device = device;
+	m_collisionRadius = 0.1f;
+	m_collisionRestitution = 0.2f;
+	m_collisionFriction = 0.1f;
+	m_reorderInterval = 0;
+	m_framesSinceReorder = 0;
+	m_preparedProgram = nullptr;
+	m_neighborCache.m_settings.maxNeighbors = MAX_NEARBY_PARTICLES - 1;
+	SetShader(device, shaderFileName, hasGeometryShader);
+	m_particleSpawner = new ParticleSpawner(position, m_particles, nullptr);
 }
 
 ParticleSystem::~ParticleSystem()
 {
-	if (m_vertexShader)
+	if (m_particleSpawner)
 	{
-		m_vertexShader->Release();
-		m_vertexShader = nullptr;
+		delete m_particleSpawner;
+		m_particleSpawner = nullptr;
 	}
 
-	if (m_pixelShader)
+	for (Particle* particle : m_particles)
 	{
-		m_pixelShader->Release();
-		m_pixelShader = nullptr;
+		delete particle;
 	}
+	m_particles.clear();
 
-	if (m_geometryShader)
-	{
-		m_geometryShader->Release();
-		m_geometryShader = nullptr;
-	}
+	for (Particle* particle : m_renderParticles)
+		delete particle;
+	m_renderParticles.clear();
+}
 
-	if (m_inputLayout)
-	{
-		m_inputLayout->Release();
-		m_inputLayout = nullptr;
-	}
+HRESULT ParticleSystem::Submit(RenderQueue& queue, const Camera& camera)
+{
+	WriteFrame(m_frame);
+	return Submit(queue, camera, m_frame);
+}
 
-	if (m_particleSpawner)
+HRESULT ParticleSystem::Submit(RenderQueue& queue, const Camera& camera, const ParticleFrame& frame)
+{
+	Prepare(camera, frame);
+	return SubmitPrepared(queue, camera, frame);
+}
+
+void ParticleSystem::Prepare(const Camera& camera, const ParticleFrame& frame)
+{
+	m_preparedProgram = m_shaderProgram.TryGet();
+	if (!m_preparedProgram)
+		return;
+
+	// Grown by half again as many, so particle counts going up and down settle without allocating
+	int numParticles = static_cast<int>(frame.positions.size());
+	if (static_cast<int>(m_renderParticles.size()) < numParticles)
 	{
-		delete m_particleSpawner;
-		m_particleSpawner = nullptr;
+		while (static_cast<int>(m_renderParticles.size()) < numParticles + numParticles / 2)
+			m_renderParticles.push_back(new Particle(m_device));
 	}
 
-	for (Particle* particle : m_particles)
+	// Only the world matrices differ between particles
+	ConstantBuffer cameraConstants;
+	cameraConstants.view = camera.GetViewMatrix();
+	cameraConstants.projection = camera.GetProjectionMatrix();
+	cameraConstants.inverseView = DirectX::XMMatrixInverse(nullptr, cameraConstants.view);
+	cameraConstants.inverseProjection = DirectX::XMMatrixInverse(nullptr, cameraConstants.projection);
+
 	{
-		delete particle;
+		PROFILE_SCOPE("NeighborSearch");
+		m_neighborCache.Update(frame.positions, frame.ids);
+
+		// Every particle is part of its own field, the nearest others fill the remaining slots. The
+		// constants are packed here as well, so queueing the particles only copies them.
+		JobSystem::GetInstance().ParallelFor(numParticles, [&](int begin, int end, int chunk)
+		{
+			int neighbors[MAX_NEARBY_PARTICLES];
+			uint64_t numDistanceEvals = 0;
+			for (int i = begin; i < end; i++)
+			{
+				neighbors[0] = i;
+				int numNeighbors = 1 + m_neighborCache.FindNearest(i, MAX_NEARBY_PARTICLES - 1, neighbors + 1, numDistanceEvals);
+				m_renderParticles[i]->SetPosition(frame.positions[i]);
+				m_renderParticles[i]->SetNearbyParticles(frame.positions.data(), neighbors, numNeighbors, camera);
+				m_renderParticles[i]->PackConstants(cameraConstants);
+			}
+			EngineStats::GetInstance().Add(STAT_NEIGHBOR_DISTANCE_EVALS, numDistanceEvals);
+		}, 64);
 	}
-	m_particles.clear();
+
+	// Blending needs the particles back to front. The queue keeps the submission order of
+	// transparent packets, so this sort is the draw order.
+	DirectX::XMFLOAT3 eye = camera.GetPosition();
+	DirectX::XMFLOAT3 forward = camera.GetForwardVector();
+	m_depthSorter.Sort(frame.positions.data(), frame.ids.data(), numParticles, eye, forward, m_drawOrder);
 }
 
-HRESULT ParticleSystem::Render(ID3D11DeviceContext* deviceContext, const Camera& camera)
+HRESULT ParticleSystem::SubmitPrepared(RenderQueue& queue, const Camera& camera, const ParticleFrame& frame)
 {
-	deviceContext->VSSetShader(m_vertexShader, nullptr, 0);
-	deviceContext->GSSetShader(m_geometryShader, nullptr, 0);
-	deviceContext->PSSetShader(m_pixelShader, nullptr, 0);
-	deviceContext->IASetInputLayout(m_inputLayout);
+	if (!m_preparedProgram)
+		return S_OK;
 
-    for (Particle* particle : m_particles)
-    {
-        particle->UpdateNearestParticles(m_particles, camera);
-        if(FAILED(particle->Render(deviceContext, camera)))
-            return E_FAIL;
-    }
+	DirectX::XMFLOAT3 eye = camera.GetPosition();
+	DirectX::XMFLOAT3 forward = camera.GetForwardVector();
+	PROFILE_SCOPE("ParticleSubmit");
+	for (int index : m_drawOrder)
+	{
+		const DirectX::XMFLOAT3& position = frame.positions[index];
+		float depth = (position.x - eye.x) * forward.x + (position.y - eye.y) * forward.y + (position.z - eye.z) * forward.z;
+		if (FAILED(m_renderParticles[index]->Submit(queue, m_preparedProgram, depth)))
+			return E_FAIL;
+	}
 
-    return S_OK;
+	return S_OK;
 }
 
 void ParticleSystem::Update(float deltaTime)
 {
-	InputSystem input = InputSystem::GetInstance();
+	if (m_isReplaying)
+	{
+		EngineStats::GetInstance().Add(STAT_LIVE_PARTICLES, m_particles.size());
+		return;
+	}
 
-	if (input.Held(VK_SHIFT) && input.Pressed('E') && GetParticleSpawner()->m_velocity < 20.0f)
-		GetParticleSpawner()->m_velocity++;
-	else if (input.Pressed('E') && GetParticleSpawner()->m_spawnRate < 40.0f)
-		GetParticleSpawner()->m_spawnRate++;
+	{
+		PROFILE_SCOPE("Integration");
+		if (m_integrator == INTEGRATOR_BALLISTIC)
+			UpdateBallistic(deltaTime);
+		else
+			UpdateFluid(deltaTime);
+	}
 
-	if (input.Held(VK_SHIFT) && input.Pressed('Q') && GetParticleSpawner()->m_velocity > 2.0f)
-		GetParticleSpawner()->m_velocity--;
-	else if (input.Pressed('Q') && GetParticleSpawner()->m_spawnRate > 2.0f)
-		GetParticleSpawner()->m_spawnRate--;
+	// Spawning after integration lets the spawner advance every new particle by exactly its age
+	{
+		PROFILE_SCOPE("Spawn");
+		m_particleSpawner->Update(deltaTime);
+	}
 
-	if (input.Pressed('X') && GetParticleSpawner()->m_dVariance < 2.0f)
-		GetParticleSpawner()->m_dVariance += 0.1f;
+	if (m_reorderInterval > 0 && ++m_framesSinceReorder >= m_reorderInterval)
+	{
+		PROFILE_SCOPE("Reorder");
+		ReorderParticles();
+		m_framesSinceReorder = 0;
+	}
 
-	if (input.Pressed('Y') && GetParticleSpawner()->m_dVariance > 0.0f)
-		GetParticleSpawner()->m_dVariance -= 0.1f;
+	EngineStats::GetInstance().Add(STAT_LIVE_PARTICLES, m_particles.size());
+}
 
+void ParticleSystem::OnKeyPressed(int key, bool isShiftHeld)
+{
+	ParticleSpawner* spawner = GetParticleSpawner();
+	switch (key)
+	{
+	case 'E':
+		if (isShiftHeld && spawner->m_velocity < 20.0f)
+			spawner->m_velocity++;
+		else if (spawner->m_spawnRate < 40.0f)
+			spawner->m_spawnRate++;
+		break;
+
+	case 'Q':
+		if (isShiftHeld && spawner->m_velocity > 2.0f)
+			spawner->m_velocity--;
+		else if (spawner->m_spawnRate > 2.0f)
+			spawner->m_spawnRate--;
+		break;
+
+	case 'X':
+		if (spawner->m_dVariance < 2.0f)
+			spawner->m_dVariance += 0.1f;
+		break;
+
+	case 'Y':
+		if (spawner->m_dVariance > 0.0f)
+			spawner->m_dVariance -= 0.1f;
+		break;
+
+	case 'I':
+		if (isShiftHeld)
+			m_pbfSolver.m_settings.numIterations = m_pbfSolver.m_settings.numIterations == 4 ? 8 : 4;
+		else
+			SetIntegrator(static_cast<ParticleIntegrator>((m_integrator + 1) % INTEGRATOR_COUNT));
+		break;
+
+	case 'K':
+		m_reorderInterval = m_reorderInterval > 0 ? 0 : DEFAULT_REORDER_INTERVAL;
+		break;
+	}
+}
 
-    m_particleSpawner->Update(deltaTime);
+void ParticleSystem::WriteFrame(ParticleFrame& frame) const
+{
+	int numParticles = static_cast<int>(m_particles.size());
+	frame.positions.resize(numParticles);
+	frame.ids.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+	{
+		frame.positions[i] = m_particles[i]->GetPosition();
+		frame.ids[i] = m_particles[i]->GetId();
+	}
+}
 
-	for (int i = 0; i < m_particles.size(); i++)
+void ParticleSystem::UpdateBallistic(float deltaTime)
+{
+	// Compact in place so surviving particles keep their order
+	size_t numAlive = 0;
+	for (size_t i = 0; i < m_particles.size(); i++)
 	{
+		DirectX::XMFLOAT3 previousPosition = m_particles[i]->GetPosition();
 		m_particles[i]->Update(deltaTime);
 
+		if (!m_colliders.empty() || !m_meshColliders.empty())
+		{
+			DirectX::XMFLOAT3 position = m_particles[i]->GetPosition();
+			DirectX::XMFLOAT3 velocity = m_particles[i]->GetVelocity();
+
+			for (const TriangleBvh* collider : m_meshColliders)
+				ResolveSegmentHit(collider->IntersectSegment(previousPosition, position), previousPosition, position, velocity);
+
+			ResolveCollisions(position, velocity);
+			m_particles[i]->SetPosition(position);
+			m_particles[i]->SetVelocity(velocity);
+		}
+
 		if (m_particles[i]->GetTimeToLive() <= 0.0f)
 		{
-			delete m_particles[i];
-			m_particles.erase(m_particles.begin() + i);
-			i--;
+			m_particleSpawner->Recycle(m_particles[i]);
+			EngineStats::GetInstance().Add(STAT_DEATHS, 1);
+		}
+		else
+		{
+			m_particles[numAlive++] = m_particles[i];
 		}
 	}
+	m_particles.resize(numAlive);
 }
 
-ParticleSpawner* ParticleSystem::GetParticleSpawner()
+void ParticleSystem::UpdateFluid(float deltaTime)
 {
-    return m_particleSpawner;
-}
+	m_positions.resize(m_particles.size());
+	m_velocities.resize(m_particles.size());
 
-HRESULT ParticleSystem::SetShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader)
-{
-	HRESULT hr;
+	for (size_t i = 0; i < m_particles.size(); i++)
+	{
+		m_positions[i] = m_particles[i]->GetPosition();
+		m_velocities[i] = m_particles[i]->GetVelocity();
+	}
+
+	m_previousPositions = m_positions;
 
-	ID3D10Blob* shaderBlob = nullptr;
+	if (m_integrator == INTEGRATOR_PBF)
+		m_pbfSolver.Step(m_positions, m_velocities, deltaTime);
+	else
+		m_sphSolver.Step(m_positions, m_velocities, deltaTime);
 
-	if (m_vertexShader)
+	if (!m_meshColliders.empty())
 	{
-		m_vertexShader->Release();
-		m_vertexShader = nullptr;
+		PROFILE_SCOPE("SweptCollisions");
+		int numParticles = static_cast<int>(m_positions.size());
+		m_segmentHits.resize(numParticles);
+
+		for (const TriangleBvh* collider : m_meshColliders)
+		{
+			collider->IntersectSegments(m_previousPositions.data(), m_positions.data(), numParticles, m_segmentHits.data());
+			for (int i = 0; i < numParticles; i++)
+				ResolveSegmentHit(m_segmentHits[i], m_previousPositions[i], m_positions[i], m_velocities[i]);
+		}
 	}
 
-	if (m_pixelShader)
+	if (!m_colliders.empty())
 	{
-		m_pixelShader->Release();
-		m_pixelShader = nullptr;
+		PROFILE_SCOPE("Collisions");
+		JobSystem::GetInstance().ParallelFor(static_cast<int>(m_positions.size()), [&](int begin, int end, int chunk)
+		{
+			for (int i = begin; i < end; i++)
+				ResolveCollisions(m_positions[i], m_velocities[i]);
+		}, 1024);
 	}
 
-	if (m_geometryShader)
+	for (size_t i = 0; i < m_particles.size(); i++)
 	{
-		m_geometryShader->Release();
-		m_geometryShader = nullptr;
+		m_particles[i]->SetPosition(m_positions[i]);
+		m_particles[i]->SetVelocity(m_velocities[i]);
+		m_particles[i]->SetTimeToLive(m_particles[i]->GetTimeToLive() - deltaTime);
 	}
 
-	if (m_inputLayout)
+	// Compact in place so surviving particles keep their order
+	int numAlive = 0;
+	for (size_t i = 0; i < m_particles.size(); i++)
 	{
-		m_inputLayout->Release();
-		m_inputLayout = nullptr;
+		if (m_particles[i]->GetTimeToLive() <= 0.0f)
+		{
+			m_particleSpawner->Recycle(m_particles[i]);
+			EngineStats::GetInstance().Add(STAT_DEATHS, 1);
+		}
+		else
+		{
+			m_particles[numAlive++] = m_particles[i];
+		}
 	}
+	m_particles.resize(numAlive);
+}
 
-	//Compile Vertex Shader
-	hr = Shader::CompileShaderFromFile(shaderFileName, "VSMain", "vs_5_0", &shaderBlob);
-	if (FAILED(hr))
+void ParticleSystem::ReorderParticles()
+{
+	int numParticles = static_cast<int>(m_particles.size());
+	m_positions.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		m_positions[i] = m_particles[i]->GetPosition();
+
+	// 30 bit codes while their cells stay well below the neighborhood of the active search, a
+	// stray particle far away stretches the bounds
+	float searchRadius = m_neighborCache.m_settings.radius;
+	if (m_integrator == INTEGRATOR_SPH)
+		searchRadius = m_sphSolver.m_settings.smoothingRadius;
+	else if (m_integrator == INTEGRATOR_PBF)
+		searchRadius = m_pbfSolver.m_settings.smoothingRadius;
+
+	MortonBounds bounds = ComputeMortonBounds(m_positions.data(), numParticles);
+	if (bounds.extent / 1024.0f <= 0.25f * searchRadius)
 	{
-		std::cout << "Compiling Vertex Shader failed." << std::endl;
-		return hr;
+		ComputeMortonCodes(m_positions.data(), numParticles, bounds, m_mortonCodes);
+		m_radixSort.Sort(m_mortonCodes.data(), numParticles, m_reorder);
 	}
-
-	hr = device->CreateVertexShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_vertexShader);
-	if (FAILED(hr))
+	else
 	{
-		std::cout << "Creating Vertex Shader failed." << std::endl;
-		shaderBlob->Release();
-		return hr;
+		ComputeMortonCodes(m_positions.data(), numParticles, bounds, m_wideMortonCodes);
+		m_radixSort.Sort(m_wideMortonCodes.data(), numParticles, m_reorder);
 	}
 
-	//Create Input Layout
-	D3D11_INPUT_ELEMENT_DESC layout[] =
+	// Only m_particles is reordered, the solver arrays are gathered from it every step and the
+	// neighbor cache follows the particles by id
+	m_reorderedParticles.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		m_reorderedParticles[i] = m_particles[m_reorder[i]];
+	m_particles.swap(m_reorderedParticles);
+}
+
+void ParticleSystem::ResolveCollisions(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity) const
+{
+	for (const SignedDistanceField* collider : m_colliders)
+		collider->ResolveCollision(position, velocity, m_collisionRadius, m_collisionRestitution, m_collisionFriction);
+}
+
+void ParticleSystem::ResolveSegmentHit(const SegmentHit& hit, const DirectX::XMFLOAT3& previousPosition, DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity) const
+{
+	if (hit.triangle < 0)
+		return;
+
+	// Stop just in front of the surface and bounce off it
+	DirectX::XMVECTOR start = DirectX::XMLoadFloat3(&previousPosition);
+	DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&position), start));
+	DirectX::XMVECTOR normal = DirectX::XMLoadFloat3(&hit.normal);
+	DirectX::XMVECTOR contact = DirectX::XMVectorAdd(start, DirectX::XMVectorScale(direction, hit.distance));
+	DirectX::XMStoreFloat3(&position, DirectX::XMVectorAdd(contact, DirectX::XMVectorScale(normal, 0.001f)));
+
+	DirectX::XMVECTOR vVelocity = DirectX::XMLoadFloat3(&velocity);
+	float normalSpeed = DirectX::XMVectorGetX(DirectX::XMVector3Dot(vVelocity, normal));
+	if (normalSpeed < 0.0f)
 	{
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0}
-	};
-	UINT numElements = ARRAYSIZE(layout);
+		DirectX::XMVECTOR normalVelocity = DirectX::XMVectorScale(normal, normalSpeed);
+		DirectX::XMVECTOR tangentVelocity = DirectX::XMVectorSubtract(vVelocity, normalVelocity);
+		vVelocity = DirectX::XMVectorSubtract(DirectX::XMVectorScale(tangentVelocity, 1.0f - m_collisionFriction), DirectX::XMVectorScale(normalVelocity, m_collisionRestitution));
+		DirectX::XMStoreFloat3(&velocity, vVelocity);
+	}
+}
+
+ParticleSpawner* ParticleSystem::GetParticleSpawner()
+{
+    return m_particleSpawner;
+}
+
+SphSolver& ParticleSystem::GetSphSolver()
+{
+	return m_sphSolver;
+}
+
+PbfSolver& ParticleSystem::GetPbfSolver()
+{
+	return m_pbfSolver;
+}
+
+NeighborCache& ParticleSystem::GetNeighborCache()
+{
+	return m_neighborCache;
+}
+
+DepthSorter& ParticleSystem::GetDepthSorter()
+{
+	return m_depthSorter;
+}
 
-	hr = device->CreateInputLayout(layout, numElements, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), &m_inputLayout);
-	if (FAILED(hr))
+void ParticleSystem::SetIntegrator(ParticleIntegrator integrator)
+{
+	m_integrator = integrator;
+}
+
+ParticleIntegrator ParticleSystem::GetIntegrator() const
+{
+	return m_integrator;
+}
+
+void ParticleSystem::GetParticlePositions(std::vector<DirectX::XMFLOAT3>& positions) const
+{
+	positions.resize(m_particles.size());
+	for (size_t i = 0; i < m_particles.size(); i++)
+		positions[i] = m_particles[i]->GetPosition();
+}
+
+void ParticleSystem::GetParticleStates(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, std::vector<uint32_t>& ids) const
+{
+	positions.resize(m_particles.size());
+	velocities.resize(m_particles.size());
+	ids.resize(m_particles.size());
+	for (size_t i = 0; i < m_particles.size(); i++)
 	{
-		std::cout << "Creating Input Layout failed." << std::endl;
-		shaderBlob->Release();
-		return hr;
+		positions[i] = m_particles[i]->GetPosition();
+		velocities[i] = m_particles[i]->GetVelocity();
+		ids[i] = m_particles[i]->GetId();
 	}
+}
+
+void ParticleSystem::SetReplaying(bool isReplaying)
+{
+	m_isReplaying = isReplaying;
+	m_replayIds.clear();
+}
 
-	shaderBlob->Release();
+bool ParticleSystem::IsReplaying() const
+{
+	return m_isReplaying;
+}
 
-	//Compile Geometry Shader if used
+void ParticleSystem::SetParticleStates(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities, const std::vector<uint32_t>& ids)
+{
+	// Particles simulated before the replay started have no replayer id and are all replaced
+	size_t numPrevious = m_replayIds.size() == m_particles.size() ? m_particles.size() : 0;
+	m_previousParticles.swap(m_particles);
+	m_particles.clear();
 
-	if (hasGeometryShader)
+	size_t previous = 0;
+	for (size_t i = 0; i < ids.size(); i++)
 	{
-		hr = Shader::CompileShaderFromFile(shaderFileName, "GSMain", "gs_5_0", &shaderBlob);
-		if (FAILED(hr))
+		// Ids increase along both frames, so previous particles with a smaller id died
+		while (previous < numPrevious && m_replayIds[previous] < ids[i])
+			m_particleSpawner->Recycle(m_previousParticles[previous++]);
+
+		Particle* particle;
+		if (previous < numPrevious && m_replayIds[previous] == ids[i])
 		{
-			std::cout << "Compiling Geometry Shader failed." << std::endl;
-			shaderBlob->Release();
-			return hr;
+			particle = m_previousParticles[previous++];
 		}
-
-		hr = device->CreateGeometryShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_geometryShader);
-		if (FAILED(hr))
+		else
 		{
-			std::cout << "Creating Geometry Shader failed." << std::endl;
-			shaderBlob->Release();
-			return hr;
+			particle = m_particleSpawner->TakeParticle();
+			particle->SetTimeToLive(m_particleSpawner->m_timeToLive);
+			particle->SetId(m_particleSpawner->TakeId());
 		}
 
-		shaderBlob->Release();
-	}
-	else
-	{
-		m_geometryShader = nullptr;
+		particle->SetPosition(positions[i]);
+		particle->SetVelocity(velocities[i]);
+		m_particles.push_back(particle);
 	}
 
-	//Compile Pixel Shader
-	hr = Shader::CompileShaderFromFile(shaderFileName, "PSMain", "ps_5_0", &shaderBlob);
-	if (FAILED(hr))
-	{
-		std::cout << "Compiling Pixel Shader failed." << std::endl;
-		return hr;
-	}
+	for (size_t i = previous; i < m_previousParticles.size(); i++)
+		m_particleSpawner->Recycle(m_previousParticles[i]);
+	m_previousParticles.clear();
+	m_replayIds = ids;
+}
 
-	hr = device->CreatePixelShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_pixelShader);
-	if (FAILED(hr))
-	{
-		std::cout << "Creating Pixel Shader failed." << std::endl;
-		shaderBlob->Release();
-		return hr;
-	}
+void ParticleSystem::AddCollider(const SignedDistanceField* collider)
+{
+	m_colliders.push_back(collider);
+}
 
-	shaderBlob->Release();
+void ParticleSystem::AddCollider(const TriangleBvh* collider)
+{
+	m_meshColliders.push_back(collider);
+}
 
+HRESULT ParticleSystem::SetShader(RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader)
+{
+	m_shaderProgram = AssetManager::GetInstance().LoadShaderProgram(device, shaderFileName, hasGeometryShader);
 	return S_OK;
 }
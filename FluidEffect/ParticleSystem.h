@@ -1,27 +1,118 @@
 #pragma once
-#include <d3d11.h>
 #include <vector>
 #include "Camera.h"
+#include "RenderDevice.h"
+#include "RenderQueue.h"
+#include "AssetManager.h"
 #include "Particle.h"
 #include "ParticleSpawner.h"
+#include "SphSolver.h"
+#include "PbfSolver.h"
+#include "SignedDistanceField.h"
+#include "TriangleBvh.h"
+#include "NeighborCache.h"
+#include "RadixSort.h"
+#include "DepthSorter.h"
+
+enum ParticleIntegrator
+{
+	INTEGRATOR_BALLISTIC,
+	INTEGRATOR_SPH,
+	INTEGRATOR_PBF,
+	INTEGRATOR_COUNT
+};
+
+// What drawing needs of the particles, so the next step can be simulated while a frame is drawn
+struct ParticleFrame
+{
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<uint32_t> ids;
+};
 
 class ParticleSystem
 {
 public:
-	ParticleSystem(DirectX::XMFLOAT3 position, ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader = false);
+	static const int DEFAULT_REORDER_INTERVAL = 30;
+
+	ParticleSystem(DirectX::XMFLOAT3 position, RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader = false);
 	~ParticleSystem();
-	HRESULT Render(ID3D11DeviceContext* deviceContext, const Camera& camera);
+	// Queues the particles back to front, nothing until the shader program is loaded
+	HRESULT Submit(RenderQueue& queue, const Camera& camera);
+	// Same for a frame written by WriteFrame, only touches what drawing owns so Update may run meanwhile
+	HRESULT Submit(RenderQueue& queue, const Camera& camera, const ParticleFrame& frame);
+	// The same in two parts, so the neighbor search and sorting of Prepare can run while other
+	// draws are queued. SubmitPrepared queues the frame Prepare was called with.
+	void Prepare(const Camera& camera, const ParticleFrame& frame);
+	HRESULT SubmitPrepared(RenderQueue& queue, const Camera& camera, const ParticleFrame& frame);
 	void Update(float deltaTime);
+	void OnKeyPressed(int key, bool isShiftHeld);
+	void WriteFrame(ParticleFrame& frame) const;
 	ParticleSpawner* GetParticleSpawner();
-	HRESULT SetShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader = false);
+	SphSolver& GetSphSolver();
+	PbfSolver& GetPbfSolver();
+	NeighborCache& GetNeighborCache();
+	DepthSorter& GetDepthSorter();
+	void SetIntegrator(ParticleIntegrator integrator);
+	ParticleIntegrator GetIntegrator() const;
+	void GetParticlePositions(std::vector<DirectX::XMFLOAT3>& positions) const;
+	void GetParticleStates(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, std::vector<uint32_t>& ids) const;
+	// While replaying, Update neither integrates nor spawns and the particles only follow SetParticleStates
+	void SetReplaying(bool isReplaying);
+	bool IsReplaying() const;
+	// Ids are the replayer's and must increase along the frame. A particle keeps its state objects as
+	// long as its id does, the others go back to the spawner and new ones come from it.
+	void SetParticleStates(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities, const std::vector<uint32_t>& ids);
+	void AddCollider(const SignedDistanceField* collider);
+	// Mesh colliders are hit by the segment every particle moved along, so fast particles can not tunnel
+	void AddCollider(const TriangleBvh* collider);
+
+	float m_collisionRadius;
+	float m_collisionRestitution;
+	float m_collisionFriction;
+	// Frames between sorting the particles along a Morton curve, 0 keeps them in spawn order
+	int m_reorderInterval;
+	// Loaded by the AssetManager, the particles are not drawn until it is ready
+	HRESULT SetShader(RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader = false);
 
 private:
+	void UpdateBallistic(float deltaTime);
+	void UpdateFluid(float deltaTime);
+	void ResolveCollisions(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity) const;
+	void ResolveSegmentHit(const SegmentHit& hit, const DirectX::XMFLOAT3& previousPosition, DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity) const;
+	void ReorderParticles();
+
 	ParticleSpawner* m_particleSpawner;
 	std::vector<Particle*> m_particles;
 
-	ID3D11InputLayout* m_inputLayout;
-	ID3D11VertexShader* m_vertexShader;
-	ID3D11PixelShader* m_pixelShader;
-	ID3D11GeometryShader* m_geometryShader;
+	ParticleIntegrator m_integrator;
+	bool m_isReplaying;
+	std::vector<uint32_t> m_replayIds;		// Replayer id of every particle while replaying
+	std::vector<Particle*> m_previousParticles;
+	SphSolver m_sphSolver;
+	PbfSolver m_pbfSolver;
+	std::vector<DirectX::XMFLOAT3> m_positions;
+	std::vector<DirectX::XMFLOAT3> m_velocities;
+	std::vector<DirectX::XMFLOAT3> m_previousPositions;
+	std::vector<SegmentHit> m_segmentHits;
+	std::vector<const SignedDistanceField*> m_colliders;
+	std::vector<const TriangleBvh*> m_meshColliders;
+
+	// Simulated particles have no buffers, drawing fills these in draw order every frame
+	std::vector<Particle*> m_renderParticles;
+	RenderShaderProgram* m_preparedProgram;		// nullptr if the shader program was not loaded for Prepare
+	ParticleFrame m_frame;
+	NeighborCache m_neighborCache;
+	DepthSorter m_depthSorter;
+	std::vector<int> m_drawOrder;
+
+	int m_framesSinceReorder;
+	RadixSort m_radixSort;
+	std::vector<uint32_t> m_mortonCodes;
+	std::vector<uint64_t> m_wideMortonCodes;
+	std::vector<int> m_reorder;
+	std::vector<Particle*> m_reorderedParticles;
+
+	RenderDevice* m_device;
+	AssetHandle<RenderShaderProgram> m_shaderProgram;
 };
 
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cmath>
+#include "PbfSolver.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+PbfSettings PbfSettings::ForParticleSpacing(float spacing)
+{
+	PbfSettings settings;
+	settings.smoothingRadius = 2.0f * spacing;
+	settings.restDensity = 1000.0f;
+	settings.particleMass = settings.restDensity * spacing * spacing * spacing;
+	settings.numIterations = 4;
+
+	// Constraint gradients grow with 1 / spacing, so lambdas shrink with spacing^2 and both the
+	// regularization and the artificial pressure have to be scaled to match
+	settings.relaxation = 0.01f / (spacing * spacing);
+	settings.artificialPressure = 0.1f * spacing * spacing;
+	settings.artificialPressureRadius = 0.2f * settings.smoothingRadius;
+	settings.xsphViscosity = 0.1f;
+	settings.maxCorrection = 0.3f * spacing;
+	// A cubic lattice at the particle spacing has 32 neighbors within two spacings
+	settings.restNeighborCount = 32;
+	settings.gravity = { 0.0f, -9.81f, 0.0f };
+	settings.boundsMin = { -1000.0f, 0.0f, -1000.0f };
+	settings.boundsMax = { 1000.0f, 1000.0f, 1000.0f };
+	settings.boundaryRestitution = 0.3f;
+	settings.maxTimeStep = 1.0f / 60.0f;
+	return settings;
+}
+
+PbfSolver::PbfSolver()
+{
+	m_settings = PbfSettings::ForParticleSpacing(0.25f);
+	m_densityError = 0.0f;
+}
+
+void PbfSolver::Step(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime)
+{
+	if (deltaTime <= 0.0f)
+		return;
+
+	int numSubsteps = static_cast<int>(std::ceil(deltaTime / m_settings.maxTimeStep));
+	float substep = deltaTime / numSubsteps;
+
+	for (int i = 0; i < numSubsteps; i++)
+		Substep(positions, velocities, substep);
+}
+
+void PbfSolver::Substep(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime)
+{
+	int numParticles = static_cast<int>(positions.size());
+	m_predicted.resize(numParticles);
+	m_corrections.resize(numParticles);
+	m_viscousVelocities.resize(numParticles);
+	m_boundaryGradients.resize(numParticles);
+	m_lambdas.resize(numParticles);
+	m_densityErrors.resize(numParticles);
+
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	const DirectX::XMFLOAT3 gravity = m_settings.gravity;
+
+	{
+		PROFILE_SCOPE("PbfPredict");
+		jobSystem.ParallelFor(numParticles, [&](int begin, int end, int chunk)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				velocities[i].x += gravity.x * deltaTime;
+				velocities[i].y += gravity.y * deltaTime;
+				velocities[i].z += gravity.z * deltaTime;
+				m_predicted[i] = DirectX::XMFLOAT3(positions[i].x + velocities[i].x * deltaTime, positions[i].y + velocities[i].y * deltaTime, positions[i].z + velocities[i].z * deltaTime);
+				ReflectFromBounds(m_predicted[i]);
+			}
+		}, 2048);
+	}
+
+	// Neighborhoods barely change within one step, so the grid and the neighbor lists are only built once
+	{
+		PROFILE_SCOPE("PbfNeighborGrid");
+		m_grid.Build(m_predicted.data(), numParticles, m_settings.smoothingRadius);
+		FindNeighbors();
+	}
+
+	// Every pass is a ParallelFor, which doubles as the barrier between the Jacobi phases
+	for (int iteration = 0; iteration < m_settings.numIterations; iteration++)
+	{
+		PROFILE_SCOPE("PbfIteration");
+		ComputeLambdas();
+		ComputeCorrections();
+		ApplyCorrections();
+	}
+
+	{
+		PROFILE_SCOPE("PbfDensityError");
+		ComputeDensityErrors();
+	}
+
+	{
+		PROFILE_SCOPE("PbfVelocity");
+		float invDeltaTime = 1.0f / deltaTime;
+		jobSystem.ParallelFor(numParticles, [&](int begin, int end, int chunk)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				velocities[i].x = (m_predicted[i].x - positions[i].x) * invDeltaTime;
+				velocities[i].y = (m_predicted[i].y - positions[i].y) * invDeltaTime;
+				velocities[i].z = (m_predicted[i].z - positions[i].z) * invDeltaTime;
+			}
+		}, 2048);
+
+		ApplyViscosity(velocities);
+	}
+
+	double error = 0.0;
+	for (float densityError : m_densityErrors)
+		error += densityError;
+	m_densityError = numParticles > 0 ? static_cast<float>(error / numParticles) : 0.0f;
+
+	positions.swap(m_predicted);
+}
+
+void PbfSolver::FindNeighbors()
+{
+	const int numParticles = static_cast<int>(m_predicted.size());
+	const float hSq = m_settings.smoothingRadius * m_settings.smoothingRadius;
+	const int minChunkSize = 512;
+	m_neighborStart.resize(numParticles + 1);
+	m_neighborStart[0] = 0;
+
+	// Chunks collect their lists separately and are appended in order, independent of the thread count
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	m_chunkNeighbors.resize(jobSystem.GetNumThreads());
+	jobSystem.ParallelFor(numParticles, [&](int begin, int end, int chunk)
+	{
+		std::vector<int>& chunkNeighbors = m_chunkNeighbors[chunk];
+		chunkNeighbors.clear();
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = m_predicted[i];
+			size_t first = chunkNeighbors.size();
+
+			m_grid.ForEachCandidate(pi, [&](int j)
+			{
+				float dx = pi.x - m_predicted[j].x;
+				float dy = pi.y - m_predicted[j].y;
+				float dz = pi.z - m_predicted[j].z;
+
+				if (j != i && dx * dx + dy * dy + dz * dz < hSq)
+					chunkNeighbors.push_back(j);
+			});
+
+			m_neighborStart[i + 1] = static_cast<int>(chunkNeighbors.size() - first);
+		}
+	}, minChunkSize);
+
+	for (int i = 0; i < numParticles; i++)
+		m_neighborStart[i + 1] += m_neighborStart[i];
+
+	m_neighbors.clear();
+	m_neighbors.reserve(m_neighborStart[numParticles]);
+	int numChunks = JobSystem::GetChunkCount(numParticles, jobSystem.GetNumThreads(), minChunkSize);
+	for (int chunk = 0; chunk < numChunks; chunk++)
+		m_neighbors.insert(m_neighbors.end(), m_chunkNeighbors[chunk].begin(), m_chunkNeighbors[chunk].end());
+}
+
+void PbfSolver::ComputeLambdas()
+{
+	const float h = m_settings.smoothingRadius;
+	const float hSq = h * h;
+	const float poly6 = m_settings.particleMass * 315.0f / (64.0f * DirectX::XM_PI * std::pow(h, 9.0f));
+	const float spikyGradient = -45.0f / (DirectX::XM_PI * std::pow(h, 6.0f));
+	const float gradientScale = m_settings.particleMass / m_settings.restDensity;
+	const float invRestDensity = 1.0f / m_settings.restDensity;
+	const float relaxation = m_settings.relaxation;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(m_predicted.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = m_predicted[i];
+			float density = hSq * hSq * hSq;
+			float gradientSumSq = 0.0f;
+			float gx = 0.0f;
+			float gy = 0.0f;
+			float gz = 0.0f;
+
+			for (int n = m_neighborStart[i]; n < m_neighborStart[i + 1]; n++)
+			{
+				int j = m_neighbors[n];
+				float dx = pi.x - m_predicted[j].x;
+				float dy = pi.y - m_predicted[j].y;
+				float dz = pi.z - m_predicted[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq >= hSq)
+					continue;
+
+				float diff = hSq - rSq;
+				density += diff * diff * diff;
+
+				if (rSq < 1e-12f)
+					continue;
+
+				float r = std::sqrt(rSq);
+				float hr = h - r;
+				float gradient = gradientScale * spikyGradient * hr * hr / r;
+				float gradX = gradient * dx;
+				float gradY = gradient * dy;
+				float gradZ = gradient * dz;
+
+				gradientSumSq += gradX * gradX + gradY * gradY + gradZ * gradZ;
+				gx += gradX;
+				gy += gradY;
+				gz += gradZ;
+			}
+
+			DirectX::XMFLOAT3& boundaryGradient = m_boundaryGradients[i];
+			float boundaryDensity = ComputeBoundaryDensity(pi, boundaryGradient);
+			gx += boundaryGradient.x;
+			gy += boundaryGradient.y;
+			gz += boundaryGradient.z;
+			gradientSumSq += gx * gx + gy * gy + gz * gz;
+
+			// Only compression is corrected, under-dense particles at the free surface would otherwise clump
+			float constraint = density * poly6 * invRestDensity + boundaryDensity - 1.0f;
+			m_lambdas[i] = -std::max(0.0f, constraint) / (gradientSumSq + relaxation);
+		}
+	}, 512);
+}
+
+void PbfSolver::ComputeCorrections()
+{
+	const float h = m_settings.smoothingRadius;
+	const float hSq = h * h;
+	const float spikyGradient = -45.0f / (DirectX::XM_PI * std::pow(h, 6.0f));
+	const float gradientScale = m_settings.particleMass / m_settings.restDensity;
+	const float artificialPressure = m_settings.artificialPressure;
+	const float deltaQSq = m_settings.artificialPressureRadius * m_settings.artificialPressureRadius;
+	const float invPoly6DeltaQ = 1.0f / ((hSq - deltaQSq) * (hSq - deltaQSq) * (hSq - deltaQSq));
+	const float maxCorrection = m_settings.maxCorrection;
+	const float restNeighborCount = static_cast<float>(m_settings.restNeighborCount);
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(m_predicted.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = m_predicted[i];
+			float lambda = m_lambdas[i];
+			float cx = 0.0f;
+			float cy = 0.0f;
+			float cz = 0.0f;
+			int numNeighbors = 0;
+
+			for (int n = m_neighborStart[i]; n < m_neighborStart[i + 1]; n++)
+			{
+				int j = m_neighbors[n];
+				float dx = pi.x - m_predicted[j].x;
+				float dy = pi.y - m_predicted[j].y;
+				float dz = pi.z - m_predicted[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq >= hSq || rSq < 1e-12f)
+					continue;
+
+				numNeighbors++;
+
+				// Artificial pressure (W(r) / W(deltaQ))^4 pushes apart particles that are closer than deltaQ
+				float ratio = (hSq - rSq) * (hSq - rSq) * (hSq - rSq) * invPoly6DeltaQ;
+				float ratioSq = ratio * ratio;
+				float correction = -artificialPressure * ratioSq * ratioSq;
+
+				float r = std::sqrt(rSq);
+				float hr = h - r;
+				float scale = (lambda + m_lambdas[j] + correction) * gradientScale * spikyGradient * hr * hr / r;
+				cx += scale * dx;
+				cy += scale * dy;
+				cz += scale * dz;
+			}
+
+			// Jacobi corrections of crowded particles add up and overshoot, so they are averaged over the
+			// neighbors beyond the rest count. The clamp keeps single iterations from launching particles.
+			float weight = numNeighbors > restNeighborCount ? restNeighborCount / numNeighbors : 1.0f;
+			float lengthSq = (cx * cx + cy * cy + cz * cz) * weight * weight;
+			if (lengthSq > maxCorrection * maxCorrection)
+				weight *= maxCorrection / std::sqrt(lengthSq);
+
+			// The walls don't move, so only the particle's own constraint pushes it off them
+			const DirectX::XMFLOAT3& boundaryGradient = m_boundaryGradients[i];
+			m_corrections[i] = DirectX::XMFLOAT3(cx * weight + lambda * boundaryGradient.x, cy * weight + lambda * boundaryGradient.y,
+				cz * weight + lambda * boundaryGradient.z);
+		}
+	}, 512);
+}
+
+void PbfSolver::ApplyCorrections()
+{
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(m_predicted.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			m_predicted[i].x += m_corrections[i].x;
+			m_predicted[i].y += m_corrections[i].y;
+			m_predicted[i].z += m_corrections[i].z;
+			ReflectFromBounds(m_predicted[i]);
+		}
+	}, 2048);
+}
+
+void PbfSolver::ComputeDensityErrors()
+{
+	const float hSq = m_settings.smoothingRadius * m_settings.smoothingRadius;
+	const float poly6 = m_settings.particleMass * 315.0f / (64.0f * DirectX::XM_PI * std::pow(m_settings.smoothingRadius, 9.0f)) / m_settings.restDensity;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(m_predicted.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = m_predicted[i];
+			float density = hSq * hSq * hSq;
+
+			for (int n = m_neighborStart[i]; n < m_neighborStart[i + 1]; n++)
+			{
+				int j = m_neighbors[n];
+				float dx = pi.x - m_predicted[j].x;
+				float dy = pi.y - m_predicted[j].y;
+				float dz = pi.z - m_predicted[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq < hSq)
+				{
+					float diff = hSq - rSq;
+					density += diff * diff * diff;
+				}
+			}
+
+			DirectX::XMFLOAT3 boundaryGradient;
+			float boundaryDensity = ComputeBoundaryDensity(pi, boundaryGradient);
+			m_densityErrors[i] = std::max(0.0f, density * poly6 + boundaryDensity - 1.0f);
+		}
+	}, 512);
+}
+
+void PbfSolver::ApplyViscosity(std::vector<DirectX::XMFLOAT3>& velocities)
+{
+	const float h = m_settings.smoothingRadius;
+	const float hSq = h * h;
+	const float poly6 = m_settings.particleMass * 315.0f / (64.0f * DirectX::XM_PI * std::pow(h, 9.0f)) / m_settings.restDensity;
+	const float viscosity = m_settings.xsphViscosity;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(m_predicted.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = m_predicted[i];
+			const DirectX::XMFLOAT3& vi = velocities[i];
+			float vx = 0.0f;
+			float vy = 0.0f;
+			float vz = 0.0f;
+
+			for (int n = m_neighborStart[i]; n < m_neighborStart[i + 1]; n++)
+			{
+				int j = m_neighbors[n];
+				float dx = pi.x - m_predicted[j].x;
+				float dy = pi.y - m_predicted[j].y;
+				float dz = pi.z - m_predicted[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq >= hSq)
+					continue;
+
+				float diff = hSq - rSq;
+				float weight = poly6 * diff * diff * diff;
+				vx += weight * (velocities[j].x - vi.x);
+				vy += weight * (velocities[j].y - vi.y);
+				vz += weight * (velocities[j].z - vi.z);
+			}
+
+			m_viscousVelocities[i] = DirectX::XMFLOAT3(vi.x + viscosity * vx, vi.y + viscosity * vy, vi.z + viscosity * vz);
+		}
+	}, 512);
+
+	velocities.swap(m_viscousVelocities);
+}
+
+float PbfSolver::ComputeBoundaryDensity(const DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& gradient) const
+{
+	const float h = m_settings.smoothingRadius;
+	const float distances[6] = { position.x - m_settings.boundsMin.x, position.y - m_settings.boundsMin.y, position.z - m_settings.boundsMin.z,
+		m_settings.boundsMax.x - position.x, m_settings.boundsMax.y - position.y, m_settings.boundsMax.z - position.z };
+
+	gradient = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+	if (*std::min_element(distances, distances + 6) >= h)
+		return 0.0f;
+
+	// Every wall hides the share of the kernel behind it, the poly6 kernel integrated over the half space:
+	// 1/2 - 315/256 (u - 4/3 u^3 + 6/5 u^5 - 4/7 u^7 + 1/9 u^9) at distance u = d / h. Edges and corners
+	// combine the walls as 1 - product of the visible shares, which is exact for a particle on the edge.
+	float hidden[6];
+	float slopes[6];
+	float visible = 1.0f;
+	for (int wall = 0; wall < 6; wall++)
+	{
+		float u = std::min(std::max(distances[wall] / h, 0.0f), 1.0f);
+		float uSq = u * u;
+		float falloff = (1.0f - uSq) * (1.0f - uSq);
+		hidden[wall] = 0.5f - 315.0f / 256.0f * u * (1.0f + uSq * (-4.0f / 3.0f + uSq * (6.0f / 5.0f + uSq * (-4.0f / 7.0f + uSq / 9.0f))));
+		slopes[wall] = 315.0f / 256.0f / h * falloff * falloff;
+		visible *= 1.0f - hidden[wall];
+	}
+
+	// The hidden share grows towards a wall, so the gradient points into it
+	float g[3] = { 0.0f, 0.0f, 0.0f };
+	for (int wall = 0; wall < 6; wall++)
+	{
+		if (slopes[wall] == 0.0f)
+			continue;
+
+		float otherVisible = 1.0f;
+		for (int other = 0; other < 6; other++)
+		{
+			if (other != wall)
+				otherVisible *= 1.0f - hidden[other];
+		}
+		g[wall % 3] += (wall < 3 ? -slopes[wall] : slopes[wall]) * otherVisible;
+	}
+
+	gradient = DirectX::XMFLOAT3(g[0], g[1], g[2]);
+	return 1.0f - visible;
+}
+
+void PbfSolver::ReflectFromBounds(DirectX::XMFLOAT3& position) const
+{
+	// Mirroring the penetration keeps particles at different depths apart, where projecting them onto
+	// the wall plane would stack them up. The velocity update turns it into a bounce with restitution.
+	float* p[3] = { &position.x, &position.y, &position.z };
+	const float minC[3] = { m_settings.boundsMin.x, m_settings.boundsMin.y, m_settings.boundsMin.z };
+	const float maxC[3] = { m_settings.boundsMax.x, m_settings.boundsMax.y, m_settings.boundsMax.z };
+	const float restitution = m_settings.boundaryRestitution;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (*p[axis] < minC[axis])
+			*p[axis] = std::min(minC[axis] + (minC[axis] - *p[axis]) * restitution, maxC[axis]);
+		else if (*p[axis] > maxC[axis])
+			*p[axis] = std::max(maxC[axis] - (*p[axis] - maxC[axis]) * restitution, minC[axis]);
+	}
+}
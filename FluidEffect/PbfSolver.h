@@ -0,0 +1,67 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "NeighborGrid.h"
+
+struct PbfSettings
+{
+	float smoothingRadius;
+	float particleMass;
+	float restDensity;
+	int numIterations;
+	float relaxation;
+	float artificialPressure;
+	float artificialPressureRadius;
+	float xsphViscosity;
+	// Longest position correction per iteration, keeps few iterations from launching particles
+	float maxCorrection;
+	// Neighbor count at rest, corrections of more crowded particles are averaged down to it
+	int restNeighborCount;
+	DirectX::XMFLOAT3 gravity;
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	float boundaryRestitution;
+	float maxTimeStep;
+
+	static PbfSettings ForParticleSpacing(float spacing);
+};
+
+// Position based fluids: density constraints solved with Jacobi iterations, artificial pressure
+// against particle clumping and XSPH viscosity. Stays stable at frame sized time steps, more
+// iterations buy lower compression. The walls of the bounds count as fluid at rest density, so
+// the density constraints push particles off them instead of piling them up on the wall planes.
+class PbfSolver
+{
+public:
+	PbfSolver();
+
+	void Step(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime);
+	void Substep(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime);
+
+	// Average compression left after the last substep's iterations, relative to the rest density
+	float GetAverageDensityError() const { return m_densityError; }
+
+	PbfSettings m_settings;
+
+private:
+	void FindNeighbors();
+	void ComputeLambdas();
+	void ComputeCorrections();
+	void ApplyCorrections();
+	void ComputeDensityErrors();
+	void ApplyViscosity(std::vector<DirectX::XMFLOAT3>& velocities);
+	float ComputeBoundaryDensity(const DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& gradient) const;
+	void ReflectFromBounds(DirectX::XMFLOAT3& position) const;
+
+	NeighborGrid m_grid;
+	std::vector<DirectX::XMFLOAT3> m_predicted;
+	std::vector<DirectX::XMFLOAT3> m_corrections;
+	std::vector<DirectX::XMFLOAT3> m_viscousVelocities;
+	std::vector<DirectX::XMFLOAT3> m_boundaryGradients;
+	std::vector<int> m_neighborStart;
+	std::vector<int> m_neighbors;
+	std::vector<std::vector<int>> m_chunkNeighbors;
+	std::vector<float> m_lambdas;
+	std::vector<float> m_densityErrors;
+	float m_densityError;
+};
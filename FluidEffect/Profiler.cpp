@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "Profiler.h"
+
+std::atomic<bool> Profiler::s_enabled(false);
+
+Profiler::Profiler()
+{
+	m_frameCount = 0;
+	for (int i = 0; i < MAX_FRAMES; i++)
+		m_frameStarts[i] = 0;
+}
+
+Profiler& Profiler::GetInstance()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::BeginFrame()
+{
+	if (!IsEnabled())
+		return;
+
+	m_frameStarts[m_frameCount % MAX_FRAMES] = GetTimestamp();
+	m_frameCount++;
+}
+
+int64_t Profiler::GetTimestamp()
+{
+	auto now = std::chrono::high_resolution_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+	thread_local ThreadBuffer* threadBuffer = nullptr;
+
+	if (!threadBuffer)
+	{
+		Profiler& profiler = GetInstance();
+		std::lock_guard<std::mutex> lock(profiler.m_registryMutex);
+
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		buffer->events.resize(EVENTS_PER_THREAD);
+		buffer->writeIndex.store(0);
+		buffer->threadId = static_cast<uint32_t>(profiler.m_threadBuffers.size());
+		buffer->depth = 0;
+
+		threadBuffer = buffer.get();
+		profiler.m_threadBuffers.push_back(std::move(buffer));
+	}
+
+	return threadBuffer;
+}
+
+int64_t Profiler::BeginScope()
+{
+	GetThreadBuffer()->depth++;
+	return GetTimestamp();
+}
+
+void Profiler::EndScope(const char* name, int64_t start)
+{
+	int64_t end = GetTimestamp();
+	ThreadBuffer* buffer = GetThreadBuffer();
+	buffer->depth--;
+
+	uint64_t index = buffer->writeIndex.load(std::memory_order_relaxed);
+	ProfileEvent& profileEvent = buffer->events[index & (EVENTS_PER_THREAD - 1)];
+	profileEvent.name = name;
+	profileEvent.start = start;
+	profileEvent.end = end;
+	profileEvent.depth = buffer->depth;
+	buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::DumpChromeTrace(const std::string& fileName, int numFrames)
+{
+	if (m_frameCount == 0)
+	{
+		std::cout << "No profiled frames to dump." << std::endl;
+		return false;
+	}
+
+	uint64_t framesToDump = std::min<uint64_t>(std::min<uint64_t>(numFrames, m_frameCount), MAX_FRAMES);
+	uint64_t firstFrame = m_frameCount - framesToDump;
+	int64_t cutoff = m_frameStarts[firstFrame % MAX_FRAMES];
+
+	std::ofstream traceFile(fileName);
+	if (!traceFile.is_open())
+	{
+		std::cerr << "Failed to open file: " << fileName << std::endl;
+		return false;
+	}
+
+	// Chrome/Perfetto expect microseconds; timestamps are rebased to the first dumped frame and
+	// written in fixed notation to the nanosecond, so long dumps keep short events in place
+	traceFile << std::fixed << std::setprecision(3);
+	traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+
+	for (uint64_t frame = firstFrame; frame < m_frameCount; frame++)
+	{
+		int64_t frameStart = m_frameStarts[frame % MAX_FRAMES];
+		traceFile << (first ? "" : ",") << "\n{\"name\":\"Frame " << frame << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":" << (frameStart - cutoff) / 1000.0 << "}";
+		first = false;
+	}
+
+	// Rings are read without synchronizing with their writers, so this is meant to be called
+	// between frames while worker threads are idle and the simulation thread is paused
+	std::lock_guard<std::mutex> lock(m_registryMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : m_threadBuffers)
+	{
+		uint64_t end = buffer->writeIndex.load(std::memory_order_acquire);
+		uint64_t begin = end > EVENTS_PER_THREAD ? end - EVENTS_PER_THREAD : 0;
+
+		for (uint64_t i = begin; i < end; i++)
+		{
+			const ProfileEvent& profileEvent = buffer->events[i & (EVENTS_PER_THREAD - 1)];
+			if (profileEvent.start < cutoff)
+				continue;
+
+			traceFile << (first ? "" : ",") << "\n{\"name\":\"" << profileEvent.name << "\",\"cat\":\"FluidEffect\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << (profileEvent.start - cutoff) / 1000.0 << ",\"dur\":" << (profileEvent.end - profileEvent.start) / 1000.0
+				<< ",\"args\":{\"depth\":" << profileEvent.depth << "}}";
+			first = false;
+		}
+	}
+
+	traceFile << "\n]}\n";
+	traceFile.close();
+
+	std::cout << "Dumped " << framesToDump << " frames to " << fileName << std::endl;
+	return true;
+}
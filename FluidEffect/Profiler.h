@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+struct ProfileEvent
+{
+	const char* name;
+	int64_t start;
+	int64_t end;
+	uint32_t depth;
+};
+
+class Profiler
+{
+public:
+	static Profiler& GetInstance();
+
+	// The only cost of a ProfileScope while profiling is disabled is this load and the branch on it
+	static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+	void SetEnabled(bool enabled);
+
+	void BeginFrame();
+	bool DumpChromeTrace(const std::string& fileName, int numFrames);
+
+	static int64_t GetTimestamp();
+	static int64_t BeginScope();
+	static void EndScope(const char* name, int64_t start);
+
+private:
+	Profiler();
+
+	// Every thread writes into its own ring, so recording needs no lock. The registry lock is only
+	// taken once per thread when its ring is created and while dumping.
+	struct ThreadBuffer
+	{
+		std::vector<ProfileEvent> events;
+		std::atomic<uint64_t> writeIndex;
+		uint32_t threadId;
+		uint32_t depth;
+	};
+
+	static ThreadBuffer* GetThreadBuffer();
+
+	static std::atomic<bool> s_enabled;
+	static const uint64_t EVENTS_PER_THREAD = 1 << 16;
+	static const int MAX_FRAMES = 256;
+
+	std::mutex m_registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> m_threadBuffers;
+	int64_t m_frameStarts[MAX_FRAMES];
+	uint64_t m_frameCount;
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name)
+	{
+		m_name = nullptr;
+		if (Profiler::IsEnabled())
+		{
+			m_name = name;
+			m_start = Profiler::BeginScope();
+		}
+	}
+
+	~ProfileScope()
+	{
+		if (m_name)
+			Profiler::EndScope(m_name, m_start);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* m_name;
+	int64_t m_start;
+};
@@ -0,0 +1,123 @@
+#include <cstring>
+#include <numeric>
+#include <utility>
+#include "RadixSort.h"
+#include "JobSystem.h"
+
+namespace
+{
+	const int MIN_CHUNK_SIZE = 8192;
+}
+
+void RadixSort::Sort(const uint32_t* keys, int numKeys, std::vector<int>& order)
+{
+	SortKeys(keys, numKeys, m_keys32, order);
+}
+
+void RadixSort::Sort(const uint64_t* keys, int numKeys, std::vector<int>& order)
+{
+	SortKeys(keys, numKeys, m_keys64, order);
+}
+
+void RadixSort::Sort(const float* keys, int numKeys, std::vector<int>& order)
+{
+	// Flipping the sign bit of positive and all bits of negative floats makes them compare as integers
+	m_floatKeys.resize(numKeys);
+	JobSystem::GetInstance().ParallelFor(numKeys, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &keys[i], sizeof(bits));
+			m_floatKeys[i] = bits ^ ((bits & 0x80000000u) ? 0xffffffffu : 0x80000000u);
+		}
+	}, MIN_CHUNK_SIZE);
+
+	SortKeys(m_floatKeys.data(), numKeys, m_keys32, order);
+}
+
+template <typename Key>
+void RadixSort::SortKeys(const Key* keys, int numKeys, std::vector<Key> (&keyBuffers)[2], std::vector<int>& order)
+{
+	// Half again as much room as needed, so key counts going up and down settle without reallocating
+	if (keyBuffers[0].capacity() < static_cast<size_t>(numKeys))
+	{
+		size_t capacity = numKeys + numKeys / 2;
+		keyBuffers[0].reserve(capacity);
+		keyBuffers[1].reserve(capacity);
+		m_indices.reserve(capacity);
+		order.reserve(capacity);
+	}
+
+	order.resize(numKeys);
+	std::iota(order.begin(), order.end(), 0);
+	if (numKeys <= 1)
+		return;
+
+	// Bits that differ between any two keys
+	Key allOr = 0;
+	Key allAnd = ~static_cast<Key>(0);
+	for (int i = 0; i < numKeys; i++)
+	{
+		allOr |= keys[i];
+		allAnd &= keys[i];
+	}
+	Key varyingBits = allOr ^ allAnd;
+
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	int numChunks = JobSystem::GetChunkCount(numKeys, jobSystem.GetNumThreads(), MIN_CHUNK_SIZE);
+	keyBuffers[0].assign(keys, keys + numKeys);
+	keyBuffers[1].resize(numKeys);
+	m_indices.resize(numKeys);
+	int source = 0;
+	std::vector<int>* sourceIndices = &order;
+	std::vector<int>* targetIndices = &m_indices;
+
+	for (int shift = 0; shift < static_cast<int>(sizeof(Key) * 8); shift += DIGIT_BITS)
+	{
+		if (((varyingBits >> shift) & (NUM_DIGITS - 1)) == 0)
+			continue;
+
+		const Key* sourceKeys = keyBuffers[source].data();
+		Key* targetKeys = keyBuffers[1 - source].data();
+		const int* sourceOrder = sourceIndices->data();
+		int* targetOrder = targetIndices->data();
+
+		m_offsets.assign(numChunks * NUM_DIGITS, 0);
+		jobSystem.ParallelFor(numKeys, [&](int begin, int end, int chunk)
+		{
+			uint32_t* counts = &m_offsets[chunk * NUM_DIGITS];
+			for (int i = begin; i < end; i++)
+				counts[(sourceKeys[i] >> shift) & (NUM_DIGITS - 1)]++;
+		}, MIN_CHUNK_SIZE);
+
+		// Digit major, chunk minor, so every chunk scatters its keys behind those of earlier chunks
+		uint32_t offset = 0;
+		for (int digit = 0; digit < NUM_DIGITS; digit++)
+		{
+			for (int chunk = 0; chunk < numChunks; chunk++)
+			{
+				uint32_t count = m_offsets[chunk * NUM_DIGITS + digit];
+				m_offsets[chunk * NUM_DIGITS + digit] = offset;
+				offset += count;
+			}
+		}
+
+		jobSystem.ParallelFor(numKeys, [&](int begin, int end, int chunk)
+		{
+			uint32_t* offsets = &m_offsets[chunk * NUM_DIGITS];
+			for (int i = begin; i < end; i++)
+			{
+				uint32_t target = offsets[(sourceKeys[i] >> shift) & (NUM_DIGITS - 1)]++;
+				targetKeys[target] = sourceKeys[i];
+				targetOrder[target] = sourceOrder[i];
+			}
+		}, MIN_CHUNK_SIZE);
+
+		source = 1 - source;
+		std::swap(sourceIndices, targetIndices);
+	}
+
+	if (sourceIndices != &order)
+		order.swap(m_indices);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Stable LSD radix sort over 8 bit digits. Every pass histograms and scatters in parallel chunks,
+// digits that are the same in all keys are skipped, so 30 bit Morton codes take at most four passes.
+class RadixSort
+{
+public:
+	// Fills order with the indices of the keys in ascending key order, equal keys keep their order
+	void Sort(const uint32_t* keys, int numKeys, std::vector<int>& order);
+	void Sort(const uint64_t* keys, int numKeys, std::vector<int>& order);
+	// Same order as comparing the floats, -0 before +0 and NaNs at the ends by sign
+	void Sort(const float* keys, int numKeys, std::vector<int>& order);
+
+private:
+	static const int DIGIT_BITS = 8;
+	static const int NUM_DIGITS = 1 << DIGIT_BITS;
+
+	template <typename Key>
+	void SortKeys(const Key* keys, int numKeys, std::vector<Key> (&keyBuffers)[2], std::vector<int>& order);
+
+	std::vector<uint32_t> m_keys32[2];
+	std::vector<uint64_t> m_keys64[2];
+	std::vector<uint32_t> m_floatKeys;
+	std::vector<int> m_indices;
+	std::vector<uint32_t> m_offsets;
+};
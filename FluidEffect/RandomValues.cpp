@@ -0,0 +1,153 @@
+#include <atomic>
+#include <emmintrin.h>
+#include "RandomValues.h"
+
+namespace
+{
+	std::atomic<uint64_t> globalSeed(0x853c49e6748fea9bULL);
+	std::atomic<uint64_t> nextThreadStream(0);
+
+	uint64_t SplitMix64(uint64_t& x)
+	{
+		uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	inline uint32_t RotateLeft(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	inline __m128i RotateLeft(__m128i x, int k)
+	{
+		return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+	}
+
+	// The upper 24 bits give every representable float in [0, 1) with equal spacing
+	inline float ToUnitFloat(uint32_t x)
+	{
+		return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+RandomGenerator::RandomGenerator(uint64_t seed, uint64_t stream)
+{
+	Seed(seed, stream);
+}
+
+void RandomGenerator::Seed(uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed ^ (stream * 0xd1342543de82ef95ULL);
+
+	for (int i = 0; i < 4; i += 2)
+	{
+		uint64_t value = SplitMix64(x);
+		m_state[i] = static_cast<uint32_t>(value);
+		m_state[i + 1] = static_cast<uint32_t>(value >> 32);
+	}
+
+	for (int lane = 0; lane < 4; lane++)
+	{
+		for (int i = 0; i < 4; i += 2)
+		{
+			uint64_t value = SplitMix64(x);
+			m_laneState[i][lane] = static_cast<uint32_t>(value);
+			m_laneState[i + 1][lane] = static_cast<uint32_t>(value >> 32);
+		}
+	}
+}
+
+uint32_t RandomGenerator::NextUInt()
+{
+	uint32_t result = m_state[0] + m_state[3];
+	uint32_t t = m_state[1] << 9;
+
+	m_state[2] ^= m_state[0];
+	m_state[3] ^= m_state[1];
+	m_state[1] ^= m_state[2];
+	m_state[0] ^= m_state[3];
+	m_state[2] ^= t;
+	m_state[3] = RotateLeft(m_state[3], 11);
+
+	return result;
+}
+
+float RandomGenerator::NextFloat()
+{
+	return ToUnitFloat(NextUInt());
+}
+
+float RandomGenerator::NextFloat(float min, float max)
+{
+	return min + (max - min) * NextFloat();
+}
+
+void RandomGenerator::Fill(float* out, size_t count, float min, float max)
+{
+	size_t i = 0;
+
+	if (count >= 8)
+	{
+		__m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_laneState[0]));
+		__m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_laneState[1]));
+		__m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_laneState[2]));
+		__m128i s3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_laneState[3]));
+
+		const __m128 scale = _mm_set1_ps((max - min) * (1.0f / 16777216.0f));
+		const __m128 offset = _mm_set1_ps(min);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i result = _mm_add_epi32(s0, s3);
+			__m128i t = _mm_slli_epi32(s1, 9);
+
+			s2 = _mm_xor_si128(s2, s0);
+			s3 = _mm_xor_si128(s3, s1);
+			s1 = _mm_xor_si128(s1, s2);
+			s0 = _mm_xor_si128(s0, s3);
+			s2 = _mm_xor_si128(s2, t);
+			s3 = RotateLeft(s3, 11);
+
+			// 24 bit integers convert to float exactly, so one multiply-add maps them into [min, max)
+			__m128 values = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(values, scale), offset));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(m_laneState[0]), s0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(m_laneState[1]), s1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(m_laneState[2]), s2);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(m_laneState[3]), s3);
+	}
+
+	for (; i < count; i++)
+		out[i] = NextFloat(min, max);
+}
+
+float RandomValues::GetRandomValue(float min, float max)
+{
+	return GetThreadGenerator().NextFloat(min, max);
+}
+
+void RandomValues::FillRandomValues(float* out, size_t count, float min, float max)
+{
+	GetThreadGenerator().Fill(out, count, min, max);
+}
+
+void RandomValues::SetSeed(uint64_t seed)
+{
+	GetThreadGenerator().Seed(seed);
+}
+
+void RandomValues::SetGlobalSeed(uint64_t seed)
+{
+	globalSeed.store(seed);
+	nextThreadStream.store(0);
+}
+
+RandomGenerator& RandomValues::GetThreadGenerator()
+{
+	thread_local RandomGenerator generator(globalSeed.load(), nextThreadStream.fetch_add(1));
+	return generator;
+}
@@ -1,14 +1,37 @@
 #pragma once
-#include <random>
+#include <cstddef>
+#include <cstdint>
 
-class RandomValues
+// xoshiro128+ generator. Single values come from one scalar stream, Fill runs four
+// independent streams side by side in SSE2 registers for batched generation.
+class RandomGenerator
 {
 public:
-	static float GetRandomValue(float min, float max) {
-		static std::random_device rd;
-		static std::mt19937 gen(rd());
-		static std::uniform_real_distribution<float> dis(min, max);
-		return dis(gen);
-	}
+	explicit RandomGenerator(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0);
+
+	void Seed(uint64_t seed, uint64_t stream = 0);
+
+	uint32_t NextUInt();
+	float NextFloat();
+	float NextFloat(float min, float max);
+
+	void Fill(float* out, size_t count, float min, float max);
+
+private:
+	uint32_t m_state[4];
+	alignas(16) uint32_t m_laneState[4][4];
 };
 
+class RandomValues
+{
+public:
+	static float GetRandomValue(float min, float max);
+	static void FillRandomValues(float* out, size_t count, float min, float max);
+
+	// Reseeds the calling thread's generator. Threads that never call this are seeded from
+	// the global seed and the order in which they first drew a value.
+	static void SetSeed(uint64_t seed);
+	static void SetGlobalSeed(uint64_t seed);
+
+	static RandomGenerator& GetThreadGenerator();
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// File layout shared by SimulationRecorder and SimulationReplayer:
+// RecordingHeader, then per frame a RecordedFrameHeader and its payload, then the chunk index
+// and a RecordingFooter. Every chunk starts with a keyframe, so seeking decodes at most one chunk.
+//
+// Particles keep their order between frames, dead ones drop out and new ones are appended. Every
+// particle therefore starts with the number of previous particles that died before it, found from
+// the particle ids, followed by the residuals against the previous particle moved on by its
+// velocity. Keyframes predict nothing, their skip counts only let a replayer decoding in sequence
+// keep following the particles.
+
+const uint32_t RECORDING_MAGIC = 0x31434552;		// "REC1"
+const uint32_t RECORDING_INDEX_MAGIC = 0x58444E49;	// "INDX"
+const uint32_t RECORDING_KEYFRAME = 1;
+const uint32_t RECORDING_KEYFRAME_SKIPS = 2;		// Keyframe particles start with a skip count too, older files lack it
+const int RECORDING_VALUES_PER_PARTICLE = 6;		// Quantized position and velocity
+
+struct RecordingHeader
+{
+	uint32_t magic;
+	uint32_t framesPerChunk;
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	float maxSpeed;
+	uint32_t reserved;
+};
+
+struct RecordedFrameHeader
+{
+	uint32_t payloadSize;
+	uint32_t numParticles;
+	float time;
+	uint32_t flags;		// RECORDING_KEYFRAME if nothing is predicted from the previous frame
+};
+
+struct RecordingChunk
+{
+	uint32_t firstFrame;
+	uint32_t reserved;
+	uint64_t offset;
+};
+
+struct RecordingFooter
+{
+	uint64_t indexOffset;
+	uint32_t numChunks;
+	uint32_t numFrames;
+	uint32_t magic;
+	uint32_t reserved;
+};
+
+inline int32_t ClampQuantized(float value, int32_t minValue, int32_t maxValue)
+{
+	// Also catches NaN before the conversion
+	if (!(value > minValue))
+		return minValue;
+	if (value >= maxValue)
+		return maxValue;
+	return static_cast<int32_t>(std::floor(value + 0.5f));
+}
+
+// Positions are stored as 16 bit fractions of the bounds around the emitter, velocities as 16 bit
+// fractions of maxSpeed. Residuals and skip counts are zigzag varints.
+struct RecordingQuantizer
+{
+	DirectX::XMFLOAT3 boundsMin;
+	float positionScale[3];		// Quantized units per meter
+	float velocityScale;		// Quantized units per m/s
+
+	void Initialize(const RecordingHeader& header)
+	{
+		boundsMin = header.boundsMin;
+		positionScale[0] = 65535.0f / std::max(header.boundsMax.x - header.boundsMin.x, 1e-3f);
+		positionScale[1] = 65535.0f / std::max(header.boundsMax.y - header.boundsMin.y, 1e-3f);
+		positionScale[2] = 65535.0f / std::max(header.boundsMax.z - header.boundsMin.z, 1e-3f);
+		velocityScale = 32767.0f / std::max(header.maxSpeed, 1e-3f);
+	}
+
+	void Quantize(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& velocity, int32_t* values) const
+	{
+		values[0] = ClampQuantized((position.x - boundsMin.x) * positionScale[0], 0, 65535);
+		values[1] = ClampQuantized((position.y - boundsMin.y) * positionScale[1], 0, 65535);
+		values[2] = ClampQuantized((position.z - boundsMin.z) * positionScale[2], 0, 65535);
+		values[3] = ClampQuantized(velocity.x * velocityScale, -32767, 32767);
+		values[4] = ClampQuantized(velocity.y * velocityScale, -32767, 32767);
+		values[5] = ClampQuantized(velocity.z * velocityScale, -32767, 32767);
+	}
+
+	void Dequantize(const int32_t* values, DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity) const
+	{
+		position.x = boundsMin.x + values[0] / positionScale[0];
+		position.y = boundsMin.y + values[1] / positionScale[1];
+		position.z = boundsMin.z + values[2] / positionScale[2];
+		velocity.x = values[3] / velocityScale;
+		velocity.y = values[4] / velocityScale;
+		velocity.z = values[5] / velocityScale;
+	}
+
+	// Quantized position change per quantized velocity unit over deltaTime, identical for encoder and decoder
+	void GetVelocityToPosition(float deltaTime, float* factors) const
+	{
+		for (int axis = 0; axis < 3; axis++)
+			factors[axis] = positionScale[axis] / velocityScale * deltaTime;
+	}
+};
+
+// Previous frame's particle moved on by its velocity, the velocity itself is predicted unchanged
+inline void PredictParticle(const int32_t* previousPosition, const int32_t* previousVelocity, const float* velocityToPosition, int32_t* position, int32_t* velocity)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		position[axis] = previousPosition[axis] + static_cast<int32_t>(std::floor(previousVelocity[axis] * velocityToPosition[axis] + 0.5f));
+		velocity[axis] = previousVelocity[axis];
+	}
+}
+
+inline void WriteVarint(std::vector<uint8_t>& out, int32_t value)
+{
+	uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	while (zigzag >= 0x80)
+	{
+		out.push_back(static_cast<uint8_t>(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(zigzag));
+}
+
+// Returns false if the varint runs past end
+inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, int32_t& value)
+{
+	uint32_t zigzag = 0;
+	for (int shift = 0; shift < 35; shift += 7)
+	{
+		if (data >= end)
+			return false;
+		uint8_t byte = *data++;
+		zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			value = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <Windows.h>
+
+enum RenderBufferType
+{
+	RENDER_BUFFER_VERTEX,
+	RENDER_BUFFER_INDEX,		// 32 bit indices
+	RENDER_BUFFER_CONSTANT,
+	RENDER_BUFFER_STRUCTURED,	// Bound as a shader resource
+	RENDER_BUFFER_TYPE_COUNT
+};
+
+enum RenderShaderStage
+{
+	RENDER_STAGE_VERTEX,
+	RENDER_STAGE_GEOMETRY,
+	RENDER_STAGE_PIXEL,
+	RENDER_STAGE_COUNT
+};
+
+enum RenderTopology
+{
+	RENDER_TOPOLOGY_POINT_LIST,
+	RENDER_TOPOLOGY_TRIANGLE_LIST
+};
+
+struct RenderBufferDesc
+{
+	RenderBufferType type;
+	UINT byteWidth;
+	UINT structureStride;	// Only for structured buffers
+	bool isDynamic;			// Dynamic buffers are written with Map, the others only get their initial data
+};
+
+struct RenderShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+// Entry points of one effect file and the defines they are compiled with
+struct RenderShaderProgramDesc
+{
+	std::wstring fileName;
+	std::string vertexEntryPoint;
+	std::string geometryEntryPoint;		// Empty without a geometry shader
+	std::string pixelEntryPoint;
+	std::vector<RenderShaderDefine> defines;
+
+	// VSMain, PSMain and with hasGeometryShader GSMain of the file
+	static RenderShaderProgramDesc FromFile(const WCHAR* fileName, bool hasGeometryShader)
+	{
+		RenderShaderProgramDesc desc;
+		desc.fileName = fileName;
+		desc.vertexEntryPoint = "VSMain";
+		desc.geometryEntryPoint = hasGeometryShader ? "GSMain" : "";
+		desc.pixelEntryPoint = "PSMain";
+		return desc;
+	}
+};
+
+// Resources belong to whoever created them and are freed with Release, like the D3D objects they wrap
+class RenderBuffer
+{
+public:
+	virtual void Release() = 0;
+	const RenderBufferDesc& GetDesc() const { return m_desc; }
+
+protected:
+	explicit RenderBuffer(const RenderBufferDesc& desc) : m_desc(desc) {}
+	virtual ~RenderBuffer() {}
+
+	RenderBufferDesc m_desc;
+};
+
+// Vertex, optional geometry and pixel shader of one effect file with the input layout of Vertex
+class RenderShaderProgram
+{
+public:
+	virtual void Release() = 0;
+	// Size of the compiled shaders
+	UINT GetNumBytes() const { return m_numBytes; }
+
+protected:
+	RenderShaderProgram() : m_numBytes(0) {}
+	virtual ~RenderShaderProgram() {}
+
+	UINT m_numBytes;
+};
+
+// Everything the renderer asks of the graphics API. D3D11RenderDevice draws, NullRenderDevice
+// only records the commands, so whole frames also run without a GPU or a window. Like on
+// ID3D11Device, resources are created and released from any thread, everything else is only
+// called by the thread that renders.
+class RenderDevice
+{
+public:
+	virtual ~RenderDevice() {}
+
+	virtual HRESULT CreateBuffer(const RenderBufferDesc& desc, const void* initialData, RenderBuffer** buffer) = 0;
+	virtual HRESULT CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program) = 0;
+
+	// Discards the old contents of a dynamic buffer, nullptr if it can not be mapped
+	virtual void* Map(RenderBuffer* buffer) = 0;
+	virtual void Unmap(RenderBuffer* buffer) = 0;
+
+	virtual void SetShaderProgram(RenderShaderProgram* program) = 0;
+	virtual void SetVertexBuffer(RenderBuffer* buffer, UINT stride) = 0;
+	virtual void SetIndexBuffer(RenderBuffer* buffer) = 0;
+	virtual void SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) = 0;
+	virtual void SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) = 0;
+	virtual void SetTopology(RenderTopology topology) = 0;
+	virtual void Draw(UINT numVertices, UINT firstVertex) = 0;
+	virtual void DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex) = 0;
+	// SV_InstanceID counts from 0 for every draw
+	virtual void DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex) = 0;
+
+	// Clears color and depth of the back buffer
+	virtual void Clear(const float color[4]) = 0;
+	virtual HRESULT Present() = 0;
+};
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include "RenderQueue.h"
+#include "Profiler.h"
+#include "EngineStats.h"
+
+namespace
+{
+	// Binds unless the device has the value already
+	template <typename T>
+	bool IsChange(T& bound, T value, bool isFiltering, RenderQueueStats& stats)
+	{
+		if (isFiltering && bound == value)
+		{
+			stats.numRedundant++;
+			return false;
+		}
+
+		bound = value;
+		stats.numStateChanges++;
+		return true;
+	}
+
+	// Addresses are aligned, so the high bits are mixed into the low ones the table masks
+	size_t HashAddress(const void* address)
+	{
+		uint64_t hash = reinterpret_cast<uintptr_t>(address);
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		return static_cast<size_t>(hash);
+	}
+}
+
+RenderQueue::RenderQueue()
+{
+	m_isSorting = true;
+	m_isFiltering = true;
+	m_programIds.numIds = 0;
+	m_materialIds.numIds = 0;
+	m_lastStats = RenderQueueStats();
+}
+
+void RenderQueue::Upload(RenderDrawPacket& packet, RenderBuffer* buffer, const void* data, UINT numBytes)
+{
+	if (!buffer || packet.numUploads >= MAX_PACKET_UPLOADS)
+		return;
+
+	RenderUpload& upload = packet.uploads[packet.numUploads++];
+	upload.buffer = buffer;
+	upload.offset = static_cast<UINT>(m_uploadData.size());
+	upload.numBytes = numBytes;
+	m_uploadData.resize(m_uploadData.size() + numBytes);
+	std::memcpy(m_uploadData.data() + upload.offset, data, numBytes);
+}
+
+void RenderQueue::Submit(const RenderDrawPacket& packet)
+{
+	if (!packet.program || !packet.vertexBuffer)
+		return;
+
+	uint32_t programId = GetId(packet.program, m_programIds, PROGRAM_ID_BITS);
+	uint32_t materialId = GetId(packet.vertexBuffer, m_materialIds, MATERIAL_ID_BITS);
+	m_keys.push_back(MakeSortKey(packet.pass, programId, materialId, packet.depth));
+	m_packets.push_back(packet);
+}
+
+void RenderQueue::Execute(RenderDevice* device)
+{
+	RenderQueueStats stats = RenderQueueStats();
+	int numPackets = static_cast<int>(m_packets.size());
+	stats.numPackets = numPackets;
+
+	long long start = Profiler::GetTimestamp();
+	{
+		PROFILE_SCOPE("RenderQueueSort");
+		if (m_isSorting)
+		{
+			m_radixSort.Sort(m_keys.data(), numPackets, m_order);
+		}
+		else
+		{
+			m_order.resize(numPackets);
+			std::iota(m_order.begin(), m_order.end(), 0);
+		}
+	}
+	long long sorted = Profiler::GetTimestamp();
+
+	{
+		PROFILE_SCOPE("RenderQueueExecute");
+		EngineStats& engineStats = EngineStats::GetInstance();
+		RenderShaderProgram* boundProgram = nullptr;
+		RenderBuffer* boundVertexBuffer = nullptr;
+		UINT boundVertexStride = 0;
+		RenderBuffer* boundIndexBuffer = nullptr;
+		RenderBuffer* boundConstantBuffers[RENDER_STAGE_COUNT][MAX_PACKET_CONSTANT_SLOTS] = {};
+		RenderBuffer* boundInstanceBuffer = nullptr;
+		int boundTopology = -1;
+		for (int index : m_order)
+		{
+			const RenderDrawPacket& packet = m_packets[index];
+			for (int i = 0; i < packet.numUploads; i++)
+			{
+				const RenderUpload& upload = packet.uploads[i];
+				void* data = device->Map(upload.buffer);
+				if (!data)
+					continue;
+
+				std::memcpy(data, m_uploadData.data() + upload.offset, upload.numBytes);
+				device->Unmap(upload.buffer);
+				engineStats.Add(STAT_MAP_UNMAPS, 1);
+				engineStats.Add(STAT_BYTES_UPLOADED, upload.numBytes);
+			}
+
+			if (IsChange(boundProgram, packet.program, m_isFiltering, stats))
+			{
+				device->SetShaderProgram(packet.program);
+				stats.numProgramChanges++;
+			}
+
+			// The stride is part of the binding
+			if (boundVertexStride != packet.vertexStride)
+				boundVertexBuffer = nullptr;
+			if (IsChange(boundVertexBuffer, packet.vertexBuffer, m_isFiltering, stats))
+			{
+				device->SetVertexBuffer(packet.vertexBuffer, packet.vertexStride);
+				boundVertexStride = packet.vertexStride;
+			}
+
+			if (packet.indexBuffer && IsChange(boundIndexBuffer, packet.indexBuffer, m_isFiltering, stats))
+				device->SetIndexBuffer(packet.indexBuffer);
+
+			for (int stage = 0; stage < RENDER_STAGE_COUNT; stage++)
+			{
+				for (int slot = 0; slot < MAX_PACKET_CONSTANT_SLOTS; slot++)
+				{
+					RenderBuffer* buffer = packet.constantBuffers[stage][slot];
+					if (buffer && IsChange(boundConstantBuffers[stage][slot], buffer, m_isFiltering, stats))
+						device->SetConstantBuffer(static_cast<RenderShaderStage>(stage), slot, buffer);
+				}
+			}
+
+			bool isInstanced = packet.instanceBuffer && packet.indexBuffer;
+			if (isInstanced && IsChange(boundInstanceBuffer, packet.instanceBuffer, m_isFiltering, stats))
+				device->SetShaderResource(RENDER_STAGE_VERTEX, INSTANCE_BUFFER_SLOT, packet.instanceBuffer);
+
+			if (IsChange(boundTopology, static_cast<int>(packet.topology), m_isFiltering, stats))
+				device->SetTopology(packet.topology);
+
+			if (isInstanced)
+			{
+				device->DrawIndexedInstanced(packet.numElements, packet.numInstances, packet.first, 0);
+				if (packet.topology == RENDER_TOPOLOGY_TRIANGLE_LIST)
+					engineStats.Add(STAT_TRIANGLES_SUBMITTED, static_cast<uint64_t>(packet.numElements / 3) * packet.numInstances);
+			}
+			else if (packet.indexBuffer)
+			{
+				device->DrawIndexed(packet.numElements, packet.first, 0);
+				if (packet.topology == RENDER_TOPOLOGY_TRIANGLE_LIST)
+					engineStats.Add(STAT_TRIANGLES_SUBMITTED, packet.numElements / 3);
+			}
+			else
+			{
+				device->Draw(packet.numElements, packet.first);
+			}
+			engineStats.Add(STAT_DRAW_CALLS, 1);
+		}
+		engineStats.Add(STAT_STATE_CHANGES, stats.numStateChanges);
+	}
+
+	long long end = Profiler::GetTimestamp();
+	stats.sortMs = static_cast<double>(sorted - start) / 1000000.0;
+	stats.executeMs = static_cast<double>(end - sorted) / 1000000.0;
+	m_lastStats = stats;
+
+	m_packets.clear();
+	m_keys.clear();
+	m_uploadData.clear();
+}
+
+uint64_t RenderQueue::MakeSortKey(RenderPass pass, uint32_t programId, uint32_t materialId, float depth)
+{
+	uint64_t key = static_cast<uint64_t>(pass) << 60;
+	if (pass == RENDER_PASS_TRANSPARENT)
+		return key;
+
+	// Positive floats compare like their bits, the ones behind the eye count as 0
+	float clampedDepth = depth > 0.0f ? depth : 0.0f;
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &clampedDepth, sizeof(depthBits));
+
+	uint64_t program = programId & ((1u << PROGRAM_ID_BITS) - 1);
+	uint64_t material = materialId & ((1u << MATERIAL_ID_BITS) - 1);
+	return key | program << 48 | material << 32 | depthBits;
+}
+
+uint32_t RenderQueue::GetId(const void* resource, IdTable& ids, int numBits)
+{
+	size_t mask = ids.resources.size() - 1;
+	for (size_t slot = HashAddress(resource) & mask; !ids.resources.empty() && ids.resources[slot]; slot = (slot + 1) & mask)
+	{
+		if (ids.resources[slot] == resource)
+			return ids.ids[slot];
+	}
+
+	// Starting over also drops the resources released since
+	if (ids.numIds >= (1u << numBits))
+	{
+		std::fill(ids.resources.begin(), ids.resources.end(), nullptr);
+		ids.numIds = 0;
+	}
+
+	// At most half full, so probes stay short
+	if (2 * (ids.numIds + 1) > ids.resources.size())
+	{
+		IdTable grown;
+		grown.resources.assign(std::max<size_t>(64, 2 * ids.resources.size()), nullptr);
+		grown.ids.resize(grown.resources.size());
+		for (size_t slot = 0; slot < ids.resources.size(); slot++)
+		{
+			if (ids.resources[slot])
+				Insert(grown, ids.resources[slot], ids.ids[slot]);
+		}
+		grown.numIds = ids.numIds;
+		std::swap(ids, grown);
+	}
+
+	uint32_t id = ids.numIds++;
+	Insert(ids, resource, id);
+	return id;
+}
+
+void RenderQueue::Insert(IdTable& ids, const void* resource, uint32_t id)
+{
+	size_t mask = ids.resources.size() - 1;
+	size_t slot = HashAddress(resource) & mask;
+	while (ids.resources[slot])
+		slot = (slot + 1) & mask;
+
+	ids.resources[slot] = resource;
+	ids.ids[slot] = id;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "RenderDevice.h"
+#include "RadixSort.h"
+#include "ConstantBuffer.h"
+
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE,			// Front to back, grouped by shader and material
+	RENDER_PASS_TRANSPARENT,	// Back to front for blending
+	RENDER_PASS_COUNT
+};
+
+const int MAX_PACKET_CONSTANT_SLOTS = 2;
+const int MAX_PACKET_UPLOADS = 2;
+
+struct RenderUpload
+{
+	RenderBuffer* buffer;
+	UINT offset;		// Into the upload data of the queue
+	UINT numBytes;
+};
+
+// One draw with everything it binds. Constant buffer slots left nullptr keep what is bound.
+struct RenderDrawPacket
+{
+	RenderPass pass;
+	float depth;					// Along the view direction
+	RenderShaderProgram* program;
+	RenderBuffer* vertexBuffer;
+	UINT vertexStride;
+	RenderBuffer* indexBuffer;		// nullptr draws without indices
+	RenderBuffer* constantBuffers[RENDER_STAGE_COUNT][MAX_PACKET_CONSTANT_SLOTS];
+	RenderBuffer* instanceBuffer;	// Bound at INSTANCE_BUFFER_SLOT for an indexed instanced draw, nullptr draws once
+	UINT numInstances;
+	RenderTopology topology;
+	UINT numElements;				// Indices, or vertices without an index buffer
+	UINT first;
+	RenderUpload uploads[MAX_PACKET_UPLOADS];
+	int numUploads;
+};
+
+struct RenderQueueStats
+{
+	int numPackets;
+	int numStateChanges;	// Bindings sent to the device
+	int numRedundant;		// Bindings skipped because the device had them already
+	int numProgramChanges;
+	double sortMs;
+	double executeMs;		// Uploads, bindings and draws
+};
+
+// Collects the draws of a frame as packets, radix sorts them by a 64 bit key and sends them to the
+// device with only the bindings that changed since the packet before. From the top bits the key
+// holds the pass, then for opaque packets shader, material and depth. Transparent packets are only
+// keyed by their pass, so the stable sort keeps their submission order and whoever submits them
+// sorts them back to front, like ParticleSystem with its DepthSorter. Materials are told apart by their vertex buffer.
+// Bindings made around the queue are not tracked, so every Execute starts without assumptions.
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// Copies data, it is written to buffer right before the packet is drawn, so packets may share buffers
+	void Upload(RenderDrawPacket& packet, RenderBuffer* buffer, const void* data, UINT numBytes);
+	void Submit(const RenderDrawPacket& packet);
+	// Draws the packets in key order and empties the queue
+	void Execute(RenderDevice* device);
+
+	int GetNumPackets() const { return static_cast<int>(m_packets.size()); }
+	const RenderQueueStats& GetLastStats() const { return m_lastStats; }
+	// Submission indices of the packets in the order the last Execute drew them
+	const std::vector<int>& GetLastOrder() const { return m_order; }
+
+	static uint64_t MakeSortKey(RenderPass pass, uint32_t programId, uint32_t materialId, float depth);
+
+	// Without sorting packets are drawn in submission order, without filtering with all their bindings
+	bool m_isSorting;
+	bool m_isFiltering;
+
+private:
+	static const int PROGRAM_ID_BITS = 12;
+	static const int MATERIAL_ID_BITS = 16;
+
+	// Resources by address to their ids, open addressing with linear probing
+	struct IdTable
+	{
+		std::vector<const void*> resources;		// nullptr for free slots
+		std::vector<uint32_t> ids;
+		uint32_t numIds;
+	};
+
+	// Numbered in the order they first showed up. Kept across frames, so a scene that stays the same
+	// queues without allocating, and numbered anew once they run out of bits.
+	static uint32_t GetId(const void* resource, IdTable& ids, int numBits);
+	static void Insert(IdTable& ids, const void* resource, uint32_t id);
+
+	std::vector<RenderDrawPacket> m_packets;
+	std::vector<uint64_t> m_keys;
+	std::vector<uint8_t> m_uploadData;
+	IdTable m_programIds;
+	IdTable m_materialIds;
+
+	RadixSort m_radixSort;
+	std::vector<int> m_order;
+	RenderQueueStats m_lastStats;
+};
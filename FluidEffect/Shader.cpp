@@ -1,12 +1,12 @@
 #include "Shader.h"
 
-HRESULT Shader::CompileShaderFromFile(const WCHAR* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** ppBlobOut)
+HRESULT Shader::CompileShaderFromFile(const WCHAR* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** ppBlobOut, const D3D_SHADER_MACRO* defines)
 {
     HRESULT hr = S_OK;
 
     ID3DBlob* pErrorBlob = nullptr;
     ID3DBlob* pBlob = nullptr;
-    hr = D3DCompileFromFile(fileName, nullptr, nullptr, entryPoint, shaderModel, 0, 0, &pBlob, &pErrorBlob);
+    hr = D3DCompileFromFile(fileName, defines, nullptr, entryPoint, shaderModel, 0, 0, &pBlob, &pErrorBlob);
     
 
     if (FAILED(hr))
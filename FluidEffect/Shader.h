@@ -4,6 +4,6 @@
 class Shader
 {
 public:
-	static HRESULT CompileShaderFromFile(const WCHAR* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** ppBlobOut);
+	static HRESULT CompileShaderFromFile(const WCHAR* fileName, LPCSTR entryPoint, LPCSTR shaderModel, ID3DBlob** ppBlobOut, const D3D_SHADER_MACRO* defines = nullptr);
 };
 
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "SharedParticleExporter.h"
+#include "Profiler.h"
+
+SharedParticleExporter::SharedParticleExporter()
+{
+#ifdef _WIN32
+	m_mapping = nullptr;
+#else
+	m_file = -1;
+	m_size = 0;
+#endif
+	m_header = nullptr;
+	m_numPublished = 0;
+}
+
+SharedParticleExporter::~SharedParticleExporter()
+{
+	Close();
+}
+
+bool SharedParticleExporter::Open(const std::string& name, int maxParticles, int numSlots)
+{
+	Close();
+
+	uint64_t size = GetSharedParticleMappingSize(numSlots, maxParticles);
+#ifdef _WIN32
+	m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str());
+	if (!m_mapping)
+	{
+		std::cout << "Failed to create shared memory: " << name << std::endl;
+		return false;
+	}
+
+	// Readers keep the shared memory alive when the exporter is reopened, its size stays the old one
+	bool alreadyExists = GetLastError() == ERROR_ALREADY_EXISTS;
+
+	m_header = static_cast<SharedParticleHeader*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size)));
+	if (!m_header)
+	{
+		std::cout << "Failed to map shared memory: " << name << (alreadyExists ? " (in use with a smaller size)" : "") << std::endl;
+		Close();
+		return false;
+	}
+#else
+	m_posixName = GetSharedParticlePosixName(name);
+	m_file = shm_open(m_posixName.c_str(), O_CREAT | O_RDWR, 0600);
+	if (m_file < 0 || ftruncate(m_file, static_cast<off_t>(size)) != 0)
+	{
+		std::cout << "Failed to create shared memory: " << m_posixName << std::endl;
+		Close();
+		return false;
+	}
+
+	void* memory = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+	if (memory == MAP_FAILED)
+	{
+		std::cout << "Failed to map shared memory: " << m_posixName << std::endl;
+		Close();
+		return false;
+	}
+	m_header = static_cast<SharedParticleHeader*>(memory);
+	m_size = size;
+#endif
+
+	m_header->magic = SHARED_PARTICLES_MAGIC;
+	m_header->version = SHARED_PARTICLES_VERSION;
+	m_header->numSlots = numSlots;
+	m_header->maxParticles = maxParticles;
+	m_header->arrayStride = GetSharedParticleArrayStride(maxParticles);
+	m_header->slotSize = sizeof(SharedParticleSlot) + SHARED_ARRAY_COUNT * m_header->arrayStride;
+	m_header->numPublished.store(0, std::memory_order_release);
+	m_numPublished = 0;
+
+	std::cout << "Sharing particles as " << name << std::endl;
+	return true;
+}
+
+void SharedParticleExporter::Close()
+{
+#ifdef _WIN32
+	if (m_header)
+	{
+		UnmapViewOfFile(m_header);
+		m_header = nullptr;
+	}
+
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+#else
+	if (m_header)
+	{
+		munmap(m_header, static_cast<size_t>(m_size));
+		m_header = nullptr;
+	}
+
+	if (m_file >= 0)
+	{
+		close(m_file);
+		shm_unlink(m_posixName.c_str());
+		m_file = -1;
+	}
+#endif
+}
+
+bool SharedParticleExporter::IsOpen() const
+{
+	return m_header != nullptr;
+}
+
+void SharedParticleExporter::Publish(float time, const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities)
+{
+	if (!IsOpen())
+		return;
+
+	PROFILE_SCOPE("SharedParticles");
+
+	SharedParticleSlot* slot = GetSharedParticleSlot(m_header, static_cast<uint32_t>(m_numPublished % m_header->numSlots));
+	uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int numParticles = static_cast<int>(std::min<size_t>(positions.size(), m_header->maxParticles));
+	slot->numParticles = numParticles;
+	slot->frame = m_numPublished;
+	slot->time = time;
+
+	float* arrays[SHARED_ARRAY_COUNT];
+	for (int array = 0; array < SHARED_ARRAY_COUNT; array++)
+		arrays[array] = GetSharedParticleArray(slot, m_header->arrayStride, static_cast<SharedParticleArray>(array));
+
+	for (int i = 0; i < numParticles; i++)
+	{
+		arrays[SHARED_POSITION_X][i] = positions[i].x;
+		arrays[SHARED_POSITION_Y][i] = positions[i].y;
+		arrays[SHARED_POSITION_Z][i] = positions[i].z;
+		arrays[SHARED_VELOCITY_X][i] = velocities[i].x;
+		arrays[SHARED_VELOCITY_Y][i] = velocities[i].y;
+		arrays[SHARED_VELOCITY_Z][i] = velocities[i].z;
+	}
+
+	slot->sequence.store(sequence + 2, std::memory_order_release);
+	m_numPublished++;
+	m_header->numPublished.store(m_numPublished, std::memory_order_release);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "SharedParticleFormat.h"
+
+// Publishes the particle state of every frame as SoA arrays into named shared memory, a file
+// mapping on Windows and shm_open elsewhere. Publishing never waits for readers, see
+// SharedParticleReader for the other side.
+class SharedParticleExporter
+{
+public:
+	SharedParticleExporter();
+	~SharedParticleExporter();
+
+	bool Open(const std::string& name, int maxParticles, int numSlots = 4);
+	void Close();
+	bool IsOpen() const;
+
+	// Particles beyond maxParticles are dropped
+	void Publish(float time, const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities);
+
+private:
+#ifdef _WIN32
+	HANDLE m_mapping;
+#else
+	// Unlinked by Close, readers that still map it have to open the name again
+	int m_file;
+	std::string m_posixName;
+	uint64_t m_size;
+#endif
+	SharedParticleHeader* m_header;
+	uint64_t m_numPublished;
+};
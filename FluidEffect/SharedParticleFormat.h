@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Shared memory layout of SharedParticleExporter: a SharedParticleHeader followed by numSlots slots.
+// Every slot is a SharedParticleSlot followed by one float array per SharedParticleArray. Frames go
+// round robin through the slots, so a reader has numSlots - 1 frames of time to read one in place.
+
+const char* const SHARED_PARTICLES_NAME = "Local\\FluidEffectParticles";
+const uint32_t SHARED_PARTICLES_MAGIC = 0x50444853;	// "SHDP"
+const uint32_t SHARED_PARTICLES_VERSION = 1;
+
+enum SharedParticleArray
+{
+	SHARED_POSITION_X,
+	SHARED_POSITION_Y,
+	SHARED_POSITION_Z,
+	SHARED_VELOCITY_X,
+	SHARED_VELOCITY_Y,
+	SHARED_VELOCITY_Z,
+	SHARED_ARRAY_COUNT
+};
+
+struct alignas(64) SharedParticleHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numSlots;
+	uint32_t maxParticles;
+	uint64_t slotSize;			// Including the SharedParticleSlot
+	uint64_t arrayStride;		// Bytes from one array of a slot to the next
+	std::atomic<uint64_t> numPublished;		// The newest frame is in slot (numPublished - 1) % numSlots
+};
+
+// Seqlock: the sequence is odd while the exporter writes the slot, a read is valid if the sequence
+// was even before and unchanged after it
+struct alignas(64) SharedParticleSlot
+{
+	std::atomic<uint32_t> sequence;
+	uint32_t numParticles;
+	uint64_t frame;
+	float time;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "Shared memory atomics must not need a lock");
+
+// The names are Win32 ones like SHARED_PARTICLES_NAME. A POSIX name starts with its only slash, so
+// "Local\\FluidEffectParticles" becomes "/Local_FluidEffectParticles".
+inline std::string GetSharedParticlePosixName(const std::string& name)
+{
+	std::string posixName = "/" + name;
+	for (size_t i = 1; i < posixName.size(); i++)
+	{
+		if (posixName[i] == '\\' || posixName[i] == '/')
+			posixName[i] = '_';
+	}
+	return posixName;
+}
+
+inline uint64_t GetSharedParticleArrayStride(uint32_t maxParticles)
+{
+	// Every array starts on its own cache line
+	return (static_cast<uint64_t>(maxParticles) * sizeof(float) + 63) / 64 * 64;
+}
+
+inline uint64_t GetSharedParticleMappingSize(uint32_t numSlots, uint32_t maxParticles)
+{
+	return sizeof(SharedParticleHeader) + numSlots * (sizeof(SharedParticleSlot) + SHARED_ARRAY_COUNT * GetSharedParticleArrayStride(maxParticles));
+}
+
+inline SharedParticleSlot* GetSharedParticleSlot(SharedParticleHeader* header, uint32_t slot)
+{
+	return reinterpret_cast<SharedParticleSlot*>(reinterpret_cast<uint8_t*>(header) + sizeof(SharedParticleHeader) + slot * header->slotSize);
+}
+
+inline float* GetSharedParticleArray(SharedParticleSlot* slot, uint64_t arrayStride, SharedParticleArray array)
+{
+	return reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(slot) + sizeof(SharedParticleSlot) + array * arrayStride);
+}
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "SharedParticleReader.h"
+
+SharedParticleReader::SharedParticleReader()
+{
+#ifdef _WIN32
+	m_mapping = nullptr;
+#else
+	m_file = -1;
+	m_size = 0;
+#endif
+	m_header = nullptr;
+}
+
+SharedParticleReader::~SharedParticleReader()
+{
+	Close();
+}
+
+bool SharedParticleReader::Open(const std::string& name)
+{
+	Close();
+
+#ifdef _WIN32
+	m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (!m_mapping)
+		return false;
+
+	m_header = static_cast<SharedParticleHeader*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	bool isMapped = m_header != nullptr;
+#else
+	m_file = shm_open(GetSharedParticlePosixName(name).c_str(), O_RDONLY, 0);
+	if (m_file < 0)
+		return false;
+
+	// The exporter may not have sized it yet
+	struct stat status;
+	bool isMapped = false;
+	if (fstat(m_file, &status) == 0 && static_cast<uint64_t>(status.st_size) >= sizeof(SharedParticleHeader))
+	{
+		void* memory = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, m_file, 0);
+		if (memory != MAP_FAILED)
+		{
+			m_header = static_cast<SharedParticleHeader*>(memory);
+			m_size = static_cast<uint64_t>(status.st_size);
+			isMapped = m_size >= GetSharedParticleMappingSize(m_header->numSlots, m_header->maxParticles);
+		}
+	}
+#endif
+	if (!isMapped || m_header->magic != SHARED_PARTICLES_MAGIC || m_header->version != SHARED_PARTICLES_VERSION || m_header->numSlots < 2)
+	{
+		std::cout << "Shared memory is not a particle export: " << name << std::endl;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void SharedParticleReader::Close()
+{
+#ifdef _WIN32
+	if (m_header)
+	{
+		UnmapViewOfFile(m_header);
+		m_header = nullptr;
+	}
+
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+#else
+	if (m_header)
+	{
+		munmap(m_header, static_cast<size_t>(m_size));
+		m_header = nullptr;
+	}
+
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+#endif
+}
+
+bool SharedParticleReader::IsOpen() const
+{
+	return m_header != nullptr;
+}
+
+uint64_t SharedParticleReader::GetNumPublished() const
+{
+	return m_header ? m_header->numPublished.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedParticleReader::AcquireLatest(SharedParticleFrame& frame) const
+{
+	uint64_t numPublished = GetNumPublished();
+	if (numPublished == 0)
+		return false;
+
+	frame.slot = GetSharedParticleSlot(m_header, static_cast<uint32_t>((numPublished - 1) % m_header->numSlots));
+	frame.sequence = frame.slot->sequence.load(std::memory_order_acquire);
+	if (frame.sequence & 1)
+		return false;
+
+	frame.frame = frame.slot->frame;
+	frame.time = frame.slot->time;
+	frame.numParticles = static_cast<int>(std::min(frame.slot->numParticles, m_header->maxParticles));
+	for (int array = 0; array < SHARED_ARRAY_COUNT; array++)
+		frame.arrays[array] = GetSharedParticleArray(frame.slot, m_header->arrayStride, static_cast<SharedParticleArray>(array));
+
+	return true;
+}
+
+bool SharedParticleReader::Release(const SharedParticleFrame& frame) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return frame.slot->sequence.load(std::memory_order_relaxed) == frame.sequence;
+}
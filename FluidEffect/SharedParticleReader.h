@@ -0,0 +1,47 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string>
+#include "SharedParticleFormat.h"
+
+// In place view of one published frame, only valid until it is released
+struct SharedParticleFrame
+{
+	uint64_t frame;
+	float time;
+	int numParticles;
+	const float* arrays[SHARED_ARRAY_COUNT];
+
+	SharedParticleSlot* slot;
+	uint32_t sequence;
+};
+
+// Maps the shared memory of a SharedParticleExporter, possibly in another process, read only
+// access to the arrays without copying them
+class SharedParticleReader
+{
+public:
+	SharedParticleReader();
+	~SharedParticleReader();
+
+	// Fails if no exporter created the shared memory yet
+	bool Open(const std::string& name);
+	void Close();
+	bool IsOpen() const;
+
+	uint64_t GetNumPublished() const;
+	// False if nothing was published yet or the exporter is just writing the newest frame
+	bool AcquireLatest(SharedParticleFrame& frame) const;
+	// False if the exporter overwrote the frame while it was read, everything read from it is invalid then
+	bool Release(const SharedParticleFrame& frame) const;
+
+private:
+#ifdef _WIN32
+	HANDLE m_mapping;
+#else
+	int m_file;
+	uint64_t m_size;
+#endif
+	SharedParticleHeader* m_header;
+};
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include "SignedDistanceField.h"
+#include "TriangleBvh.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+namespace
+{
+	const uint32_t SDF_FILE_MAGIC = 0x31464453;	// "SDF1"
+
+	inline DirectX::XMFLOAT3 Subtract(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return DirectX::XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline float Dot(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline DirectX::XMFLOAT3 Cross(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return DirectX::XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline DirectX::XMFLOAT3 Normalize(const DirectX::XMFLOAT3& v)
+	{
+		float length = std::sqrt(Dot(v, v));
+		if (length <= 0.0f)
+			return DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return DirectX::XMFLOAT3(v.x / length, v.y / length, v.z / length);
+	}
+
+	inline void Accumulate(DirectX::XMFLOAT3& target, const DirectX::XMFLOAT3& v, float weight)
+	{
+		target.x += v.x * weight;
+		target.y += v.y * weight;
+		target.z += v.z * weight;
+	}
+
+	inline uint64_t GetEdgeKey(unsigned int a, unsigned int b)
+	{
+		return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+	}
+
+	uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+SignedDistanceField::SignedDistanceField()
+{
+	m_origin = { 0.0f, 0.0f, 0.0f };
+	m_voxelSize = 1.0f;
+	m_bandWidth = 0.0f;
+	m_sizeX = 0;
+	m_sizeY = 0;
+	m_sizeZ = 0;
+	m_sourceHash = 0;
+}
+
+void SignedDistanceField::Bake(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth)
+{
+	PROFILE_SCOPE("SdfBake");
+
+	m_voxelSize = voxelSize;
+	m_bandWidth = bandWidth;
+	m_sourceHash = GetSourceHash(vertices, indices, voxelSize, bandWidth);
+	m_distances.clear();
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+
+	if (vertices.empty() || indices.size() < 3)
+		return;
+
+	DirectX::XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	DirectX::XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const DirectX::XMFLOAT3& v : vertices)
+	{
+		boundsMin = DirectX::XMFLOAT3(std::min(boundsMin.x, v.x), std::min(boundsMin.y, v.y), std::min(boundsMin.z, v.z));
+		boundsMax = DirectX::XMFLOAT3(std::max(boundsMax.x, v.x), std::max(boundsMax.y, v.y), std::max(boundsMax.z, v.z));
+	}
+
+	float padding = bandWidth + voxelSize;
+	m_origin = DirectX::XMFLOAT3(boundsMin.x - padding, boundsMin.y - padding, boundsMin.z - padding);
+	m_sizeX = static_cast<int>(std::ceil((boundsMax.x - boundsMin.x + 2.0f * padding) / voxelSize)) + 1;
+	m_sizeY = static_cast<int>(std::ceil((boundsMax.y - boundsMin.y + 2.0f * padding) / voxelSize)) + 1;
+	m_sizeZ = static_cast<int>(std::ceil((boundsMax.z - boundsMin.z + 2.0f * padding) / voxelSize)) + 1;
+	m_distances.assign(static_cast<size_t>(m_sizeX) * m_sizeY * m_sizeZ, bandWidth);
+
+	TriangleBvh bvh;
+	bvh.Build(vertices, indices);
+
+	// Angle weighted pseudo normals give the correct sign at edges and vertices as well
+	// (Baerentzen and Aanaes, Signed Distance Computation Using the Angle Weighted Pseudonormal)
+	int numTriangles = static_cast<int>(indices.size() / 3);
+	std::vector<DirectX::XMFLOAT3> faceNormals(numTriangles);
+	std::vector<DirectX::XMFLOAT3> vertexNormals(vertices.size(), DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+	std::unordered_map<uint64_t, DirectX::XMFLOAT3> edgeNormalSums;
+	edgeNormalSums.reserve(indices.size());
+
+	for (int t = 0; t < numTriangles; t++)
+	{
+		const unsigned int* triangle = &indices[t * 3];
+
+		// OBJ files wind counter-clockwise around the outward normal
+		DirectX::XMFLOAT3 normal = Normalize(Cross(Subtract(vertices[triangle[1]], vertices[triangle[0]]), Subtract(vertices[triangle[2]], vertices[triangle[0]])));
+		faceNormals[t] = normal;
+
+		for (int k = 0; k < 3; k++)
+		{
+			const DirectX::XMFLOAT3& corner = vertices[triangle[k]];
+			DirectX::XMFLOAT3 toNext = Normalize(Subtract(vertices[triangle[(k + 1) % 3]], corner));
+			DirectX::XMFLOAT3 toPrevious = Normalize(Subtract(vertices[triangle[(k + 2) % 3]], corner));
+			float angle = std::acos(std::min(1.0f, std::max(-1.0f, Dot(toNext, toPrevious))));
+			Accumulate(vertexNormals[triangle[k]], normal, angle);
+			Accumulate(edgeNormalSums[GetEdgeKey(triangle[k], triangle[(k + 1) % 3])], normal, 1.0f);
+		}
+	}
+
+	std::vector<DirectX::XMFLOAT3> edgeNormals(indices.size());
+	for (int t = 0; t < numTriangles; t++)
+	{
+		for (int k = 0; k < 3; k++)
+			edgeNormals[t * 3 + k] = edgeNormalSums[GetEdgeKey(indices[t * 3 + k], indices[t * 3 + (k + 1) % 3])];
+	}
+
+	JobSystem::GetInstance().ParallelFor(m_sizeY * m_sizeZ, [&](int begin, int end, int chunk)
+	{
+		for (int row = begin; row < end; row++)
+		{
+			int y = row % m_sizeY;
+			int z = row / m_sizeY;
+			float* distances = &m_distances[(static_cast<size_t>(z) * m_sizeY + y) * m_sizeX];
+
+			for (int x = 0; x < m_sizeX; x++)
+			{
+				DirectX::XMFLOAT3 position(m_origin.x + x * voxelSize, m_origin.y + y * voxelSize, m_origin.z + z * voxelSize);
+				ClosestTriangleHit hit = bvh.FindClosest(position, bandWidth);
+				if (hit.triangle < 0)
+					continue;
+
+				const unsigned int* triangle = &indices[hit.triangle * 3];
+				DirectX::XMFLOAT3 normal;
+				switch (hit.feature)
+				{
+				case TRIANGLE_FEATURE_VERTEX0: normal = vertexNormals[triangle[0]]; break;
+				case TRIANGLE_FEATURE_VERTEX1: normal = vertexNormals[triangle[1]]; break;
+				case TRIANGLE_FEATURE_VERTEX2: normal = vertexNormals[triangle[2]]; break;
+				case TRIANGLE_FEATURE_EDGE01: normal = edgeNormals[hit.triangle * 3]; break;
+				case TRIANGLE_FEATURE_EDGE12: normal = edgeNormals[hit.triangle * 3 + 1]; break;
+				case TRIANGLE_FEATURE_EDGE20: normal = edgeNormals[hit.triangle * 3 + 2]; break;
+				default: normal = faceNormals[hit.triangle]; break;
+				}
+
+				float distance = std::sqrt(hit.distanceSq);
+				distances[x] = Dot(Subtract(position, hit.point), normal) < 0.0f ? -distance : distance;
+			}
+		}
+	}, 4);
+}
+
+bool SignedDistanceField::LoadOrBake(const std::string& cacheFileName, const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth)
+{
+	if (Load(cacheFileName, GetSourceHash(vertices, indices, voxelSize, bandWidth)))
+		return true;
+
+	Bake(vertices, indices, voxelSize, bandWidth);
+	Save(cacheFileName);
+	return false;
+}
+
+bool SignedDistanceField::Save(const std::string& fileName) const
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Failed to write distance field: " << fileName << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&SDF_FILE_MAGIC), sizeof(SDF_FILE_MAGIC));
+	file.write(reinterpret_cast<const char*>(&m_sourceHash), sizeof(m_sourceHash));
+	file.write(reinterpret_cast<const char*>(&m_origin), sizeof(m_origin));
+	file.write(reinterpret_cast<const char*>(&m_voxelSize), sizeof(m_voxelSize));
+	file.write(reinterpret_cast<const char*>(&m_bandWidth), sizeof(m_bandWidth));
+	file.write(reinterpret_cast<const char*>(&m_sizeX), sizeof(m_sizeX));
+	file.write(reinterpret_cast<const char*>(&m_sizeY), sizeof(m_sizeY));
+	file.write(reinterpret_cast<const char*>(&m_sizeZ), sizeof(m_sizeZ));
+	file.write(reinterpret_cast<const char*>(m_distances.data()), m_distances.size() * sizeof(float));
+	return file.good();
+}
+
+bool SignedDistanceField::Load(const std::string& fileName, uint64_t expectedSourceHash)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	uint32_t magic = 0;
+	uint64_t sourceHash = 0;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&sourceHash), sizeof(sourceHash));
+	if (!file.good() || magic != SDF_FILE_MAGIC || sourceHash != expectedSourceHash)
+		return false;
+
+	DirectX::XMFLOAT3 origin;
+	float voxelSize;
+	float bandWidth;
+	int sizeX;
+	int sizeY;
+	int sizeZ;
+	file.read(reinterpret_cast<char*>(&origin), sizeof(origin));
+	file.read(reinterpret_cast<char*>(&voxelSize), sizeof(voxelSize));
+	file.read(reinterpret_cast<char*>(&bandWidth), sizeof(bandWidth));
+	file.read(reinterpret_cast<char*>(&sizeX), sizeof(sizeX));
+	file.read(reinterpret_cast<char*>(&sizeY), sizeof(sizeY));
+	file.read(reinterpret_cast<char*>(&sizeZ), sizeof(sizeZ));
+	if (!file.good() || sizeX < 0 || sizeY < 0 || sizeZ < 0)
+		return false;
+
+	std::vector<float> distances(static_cast<size_t>(sizeX) * sizeY * sizeZ);
+	file.read(reinterpret_cast<char*>(distances.data()), distances.size() * sizeof(float));
+	if (!file.good())
+	{
+		std::cout << "Distance field file is truncated: " << fileName << std::endl;
+		return false;
+	}
+
+	m_origin = origin;
+	m_voxelSize = voxelSize;
+	m_bandWidth = bandWidth;
+	m_sizeX = sizeX;
+	m_sizeY = sizeY;
+	m_sizeZ = sizeZ;
+	m_sourceHash = sourceHash;
+	m_distances.swap(distances);
+	return true;
+}
+
+float SignedDistanceField::GetVoxel(int x, int y, int z) const
+{
+	return m_distances[(static_cast<size_t>(z) * m_sizeY + y) * m_sizeX + x];
+}
+
+float SignedDistanceField::Sample(const DirectX::XMFLOAT3& position) const
+{
+	float fx = (position.x - m_origin.x) / m_voxelSize;
+	float fy = (position.y - m_origin.y) / m_voxelSize;
+	float fz = (position.z - m_origin.z) / m_voxelSize;
+
+	if (!(fx >= 0.0f && fy >= 0.0f && fz >= 0.0f && fx < m_sizeX - 1 && fy < m_sizeY - 1 && fz < m_sizeZ - 1))
+		return m_bandWidth;
+
+	int x = static_cast<int>(fx);
+	int y = static_cast<int>(fy);
+	int z = static_cast<int>(fz);
+	float tx = fx - x;
+	float ty = fy - y;
+	float tz = fz - z;
+
+	const float* base = &m_distances[(static_cast<size_t>(z) * m_sizeY + y) * m_sizeX + x];
+	size_t strideY = m_sizeX;
+	size_t strideZ = static_cast<size_t>(m_sizeX) * m_sizeY;
+
+	float c00 = base[0] + (base[1] - base[0]) * tx;
+	float c10 = base[strideY] + (base[strideY + 1] - base[strideY]) * tx;
+	float c01 = base[strideZ] + (base[strideZ + 1] - base[strideZ]) * tx;
+	float c11 = base[strideZ + strideY] + (base[strideZ + strideY + 1] - base[strideZ + strideY]) * tx;
+
+	float c0 = c00 + (c10 - c00) * ty;
+	float c1 = c01 + (c11 - c01) * ty;
+	return c0 + (c1 - c0) * tz;
+}
+
+DirectX::XMFLOAT3 SignedDistanceField::SampleGradient(const DirectX::XMFLOAT3& position) const
+{
+	float h = 0.5f * m_voxelSize;
+	float dx = Sample(DirectX::XMFLOAT3(position.x + h, position.y, position.z)) - Sample(DirectX::XMFLOAT3(position.x - h, position.y, position.z));
+	float dy = Sample(DirectX::XMFLOAT3(position.x, position.y + h, position.z)) - Sample(DirectX::XMFLOAT3(position.x, position.y - h, position.z));
+	float dz = Sample(DirectX::XMFLOAT3(position.x, position.y, position.z + h)) - Sample(DirectX::XMFLOAT3(position.x, position.y, position.z - h));
+	return DirectX::XMFLOAT3(dx / (2.0f * h), dy / (2.0f * h), dz / (2.0f * h));
+}
+
+bool SignedDistanceField::ResolveCollision(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity, float radius, float restitution, float friction) const
+{
+	float distance = Sample(position);
+	if (distance >= radius)
+		return false;
+
+	DirectX::XMFLOAT3 normal = Normalize(SampleGradient(position));
+	if (Dot(normal, normal) == 0.0f)
+		return false;
+
+	float penetration = radius - distance;
+	position.x += normal.x * penetration;
+	position.y += normal.y * penetration;
+	position.z += normal.z * penetration;
+
+	float normalSpeed = Dot(velocity, normal);
+	if (normalSpeed < 0.0f)
+	{
+		DirectX::XMFLOAT3 tangent(velocity.x - normal.x * normalSpeed, velocity.y - normal.y * normalSpeed, velocity.z - normal.z * normalSpeed);
+		float bounce = -normalSpeed * restitution;
+		velocity.x = tangent.x * (1.0f - friction) + normal.x * bounce;
+		velocity.y = tangent.y * (1.0f - friction) + normal.y * bounce;
+		velocity.z = tangent.z * (1.0f - friction) + normal.z * bounce;
+	}
+
+	return true;
+}
+
+uint64_t SignedDistanceField::GetSourceHash(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashBytes(hash, vertices.data(), vertices.size() * sizeof(DirectX::XMFLOAT3));
+	hash = HashBytes(hash, indices.data(), indices.size() * sizeof(unsigned int));
+	hash = HashBytes(hash, &voxelSize, sizeof(voxelSize));
+	hash = HashBytes(hash, &bandWidth, sizeof(bandWidth));
+	return hash;
+}
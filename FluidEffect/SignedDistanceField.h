@@ -0,0 +1,52 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Narrow band signed distance grid in world space, negative inside the mesh. Voxels further than
+// the band width from the surface store +bandWidth, so only thin geometry is solid throughout.
+class SignedDistanceField
+{
+public:
+	SignedDistanceField();
+
+	void Bake(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth);
+
+	// Loads cacheFileName if it was baked from the same input, otherwise bakes and writes it.
+	// Returns true if the field came from the cache.
+	bool LoadOrBake(const std::string& cacheFileName, const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth);
+
+	bool Save(const std::string& fileName) const;
+	bool Load(const std::string& fileName, uint64_t expectedSourceHash);
+
+	// Trilinear distance, +bandWidth outside of the grid
+	float Sample(const DirectX::XMFLOAT3& position) const;
+	DirectX::XMFLOAT3 SampleGradient(const DirectX::XMFLOAT3& position) const;
+
+	// Pushes a sphere out of the surface and removes the velocity into it.
+	// Returns true if the sphere was touching.
+	bool ResolveCollision(DirectX::XMFLOAT3& position, DirectX::XMFLOAT3& velocity, float radius, float restitution, float friction) const;
+
+	int GetSizeX() const { return m_sizeX; }
+	int GetSizeY() const { return m_sizeY; }
+	int GetSizeZ() const { return m_sizeZ; }
+	float GetVoxelSize() const { return m_voxelSize; }
+	float GetBandWidth() const { return m_bandWidth; }
+	const DirectX::XMFLOAT3& GetOrigin() const { return m_origin; }
+	const std::vector<float>& GetDistances() const { return m_distances; }
+
+	static uint64_t GetSourceHash(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices, float voxelSize, float bandWidth);
+
+private:
+	float GetVoxel(int x, int y, int z) const;
+
+	DirectX::XMFLOAT3 m_origin;
+	float m_voxelSize;
+	float m_bandWidth;
+	int m_sizeX;
+	int m_sizeY;
+	int m_sizeZ;
+	uint64_t m_sourceHash;
+	std::vector<float> m_distances;
+};
@@ -0,0 +1,247 @@
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+#include "SimulationRecorder.h"
+#include "Profiler.h"
+
+SimulationRecorder::SimulationRecorder()
+{
+	m_firstQueued = 0;
+	m_numQueued = 0;
+	m_closing = false;
+	m_numFrames = 0;
+	m_numDroppedFrames = 0;
+	m_previousTime = 0.0f;
+	m_numEncodedFrames = 0;
+	m_bytesWritten = 0;
+}
+
+SimulationRecorder::~SimulationRecorder()
+{
+	Close();
+}
+
+bool SimulationRecorder::Open(const std::string& fileName, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, float maxSpeed)
+{
+	Close();
+
+	m_file.open(fileName, std::ios::binary | std::ios::trunc);
+	if (!m_file)
+	{
+		std::cout << "Failed to open recording: " << fileName << std::endl;
+		return false;
+	}
+
+	RecordingHeader header = {};
+	header.magic = RECORDING_MAGIC;
+	header.framesPerChunk = FRAMES_PER_CHUNK;
+	header.boundsMin = boundsMin;
+	header.boundsMax = boundsMax;
+	header.maxSpeed = maxSpeed;
+
+	m_quantizer.Initialize(header);
+	m_current.clear();
+	m_previous.clear();
+	m_previousIds.clear();
+	m_chunks.clear();
+	m_numFrames = 0;
+	m_numDroppedFrames = 0;
+	m_numEncodedFrames = 0;
+	m_bytesWritten = 0;
+	Write(&header, sizeof(header));
+
+	m_firstQueued = 0;
+	m_numQueued = 0;
+	m_closing = false;
+	m_writer = std::thread(&SimulationRecorder::WriterLoop, this);
+
+	std::cout << "Recording to " << fileName << std::endl;
+	return true;
+}
+
+void SimulationRecorder::RecordFrame(float time, const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities, const std::vector<uint32_t>& ids)
+{
+	if (!IsOpen())
+		return;
+
+	PROFILE_SCOPE("RecordFrame");
+
+	// Only this thread adds frames, so the slot after the queued ones stays free while it is filled
+	int slot;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_numQueued == MAX_QUEUED_FRAMES)
+		{
+			m_numDroppedFrames++;
+			return;
+		}
+		slot = (m_firstQueued + m_numQueued) % MAX_QUEUED_FRAMES;
+	}
+
+	PendingFrame& frame = m_frames[slot];
+	frame.time = time;
+	frame.positions = positions;
+	frame.velocities = velocities;
+	frame.ids = ids;
+
+	// Waking the writer could hand it the core this frame runs on, it finds the frame when it
+	// polls next unless the queue fills up
+	bool isWriterBehind;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_numQueued++;
+		isWriterBehind = m_numQueued >= MAX_QUEUED_FRAMES / 2;
+	}
+	if (isWriterBehind)
+		m_frameReady.notify_one();
+	m_numFrames++;
+}
+
+void SimulationRecorder::Close()
+{
+	if (!IsOpen())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closing = true;
+	}
+	m_frameReady.notify_one();
+	m_writer.join();
+
+	RecordingFooter footer = {};
+	footer.indexOffset = m_bytesWritten;
+	footer.numChunks = static_cast<uint32_t>(m_chunks.size());
+	footer.numFrames = static_cast<uint32_t>(m_numEncodedFrames);
+	footer.magic = RECORDING_INDEX_MAGIC;
+
+	if (!m_chunks.empty())
+		Write(m_chunks.data(), m_chunks.size() * sizeof(RecordingChunk));
+	Write(&footer, sizeof(footer));
+	m_file.close();
+
+	std::cout << "Recorded " << m_numEncodedFrames << " frames, " << m_bytesWritten << " bytes, " << m_numDroppedFrames << " frames dropped" << std::endl;
+}
+
+bool SimulationRecorder::IsOpen() const
+{
+	return m_writer.joinable();
+}
+
+int SimulationRecorder::GetNumFrames() const
+{
+	return m_numFrames;
+}
+
+int SimulationRecorder::GetNumDroppedFrames() const
+{
+	return m_numDroppedFrames;
+}
+
+uint64_t SimulationRecorder::GetNumBytesWritten() const
+{
+	return m_bytesWritten;
+}
+
+void SimulationRecorder::WriterLoop()
+{
+	while (true)
+	{
+		// Queued frames are still written after Close was requested
+		int frameIndex;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_frameReady.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS), [this] { return m_numQueued > 0 || m_closing; });
+			if (m_numQueued == 0)
+			{
+				if (m_closing)
+					return;
+				continue;
+			}
+
+			frameIndex = m_firstQueued;
+		}
+
+		EncodeFrame(m_frames[frameIndex]);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_firstQueued = (m_firstQueued + 1) % MAX_QUEUED_FRAMES;
+			m_numQueued--;
+		}
+	}
+}
+
+void SimulationRecorder::EncodeFrame(const PendingFrame& frame)
+{
+	int numParticles = static_cast<int>(frame.positions.size());
+	m_previous.swap(m_current);
+	m_current.resize(numParticles * RECORDING_VALUES_PER_PARTICLE);
+	for (int i = 0; i < numParticles; i++)
+		m_quantizer.Quantize(frame.positions[i], frame.velocities[i], &m_current[i * RECORDING_VALUES_PER_PARTICLE]);
+
+	bool isKeyframe = m_numEncodedFrames % FRAMES_PER_CHUNK == 0;
+	if (isKeyframe)
+	{
+		RecordingChunk chunk = {};
+		chunk.firstFrame = m_numEncodedFrames;
+		chunk.offset = m_bytesWritten;
+		m_chunks.push_back(chunk);
+
+		// Whatever made it to the file is a valid recording up to the last complete chunk
+		m_file.flush();
+	}
+
+	float velocityToPosition[3];
+	m_quantizer.GetVelocityToPosition(frame.time - m_previousTime, velocityToPosition);
+
+	int numPrevious = static_cast<int>(m_previousIds.size());
+	int previous = 0;
+	m_payload.clear();
+
+	for (int i = 0; i < numParticles; i++)
+	{
+		const int32_t* current = &m_current[i * RECORDING_VALUES_PER_PARTICLE];
+		int32_t predicted[RECORDING_VALUES_PER_PARTICLE] = {};
+
+		// Particles only die or get appended, so the previous particle this one continues can only
+		// lie ahead. Without one the rest of the frame counts as new.
+		int skip = 0;
+		while (previous + skip < numPrevious && m_previousIds[previous + skip] < frame.ids[i])
+			skip++;
+		if (previous + skip < numPrevious && m_previousIds[previous + skip] != frame.ids[i])
+			skip = numPrevious - previous;
+
+		WriteVarint(m_payload, skip);
+		previous += skip;
+		if (!isKeyframe && previous < numPrevious)
+		{
+			const int32_t* previousValues = &m_previous[previous * RECORDING_VALUES_PER_PARTICLE];
+			PredictParticle(previousValues, previousValues + 3, velocityToPosition, predicted, predicted + 3);
+		}
+		previous++;
+
+		for (int value = 0; value < RECORDING_VALUES_PER_PARTICLE; value++)
+			WriteVarint(m_payload, current[value] - predicted[value]);
+	}
+	m_previousIds = frame.ids;
+
+	RecordedFrameHeader header = {};
+	header.payloadSize = static_cast<uint32_t>(m_payload.size());
+	header.numParticles = static_cast<uint32_t>(numParticles);
+	header.time = frame.time;
+	header.flags = isKeyframe ? RECORDING_KEYFRAME | RECORDING_KEYFRAME_SKIPS : 0;
+
+	Write(&header, sizeof(header));
+	if (!m_payload.empty())
+		Write(m_payload.data(), m_payload.size());
+
+	m_previousTime = frame.time;
+	m_numEncodedFrames++;
+}
+
+void SimulationRecorder::Write(const void* data, size_t size)
+{
+	m_file.write(static_cast<const char*>(data), size);
+	m_bytesWritten += size;
+}
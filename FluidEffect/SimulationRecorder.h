@@ -0,0 +1,76 @@
+#pragma once
+#include <DirectXMath.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RecordingFormat.h"
+
+// Streams particle states to a file. RecordFrame only copies the state into a free buffer of a
+// small queue, a writer thread polling the queue quantizes, delta encodes and writes it while the
+// next frames are simulated. RecordFrame never waits for the writer: with the queue full the frame
+// is dropped and counted, replay finds frames by their time, so it only sees a longer step.
+class SimulationRecorder
+{
+public:
+	static const int FRAMES_PER_CHUNK = 60;
+	static const int MAX_QUEUED_FRAMES = 8;
+	static const int WRITER_POLL_MS = 2;
+
+	SimulationRecorder();
+	~SimulationRecorder();
+
+	// Particles outside of the bounds or faster than maxSpeed are clamped
+	bool Open(const std::string& fileName, const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, float maxSpeed);
+	// Ids increase along the frame while particles keep their order, a particle whose id is out of
+	// order (e.g. after a Morton reorder) is recorded as new
+	void RecordFrame(float time, const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities, const std::vector<uint32_t>& ids);
+	// Waits for the writer and appends the chunk index
+	void Close();
+
+	bool IsOpen() const;
+	// Frames handed to the writer and the ones dropped because it was behind
+	int GetNumFrames() const;
+	int GetNumDroppedFrames() const;
+	uint64_t GetNumBytesWritten() const;
+
+private:
+	struct PendingFrame
+	{
+		float time;
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT3> velocities;
+		std::vector<uint32_t> ids;
+	};
+
+	void WriterLoop();
+	void EncodeFrame(const PendingFrame& frame);
+	void Write(const void* data, size_t size);
+
+	std::ofstream m_file;
+	std::thread m_writer;
+	std::mutex m_mutex;
+	std::condition_variable m_frameReady;
+	// Ring of frames handed to the writer, the first one is encoded, the writer removes it when done
+	PendingFrame m_frames[MAX_QUEUED_FRAMES];
+	int m_firstQueued;
+	int m_numQueued;
+	bool m_closing;
+	int m_numFrames;
+	int m_numDroppedFrames;
+
+	// Only touched by the writer thread while the file is open
+	RecordingQuantizer m_quantizer;
+	std::vector<int32_t> m_current;
+	std::vector<int32_t> m_previous;
+	std::vector<uint32_t> m_previousIds;
+	float m_previousTime;
+	int m_numEncodedFrames;
+	std::vector<uint8_t> m_payload;
+	std::vector<RecordingChunk> m_chunks;
+	std::atomic<uint64_t> m_bytesWritten;
+};
@@ -0,0 +1,342 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include "SimulationReplayer.h"
+#include "Profiler.h"
+
+SimulationReplayer::SimulationReplayer()
+{
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+	m_data = nullptr;
+	m_size = 0;
+	m_framesEnd = 0;
+	m_numFrames = 0;
+	m_duration = 0.0f;
+	m_currentFrame = -1;
+	m_nextOffset = 0;
+	m_currentTime = 0.0f;
+	m_nextId = 0;
+}
+
+SimulationReplayer::~SimulationReplayer()
+{
+	Close();
+}
+
+bool SimulationReplayer::Open(const std::string& fileName)
+{
+	Close();
+
+	m_file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Failed to open recording: " << fileName << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || static_cast<uint64_t>(fileSize.QuadPart) < sizeof(RecordingHeader))
+	{
+		std::cout << "Recording is truncated: " << fileName << std::endl;
+		Close();
+		return false;
+	}
+	m_size = static_cast<uint64_t>(fileSize.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping)
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		std::cout << "Failed to map recording: " << fileName << std::endl;
+		Close();
+		return false;
+	}
+
+	memcpy(&m_header, m_data, sizeof(m_header));
+	if (m_header.magic != RECORDING_MAGIC || m_header.framesPerChunk == 0)
+	{
+		std::cout << "Not a recording: " << fileName << std::endl;
+		Close();
+		return false;
+	}
+	m_quantizer.Initialize(m_header);
+
+	if (!ReadIndex())
+	{
+		std::cout << "Recording has no index, scanning frames: " << fileName << std::endl;
+		RebuildIndex();
+	}
+
+	// Keyframe times for seeking and the last frame time for looping
+	m_chunkTimes.clear();
+	for (const RecordingChunk& chunk : m_chunks)
+	{
+		RecordedFrameHeader header;
+		ReadFrameHeader(chunk.offset, header);
+		m_chunkTimes.push_back(header.time);
+	}
+
+	m_duration = 0.0f;
+	if (!m_chunks.empty())
+	{
+		RecordedFrameHeader header;
+		for (uint64_t offset = m_chunks.back().offset; ReadFrameHeader(offset, header); offset += sizeof(header) + header.payloadSize)
+			m_duration = header.time;
+	}
+
+	m_currentFrame = -1;
+	std::cout << "Replaying " << m_numFrames << " frames from " << fileName << std::endl;
+	return true;
+}
+
+void SimulationReplayer::Close()
+{
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+
+	m_size = 0;
+	m_framesEnd = 0;
+	m_chunks.clear();
+	m_chunkTimes.clear();
+	m_numFrames = 0;
+	m_currentFrame = -1;
+}
+
+bool SimulationReplayer::IsOpen() const
+{
+	return m_data != nullptr;
+}
+
+int SimulationReplayer::GetNumFrames() const
+{
+	return m_numFrames;
+}
+
+float SimulationReplayer::GetDuration() const
+{
+	return m_duration;
+}
+
+int SimulationReplayer::FindFrame(float time) const
+{
+	if (m_chunks.empty())
+		return -1;
+
+	int chunk = static_cast<int>(std::upper_bound(m_chunkTimes.begin(), m_chunkTimes.end(), time) - m_chunkTimes.begin()) - 1;
+	if (chunk < 0)
+		return 0;
+
+	int frame = m_chunks[chunk].firstFrame;
+	uint64_t offset = m_chunks[chunk].offset;
+	RecordedFrameHeader header;
+	ReadFrameHeader(offset, header);
+	offset += sizeof(header) + header.payloadSize;
+
+	while (frame + 1 < m_numFrames && ReadFrameHeader(offset, header) && header.time <= time)
+	{
+		frame++;
+		offset += sizeof(header) + header.payloadSize;
+	}
+	return frame;
+}
+
+bool SimulationReplayer::ReadFrame(int frame, std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, std::vector<uint32_t>& ids)
+{
+	if (!IsOpen() || frame < 0 || frame >= m_numFrames)
+		return false;
+
+	PROFILE_SCOPE("ReplayFrame");
+
+	// Continue from the current frame if it lies in the same chunk or just before it, otherwise start
+	// at the keyframe
+	int chunk = static_cast<int>(std::upper_bound(m_chunks.begin(), m_chunks.end(), static_cast<uint32_t>(frame), [](uint32_t value, const RecordingChunk& c) { return value < c.firstFrame; }) - m_chunks.begin()) - 1;
+	if (chunk < 0)
+		return false;
+
+	if (m_currentFrame < 0 || m_currentFrame > frame || m_currentFrame < static_cast<int>(m_chunks[chunk].firstFrame) - 1)
+	{
+		m_currentFrame = m_chunks[chunk].firstFrame - 1;
+		m_nextOffset = m_chunks[chunk].offset;
+		m_current.clear();
+		m_currentIds.clear();
+	}
+
+	while (m_currentFrame < frame)
+	{
+		if (!DecodeFrame(m_nextOffset, m_nextOffset))
+		{
+			std::cout << "Recording is corrupt at frame " << m_currentFrame + 1 << std::endl;
+			m_currentFrame = -1;
+			return false;
+		}
+		m_currentFrame++;
+	}
+
+	int numParticles = static_cast<int>(m_current.size()) / RECORDING_VALUES_PER_PARTICLE;
+	positions.resize(numParticles);
+	velocities.resize(numParticles);
+	for (int i = 0; i < numParticles; i++)
+		m_quantizer.Dequantize(&m_current[i * RECORDING_VALUES_PER_PARTICLE], positions[i], velocities[i]);
+	ids = m_currentIds;
+
+	return true;
+}
+
+bool SimulationReplayer::ReadIndex()
+{
+	if (m_size < sizeof(RecordingHeader) + sizeof(RecordingFooter))
+		return false;
+
+	RecordingFooter footer;
+	memcpy(&footer, m_data + m_size - sizeof(footer), sizeof(footer));
+	if (footer.magic != RECORDING_INDEX_MAGIC || footer.indexOffset < sizeof(RecordingHeader))
+		return false;
+
+	uint64_t indexSize = static_cast<uint64_t>(footer.numChunks) * sizeof(RecordingChunk);
+	if (footer.indexOffset + indexSize + sizeof(footer) != m_size)
+		return false;
+
+	m_chunks.resize(footer.numChunks);
+	if (footer.numChunks > 0)
+		memcpy(m_chunks.data(), m_data + footer.indexOffset, indexSize);
+
+	for (size_t i = 0; i < m_chunks.size(); i++)
+	{
+		bool isOrdered = i == 0 || (m_chunks[i].firstFrame > m_chunks[i - 1].firstFrame && m_chunks[i].offset > m_chunks[i - 1].offset);
+		if (!isOrdered || m_chunks[i].offset >= footer.indexOffset || m_chunks[i].firstFrame >= footer.numFrames)
+		{
+			m_chunks.clear();
+			return false;
+		}
+	}
+
+	m_framesEnd = footer.indexOffset;
+	m_numFrames = static_cast<int>(footer.numFrames);
+	return true;
+}
+
+void SimulationReplayer::RebuildIndex()
+{
+	m_chunks.clear();
+	m_framesEnd = m_size;
+	m_numFrames = 0;
+
+	uint64_t offset = sizeof(RecordingHeader);
+	RecordedFrameHeader header;
+	while (ReadFrameHeader(offset, header))
+	{
+		if (header.flags & RECORDING_KEYFRAME)
+		{
+			RecordingChunk chunk = {};
+			chunk.firstFrame = m_numFrames;
+			chunk.offset = offset;
+			m_chunks.push_back(chunk);
+		}
+		else if (m_chunks.empty())
+		{
+			break;
+		}
+
+		offset += sizeof(header) + header.payloadSize;
+		m_numFrames++;
+	}
+
+	m_framesEnd = offset;
+}
+
+bool SimulationReplayer::ReadFrameHeader(uint64_t offset, RecordedFrameHeader& header) const
+{
+	if (offset + sizeof(header) > m_framesEnd)
+		return false;
+
+	memcpy(&header, m_data + offset, sizeof(header));
+
+	// Every particle takes at least one byte per value
+	return offset + sizeof(header) + header.payloadSize <= m_framesEnd && header.numParticles <= header.payloadSize / RECORDING_VALUES_PER_PARTICLE;
+}
+
+bool SimulationReplayer::DecodeFrame(uint64_t offset, uint64_t& nextOffset)
+{
+	RecordedFrameHeader header;
+	if (!ReadFrameHeader(offset, header))
+		return false;
+
+	bool isKeyframe = (header.flags & RECORDING_KEYFRAME) != 0;
+	if (!isKeyframe && m_currentFrame < 0)
+		return false;
+
+	int numParticles = static_cast<int>(header.numParticles);
+	m_previous.swap(m_current);
+	m_current.resize(numParticles * RECORDING_VALUES_PER_PARTICLE);
+	m_previousIds.swap(m_currentIds);
+	m_currentIds.resize(numParticles);
+
+	float velocityToPosition[3];
+	m_quantizer.GetVelocityToPosition(header.time - m_currentTime, velocityToPosition);
+
+	const uint8_t* data = m_data + offset + sizeof(header);
+	const uint8_t* end = data + header.payloadSize;
+	// After a seek m_previous is empty, otherwise it is the frame before. Keyframes of older files
+	// have no skip counts and start over with new ids.
+	bool hasSkips = !isKeyframe || (header.flags & RECORDING_KEYFRAME_SKIPS) != 0;
+	int numPrevious = hasSkips ? static_cast<int>(m_previous.size()) / RECORDING_VALUES_PER_PARTICLE : 0;
+	int previous = 0;
+
+	for (int i = 0; i < numParticles; i++)
+	{
+		int32_t* current = &m_current[i * RECORDING_VALUES_PER_PARTICLE];
+		int32_t predicted[RECORDING_VALUES_PER_PARTICLE] = {};
+
+		int32_t skip = 0;
+		if (hasSkips)
+		{
+			if (!ReadVarint(data, end, skip) || skip < 0)
+				return false;
+
+			// A keyframe decoded after a seek has no previous particles to skip
+			if (isKeyframe && numPrevious == 0)
+				skip = 0;
+			if (skip > numPrevious)
+				return false;
+
+			if (!isKeyframe && previous + skip < numPrevious)
+			{
+				const int32_t* previousValues = &m_previous[(previous + skip) * RECORDING_VALUES_PER_PARTICLE];
+				PredictParticle(previousValues, previousValues + 3, velocityToPosition, predicted, predicted + 3);
+			}
+		}
+
+		for (int value = 0; value < RECORDING_VALUES_PER_PARTICLE; value++)
+		{
+			int32_t residual;
+			if (!ReadVarint(data, end, residual))
+				return false;
+			current[value] = predicted[value] + residual;
+		}
+
+		previous += skip;
+		m_currentIds[i] = previous < numPrevious ? m_previousIds[previous] : m_nextId++;
+		previous++;
+	}
+
+	m_currentTime = header.time;
+	nextOffset = offset + sizeof(header) + header.payloadSize;
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <Windows.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RecordingFormat.h"
+
+// Plays back a file written by SimulationRecorder. The file is memory mapped, consecutive frames
+// decode from the previous one and seeking starts at the keyframe of the chunk.
+class SimulationReplayer
+{
+public:
+	SimulationReplayer();
+	~SimulationReplayer();
+
+	bool Open(const std::string& fileName);
+	void Close();
+
+	bool IsOpen() const;
+	int GetNumFrames() const;
+	float GetDuration() const;
+	// Last frame recorded at or before time
+	int FindFrame(float time) const;
+	// Ids follow the particles from frame to frame by the skip counts, they increase along a frame.
+	// After a seek every particle has a new id.
+	bool ReadFrame(int frame, std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, std::vector<uint32_t>& ids);
+
+private:
+	// Recordings without an index (e.g. the application crashed) are recovered up to the last complete frame
+	bool ReadIndex();
+	void RebuildIndex();
+	bool ReadFrameHeader(uint64_t offset, RecordedFrameHeader& header) const;
+	bool DecodeFrame(uint64_t offset, uint64_t& nextOffset);
+
+	HANDLE m_file;
+	HANDLE m_mapping;
+	const uint8_t* m_data;
+	uint64_t m_size;
+	uint64_t m_framesEnd;
+
+	RecordingHeader m_header;
+	RecordingQuantizer m_quantizer;
+	std::vector<RecordingChunk> m_chunks;
+	std::vector<float> m_chunkTimes;
+	int m_numFrames;
+	float m_duration;
+
+	int m_currentFrame;
+	uint64_t m_nextOffset;
+	float m_currentTime;
+	std::vector<int32_t> m_current;
+	std::vector<int32_t> m_previous;
+	std::vector<uint32_t> m_currentIds;
+	std::vector<uint32_t> m_previousIds;
+	uint32_t m_nextId;
+};
@@ -0,0 +1,178 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+
+SimulationThread::SimulationThread()
+{
+	m_isStopping = false;
+	m_isPaused = false;
+	m_numStepsDone = 0;
+	m_isSimulating = false;
+	m_numStepsSimulated = 0;
+	m_inputTimestamp = 0;
+	m_numStepsSent = 0;
+	m_numStepsMerged = 0;
+	m_pendingDeltaTime = 0.0f;
+}
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+}
+
+void SimulationThread::Start(const KeyHandler& onKey, const StepHandler& onStep, bool isThreaded)
+{
+	Stop();
+
+	m_onKey = onKey;
+	m_onStep = onStep;
+	m_isStopping = false;
+	m_isPaused = false;
+	if (isThreaded)
+		m_thread = std::thread(&SimulationThread::Run, this);
+}
+
+void SimulationThread::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_isStopping.store(true, std::memory_order_release);
+	WakeUp(m_eventSent);
+	m_thread.join();
+
+	SimulationEvent event;
+	while (m_events.Pop(event))
+	{
+	}
+	m_numStepsSent = m_numStepsDone.load(std::memory_order_acquire);
+	m_pendingDeltaTime = 0.0f;
+}
+
+bool SimulationThread::SendKey(int key, bool isShiftHeld, int64_t timestamp)
+{
+	SimulationEvent event = { SIMULATION_EVENT_KEY, key, isShiftHeld, 0.0f, timestamp };
+	if (!IsThreaded())
+	{
+		Simulate(event);
+		return true;
+	}
+
+	if (!m_events.Push(event))
+		return false;
+
+	WakeUp(m_eventSent);
+	return true;
+}
+
+const SimulationFrame* SimulationThread::Step(float deltaTime, bool isWaiting)
+{
+	SimulationEvent event = { SIMULATION_EVENT_STEP, 0, false, deltaTime + m_pendingDeltaTime, Profiler::GetTimestamp() };
+	if (!IsThreaded())
+	{
+		Simulate(event);
+		m_numStepsSent++;
+		m_frames.Update();
+	}
+	else
+	{
+		if (isWaiting)
+			Wait();
+		// Before sending, so the frame drawn never is the step sent
+		m_frames.Update();
+
+		// At most one step is on its way, so a slow simulation catches up with longer steps
+		// instead of a growing backlog
+		if (m_numStepsDone.load(std::memory_order_acquire) < m_numStepsSent || !m_events.Push(event))
+		{
+			m_pendingDeltaTime += deltaTime;
+			m_numStepsMerged++;
+		}
+		else
+		{
+			m_pendingDeltaTime = 0.0f;
+			m_numStepsSent++;
+			WakeUp(m_eventSent);
+		}
+	}
+
+	const SimulationFrame& frame = m_frames.GetReadBuffer();
+	return frame.step > 0 ? &frame : nullptr;
+}
+
+void SimulationThread::Wait()
+{
+	if (m_numStepsDone.load(std::memory_order_acquire) >= m_numStepsSent)
+		return;
+
+	std::unique_lock<std::mutex> lock(m_wakeLock);
+	m_eventsDone.wait(lock, [this]() { return m_numStepsDone.load(std::memory_order_acquire) >= m_numStepsSent; });
+}
+
+void SimulationThread::Pause()
+{
+	if (!IsThreaded())
+		return;
+
+	std::unique_lock<std::mutex> lock(m_wakeLock);
+	m_isPaused.store(true, std::memory_order_release);
+	m_eventsDone.wait(lock, [this]() { return !m_isSimulating; });
+}
+
+void SimulationThread::Resume()
+{
+	if (!IsThreaded())
+		return;
+
+	m_isPaused.store(false, std::memory_order_release);
+	WakeUp(m_eventSent);
+}
+
+void SimulationThread::WakeUp(std::condition_variable& condition)
+{
+	// Taking the lock orders the change before the check of a thread about to wait
+	{
+		std::lock_guard<std::mutex> lock(m_wakeLock);
+	}
+	condition.notify_all();
+}
+
+void SimulationThread::Run()
+{
+	SimulationEvent event;
+	std::unique_lock<std::mutex> lock(m_wakeLock);
+	while (true)
+	{
+		m_eventSent.wait(lock, [this]() { return m_isStopping.load(std::memory_order_acquire) || (!m_isPaused.load(std::memory_order_acquire) && !m_events.IsEmpty()); });
+		if (m_isStopping.load(std::memory_order_acquire))
+			break;
+
+		m_isSimulating = true;
+		lock.unlock();
+		while (!m_isPaused.load(std::memory_order_acquire) && m_events.Pop(event))
+			Simulate(event);
+		lock.lock();
+		m_isSimulating = false;
+		m_eventsDone.notify_all();
+	}
+}
+
+void SimulationThread::Simulate(const SimulationEvent& event)
+{
+	if (event.type == SIMULATION_EVENT_KEY)
+	{
+		m_onKey(event);
+		m_inputTimestamp = event.timestamp;
+		return;
+	}
+
+	PROFILE_SCOPE("SimulationStep");
+	int64_t start = Profiler::GetTimestamp();
+	SimulationFrame& frame = m_frames.GetWriteBuffer();
+	m_onStep(event.deltaTime, frame);
+	frame.step = ++m_numStepsSimulated;
+	frame.inputTimestamp = m_inputTimestamp;
+	frame.stepMs = static_cast<double>(Profiler::GetTimestamp() - start) / 1000000.0;
+	m_frames.Publish();
+	m_numStepsDone.store(m_numStepsSimulated, std::memory_order_release);
+	WakeUp(m_eventsDone);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ParticleSystem.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+enum SimulationEventType
+{
+	SIMULATION_EVENT_KEY,
+	SIMULATION_EVENT_STEP
+};
+
+struct SimulationEvent
+{
+	SimulationEventType type;
+	int key;
+	bool isShiftHeld;
+	float deltaTime;
+	int64_t timestamp;		// Profiler timestamp of when it was sent
+};
+
+// Everything drawing needs of one simulated step
+struct SimulationFrame
+{
+	uint64_t step;				// Counted from 1, 0 before the first step
+	int64_t inputTimestamp;		// Of the newest key the step saw, 0 for none
+	double stepMs;
+	std::vector<ParticleFrame> particleSystems;
+};
+
+// Runs the simulation on a thread of its own, a step ahead of drawing. The frame loop sends keys and
+// steps through a lock-free queue and draws the newest finished step from a lock-free triple buffer.
+// The thread sleeps while the queue is empty, the lock is only taken to wake it or the frame loop.
+// Without a thread every step runs right away on the frame loop, like the frame loop did it before.
+class SimulationThread
+{
+public:
+	typedef std::function<void(const SimulationEvent& event)> KeyHandler;
+	// Simulates deltaTime and writes what drawing needs into frame, its vectors are reused
+	typedef std::function<void(float deltaTime, SimulationFrame& frame)> StepHandler;
+
+	SimulationThread();
+	~SimulationThread();
+
+	void Start(const KeyHandler& onKey, const StepHandler& onStep, bool isThreaded);
+	// Steps and keys not simulated yet are dropped
+	void Stop();
+	bool IsThreaded() const { return m_thread.joinable(); }
+
+	// Key handlers run before the next step. False if the queue is full and the key was dropped.
+	bool SendKey(int key, bool isShiftHeld, int64_t timestamp);
+	// Sends the next step and returns the newest frame to draw, nullptr before the first. Without a
+	// thread that is the step just simulated. With one it is the newest finished step while the one
+	// sent runs on. isWaiting waits for the step before, so every frame draws a step of its own.
+	// Otherwise the frame loop never waits and the time of steps it sent while the simulation was
+	// behind is added to the next step.
+	const SimulationFrame* Step(float deltaTime, bool isWaiting);
+	// Blocks until every step sent is simulated, not while paused
+	void Wait();
+	// Blocks until the thread is between events and keeps it there, so the frame loop may read what
+	// it writes, like the profiler rings. Keys and steps sent meanwhile run after Resume.
+	void Pause();
+	void Resume();
+
+	uint64_t GetNumStepsSent() const { return m_numStepsSent; }
+	// Steps sent while the previous one was still running, merged into a later one
+	uint64_t GetNumStepsMerged() const { return m_numStepsMerged; }
+
+private:
+	static const int QUEUE_SIZE = 256;
+
+	void Run();
+	void Simulate(const SimulationEvent& event);
+	void WakeUp(std::condition_variable& condition);
+
+	KeyHandler m_onKey;
+	StepHandler m_onStep;
+	SpscQueue<SimulationEvent, QUEUE_SIZE> m_events;
+	TripleBuffer<SimulationFrame> m_frames;
+	std::thread m_thread;
+	std::atomic<bool> m_isStopping;
+	std::atomic<bool> m_isPaused;
+	std::atomic<uint64_t> m_numStepsDone;
+
+	std::mutex m_wakeLock;
+	std::condition_variable m_eventSent;		// Wakes the thread
+	std::condition_variable m_eventsDone;		// Wakes the frame loop in Wait and Pause
+	bool m_isSimulating;						// Guarded by m_wakeLock
+
+	// Simulating side
+	uint64_t m_numStepsSimulated;
+	int64_t m_inputTimestamp;
+
+	// Frame loop side
+	uint64_t m_numStepsSent;
+	uint64_t m_numStepsMerged;
+	float m_pendingDeltaTime;
+};
@@ -0,0 +1,638 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "SoftwareRenderDevice.h"
+#include "ConstantBuffer.h"
+#include "Vertex.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+namespace
+{
+	uint32_t PackColor(float r, float g, float b, float a)
+	{
+		auto toByte = [](float value) { return static_cast<uint32_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f); };
+		return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | (toByte(a) << 24);
+	}
+
+	bool EndsWith(const std::wstring& text, const wchar_t* suffix)
+	{
+		size_t length = std::wcslen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	// Top edges run right and left edges run up, pixel centers exactly on them are inside
+	bool IsTopLeftEdge(float dx, float dy)
+	{
+		return (dy == 0.0f && dx > 0.0f) || dy < 0.0f;
+	}
+
+	DirectX::XMFLOAT3 Lerp(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, float t)
+	{
+		return DirectX::XMFLOAT3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+	}
+}
+
+SoftwareRenderDevice::SoftwareRenderDevice(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	m_numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+	m_shading = SOFTWARE_SHADING_NONE;
+	m_vertexBuffer = nullptr;
+	m_vertexStride = 0;
+	m_indexBuffer = nullptr;
+	m_constantBuffer = nullptr;
+	m_lightBuffer = nullptr;
+	m_clusterRangeBuffer = nullptr;
+	m_lightIndexBuffer = nullptr;
+	m_clusterConstantBuffer = nullptr;
+	m_instanceBuffer = nullptr;
+	m_topology = RENDER_TOPOLOGY_TRIANGLE_LIST;
+
+	m_clearColor = PackColor(0.0f, 0.0f, 0.0f, 1.0f);
+	m_isClearPending = true;
+	m_numTriangleSlots = 0;
+	m_depthBuffer.assign(width * height, 1.0f);
+	m_colorBuffer.assign(width * height, m_clearColor);
+	m_rasterStats = SoftwareRasterStats();
+	m_lastRasterStats = SoftwareRasterStats();
+}
+
+HRESULT SoftwareRenderDevice::CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program)
+{
+	HRESULT hr = NullRenderDevice::CreateShaderProgram(desc, program);
+	if (FAILED(hr))
+		return hr;
+
+	// Only the plain and instanced mesh shaders have a CPU port, everything drawn with a geometry shader is skipped
+	bool isInstanced = desc.defines.size() == 1 && desc.defines[0].name == "INSTANCED";
+	bool isPortable = desc.vertexEntryPoint == "VSMain" && desc.pixelEntryPoint == "PSMain" && desc.geometryEntryPoint.empty() && (desc.defines.empty() || isInstanced);
+	SoftwareShading shading = SOFTWARE_SHADING_NONE;
+	if (isPortable && EndsWith(desc.fileName, L"BlinnPhongShader.hlsl"))
+		shading = SOFTWARE_SHADING_BLINN_PHONG;
+	else if (isPortable && EndsWith(desc.fileName, L"DefaultShader.hlsl"))
+		shading = SOFTWARE_SHADING_DEFAULT;
+
+	std::lock_guard<std::mutex> lock(m_programMutex);
+	m_programShading[*program] = shading;
+	return S_OK;
+}
+
+void SoftwareRenderDevice::SetShaderProgram(RenderShaderProgram* program)
+{
+	NullRenderDevice::SetShaderProgram(program);
+	std::lock_guard<std::mutex> lock(m_programMutex);
+	auto it = m_programShading.find(program);
+	m_shading = it != m_programShading.end() ? it->second : SOFTWARE_SHADING_NONE;
+}
+
+void SoftwareRenderDevice::SetVertexBuffer(RenderBuffer* buffer, UINT stride)
+{
+	NullRenderDevice::SetVertexBuffer(buffer, stride);
+	m_vertexBuffer = buffer;
+	m_vertexStride = stride;
+}
+
+void SoftwareRenderDevice::SetIndexBuffer(RenderBuffer* buffer)
+{
+	NullRenderDevice::SetIndexBuffer(buffer);
+	m_indexBuffer = buffer;
+}
+
+void SoftwareRenderDevice::SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	NullRenderDevice::SetConstantBuffer(stage, slot, buffer);
+	if (stage == RENDER_STAGE_VERTEX && slot == 0)
+		m_constantBuffer = buffer;
+	else if (stage == RENDER_STAGE_PIXEL && slot == CLUSTER_CONSTANT_SLOT)
+		m_clusterConstantBuffer = buffer;
+}
+
+void SoftwareRenderDevice::SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer)
+{
+	NullRenderDevice::SetShaderResource(stage, slot, buffer);
+	if (stage == RENDER_STAGE_PIXEL && slot == CLUSTER_LIGHT_SLOT)
+		m_lightBuffer = buffer;
+	else if (stage == RENDER_STAGE_PIXEL && slot == CLUSTER_RANGE_SLOT)
+		m_clusterRangeBuffer = buffer;
+	else if (stage == RENDER_STAGE_PIXEL && slot == CLUSTER_INDEX_SLOT)
+		m_lightIndexBuffer = buffer;
+	else if (stage == RENDER_STAGE_VERTEX && slot == INSTANCE_BUFFER_SLOT)
+		m_instanceBuffer = buffer;
+}
+
+void SoftwareRenderDevice::SetTopology(RenderTopology topology)
+{
+	NullRenderDevice::SetTopology(topology);
+	m_topology = topology;
+}
+
+void SoftwareRenderDevice::Draw(UINT numVertices, UINT firstVertex)
+{
+	NullRenderDevice::Draw(numVertices, firstVertex);
+	m_rasterStats.numSkippedDraws++;
+}
+
+void SoftwareRenderDevice::DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex)
+{
+	NullRenderDevice::DrawIndexed(numIndices, firstIndex, baseVertex);
+	if (!IsDrawable(numIndices, firstIndex))
+	{
+		m_rasterStats.numSkippedDraws++;
+		return;
+	}
+
+	ConstantBuffer constants;
+	std::memcpy(&constants, GetBufferData(m_constantBuffer), sizeof(ConstantBuffer));
+	SetupDraw(constants, numIndices, firstIndex, baseVertex);
+}
+
+void SoftwareRenderDevice::DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex)
+{
+	NullRenderDevice::DrawIndexedInstanced(numIndices, numInstances, firstIndex, baseVertex);
+	bool hasInstances = m_instanceBuffer && numInstances * sizeof(InstanceData) <= m_instanceBuffer->GetDesc().byteWidth;
+	if (!IsDrawable(numIndices, firstIndex) || !hasInstances)
+	{
+		m_rasterStats.numSkippedDraws++;
+		return;
+	}
+
+	// Like the instanced vertex shaders, world comes per instance and view and projection from the constant buffer
+	ConstantBuffer constants;
+	std::memcpy(&constants, GetBufferData(m_constantBuffer), sizeof(ConstantBuffer));
+	const InstanceData* instances = reinterpret_cast<const InstanceData*>(GetBufferData(m_instanceBuffer));
+	for (UINT i = 0; i < numInstances; i++)
+	{
+		constants.world = DirectX::XMLoadFloat4x4(&instances[i].world);
+		constants.worldView = constants.world * constants.view;
+		constants.worldViewProj = constants.worldView * constants.projection;
+		SetupDraw(constants, numIndices, firstIndex, baseVertex);
+	}
+}
+
+bool SoftwareRenderDevice::IsDrawable(UINT numIndices, UINT firstIndex) const
+{
+	return m_topology == RENDER_TOPOLOGY_TRIANGLE_LIST && m_shading != SOFTWARE_SHADING_NONE && m_vertexBuffer && m_indexBuffer
+		&& m_constantBuffer && m_vertexStride >= sizeof(Vertex) && m_constantBuffer->GetDesc().byteWidth >= sizeof(ConstantBuffer)
+		&& (firstIndex + numIndices) * sizeof(UINT) <= m_indexBuffer->GetDesc().byteWidth;
+}
+
+void SoftwareRenderDevice::SetupDraw(const ConstantBuffer& constants, UINT numIndices, UINT firstIndex, INT baseVertex)
+{
+	long long start = Profiler::GetTimestamp();
+
+	// The light clusters are only used when every part of them is bound and large enough
+	DrawState state = DrawState();
+	state.shading = m_shading;
+	bool hasClusters = m_lightBuffer && m_clusterRangeBuffer && m_lightIndexBuffer && m_clusterConstantBuffer
+		&& m_clusterConstantBuffer->GetDesc().byteWidth >= sizeof(ClusterConstants);
+	if (hasClusters)
+	{
+		std::memcpy(&state.clusterConstants, GetBufferData(m_clusterConstantBuffer), sizeof(ClusterConstants));
+		const ClusterConstants& clusterConstants = state.clusterConstants;
+		uint64_t numClusters = static_cast<uint64_t>(clusterConstants.numClustersX) * clusterConstants.numClustersY * clusterConstants.numClustersZ;
+		state.numLights = m_lightBuffer->GetDesc().byteWidth / sizeof(ClusterLight);
+		state.numLightIndices = m_lightIndexBuffer->GetDesc().byteWidth / sizeof(uint32_t);
+		if (numClusters > 0 && numClusters * sizeof(ClusterLightRange) <= m_clusterRangeBuffer->GetDesc().byteWidth)
+		{
+			state.lights = reinterpret_cast<const ClusterLight*>(GetBufferData(m_lightBuffer));
+			state.clusters = reinterpret_cast<const ClusterLightRange*>(GetBufferData(m_clusterRangeBuffer));
+			state.lightIndices = reinterpret_cast<const uint32_t*>(GetBufferData(m_lightIndexBuffer));
+		}
+	}
+	int draw = static_cast<int>(m_draws.size());
+	m_draws.push_back(state);
+
+	// Vertex stage of the shaders on every vertex of the buffer
+	const uint8_t* vertexData = GetBufferData(m_vertexBuffer);
+	int numVertices = static_cast<int>(m_vertexBuffer->GetDesc().byteWidth / m_vertexStride);
+	m_shadedVertices.resize(numVertices);
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	jobSystem.ParallelFor(numVertices, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			Vertex vertex;
+			std::memcpy(&vertex, vertexData + i * m_vertexStride, sizeof(Vertex));
+			DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&vertex.position);
+			ShadedVertex& shaded = m_shadedVertices[i];
+			DirectX::XMStoreFloat4(&shaded.position, DirectX::XMVector3Transform(position, constants.worldViewProj));
+			DirectX::XMStoreFloat3(&shaded.viewPosition, DirectX::XMVector3Transform(position, constants.worldView));
+			DirectX::XMStoreFloat3(&shaded.normal, DirectX::XMVector3Normalize(DirectX::XMVector3TransformNormal(DirectX::XMLoadFloat3(&vertex.normal), constants.worldView)));
+			shaded.color = vertex.color;
+		}
+	}, 1024);
+
+	// Clipping against the near plane, setup and binning. Every chunk bins into its own lists so
+	// the tiles see the triangles of a chunk in submission order.
+	int numTriangles = static_cast<int>(numIndices / 3);
+	uint32_t firstSlot = m_numTriangleSlots;
+	m_numTriangleSlots += 2 * numTriangles;
+	if (m_triangles.size() < m_numTriangleSlots)
+		m_triangles.resize(m_numTriangleSlots);
+
+	const int minChunkSize = 512;
+	int numChunks = JobSystem::GetChunkCount(numTriangles, jobSystem.GetNumThreads(), minChunkSize);
+	while (static_cast<int>(m_bins.size()) < numChunks)
+		m_bins.emplace_back(m_numTilesX * m_numTilesY);
+
+	const UINT* indices = reinterpret_cast<const UINT*>(GetBufferData(m_indexBuffer)) + firstIndex;
+	std::vector<int> chunkCulled(numChunks, 0);
+	std::vector<int> chunkBinned(numChunks, 0);
+	jobSystem.ParallelFor(numTriangles, [&](int begin, int end, int chunk)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			const ShadedVertex* corners[3];
+			bool isInRange = true;
+			for (int k = 0; k < 3; k++)
+			{
+				int index = static_cast<int>(indices[3 * t + k]) + baseVertex;
+				isInRange = isInRange && index >= 0 && index < numVertices;
+				corners[k] = isInRange ? &m_shadedVertices[index] : nullptr;
+			}
+			if (!isInRange)
+			{
+				chunkCulled[chunk]++;
+				continue;
+			}
+
+			// D3D clips to 0 <= z, which leaves a triangle or a quad in front of the near plane
+			ShadedVertex polygon[4];
+			int numCorners = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				const ShadedVertex& current = *corners[k];
+				const ShadedVertex& next = *corners[(k + 1) % 3];
+				if (current.position.z >= 0.0f)
+					polygon[numCorners++] = current;
+				if ((current.position.z >= 0.0f) != (next.position.z >= 0.0f))
+				{
+					float s = current.position.z / (current.position.z - next.position.z);
+					ShadedVertex& clipped = polygon[numCorners++];
+					clipped.position = DirectX::XMFLOAT4(current.position.x + (next.position.x - current.position.x) * s, current.position.y + (next.position.y - current.position.y) * s,
+						0.0f, current.position.w + (next.position.w - current.position.w) * s);
+					clipped.viewPosition = Lerp(current.viewPosition, next.viewPosition, s);
+					clipped.normal = Lerp(current.normal, next.normal, s);
+					clipped.color = Lerp(current.color, next.color, s);
+				}
+			}
+
+			bool isVisible = false;
+			for (int k = 0; k + 2 < numCorners; k++)
+			{
+				uint32_t slot = firstSlot + 2 * t + k;
+				if (SetupTriangle(polygon[0], polygon[k + 1], polygon[k + 2], draw, m_triangles[slot]))
+				{
+					chunkBinned[chunk] += BinTriangle(m_triangles[slot], slot, m_bins[chunk]);
+					isVisible = true;
+				}
+			}
+			chunkCulled[chunk] += isVisible ? 0 : 1;
+		}
+	}, minChunkSize);
+
+	m_rasterStats.numTriangles += numTriangles;
+	for (int chunk = 0; chunk < numChunks; chunk++)
+	{
+		m_rasterStats.numCulled += chunkCulled[chunk];
+		m_rasterStats.numBinned += chunkBinned[chunk];
+	}
+	m_rasterStats.setupMs += static_cast<double>(Profiler::GetTimestamp() - start) / 1000000.0;
+}
+
+void SoftwareRenderDevice::Clear(const float color[4])
+{
+	NullRenderDevice::Clear(color);
+	m_clearColor = PackColor(color[0], color[1], color[2], color[3]);
+	m_isClearPending = true;
+
+	// Nothing drawn before the clear can show
+	for (std::vector<std::vector<uint32_t>>& chunkBins : m_bins)
+	{
+		for (std::vector<uint32_t>& bin : chunkBins)
+			bin.clear();
+	}
+	m_numTriangleSlots = 0;
+	m_draws.clear();
+}
+
+HRESULT SoftwareRenderDevice::Present()
+{
+	long long start = Profiler::GetTimestamp();
+
+	// Chunk c takes every numChunks-th tile, so the heavy rows at the floor are spread out
+	int numTiles = m_numTilesX * m_numTilesY;
+	int numChunks = std::min(JobSystem::GetInstance().GetNumThreads(), numTiles);
+	std::vector<int> chunkShaded(numChunks, 0);
+	JobSystem::GetInstance().ParallelFor(numChunks, [&](int begin, int end, int chunk)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			for (int tile = c; tile < numTiles; tile += numChunks)
+				chunkShaded[c] += RasterizeTile(tile);
+		}
+	}, 1);
+
+	for (int shaded : chunkShaded)
+		m_rasterStats.numPixelsShaded += shaded;
+	m_rasterStats.rasterMs += static_cast<double>(Profiler::GetTimestamp() - start) / 1000000.0;
+
+	for (std::vector<std::vector<uint32_t>>& chunkBins : m_bins)
+	{
+		for (std::vector<uint32_t>& bin : chunkBins)
+			bin.clear();
+	}
+	m_numTriangleSlots = 0;
+	m_draws.clear();
+	m_isClearPending = false;
+
+	m_lastRasterStats = m_rasterStats;
+	m_rasterStats = SoftwareRasterStats();
+	return NullRenderDevice::Present();
+}
+
+bool SoftwareRenderDevice::SaveBitmap(const std::string& fileName) const
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Failed to write bitmap: " << fileName << std::endl;
+		return false;
+	}
+
+	int rowSize = (3 * m_width + 3) & ~3;
+	uint32_t imageSize = static_cast<uint32_t>(rowSize * m_height);
+	auto write16 = [&](uint16_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+	auto write32 = [&](uint32_t value) { file.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+	// File header, then the info header of an uncompressed 24 bit bitmap stored bottom up
+	write16(0x4D42);
+	write32(54 + imageSize);
+	write32(0);
+	write32(54);
+	write32(40);
+	write32(static_cast<uint32_t>(m_width));
+	write32(static_cast<uint32_t>(m_height));
+	write16(1);
+	write16(24);
+	write32(0);
+	write32(imageSize);
+	write32(2835);
+	write32(2835);
+	write32(0);
+	write32(0);
+
+	std::vector<uint8_t> row(rowSize, 0);
+	for (int y = m_height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < m_width; x++)
+		{
+			uint32_t color = m_colorBuffer[y * m_width + x];
+			row[3 * x + 0] = static_cast<uint8_t>(color >> 16);
+			row[3 * x + 1] = static_cast<uint8_t>(color >> 8);
+			row[3 * x + 2] = static_cast<uint8_t>(color);
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), rowSize);
+	}
+	return static_cast<bool>(file);
+}
+
+bool SoftwareRenderDevice::SetupTriangle(const ShadedVertex& a, const ShadedVertex& b, const ShadedVertex& c, int draw, Triangle& triangle) const
+{
+	const ShadedVertex* corners[3] = { &a, &b, &c };
+	for (int k = 0; k < 3; k++)
+	{
+		const ShadedVertex& corner = *corners[k];
+		if (corner.position.w <= 0.0f)
+			return false;
+
+		float invW = 1.0f / corner.position.w;
+		triangle.x[k] = (corner.position.x * invW * 0.5f + 0.5f) * m_width;
+		triangle.y[k] = (0.5f - corner.position.y * invW * 0.5f) * m_height;
+		triangle.z[k] = corner.position.z * invW;
+		triangle.invW[k] = invW;
+		triangle.viewPosition[k] = DirectX::XMFLOAT3(corner.viewPosition.x * invW, corner.viewPosition.y * invW, corner.viewPosition.z * invW);
+		triangle.normal[k] = DirectX::XMFLOAT3(corner.normal.x * invW, corner.normal.y * invW, corner.normal.z * invW);
+		triangle.color[k] = DirectX::XMFLOAT3(corner.color.x * invW, corner.color.y * invW, corner.color.z * invW);
+	}
+	triangle.draw = draw;
+
+	// Front faces wind clockwise on screen like in the rasterizer state, so back faces and
+	// degenerate triangles have no positive area
+	float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+	if (!(area > 0.0f))
+		return false;
+
+	float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	return maxX >= 0.0f && minX < m_width && maxY >= 0.0f && minY < m_height;
+}
+
+int SoftwareRenderDevice::BinTriangle(const Triangle& triangle, uint32_t triangleIndex, std::vector<std::vector<uint32_t>>& bins) const
+{
+	float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+	float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+	int tileMinX = std::max(0, static_cast<int>(minX) / TILE_SIZE);
+	int tileMaxX = std::min(m_numTilesX - 1, static_cast<int>(maxX) / TILE_SIZE);
+	int tileMinY = std::max(0, static_cast<int>(minY) / TILE_SIZE);
+	int tileMaxY = std::min(m_numTilesY - 1, static_cast<int>(maxY) / TILE_SIZE);
+
+	int numBinned = 0;
+	for (int tileY = tileMinY; tileY <= tileMaxY; tileY++)
+	{
+		for (int tileX = tileMinX; tileX <= tileMaxX; tileX++)
+		{
+			// Skips tiles whose corners are all outside one of the edges
+			float cornersX[2] = { static_cast<float>(tileX * TILE_SIZE), static_cast<float>((tileX + 1) * TILE_SIZE) };
+			float cornersY[2] = { static_cast<float>(tileY * TILE_SIZE), static_cast<float>((tileY + 1) * TILE_SIZE) };
+			bool isOutside = false;
+			for (int k = 0; k < 3 && !isOutside; k++)
+			{
+				int next = (k + 1) % 3;
+				float dx = triangle.x[next] - triangle.x[k];
+				float dy = triangle.y[next] - triangle.y[k];
+				float cornerX = dy >= 0.0f ? cornersX[0] : cornersX[1];
+				float cornerY = dx >= 0.0f ? cornersY[1] : cornersY[0];
+				isOutside = dx * (cornerY - triangle.y[k]) - dy * (cornerX - triangle.x[k]) < 0.0f;
+			}
+			if (isOutside)
+				continue;
+
+			bins[tileY * m_numTilesX + tileX].push_back(triangleIndex);
+			numBinned++;
+		}
+	}
+	return numBinned;
+}
+
+int SoftwareRenderDevice::RasterizeTile(int tile)
+{
+	int tileX = tile % m_numTilesX;
+	int tileY = tile / m_numTilesX;
+	int beginX = tileX * TILE_SIZE;
+	int beginY = tileY * TILE_SIZE;
+	int endX = std::min(beginX + TILE_SIZE, m_width);
+	int endY = std::min(beginY + TILE_SIZE, m_height);
+
+	if (m_isClearPending)
+	{
+		for (int y = beginY; y < endY; y++)
+		{
+			std::fill(m_depthBuffer.begin() + y * m_width + beginX, m_depthBuffer.begin() + y * m_width + endX, 1.0f);
+			std::fill(m_colorBuffer.begin() + y * m_width + beginX, m_colorBuffer.begin() + y * m_width + endX, m_clearColor);
+		}
+	}
+
+	// Merges the lists of the setup chunks back into submission order
+	int numChunks = static_cast<int>(m_bins.size());
+	std::vector<size_t> heads(numChunks, 0);
+	int numShaded = 0;
+	while (true)
+	{
+		int nextChunk = -1;
+		uint32_t nextTriangle = 0;
+		for (int chunk = 0; chunk < numChunks; chunk++)
+		{
+			const std::vector<uint32_t>& bin = m_bins[chunk][tile];
+			if (heads[chunk] < bin.size() && (nextChunk < 0 || bin[heads[chunk]] < nextTriangle))
+			{
+				nextChunk = chunk;
+				nextTriangle = bin[heads[chunk]];
+			}
+		}
+		if (nextChunk < 0)
+			break;
+		heads[nextChunk]++;
+
+		const Triangle& triangle = m_triangles[nextTriangle];
+		const DrawState& state = m_draws[triangle.draw];
+
+		float minX = std::min(std::min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float maxX = std::max(std::max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float minY = std::min(std::min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		float maxY = std::max(std::max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		int pixelMinX = std::max(beginX, static_cast<int>(std::floor(minX)));
+		int pixelMaxX = std::min(endX - 1, static_cast<int>(std::ceil(maxX)));
+		int pixelMinY = std::max(beginY, static_cast<int>(std::floor(minY)));
+		int pixelMaxY = std::min(endY - 1, static_cast<int>(std::ceil(maxY)));
+
+		// Edge k is opposite to corner k, its function is the barycentric weight of k times the area
+		float stepX[3];
+		float stepY[3];
+		float offset[3];
+		bool isTopLeft[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int from = (k + 1) % 3;
+			int to = (k + 2) % 3;
+			float dx = triangle.x[to] - triangle.x[from];
+			float dy = triangle.y[to] - triangle.y[from];
+			stepX[k] = -dy;
+			stepY[k] = dx;
+			offset[k] = dy * triangle.x[from] - dx * triangle.y[from];
+			isTopLeft[k] = IsTopLeftEdge(dx, dy);
+		}
+		float invArea = 1.0f / (offset[0] + stepX[0] * triangle.x[0] + stepY[0] * triangle.y[0]);
+
+		for (int y = pixelMinY; y <= pixelMaxY; y++)
+		{
+			float centerY = y + 0.5f;
+			float centerX = pixelMinX + 0.5f;
+			float edges[3];
+			for (int k = 0; k < 3; k++)
+				edges[k] = offset[k] + stepX[k] * centerX + stepY[k] * centerY;
+
+			for (int x = pixelMinX; x <= pixelMaxX; x++, edges[0] += stepX[0], edges[1] += stepX[1], edges[2] += stepX[2])
+			{
+				bool isInside = true;
+				for (int k = 0; k < 3; k++)
+					isInside = isInside && (edges[k] > 0.0f || (edges[k] == 0.0f && isTopLeft[k]));
+				if (!isInside)
+					continue;
+
+				float b0 = edges[0] * invArea;
+				float b1 = edges[1] * invArea;
+				float b2 = edges[2] * invArea;
+				float depth = b0 * triangle.z[0] + b1 * triangle.z[1] + b2 * triangle.z[2];
+				int pixel = y * m_width + x;
+				if (!(depth < m_depthBuffer[pixel]) || depth < 0.0f)
+					continue;
+				m_depthBuffer[pixel] = depth;
+
+				// Perspective correct attributes
+				float w = 1.0f / (b0 * triangle.invW[0] + b1 * triangle.invW[1] + b2 * triangle.invW[2]);
+				auto interpolate = [&](const DirectX::XMFLOAT3* values)
+				{
+					return DirectX::XMFLOAT3((b0 * values[0].x + b1 * values[1].x + b2 * values[2].x) * w, (b0 * values[0].y + b1 * values[1].y + b2 * values[2].y) * w,
+						(b0 * values[0].z + b1 * values[1].z + b2 * values[2].z) * w);
+				};
+				m_colorBuffer[pixel] = Shade(state, x + 0.5f, centerY, interpolate(triangle.viewPosition), interpolate(triangle.normal), interpolate(triangle.color));
+				numShaded++;
+			}
+		}
+	}
+	return numShaded;
+}
+
+uint32_t SoftwareRenderDevice::Shade(const DrawState& state, float pixelX, float pixelY, const DirectX::XMFLOAT3& viewPosition, const DirectX::XMFLOAT3& normal, const DirectX::XMFLOAT3& color) const
+{
+	if (state.shading == SOFTWARE_SHADING_DEFAULT)
+		return PackColor(1.0f, 0.0f, 0.4f, 1.0f);
+
+	// BlinnPhong of BlinnPhongShader.hlsl, the interpolated normal is not renormalized there either.
+	// The shininess of 20 is raised by squaring instead of pow.
+	const float screenGamma = 2.2f;
+	const DirectX::XMFLOAT3 ambientColor(0.0f, 0.02f, 0.05f);
+	float linearColor[3] = { 0.0f, 0.0f, 0.0f };
+	ClusterLightRange cluster = ClusterLightRange();
+	if (state.lights)
+		cluster = state.clusters[LightClusters::GetClusterIndex(state.clusterConstants, pixelX, pixelY, viewPosition.z)];
+	if (static_cast<uint64_t>(cluster.offset) + cluster.numLights > state.numLightIndices)
+		cluster.numLights = 0;
+
+	for (uint32_t i = 0; i < cluster.numLights; i++)
+	{
+		uint32_t lightIndex = state.lightIndices[cluster.offset + i];
+		if (lightIndex >= state.numLights)
+			continue;
+
+		const ClusterLight& light = state.lights[lightIndex];
+		float lightDir[3] = { light.viewPosition.x - viewPosition.x, light.viewPosition.y - viewPosition.y, light.viewPosition.z - viewPosition.z };
+		float distance = lightDir[0] * lightDir[0] + lightDir[1] * lightDir[1] + lightDir[2] * lightDir[2];
+		float invLength = 1.0f / std::sqrt(distance);
+		for (float& value : lightDir)
+			value *= invLength;
+
+		float lambertian = std::max(lightDir[0] * normal.x + lightDir[1] * normal.y + lightDir[2] * normal.z, 0.0f);
+		float specular = 0.0f;
+		if (lambertian > 0.0f)
+		{
+			float viewLength = std::sqrt(viewPosition.x * viewPosition.x + viewPosition.y * viewPosition.y + viewPosition.z * viewPosition.z);
+			float halfDir[3] = { lightDir[0] - viewPosition.x / viewLength, lightDir[1] - viewPosition.y / viewLength, lightDir[2] - viewPosition.z / viewLength };
+			float halfLength = std::sqrt(halfDir[0] * halfDir[0] + halfDir[1] * halfDir[1] + halfDir[2] * halfDir[2]);
+			float specAngle = std::max((halfDir[0] * normal.x + halfDir[1] * normal.y + halfDir[2] * normal.z) / halfLength, 0.0f);
+			float specAngle4 = specAngle * specAngle * specAngle * specAngle;
+			float specAngle16 = specAngle4 * specAngle4 * specAngle4 * specAngle4;
+			specular = specAngle16 * specAngle4;
+		}
+
+		float intensity = light.power * std::max(1.0f / distance - 1.0f / (light.range * light.range), 0.0f);
+		const DirectX::XMFLOAT3& lightColor = light.color;
+		linearColor[0] += (color.x * lambertian + specular) * lightColor.x * intensity;
+		linearColor[1] += (color.y * lambertian + specular) * lightColor.y * intensity;
+		linearColor[2] += (color.z * lambertian + specular) * lightColor.z * intensity;
+	}
+
+	return PackColor(std::pow(linearColor[0], 1.0f / screenGamma) + ambientColor.x, std::pow(linearColor[1], 1.0f / screenGamma) + ambientColor.y,
+		std::pow(linearColor[2], 1.0f / screenGamma) + ambientColor.z, 1.0f);
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include "NullRenderDevice.h"
+#include "LightClusters.h"
+#include "ConstantBuffer.h"
+
+enum SoftwareShading
+{
+	SOFTWARE_SHADING_NONE,			// Draws of unknown shaders are skipped
+	SOFTWARE_SHADING_DEFAULT,		// DefaultShader.hlsl
+	SOFTWARE_SHADING_BLINN_PHONG	// BlinnPhongShader.hlsl
+};
+
+struct SoftwareRasterStats
+{
+	int numTriangles;		// Submitted by indexed triangle list draws
+	int numCulled;			// Back facing, degenerate or behind the near plane
+	int numBinned;			// Triangle and tile pairs
+	int numPixelsShaded;	// Pixels that passed the depth test
+	int numSkippedDraws;	// Draws of points or of shaders without a CPU port
+	double setupMs;			// Vertex transform, clipping and binning of all draws
+	double rasterMs;		// Depth test and shading of all tiles
+};
+
+// Rasterizes the indexed triangle lists of StaticMesh draws on the CPU. Draws are transformed and
+// binned into screen tiles as they come in, Present then depth tests and shades the tiles in
+// parallel. The vertex stage and lighting follow DefaultShader.hlsl and BlinnPhongShader.hlsl,
+// with the light clusters of LightClusters::Upload, which are read when the frame is presented.
+// Instanced draws are set up once per instance.
+// Commands are counted like on the null device.
+class SoftwareRenderDevice : public NullRenderDevice
+{
+public:
+	static const int TILE_SIZE = 64;
+
+	SoftwareRenderDevice(int width, int height);
+
+	HRESULT CreateShaderProgram(const RenderShaderProgramDesc& desc, RenderShaderProgram** program) override;
+
+	void SetShaderProgram(RenderShaderProgram* program) override;
+	void SetVertexBuffer(RenderBuffer* buffer, UINT stride) override;
+	void SetIndexBuffer(RenderBuffer* buffer) override;
+	void SetConstantBuffer(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetShaderResource(RenderShaderStage stage, UINT slot, RenderBuffer* buffer) override;
+	void SetTopology(RenderTopology topology) override;
+	void Draw(UINT numVertices, UINT firstVertex) override;
+	void DrawIndexed(UINT numIndices, UINT firstIndex, INT baseVertex) override;
+	void DrawIndexedInstanced(UINT numIndices, UINT numInstances, UINT firstIndex, INT baseVertex) override;
+
+	void Clear(const float color[4]) override;
+	// Rasterizes the binned triangles into the color buffer, then ends the frame
+	HRESULT Present() override;
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	// RGBA8 of the last presented frame, rows top to bottom
+	const std::vector<uint32_t>& GetColorBuffer() const { return m_colorBuffer; }
+	const SoftwareRasterStats& GetLastRasterStats() const { return m_lastRasterStats; }
+
+	// 24 bit uncompressed bitmap of the last presented frame
+	bool SaveBitmap(const std::string& fileName) const;
+
+private:
+	struct ShadedVertex
+	{
+		DirectX::XMFLOAT4 position;		// Clip space
+		DirectX::XMFLOAT3 viewPosition;
+		DirectX::XMFLOAT3 normal;
+		DirectX::XMFLOAT3 color;
+	};
+
+	// Attributes are divided by w, so they interpolate linearly in screen space
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+		float invW[3];
+		DirectX::XMFLOAT3 viewPosition[3];
+		DirectX::XMFLOAT3 normal[3];
+		DirectX::XMFLOAT3 color[3];
+		int draw;
+	};
+
+	// What the pixel shader of a draw reads, captured when it was issued
+	struct DrawState
+	{
+		SoftwareShading shading;
+		ClusterConstants clusterConstants;
+		const ClusterLight* lights;			// nullptr without complete light clusters
+		const ClusterLightRange* clusters;
+		const uint32_t* lightIndices;
+		uint32_t numLights;
+		uint32_t numLightIndices;
+	};
+
+	bool IsDrawable(UINT numIndices, UINT firstIndex) const;
+	// Transforms, clips and bins the triangles of one draw or instance
+	void SetupDraw(const ConstantBuffer& constants, UINT numIndices, UINT firstIndex, INT baseVertex);
+	// Projects a triangle in front of the near plane, false if it faces away or covers no pixel
+	bool SetupTriangle(const ShadedVertex& a, const ShadedVertex& b, const ShadedVertex& c, int draw, Triangle& triangle) const;
+	int BinTriangle(const Triangle& triangle, uint32_t triangleIndex, std::vector<std::vector<uint32_t>>& bins) const;
+	int RasterizeTile(int tile);
+	uint32_t Shade(const DrawState& state, float pixelX, float pixelY, const DirectX::XMFLOAT3& viewPosition, const DirectX::XMFLOAT3& normal, const DirectX::XMFLOAT3& color) const;
+
+	int m_width;
+	int m_height;
+	int m_numTilesX;
+	int m_numTilesY;
+
+	// Programs are also created by loading jobs
+	std::mutex m_programMutex;
+	std::unordered_map<RenderShaderProgram*, SoftwareShading> m_programShading;
+	SoftwareShading m_shading;
+	RenderBuffer* m_vertexBuffer;
+	UINT m_vertexStride;
+	RenderBuffer* m_indexBuffer;
+	RenderBuffer* m_constantBuffer;
+	RenderBuffer* m_lightBuffer;
+	RenderBuffer* m_clusterRangeBuffer;
+	RenderBuffer* m_lightIndexBuffer;
+	RenderBuffer* m_clusterConstantBuffer;
+	RenderBuffer* m_instanceBuffer;
+	RenderTopology m_topology;
+
+	uint32_t m_clearColor;
+	bool m_isClearPending;
+	std::vector<ShadedVertex> m_shadedVertices;
+	// Setup writes up to two triangles per input triangle, slots only grow so frames reuse them
+	std::vector<Triangle> m_triangles;
+	uint32_t m_numTriangleSlots;
+	std::vector<DrawState> m_draws;
+	// Triangle indices per setup chunk and tile, ascending within every list
+	std::vector<std::vector<std::vector<uint32_t>>> m_bins;
+
+	std::vector<float> m_depthBuffer;
+	std::vector<uint32_t> m_colorBuffer;
+	SoftwareRasterStats m_rasterStats;
+	SoftwareRasterStats m_lastRasterStats;
+};
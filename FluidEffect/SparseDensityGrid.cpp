@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <cmath>
+#include "SparseDensityGrid.h"
+#include "GooKernel.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+namespace
+{
+	const int BRICK_COORD_OFFSET = 1 << 20;
+
+	inline int FloorToInt(float value)
+	{
+		return static_cast<int>(std::floor(value));
+	}
+
+	inline uint64_t GetBrickKey(int x, int y, int z)
+	{
+		return (static_cast<uint64_t>(x + BRICK_COORD_OFFSET) << 42) |
+			(static_cast<uint64_t>(y + BRICK_COORD_OFFSET) << 21) |
+			static_cast<uint64_t>(z + BRICK_COORD_OFFSET);
+	}
+
+	inline void DecodeBrickKey(uint64_t key, int& x, int& y, int& z)
+	{
+		x = static_cast<int>((key >> 42) & 0x1FFFFF) - BRICK_COORD_OFFSET;
+		y = static_cast<int>((key >> 21) & 0x1FFFFF) - BRICK_COORD_OFFSET;
+		z = static_cast<int>(key & 0x1FFFFF) - BRICK_COORD_OFFSET;
+	}
+}
+
+template<typename Visitor>
+void SparseDensityGrid::ForEachNearbyParticle(int brickX, int brickY, int brickZ, int reach, Visitor visitor) const
+{
+	const std::vector<DirectX::XMFLOAT3>& particles = *m_particles;
+	for (int dz = -reach; dz <= reach; dz++)
+	{
+		for (int dy = -reach; dy <= reach; dy++)
+		{
+			for (int dx = -reach; dx <= reach; dx++)
+			{
+				uint64_t key = GetBrickKey(brickX + dx, brickY + dy, brickZ + dz);
+				auto found = std::lower_bound(m_occupiedBricks.begin(), m_occupiedBricks.end(), key);
+				if (found == m_occupiedBricks.end() || *found != key)
+					continue;
+
+				size_t occupied = found - m_occupiedBricks.begin();
+				for (int i = m_occupiedBrickStart[occupied]; i < m_occupiedBrickStart[occupied + 1]; i++)
+					visitor(particles[m_sortedParticles[i]]);
+			}
+		}
+	}
+}
+
+SparseDensityGrid::SparseDensityGrid()
+{
+	m_settings.fieldFalloff = 3.0f;
+	m_settings.voxelSize = 0.1f;
+	m_settings.cutoffRadius = 1.0f;
+	m_particles = nullptr;
+}
+
+void SparseDensityGrid::Splat(const std::vector<DirectX::XMFLOAT3>& particles)
+{
+	Allocate(particles);
+	m_allBricks.resize(m_brickKeys.size());
+	for (size_t i = 0; i < m_allBricks.size(); i++)
+		m_allBricks[i] = static_cast<int>(i);
+	SplatBricks(m_allBricks);
+}
+
+void SparseDensityGrid::Allocate(const std::vector<DirectX::XMFLOAT3>& particles)
+{
+	PROFILE_SCOPE("DensityAllocate");
+
+	m_particles = &particles;
+	m_brickKeys.clear();
+	m_brickIndices.clear();
+	m_brickSlots.clear();
+	m_samples.clear();
+	if (particles.empty())
+		return;
+
+	m_kernel.Initialize(m_settings.fieldFalloff, m_settings.cutoffRadius);
+
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	float brickWorldSize = m_settings.voxelSize * BRICK_SIZE;
+	int count = static_cast<int>(particles.size());
+
+	// Bin the particles by brick, so each brick can gather its neighbours without locking
+	m_particleBrickKeys.resize(count);
+	jobSystem.ParallelFor(count, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			m_particleBrickKeys[i] = GetBrickKey(
+				FloorToInt(particles[i].x / brickWorldSize),
+				FloorToInt(particles[i].y / brickWorldSize),
+				FloorToInt(particles[i].z / brickWorldSize));
+		}
+	});
+
+	m_sortedParticles.resize(count);
+	for (int i = 0; i < count; i++)
+		m_sortedParticles[i] = i;
+	std::sort(m_sortedParticles.begin(), m_sortedParticles.end(), [this](int a, int b)
+	{
+		return m_particleBrickKeys[a] < m_particleBrickKeys[b] || (m_particleBrickKeys[a] == m_particleBrickKeys[b] && a < b);
+	});
+
+	m_occupiedBricks.clear();
+	m_occupiedBrickStart.clear();
+	for (int i = 0; i < count; i++)
+	{
+		uint64_t key = m_particleBrickKeys[m_sortedParticles[i]];
+		if (m_occupiedBricks.empty() || m_occupiedBricks.back() != key)
+		{
+			m_occupiedBricks.push_back(key);
+			m_occupiedBrickStart.push_back(i);
+		}
+	}
+	m_occupiedBrickStart.push_back(count);
+
+	// Allocate every brick a particle reaches with its cutoff
+	int reach = static_cast<int>(std::ceil(m_settings.cutoffRadius / brickWorldSize));
+	for (uint64_t occupied : m_occupiedBricks)
+	{
+		int x, y, z;
+		DecodeBrickKey(occupied, x, y, z);
+		for (int dz = -reach; dz <= reach; dz++)
+			for (int dy = -reach; dy <= reach; dy++)
+				for (int dx = -reach; dx <= reach; dx++)
+					m_brickKeys.push_back(GetBrickKey(x + dx, y + dy, z + dz));
+	}
+	std::sort(m_brickKeys.begin(), m_brickKeys.end());
+	m_brickKeys.erase(std::unique(m_brickKeys.begin(), m_brickKeys.end()), m_brickKeys.end());
+
+	int numBricks = static_cast<int>(m_brickKeys.size());
+	m_brickIndices.reserve(numBricks);
+	for (int i = 0; i < numBricks; i++)
+		m_brickIndices[m_brickKeys[i]] = i;
+	m_brickSlots.assign(numBricks, -1);
+}
+
+void SparseDensityGrid::SplatBricks(const std::vector<int>& bricks)
+{
+	PROFILE_SCOPE("DensitySplat");
+
+	// Samples are only stored for splatted bricks
+	int numSlots = static_cast<int>(m_samples.size() / BRICK_VOLUME);
+	for (int brick : bricks)
+	{
+		if (m_brickSlots[brick] < 0)
+			m_brickSlots[brick] = numSlots++;
+	}
+	m_samples.resize(static_cast<size_t>(numSlots) * BRICK_VOLUME);
+
+	// The upper faces of a brick are the first samples of the next bricks. When those are all
+	// splatted, or missing and so zero, the faces are copied afterwards, which saves splatting
+	// 217 of the 729 samples.
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	int count = static_cast<int>(bricks.size());
+	m_isFaceCopied.resize(count);
+	jobSystem.ParallelFor(count, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			int brickX, brickY, brickZ;
+			GetBrickCoords(bricks[i], brickX, brickY, brickZ);
+			bool isFaceCopied = true;
+			for (int neighbour = 1; neighbour < 8 && isFaceCopied; neighbour++)
+			{
+				int index = FindBrickIndex(brickX + (neighbour & 1), brickY + (neighbour >> 1 & 1), brickZ + (neighbour >> 2));
+				isFaceCopied = index < 0 || m_brickSlots[index] >= 0;
+			}
+
+			m_isFaceCopied[i] = isFaceCopied ? 1 : 0;
+			SplatBrick(bricks[i], isFaceCopied ? BRICK_SIZE : BRICK_SAMPLES, &m_samples[static_cast<size_t>(m_brickSlots[bricks[i]]) * BRICK_VOLUME]);
+		}
+	}, 4);
+
+	// Only reads the samples below BRICK_SIZE, which no brick writes here
+	jobSystem.ParallelFor(count, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			if (m_isFaceCopied[i])
+				CopyUpperFaces(bricks[i], &m_samples[static_cast<size_t>(m_brickSlots[bricks[i]]) * BRICK_VOLUME]);
+		}
+	}, 16);
+}
+
+void SparseDensityGrid::SplatBrick(int brick, int extent, float* samples) const
+{
+	float voxelSize = m_settings.voxelSize;
+	float invVoxelSize = 1.0f / voxelSize;
+	float cutoff = m_settings.cutoffRadius;
+	float cutoffSq = cutoff * cutoff;
+	float brickWorldSize = voxelSize * BRICK_SIZE;
+	int reach = static_cast<int>(std::ceil(cutoff / brickWorldSize));
+
+	int brickX, brickY, brickZ;
+	GetBrickCoords(brick, brickX, brickY, brickZ);
+	int firstX = brickX * BRICK_SIZE;
+	int firstY = brickY * BRICK_SIZE;
+	int firstZ = brickZ * BRICK_SIZE;
+	DirectX::XMFLOAT3 boxMin(brickX * brickWorldSize, brickY * brickWorldSize, brickZ * brickWorldSize);
+	DirectX::XMFLOAT3 boxMax(boxMin.x + brickWorldSize, boxMin.y + brickWorldSize, boxMin.z + brickWorldSize);
+
+	std::fill(samples, samples + BRICK_VOLUME, 0.0f);
+	float offsetsSqX[BRICK_SAMPLES];
+	ForEachNearbyParticle(brickX, brickY, brickZ, reach, [&](const DirectX::XMFLOAT3& p)
+	{
+		// The neighbourhood is a cube of bricks, the particles in its corners are out of reach
+		float nearX = std::max(0.0f, std::max(boxMin.x - p.x, p.x - boxMax.x));
+		float nearY = std::max(0.0f, std::max(boxMin.y - p.y, p.y - boxMax.y));
+		float nearZ = std::max(0.0f, std::max(boxMin.z - p.z, p.z - boxMax.z));
+		if (nearX * nearX + nearY * nearY + nearZ * nearZ >= cutoffSq)
+			return;
+
+		int minX = std::max(0, static_cast<int>(std::ceil((p.x - cutoff) * invVoxelSize)) - firstX);
+		int minY = std::max(0, static_cast<int>(std::ceil((p.y - cutoff) * invVoxelSize)) - firstY);
+		int minZ = std::max(0, static_cast<int>(std::ceil((p.z - cutoff) * invVoxelSize)) - firstZ);
+		int maxX = std::min(extent - 1, FloorToInt((p.x + cutoff) * invVoxelSize) - firstX);
+		int maxY = std::min(extent - 1, FloorToInt((p.y + cutoff) * invVoxelSize) - firstY);
+		int maxZ = std::min(extent - 1, FloorToInt((p.z + cutoff) * invVoxelSize) - firstZ);
+		for (int x = minX; x <= maxX; x++)
+		{
+			float offsetX = (firstX + x) * voxelSize - p.x;
+			offsetsSqX[x] = offsetX * offsetX;
+		}
+
+		// The kernel is zero beyond the cutoff, so only whole rows outside of it are skipped
+		for (int z = minZ; z <= maxZ; z++)
+		{
+			float offsetZ = (firstZ + z) * voxelSize - p.z;
+			for (int y = minY; y <= maxY; y++)
+			{
+				float offsetY = (firstY + y) * voxelSize - p.y;
+				float distanceSqYZ = offsetY * offsetY + offsetZ * offsetZ;
+				if (distanceSqYZ >= cutoffSq)
+					continue;
+
+				float* row = &samples[(z * BRICK_SAMPLES + y) * BRICK_SAMPLES];
+				for (int x = minX; x <= maxX; x++)
+					row[x] += m_kernel.Evaluate(offsetsSqX[x] + distanceSqYZ);
+			}
+		}
+	});
+}
+
+void SparseDensityGrid::CopyUpperFaces(int brick, float* samples) const
+{
+	int brickX, brickY, brickZ;
+	GetBrickCoords(brick, brickX, brickY, brickZ);
+	const float* neighbours[8] = {};
+	for (int neighbour = 1; neighbour < 8; neighbour++)
+	{
+		int index = FindBrickIndex(brickX + (neighbour & 1), brickY + (neighbour >> 1 & 1), brickZ + (neighbour >> 2));
+		neighbours[neighbour] = index >= 0 ? GetBrickSamples(index) : nullptr;
+	}
+
+	for (int z = 0; z < BRICK_SAMPLES; z++)
+	{
+		int dz = z == BRICK_SIZE ? 1 : 0;
+		for (int y = 0; y < BRICK_SAMPLES; y++)
+		{
+			int dy = y == BRICK_SIZE ? 1 : 0;
+			for (int x = 0; x < BRICK_SAMPLES; x++)
+			{
+				int dx = x == BRICK_SIZE ? 1 : 0;
+				if ((dx | dy | dz) == 0)
+					continue;
+
+				const float* source = neighbours[dx | dy << 1 | dz << 2];
+				int sourceIndex = ((z - dz * BRICK_SIZE) * BRICK_SAMPLES + y - dy * BRICK_SIZE) * BRICK_SAMPLES + x - dx * BRICK_SIZE;
+				samples[(z * BRICK_SAMPLES + y) * BRICK_SAMPLES + x] = source ? source[sourceIndex] : 0.0f;
+			}
+		}
+	}
+}
+
+void SparseDensityGrid::GetFieldBounds(int brick, float& lowerBound, float& upperBound) const
+{
+	int brickX, brickY, brickZ;
+	GetBrickCoords(brick, brickX, brickY, brickZ);
+	float brickWorldSize = m_settings.voxelSize * BRICK_SIZE;
+	DirectX::XMFLOAT3 boxMin(brickX * brickWorldSize, brickY * brickWorldSize, brickZ * brickWorldSize);
+	DirectX::XMFLOAT3 boxMax(boxMin.x + brickWorldSize, boxMin.y + brickWorldSize, boxMin.z + brickWorldSize);
+	float cutoffSq = m_settings.cutoffRadius * m_settings.cutoffRadius;
+	int reach = static_cast<int>(std::ceil(m_settings.cutoffRadius / brickWorldSize));
+
+	lowerBound = 0.0f;
+	upperBound = 0.0f;
+	ForEachNearbyParticle(brickX, brickY, brickZ, reach, [&](const DirectX::XMFLOAT3& p)
+	{
+		float nearX = std::max(0.0f, std::max(boxMin.x - p.x, p.x - boxMax.x));
+		float nearY = std::max(0.0f, std::max(boxMin.y - p.y, p.y - boxMax.y));
+		float nearZ = std::max(0.0f, std::max(boxMin.z - p.z, p.z - boxMax.z));
+		float nearSq = nearX * nearX + nearY * nearY + nearZ * nearZ;
+		if (nearSq >= cutoffSq)
+			return;
+		upperBound += m_kernel.Evaluate(nearSq);
+
+		float farX = std::max(p.x - boxMin.x, boxMax.x - p.x);
+		float farY = std::max(p.y - boxMin.y, boxMax.y - p.y);
+		float farZ = std::max(p.z - boxMin.z, boxMax.z - p.z);
+		lowerBound += m_kernel.Evaluate(farX * farX + farY * farY + farZ * farZ);
+	});
+}
+
+int SparseDensityGrid::FindBrickIndex(int brickX, int brickY, int brickZ) const
+{
+	auto found = m_brickIndices.find(GetBrickKey(brickX, brickY, brickZ));
+	return found != m_brickIndices.end() ? found->second : -1;
+}
+
+void SparseDensityGrid::GetBrickCoords(int brick, int& brickX, int& brickY, int& brickZ) const
+{
+	DecodeBrickKey(m_brickKeys[brick], brickX, brickY, brickZ);
+}
+
+const float* SparseDensityGrid::GetBrickSamples(int brick) const
+{
+	if (m_brickSlots[brick] < 0)
+		return nullptr;
+	return &m_samples[static_cast<size_t>(m_brickSlots[brick]) * BRICK_VOLUME];
+}
+
+float SparseDensityGrid::Sample(const DirectX::XMFLOAT3& position) const
+{
+	float gridX = position.x / m_settings.voxelSize;
+	float gridY = position.y / m_settings.voxelSize;
+	float gridZ = position.z / m_settings.voxelSize;
+	int voxelX = FloorToInt(gridX);
+	int voxelY = FloorToInt(gridY);
+	int voxelZ = FloorToInt(gridZ);
+
+	int brickX = FloorToInt(static_cast<float>(voxelX) / BRICK_SIZE);
+	int brickY = FloorToInt(static_cast<float>(voxelY) / BRICK_SIZE);
+	int brickZ = FloorToInt(static_cast<float>(voxelZ) / BRICK_SIZE);
+	int brick = FindBrickIndex(brickX, brickY, brickZ);
+	const float* samples = brick >= 0 ? GetBrickSamples(brick) : nullptr;
+	if (!samples)
+		return 0.0f;
+
+	int x = voxelX - brickX * BRICK_SIZE;
+	int y = voxelY - brickY * BRICK_SIZE;
+	int z = voxelZ - brickZ * BRICK_SIZE;
+	float fx = gridX - voxelX;
+	float fy = gridY - voxelY;
+	float fz = gridZ - voxelZ;
+
+	const float* s = &samples[(z * BRICK_SAMPLES + y) * BRICK_SAMPLES + x];
+	const int strideY = BRICK_SAMPLES;
+	const int strideZ = BRICK_SAMPLES * BRICK_SAMPLES;
+	float c00 = s[0] + (s[1] - s[0]) * fx;
+	float c10 = s[strideY] + (s[strideY + 1] - s[strideY]) * fx;
+	float c01 = s[strideZ] + (s[strideZ + 1] - s[strideZ]) * fx;
+	float c11 = s[strideZ + strideY] + (s[strideZ + strideY + 1] - s[strideZ + strideY]) * fx;
+	float c0 = c00 + (c10 - c00) * fy;
+	float c1 = c01 + (c11 - c01) * fy;
+	return c0 + (c1 - c0) * fz;
+}
+
+DirectX::XMFLOAT3 SparseDensityGrid::SampleGradient(const DirectX::XMFLOAT3& position) const
+{
+	// Central differences over half a voxel, smoother than the piecewise trilinear derivative
+	float h = 0.5f * m_settings.voxelSize;
+	float scale = 0.5f / h;
+	return DirectX::XMFLOAT3(
+		(Sample(DirectX::XMFLOAT3(position.x + h, position.y, position.z)) - Sample(DirectX::XMFLOAT3(position.x - h, position.y, position.z))) * scale,
+		(Sample(DirectX::XMFLOAT3(position.x, position.y + h, position.z)) - Sample(DirectX::XMFLOAT3(position.x, position.y - h, position.z))) * scale,
+		(Sample(DirectX::XMFLOAT3(position.x, position.y, position.z + h)) - Sample(DirectX::XMFLOAT3(position.x, position.y, position.z - h))) * scale);
+}
+
+float SparseDensityGrid::EvaluateDirect(const std::vector<DirectX::XMFLOAT3>& particles, const DirectX::XMFLOAT3& position) const
+{
+	float cutoffSq = m_settings.cutoffRadius * m_settings.cutoffRadius;
+	float value = 0.0f;
+	for (const DirectX::XMFLOAT3& p : particles)
+	{
+		float dx = position.x - p.x;
+		float dy = position.y - p.y;
+		float dz = position.z - p.z;
+		float distanceSq = dx * dx + dy * dy + dz * dz;
+		if (distanceSq < cutoffSq)
+			value += GooKernel::EvaluateExact(std::sqrt(distanceSq), m_settings.fieldFalloff, m_settings.cutoffRadius);
+	}
+	return value;
+}
+
+size_t SparseDensityGrid::GetMemoryUsage() const
+{
+	// The lookup table is estimated as one node per brick plus the bucket array
+	size_t lookupBytes = m_brickIndices.size() * (sizeof(std::pair<const uint64_t, int>) + 2 * sizeof(void*)) + m_brickIndices.bucket_count() * sizeof(void*);
+	return m_samples.capacity() * sizeof(float) + m_brickKeys.capacity() * sizeof(uint64_t) + m_brickSlots.capacity() * sizeof(int) + lookupBytes;
+}
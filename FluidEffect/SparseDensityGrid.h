@@ -0,0 +1,80 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "GooKernel.h"
+
+struct DensityGridSettings
+{
+	float fieldFalloff;		// k in exp(-k * d), as in GooShader.hlsl
+	float voxelSize;
+	float cutoffRadius;		// Particles further away do not contribute to the field
+};
+
+// Goo field cached in 8^3 voxel bricks that only exist around particles. Particles are splatted
+// once per update, afterwards field and gradient queries are trilinear lookups into one brick.
+class SparseDensityGrid
+{
+public:
+	static const int BRICK_SIZE = 8;
+	// Bricks store BRICK_SIZE + 1 samples per side, so lookups never need a neighbouring brick
+	static const int BRICK_SAMPLES = BRICK_SIZE + 1;
+
+	SparseDensityGrid();
+
+	void Splat(const std::vector<DirectX::XMFLOAT3>& particles);
+
+	// Splat in two steps for callers that only need part of the field: Allocate bins the particles
+	// and creates the bricks, SplatBricks fills the given ones. Bricks left out read as zero.
+	void Allocate(const std::vector<DirectX::XMFLOAT3>& particles);
+	void SplatBricks(const std::vector<int>& bricks);
+
+	// Zero outside of the allocated bricks
+	float Sample(const DirectX::XMFLOAT3& position) const;
+	// Points up the field, so the goo surface normal is the negated direction
+	DirectX::XMFLOAT3 SampleGradient(const DirectX::XMFLOAT3& position) const;
+
+	// Bounds of the field over a brick from the nearest and the farthest point of it to each
+	// particle, available right after Allocate
+	void GetFieldBounds(int brick, float& lowerBound, float& upperBound) const;
+
+	// -1 if no particle reaches the brick
+	int FindBrickIndex(int brickX, int brickY, int brickZ) const;
+	void GetBrickCoords(int brick, int& brickX, int& brickY, int& brickZ) const;
+	// BRICK_SAMPLES^3 samples with x running fastest, nullptr if the brick was not splatted
+	const float* GetBrickSamples(int brick) const;
+
+	// Reference sum over all particles within the cutoff
+	float EvaluateDirect(const std::vector<DirectX::XMFLOAT3>& particles, const DirectX::XMFLOAT3& position) const;
+
+	int GetNumBricks() const { return static_cast<int>(m_brickKeys.size()); }
+	size_t GetMemoryUsage() const;
+
+	DensityGridSettings m_settings;
+
+private:
+	static const int BRICK_VOLUME = BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES;
+
+	// Samples up to extent - 1 per side, BRICK_SIZE leaves the upper faces to CopyUpperFaces
+	void SplatBrick(int brick, int extent, float* samples) const;
+	void CopyUpperFaces(int brick, float* samples) const;
+
+	// Calls visitor with every particle in the occupied bricks up to reach bricks away
+	template<typename Visitor>
+	void ForEachNearbyParticle(int brickX, int brickY, int brickZ, int reach, Visitor visitor) const;
+
+	GooKernel m_kernel;
+	const std::vector<DirectX::XMFLOAT3>* m_particles;
+	std::vector<uint64_t> m_particleBrickKeys;
+	std::vector<int> m_sortedParticles;
+	std::vector<uint64_t> m_occupiedBricks;
+	std::vector<int> m_occupiedBrickStart;
+
+	std::vector<uint64_t> m_brickKeys;
+	std::unordered_map<uint64_t, int> m_brickIndices;
+	std::vector<int> m_brickSlots;		// Brick's offset in m_samples in bricks, -1 if not splatted
+	std::vector<float> m_samples;
+	std::vector<int> m_allBricks;
+	std::vector<uint8_t> m_isFaceCopied;
+};
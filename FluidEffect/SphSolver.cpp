@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include "SphSolver.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+SphSettings SphSettings::ForParticleSpacing(float spacing)
+{
+	SphSettings settings;
+	settings.smoothingRadius = 2.0f * spacing;
+	settings.restDensity = 1000.0f;
+	settings.particleMass = settings.restDensity * spacing * spacing * spacing;
+
+	// Speed of sound of 20 m/s keeps density fluctuations around 1% for splashes of a few meters
+	float speedOfSound = 20.0f;
+	settings.stiffness = settings.restDensity * speedOfSound * speedOfSound / 7.0f;
+	settings.viscosity = 2.0f;
+	settings.gravity = { 0.0f, -9.81f, 0.0f };
+	settings.boundsMin = { -1000.0f, 0.0f, -1000.0f };
+	settings.boundsMax = { 1000.0f, 1000.0f, 1000.0f };
+	settings.boundaryRestitution = 0.3f;
+	settings.maxTimeStep = 0.4f * settings.smoothingRadius / speedOfSound;
+	return settings;
+}
+
+SphSolver::SphSolver()
+{
+	m_settings = SphSettings::ForParticleSpacing(0.25f);
+}
+
+void SphSolver::Step(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime)
+{
+	if (deltaTime <= 0.0f)
+		return;
+
+	int numSubsteps = static_cast<int>(std::ceil(deltaTime / m_settings.maxTimeStep));
+	float substep = deltaTime / numSubsteps;
+
+	for (int i = 0; i < numSubsteps; i++)
+		Substep(positions, velocities, substep);
+}
+
+void SphSolver::Substep(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime)
+{
+	int numParticles = static_cast<int>(positions.size());
+	m_densities.resize(numParticles);
+	m_pressures.resize(numParticles);
+	m_accelerations.resize(numParticles);
+
+	{
+		PROFILE_SCOPE("SphNeighborGrid");
+		m_grid.Build(positions.data(), numParticles, m_settings.smoothingRadius);
+	}
+
+	{
+		PROFILE_SCOPE("SphDensity");
+		ComputeDensities(positions);
+	}
+
+	{
+		PROFILE_SCOPE("SphForces");
+		ComputeAccelerations(positions, velocities);
+	}
+
+	{
+		PROFILE_SCOPE("SphIntegrate");
+		Integrate(positions, velocities, deltaTime);
+	}
+}
+
+float SphSolver::GetAverageDensityError() const
+{
+	if (m_densities.empty())
+		return 0.0f;
+
+	double error = 0.0;
+	for (float density : m_densities)
+		error += std::max(0.0f, density - m_settings.restDensity);
+
+	return static_cast<float>(error / m_densities.size() / m_settings.restDensity);
+}
+
+void SphSolver::ComputeDensities(const std::vector<DirectX::XMFLOAT3>& positions)
+{
+	const float h = m_settings.smoothingRadius;
+	const float hSq = h * h;
+	const float poly6 = 315.0f / (64.0f * DirectX::XM_PI * std::pow(h, 9.0f));
+	const float massPoly6 = m_settings.particleMass * poly6;
+	const float restDensity = m_settings.restDensity;
+	const float stiffness = m_settings.stiffness;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(positions.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = positions[i];
+			float density = 0.0f;
+
+			m_grid.ForEachCandidate(pi, [&](int j)
+			{
+				float dx = pi.x - positions[j].x;
+				float dy = pi.y - positions[j].y;
+				float dz = pi.z - positions[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq < hSq)
+				{
+					float diff = hSq - rSq;
+					density += diff * diff * diff;
+				}
+			});
+
+			density *= massPoly6;
+			m_densities[i] = density;
+
+			// Tait equation with gamma = 7, clamped so particles at the free surface do not attract each other
+			float ratio = density / restDensity;
+			float ratioSq = ratio * ratio;
+			float ratio7 = ratioSq * ratioSq * ratioSq * ratio;
+			m_pressures[i] = std::max(0.0f, stiffness * (ratio7 - 1.0f));
+		}
+	}, 512);
+}
+
+void SphSolver::ComputeAccelerations(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities)
+{
+	const float h = m_settings.smoothingRadius;
+	const float hSq = h * h;
+	const float spikyGradient = -45.0f / (DirectX::XM_PI * std::pow(h, 6.0f));
+	const float viscosityLaplacian = 45.0f / (DirectX::XM_PI * std::pow(h, 6.0f));
+	const float mass = m_settings.particleMass;
+	const float viscosity = m_settings.viscosity;
+	const DirectX::XMFLOAT3 gravity = m_settings.gravity;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(positions.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& pi = positions[i];
+			const DirectX::XMFLOAT3& vi = velocities[i];
+			float pressureTerm = m_pressures[i] / (m_densities[i] * m_densities[i]);
+			float ax = 0.0f;
+			float ay = 0.0f;
+			float az = 0.0f;
+			float vx = 0.0f;
+			float vy = 0.0f;
+			float vz = 0.0f;
+
+			m_grid.ForEachCandidate(pi, [&](int j)
+			{
+				if (j == i)
+					return;
+
+				float dx = pi.x - positions[j].x;
+				float dy = pi.y - positions[j].y;
+				float dz = pi.z - positions[j].z;
+				float rSq = dx * dx + dy * dy + dz * dz;
+
+				if (rSq >= hSq || rSq < 1e-12f)
+					return;
+
+				float r = std::sqrt(rSq);
+				float hr = h - r;
+
+				// Symmetric pressure force, gradient of the spiky kernel along the connecting line
+				float pressure = -mass * (pressureTerm + m_pressures[j] / (m_densities[j] * m_densities[j])) * spikyGradient * hr * hr / r;
+				ax += pressure * dx;
+				ay += pressure * dy;
+				az += pressure * dz;
+
+				float viscous = mass * viscosityLaplacian * hr / m_densities[j];
+				vx += viscous * (velocities[j].x - vi.x);
+				vy += viscous * (velocities[j].y - vi.y);
+				vz += viscous * (velocities[j].z - vi.z);
+			});
+
+			float viscousScale = viscosity / m_densities[i];
+			m_accelerations[i].x = ax + vx * viscousScale + gravity.x;
+			m_accelerations[i].y = ay + vy * viscousScale + gravity.y;
+			m_accelerations[i].z = az + vz * viscousScale + gravity.z;
+		}
+	}, 512);
+}
+
+void SphSolver::Integrate(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime)
+{
+	const DirectX::XMFLOAT3 boundsMin = m_settings.boundsMin;
+	const DirectX::XMFLOAT3 boundsMax = m_settings.boundsMax;
+	const float restitution = m_settings.boundaryRestitution;
+
+	JobSystem::GetInstance().ParallelFor(static_cast<int>(positions.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			DirectX::XMVECTOR velocity = DirectX::XMLoadFloat3(&velocities[i]);
+			DirectX::XMVECTOR acceleration = DirectX::XMLoadFloat3(&m_accelerations[i]);
+			velocity = DirectX::XMVectorAdd(velocity, DirectX::XMVectorScale(acceleration, deltaTime));
+
+			DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&positions[i]);
+			position = DirectX::XMVectorAdd(position, DirectX::XMVectorScale(velocity, deltaTime));
+
+			DirectX::XMFLOAT3 p;
+			DirectX::XMFLOAT3 v;
+			DirectX::XMStoreFloat3(&p, position);
+			DirectX::XMStoreFloat3(&v, velocity);
+
+			// Reflect off the domain box, losing energy at every contact
+			float* pc[3] = { &p.x, &p.y, &p.z };
+			float* vc[3] = { &v.x, &v.y, &v.z };
+			const float minC[3] = { boundsMin.x, boundsMin.y, boundsMin.z };
+			const float maxC[3] = { boundsMax.x, boundsMax.y, boundsMax.z };
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (*pc[axis] < minC[axis])
+				{
+					*pc[axis] = minC[axis];
+					if (*vc[axis] < 0.0f)
+						*vc[axis] *= -restitution;
+				}
+				else if (*pc[axis] > maxC[axis])
+				{
+					*pc[axis] = maxC[axis];
+					if (*vc[axis] > 0.0f)
+						*vc[axis] *= -restitution;
+				}
+			}
+
+			positions[i] = p;
+			velocities[i] = v;
+		}
+	}, 2048);
+}
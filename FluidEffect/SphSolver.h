@@ -0,0 +1,49 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "NeighborGrid.h"
+
+struct SphSettings
+{
+	float smoothingRadius;
+	float particleMass;
+	float restDensity;
+	float stiffness;
+	float viscosity;
+	DirectX::XMFLOAT3 gravity;
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	float boundaryRestitution;
+	float maxTimeStep;
+
+	// Derives kernel radius, mass and a stable time step from the rest spacing of the particles
+	static SphSettings ForParticleSpacing(float spacing);
+};
+
+// Weakly compressible SPH: poly6 density, Tait equation of state, spiky pressure gradient and
+// laplacian viscosity. Every particle only gathers from its neighbors, so the result does not
+// depend on how the work is split across threads.
+class SphSolver
+{
+public:
+	SphSolver();
+
+	// Advances the state by deltaTime, split into substeps no longer than m_settings.maxTimeStep
+	void Step(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime);
+	void Substep(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime);
+
+	const std::vector<float>& GetDensities() const { return m_densities; }
+	float GetAverageDensityError() const;
+
+	SphSettings m_settings;
+
+private:
+	void ComputeDensities(const std::vector<DirectX::XMFLOAT3>& positions);
+	void ComputeAccelerations(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<DirectX::XMFLOAT3>& velocities);
+	void Integrate(std::vector<DirectX::XMFLOAT3>& positions, std::vector<DirectX::XMFLOAT3>& velocities, float deltaTime);
+
+	NeighborGrid m_grid;
+	std::vector<float> m_densities;
+	std::vector<float> m_pressures;
+	std::vector<DirectX::XMFLOAT3> m_accelerations;
+};
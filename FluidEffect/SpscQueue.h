@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Bounded queue from one producer thread to one consumer thread without locks. Each side only writes
+// its own counter, on its own cache line. Capacity has to be a power of two.
+template <typename T, int Capacity>
+class SpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+	SpscQueue() : m_head(0), m_tail(0)
+	{
+	}
+
+	// Producer only, false if the queue is full
+	bool Push(const T& item)
+	{
+		uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) >= Capacity)
+			return false;
+
+		m_items[tail & (Capacity - 1)] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only
+	bool IsEmpty() const
+	{
+		return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+	}
+
+	// Consumer only, false if the queue is empty
+	bool Pop(T& item)
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		item = m_items[head & (Capacity - 1)];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T m_items[Capacity];
+	alignas(64) std::atomic<uint64_t> m_head;	// Items popped
+	alignas(64) std::atomic<uint64_t> m_tail;	// Items pushed
+};
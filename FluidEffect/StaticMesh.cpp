@@ -1,25 +1,65 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <sstream>
 #include <DirectXMath.h>
 #include "StaticMesh.h"
-#include "Shader.h"
 #include "PointLight.h"
+#include "Profiler.h"
 
-StaticMesh::StaticMesh(std::string filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+StaticMesh::StaticMesh(std::string filename, RenderDevice* device, const WCHAR* shaderFileName)
 {
-	LoadObjFile(filename, device, deviceContext);
-	SetShader(device, deviceContext, L"DefaultShader.hlsl", false);
+	m_vertices = nullptr;
+	m_numVertices = 0;
+	m_indices = nullptr;
+	m_numIndices = 0;
+	m_vertexBuffer = nullptr;
+	m_indexBuffer = nullptr;
+	m_constantBuffer = nullptr;
+	m_instanceBuffer = nullptr;
+	m_instanceCapacity = 0;
+	m_device = nullptr;
+
+	LoadObjFile(filename, device);
+
+	// Without a device only the CPU side geometry is loaded, e.g. for baking distance fields
+	if (device)
+		SetShader(device, shaderFileName, false);
 }
 
-StaticMesh::StaticMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+StaticMesh::StaticMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, RenderDevice* device)
 {
+	m_vertexBuffer = nullptr;
+	m_indexBuffer = nullptr;
 	m_constantBuffer = nullptr;
-	m_geometryShader = nullptr;
-	m_inputLayout = nullptr;
-	m_pixelShader = nullptr;
-	m_vertexShader = nullptr;
+	m_instanceBuffer = nullptr;
+	m_instanceCapacity = 0;
+	m_device = nullptr;
+
+	m_numVertices = static_cast<int>(vertices.size());
+	m_vertices = new Vertex[m_numVertices];
+	std::copy(vertices.begin(), vertices.end(), m_vertices);
+
+	m_numIndices = static_cast<int>(indices.size());
+	m_indices = new unsigned int[m_numIndices];
+	std::copy(indices.begin(), indices.end(), m_indices);
+
+	if (device)
+	{
+		CreateBuffers(device);
+		SetShader(device, L"DefaultShader.hlsl", false);
+	}
+}
+
+StaticMesh::StaticMesh(RenderDevice* device)
+{
+	m_vertexBuffer = nullptr;
+	m_indexBuffer = nullptr;
+	m_constantBuffer = nullptr;
+	m_instanceBuffer = nullptr;
+	m_instanceCapacity = 0;
+	m_device = nullptr;
 
 	float sideHalfLength = 0.6f;
 	m_numVertices = 3;
@@ -36,31 +76,8 @@ StaticMesh::StaticMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext)
 		0, 2, 1
 	};
 
-	D3D11_BUFFER_DESC vertexBufferDesc = {};
-	ZeroMemory(&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(Vertex) * 3;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	D3D11_SUBRESOURCE_DATA vertexBufferData = {};
-	vertexBufferData.pSysMem = m_vertices;
-	device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_vertexBuffer);
-
-	unsigned int stride = sizeof(Vertex);
-	unsigned int offset = 0;
-	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
-
-	D3D11_BUFFER_DESC indexBufferDesc;
-	ZeroMemory(&indexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(UINT) * m_numIndices;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-
-	D3D11_SUBRESOURCE_DATA indexBufferData = {};
-	indexBufferData.pSysMem = m_indices;
-	device->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_indexBuffer);
-
-	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	SetShader(device, deviceContext, L"DefaultShader.hlsl", false);
+	CreateBuffers(device);
+	SetShader(device, L"DefaultShader.hlsl", false);
 }
 
 StaticMesh::~StaticMesh()
@@ -83,38 +100,38 @@ StaticMesh::~StaticMesh()
 		m_constantBuffer = nullptr;
 	}
 
-	if (m_vertexShader)
-	{
-		m_vertexShader->Release();
-		m_vertexShader = nullptr;
-	}
-
-	if (m_geometryShader)
-	{
-		m_geometryShader->Release();
-		m_geometryShader = nullptr;
-	}
-
-	if (m_pixelShader)
-	{
-		m_pixelShader->Release();
-		m_pixelShader = nullptr;
-	}
-
-	if (m_inputLayout)
+	if (m_instanceBuffer)
 	{
-		m_inputLayout->Release();
-		m_inputLayout = nullptr;
+		m_instanceBuffer->Release();
+		m_instanceBuffer = nullptr;
 	}
 	delete[] m_indices;
 	delete[] m_vertices;
 }
 
-HRESULT StaticMesh::Render(ID3D11DeviceContext* deviceContext, const Camera& camera, DirectX::XMMATRIX worldMatrix)
+HRESULT StaticMesh::Submit(RenderQueue& queue, const Camera& camera, DirectX::XMMATRIX worldMatrix)
 {
-	D3D11_MAPPED_SUBRESOURCE constantBufferSR;
-	if (SUCCEEDED(deviceContext->Map(m_constantBuffer, NULL, D3D11_MAP_WRITE_DISCARD, NULL, &constantBufferSR)))
+	RenderShaderProgram* shaderProgram = m_shaderProgram.TryGet();
+	if (!shaderProgram)
+		return S_OK;
+
+	DirectX::XMFLOAT3 position;
+	DirectX::XMStoreFloat3(&position, worldMatrix.r[3]);
+
+	RenderDrawPacket packet = RenderDrawPacket();
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.depth = camera.GetViewDepth(position);
+	packet.program = shaderProgram;
+	packet.vertexBuffer = m_vertexBuffer;
+	packet.vertexStride = sizeof(Vertex);
+	packet.indexBuffer = m_indexBuffer;
+	packet.constantBuffers[RENDER_STAGE_VERTEX][0] = m_constantBuffer;
+	packet.constantBuffers[RENDER_STAGE_PIXEL][0] = m_constantBuffer;
+	packet.topology = RENDER_TOPOLOGY_TRIANGLE_LIST;
+	packet.numElements = m_numIndices;
+
 	{
+		PROFILE_SCOPE("ConstantUpload");
 		ConstantBuffer constantBuffer;
 		constantBuffer.world = worldMatrix;
 		constantBuffer.view = camera.GetViewMatrix();
@@ -124,176 +141,147 @@ HRESULT StaticMesh::Render(ID3D11DeviceContext* deviceContext, const Camera& cam
 		constantBuffer.inverseWorld = DirectX::XMMatrixInverse(nullptr, constantBuffer.world);
 		constantBuffer.inverseView = DirectX::XMMatrixInverse(nullptr, constantBuffer.view);
 		constantBuffer.inverseProjection = DirectX::XMMatrixInverse(nullptr, constantBuffer.projection);
-		memcpy(constantBufferSR.pData, &constantBuffer, sizeof(ConstantBuffer));
-		deviceContext->Unmap(m_constantBuffer, NULL);
+		queue.Upload(packet, m_constantBuffer, &constantBuffer, sizeof(ConstantBuffer));
 	}
-	unsigned int stride = sizeof(Vertex);
-	unsigned int offset = 0;
-
-	deviceContext->VSSetShader(m_vertexShader, nullptr, 0);
-	deviceContext->GSSetShader(m_geometryShader, nullptr, 0);
-	deviceContext->PSSetShader(m_pixelShader, nullptr, 0);
-	deviceContext->IASetInputLayout(m_inputLayout);
-
-	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
-	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	deviceContext->VSSetConstantBuffers(0, 1, &m_constantBuffer);
-	deviceContext->PSSetConstantBuffers(0, 1, &m_constantBuffer);
-
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	deviceContext->DrawIndexed(m_numIndices, 0, 0);
 
+	queue.Submit(packet);
 	return S_OK;
 }
 
-HRESULT StaticMesh::SetShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader)
+HRESULT StaticMesh::SubmitInstances(RenderQueue& queue, const Camera& camera, const InstanceData* instances, int numInstances)
 {
-	HRESULT hr;
-
-	ID3D10Blob* shaderBlob = nullptr;
+	// Geometry shaders get no instanced variant
+	if (numInstances <= 0 || !m_device || !m_shaderDesc.geometryEntryPoint.empty())
+		return S_FALSE;
 
-	if (m_vertexShader)
+	if (!m_instancedShaderProgram.IsValid())
 	{
-		m_vertexShader->Release();
-		m_vertexShader = nullptr;
+		RenderShaderProgramDesc desc = m_shaderDesc;
+		desc.defines.push_back({ "INSTANCED", "1" });
+		m_instancedShaderProgram = AssetManager::GetInstance().LoadShaderProgram(m_device, desc);
 	}
 
-	if (m_pixelShader)
-	{
-		m_pixelShader->Release();
-		m_pixelShader = nullptr;
-	}
+	RenderShaderProgram* shaderProgram = m_instancedShaderProgram.TryGet();
+	if (!shaderProgram)
+		return S_FALSE;
 
-	if (m_geometryShader)
+	if (numInstances > m_instanceCapacity)
 	{
-		m_geometryShader->Release();
-		m_geometryShader = nullptr;
-	}
+		int capacity = std::max(numInstances, m_instanceCapacity * 2);
+		if (m_instanceBuffer)
+		{
+			m_instanceBuffer->Release();
+			m_instanceBuffer = nullptr;
+			m_instanceCapacity = 0;
+		}
 
-	if (m_inputLayout)
-	{
-		m_inputLayout->Release();
-		m_inputLayout = nullptr;
+		RenderBufferDesc instanceBufferDesc = { RENDER_BUFFER_STRUCTURED, static_cast<UINT>(sizeof(InstanceData) * capacity), sizeof(InstanceData), true };
+		HRESULT hr = m_device->CreateBuffer(instanceBufferDesc, nullptr, &m_instanceBuffer);
+		if (FAILED(hr))
+		{
+			std::cout << "Creating Instance Buffer failed." << std::endl;
+			return hr;
+		}
+		m_instanceCapacity = capacity;
 	}
 
-	//Compile Vertex Shader
-	hr = Shader::CompileShaderFromFile(shaderFileName, "VSMain", "vs_5_0", &shaderBlob);
-	if (FAILED(hr))
-	{
-		std::cout << "Compiling Vertex Shader failed." << std::endl;
-		return hr;
-	}
+	RenderDrawPacket packet = RenderDrawPacket();
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.program = shaderProgram;
+	packet.vertexBuffer = m_vertexBuffer;
+	packet.vertexStride = sizeof(Vertex);
+	packet.indexBuffer = m_indexBuffer;
+	packet.constantBuffers[RENDER_STAGE_VERTEX][0] = m_constantBuffer;
+	packet.constantBuffers[RENDER_STAGE_PIXEL][0] = m_constantBuffer;
+	packet.instanceBuffer = m_instanceBuffer;
+	packet.numInstances = numInstances;
+	packet.topology = RENDER_TOPOLOGY_TRIANGLE_LIST;
+	packet.numElements = m_numIndices;
 
-	hr = device->CreateVertexShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_vertexShader);
-	if (FAILED(hr))
 	{
-		std::cout << "Creating Vertex Shader failed." << std::endl;
-		shaderBlob->Release();
-		return hr;
+		PROFILE_SCOPE("ConstantUpload");
+		// The world matrices come from the instances
+		ConstantBuffer constantBuffer;
+		constantBuffer.world = DirectX::XMMatrixIdentity();
+		constantBuffer.view = camera.GetViewMatrix();
+		constantBuffer.projection = camera.GetProjectionMatrix();
+		constantBuffer.worldView = constantBuffer.view;
+		constantBuffer.worldViewProj = constantBuffer.view * constantBuffer.projection;
+		constantBuffer.inverseWorld = constantBuffer.world;
+		constantBuffer.inverseView = DirectX::XMMatrixInverse(nullptr, constantBuffer.view);
+		constantBuffer.inverseProjection = DirectX::XMMatrixInverse(nullptr, constantBuffer.projection);
+		queue.Upload(packet, m_constantBuffer, &constantBuffer, sizeof(ConstantBuffer));
+		queue.Upload(packet, m_instanceBuffer, instances, static_cast<UINT>(sizeof(InstanceData) * numInstances));
 	}
 
-	//Create Input Layout
-	D3D11_INPUT_ELEMENT_DESC layout[] =
-	{
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0}
-	};
-	UINT numElements = ARRAYSIZE(layout);
+	queue.Submit(packet);
+	return S_OK;
+}
+
+HRESULT StaticMesh::SetShader(RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader)
+{
+	HRESULT hr;
 
-	hr = device->CreateInputLayout(layout, numElements, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), &m_inputLayout);
+	m_device = device;
+	m_shaderDesc = RenderShaderProgramDesc::FromFile(shaderFileName, hasGeometryShader);
+	m_shaderProgram = AssetManager::GetInstance().LoadShaderProgram(device, m_shaderDesc);
+	m_instancedShaderProgram = AssetHandle<RenderShaderProgram>();
+	if (m_constantBuffer)
+		return S_OK;
+
+	RenderBufferDesc constantBufferDesc = { RENDER_BUFFER_CONSTANT, sizeof(ConstantBuffer), 0, true };
+	hr = device->CreateBuffer(constantBufferDesc, nullptr, &m_constantBuffer);
 	if (FAILED(hr))
 	{
-		std::cout << "Creating Input Layout failed." << std::endl;
-		shaderBlob->Release();
+		std::cout << "Creating Constant Buffer failed." << std::endl;
 		return hr;
 	}
 
-	shaderBlob->Release();
-
-	//Compile Geometry Shader if used
-
-	if (hasGeometryShader)
-	{
-		hr = Shader::CompileShaderFromFile(shaderFileName, "GSMain", "gs_5_0", &shaderBlob);
-		if (FAILED(hr))
-		{
-			std::cout << "Compiling Geometry Shader failed." << std::endl;
-			shaderBlob->Release();
-			return hr;
-		}
-
-		hr = device->CreateGeometryShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_geometryShader);
-		if (FAILED(hr))
-		{
-			std::cout << "Creating Geometry Shader failed." << std::endl;
-			shaderBlob->Release();
-			return hr;
-		}
+	return S_OK;
+}
 
-		shaderBlob->Release();
-	}
-	else
+void StaticMesh::SetColor(RenderDevice* device, const DirectX::XMFLOAT3& color)
+{
+	for (int i = 0; i < m_numVertices; i++)
 	{
-		m_geometryShader = nullptr;
+		m_vertices[i].color = color;
 	}
 
-	//Compile Pixel Shader
-	hr = Shader::CompileShaderFromFile(shaderFileName, "PSMain", "ps_5_0", &shaderBlob);
-	if (FAILED(hr))
+	if (m_vertexBuffer)
 	{
-		std::cout << "Compiling Pixel Shader failed." << std::endl;
-		return hr;
+		m_vertexBuffer->Release();
+		m_vertexBuffer = nullptr;
 	}
 
-	hr = device->CreatePixelShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &m_pixelShader);
-	if (FAILED(hr))
-	{
-		std::cout << "Creating Pixel Shader failed." << std::endl;
-		shaderBlob->Release();
-		return hr;
-	}
+	RenderBufferDesc vertexBufferDesc = { RENDER_BUFFER_VERTEX, static_cast<UINT>(sizeof(Vertex) * m_numVertices), 0, false };
+	device->CreateBuffer(vertexBufferDesc, m_vertices, &m_vertexBuffer);
+}
 
-	shaderBlob->Release();
-
-	D3D11_BUFFER_DESC constantBufferDesc;
-	ZeroMemory(&constantBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	constantBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	constantBufferDesc.ByteWidth = sizeof(ConstantBuffer);
-	constantBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	constantBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	constantBufferDesc.MiscFlags = 0;
-	constantBufferDesc.StructureByteStride = 0;
-	hr = device->CreateBuffer(&constantBufferDesc, NULL, &m_constantBuffer);
-	if (FAILED(hr))
+uint64_t StaticMesh::GetNumBytes() const
+{
+	uint64_t numBytes = sizeof(Vertex) * m_numVertices + sizeof(unsigned int) * m_numIndices;
+	RenderBuffer* buffers[] = { m_vertexBuffer, m_indexBuffer, m_constantBuffer, m_instanceBuffer };
+	for (RenderBuffer* buffer : buffers)
 	{
-		std::cout << "Creating Constant Buffer failed." << std::endl;
-		return hr;
+		if (buffer)
+			numBytes += buffer->GetDesc().byteWidth;
 	}
-
-	return S_OK;
+	return numBytes;
 }
 
-void StaticMesh::SetColor(ID3D11Device* device, const DirectX::XMFLOAT3& color)
+void StaticMesh::GetTriangles(DirectX::XMMATRIX worldMatrix, std::vector<DirectX::XMFLOAT3>& vertices, std::vector<unsigned int>& indices) const
 {
+	vertices.resize(m_numVertices);
 	for (int i = 0; i < m_numVertices; i++)
 	{
-		m_vertices[i].color = color;
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(&m_vertices[i].position);
+		DirectX::XMStoreFloat3(&vertices[i], DirectX::XMVector3TransformCoord(position, worldMatrix));
 	}
 
-	D3D11_BUFFER_DESC vertexBufferDesc;
-	ZeroMemory(&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(Vertex) * m_numVertices;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-	D3D11_SUBRESOURCE_DATA vertexBufferData = {};
-	vertexBufferData.pSysMem = m_vertices;
-	device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_vertexBuffer);
+	indices.assign(m_indices, m_indices + m_numIndices);
 }
 
-void StaticMesh::LoadObjFile(std::string filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext)
+void StaticMesh::LoadObjFile(std::string filename, RenderDevice* device)
 {
 	std::ifstream objFile(filename);
 
@@ -399,25 +387,17 @@ void StaticMesh::LoadObjFile(std::string filename, ID3D11Device* device, ID3D11D
 		m_indices[i] = tempVIndices[i];
 	}
 
-	D3D11_BUFFER_DESC vertexBufferDesc;
-	ZeroMemory(&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(Vertex) * m_numVertices;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-	D3D11_SUBRESOURCE_DATA vertexBufferData = {};
-	vertexBufferData.pSysMem = m_vertices;
-	device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &m_vertexBuffer);
-
-	D3D11_BUFFER_DESC indexBufferDesc;
-	ZeroMemory(&indexBufferDesc, sizeof(D3D11_BUFFER_DESC));
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(UINT) * m_numIndices;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-
-	D3D11_SUBRESOURCE_DATA indexBufferData = {};
-	indexBufferData.pSysMem = m_indices;
-	device->CreateBuffer(&indexBufferDesc, &indexBufferData, &m_indexBuffer);
+	if (device)
+		CreateBuffers(device);
+}
+
+void StaticMesh::CreateBuffers(RenderDevice* device)
+{
+	RenderBufferDesc vertexBufferDesc = { RENDER_BUFFER_VERTEX, static_cast<UINT>(sizeof(Vertex) * m_numVertices), 0, false };
+	device->CreateBuffer(vertexBufferDesc, m_vertices, &m_vertexBuffer);
+
+	RenderBufferDesc indexBufferDesc = { RENDER_BUFFER_INDEX, static_cast<UINT>(sizeof(UINT) * m_numIndices), 0, false };
+	device->CreateBuffer(indexBufferDesc, m_indices, &m_indexBuffer);
 }
 
 void StaticMesh::GetSmoothedNormals(int numVertices, const std::vector<int>& vertexIndices, const std::vector<int>& normalIndices, const std::vector<DirectX::XMFLOAT3>& normals, std::vector<DirectX::XMFLOAT3>& out)
@@ -1,28 +1,46 @@
 #pragma once
 #include <String>
-#include <d3d11.h>
+#include <vector>
+#include "AssetManager.h"
 #include "Mesh.h"
+#include "RenderDevice.h"
 #include "Vertex.h"
 
 class StaticMesh : public Mesh
 {
 public:
-	StaticMesh(std::string filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext);
-	StaticMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+	StaticMesh(std::string filename, RenderDevice* device, const WCHAR* shaderFileName = L"DefaultShader.hlsl");
+	// Copies generated geometry, e.g. from IsoSurfaceExtractor
+	StaticMesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, RenderDevice* device);
+	StaticMesh(RenderDevice* device);
 	~StaticMesh();
 
-	HRESULT Render(ID3D11DeviceContext* deviceContext, const Camera& camera, DirectX::XMMATRIX worldMatrix) override;
+	// Queues an opaque draw, nothing until the shader program is loaded
+	HRESULT Submit(RenderQueue& queue, const Camera& camera, DirectX::XMMATRIX worldMatrix) override;
+	// The instanced variant of the shader is loaded on the first call, until then S_FALSE. The instance
+	// buffer grows to the largest call, so there should be one call per frame.
+	HRESULT SubmitInstances(RenderQueue& queue, const Camera& camera, const InstanceData* instances, int numInstances) override;
 
 	int GetNumVertices() { return m_numVertices; }
 	int GetNumFaces() { return m_numIndices; }
-	ID3D11Buffer* GetVertexBuffer() { return m_vertexBuffer; }
+	int GetNumIndices() { return m_numIndices; }
+	Vertex* GetVertices() { return m_vertices; }
+
+	// World space triangles, as placed by worldMatrix
+	void GetTriangles(DirectX::XMMATRIX worldMatrix, std::vector<DirectX::XMFLOAT3>& vertices, std::vector<unsigned int>& indices) const;
+	RenderBuffer* GetVertexBuffer() { return m_vertexBuffer; }
 	UINT* GetIndexBuffer() { return m_indices; }
+	// CPU copy of the geometry and the buffers on the device
+	uint64_t GetNumBytes() const;
 
-	HRESULT SetShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const WCHAR* shaderFileName, bool hasGeometryShader) override;
-	void SetColor(ID3D11Device* device, const DirectX::XMFLOAT3& color);
+	// The program is loaded by the AssetManager and shared with every mesh using the same file
+	HRESULT SetShader(RenderDevice* device, const WCHAR* shaderFileName, bool hasGeometryShader) override;
+	// Recreates the vertex buffer, objects sharing the mesh also share its color
+	void SetColor(RenderDevice* device, const DirectX::XMFLOAT3& color);
 
 private:
-	void LoadObjFile(std::string filename, ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+	void LoadObjFile(std::string filename, RenderDevice* device);
+	void CreateBuffers(RenderDevice* device);
 	void GetSmoothedNormals(int numVertices, const std::vector<int>& vertexIndices, const std::vector<int>& normalIndices, const std::vector<DirectX::XMFLOAT3>& normals, std::vector<DirectX::XMFLOAT3> &out);
 
 	Vertex* m_vertices;
@@ -31,13 +49,16 @@ private:
 	unsigned int* m_indices;
 	int m_numIndices;
 
-	ID3D11Buffer* m_vertexBuffer;
-	ID3D11Buffer* m_indexBuffer;
-	ID3D11Buffer* m_constantBuffer;
+	RenderBuffer* m_vertexBuffer;
+	RenderBuffer* m_indexBuffer;
+	RenderBuffer* m_constantBuffer;
+	RenderBuffer* m_instanceBuffer;
+	int m_instanceCapacity;
 
-	ID3D11InputLayout* m_inputLayout;
-	ID3D11VertexShader* m_vertexShader;
-	ID3D11GeometryShader* m_geometryShader;
-	ID3D11PixelShader* m_pixelShader;
+	RenderDevice* m_device;
+	RenderShaderProgramDesc m_shaderDesc;
+	AssetHandle<RenderShaderProgram> m_shaderProgram;
+	// Same file with INSTANCED defined
+	AssetHandle<RenderShaderProgram> m_instancedShaderProgram;
 };
 
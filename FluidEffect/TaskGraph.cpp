@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <thread>
+#include "TaskGraph.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+TaskGraph::TaskGraph()
+{
+	m_numLeft = 0;
+	m_runStart = 0;
+	m_lastRunMs = 0.0;
+	m_criticalPathMs = 0.0;
+	m_numRuns = 0;
+	m_totalRunMs = 0.0;
+	m_totalCriticalPathMs = 0.0;
+}
+
+int TaskGraph::AddTask(const char* name, const std::function<void()>& run, std::initializer_list<const char*> reads, std::initializer_list<const char*> writes, bool isMainThread)
+{
+	int index = static_cast<int>(m_tasks.size());
+	std::unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->run = run;
+	task->isMainThread = isMainThread;
+	task->numWaiting = 0;
+	task->start = 0;
+	task->end = 0;
+	task->totalMs = 0.0;
+	task->numCritical = 0;
+	m_tasks.push_back(std::move(task));
+
+	for (const char* resource : reads)
+	{
+		auto found = m_resources.find(resource);
+		if (found == m_resources.end())
+			found = m_resources.insert({ resource, ResourceState{ -1, {} } }).first;
+		AddDependency(index, found->second.writer);
+		found->second.readers.push_back(index);
+	}
+
+	for (const char* resource : writes)
+	{
+		auto found = m_resources.find(resource);
+		if (found == m_resources.end())
+			found = m_resources.insert({ resource, ResourceState{ -1, {} } }).first;
+		AddDependency(index, found->second.writer);
+		for (int reader : found->second.readers)
+			AddDependency(index, reader);
+		found->second.writer = index;
+		found->second.readers.clear();
+	}
+
+	return index;
+}
+
+void TaskGraph::AddDependency(int task, int dependency)
+{
+	std::vector<int>& dependencies = m_tasks[task]->dependencies;
+	if (dependency < 0 || dependency == task || std::find(dependencies.begin(), dependencies.end(), dependency) != dependencies.end())
+		return;
+
+	dependencies.push_back(dependency);
+	m_tasks[dependency]->successors.push_back(task);
+}
+
+void TaskGraph::Run()
+{
+	int numTasks = GetNumTasks();
+	if (numTasks == 0)
+		return;
+
+	m_runStart = Profiler::GetTimestamp();
+	m_numLeft.store(numTasks, std::memory_order_relaxed);
+	for (std::unique_ptr<Task>& task : m_tasks)
+		task->numWaiting.store(static_cast<int>(task->dependencies.size()), std::memory_order_relaxed);
+
+	for (int i = 0; i < numTasks; i++)
+	{
+		if (m_tasks[i]->dependencies.empty())
+			Schedule(i);
+	}
+
+	// Main thread tasks are only run here, other tasks are helped with while waiting
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	while (m_numLeft.load(std::memory_order_acquire) > 0)
+	{
+		int mainThreadTask = -1;
+		{
+			std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+			if (!m_mainThreadReady.empty())
+			{
+				mainThreadTask = m_mainThreadReady.back();
+				m_mainThreadReady.pop_back();
+			}
+		}
+
+		if (mainThreadTask >= 0)
+			Execute(mainThreadTask);
+		else if (!jobSystem.RunPendingJob())
+			std::this_thread::yield();
+	}
+
+	m_lastRunMs = static_cast<double>(Profiler::GetTimestamp() - m_runStart) / 1000000.0;
+	UpdateCriticalPath();
+}
+
+void TaskGraph::Schedule(int task)
+{
+	if (m_tasks[task]->isMainThread)
+	{
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		m_mainThreadReady.push_back(task);
+		return;
+	}
+
+	JobSystem::GetInstance().Submit([this, task]() { Execute(task); });
+}
+
+void TaskGraph::Execute(int index)
+{
+	Task& task = *m_tasks[index];
+	task.start = Profiler::GetTimestamp();
+	{
+		PROFILE_SCOPE(task.name);
+		task.run();
+	}
+	task.end = Profiler::GetTimestamp();
+
+	for (int successor : task.successors)
+	{
+		if (m_tasks[successor]->numWaiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			Schedule(successor);
+	}
+	m_numLeft.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TaskGraph::UpdateCriticalPath()
+{
+	// Dependencies were added before their tasks, so one pass in order finds the longest chains
+	int numTasks = GetNumTasks();
+	m_pathMs.resize(numTasks);
+	m_pathPrevious.resize(numTasks);
+	int last = 0;
+	for (int i = 0; i < numTasks; i++)
+	{
+		double longest = 0.0;
+		m_pathPrevious[i] = -1;
+		for (int dependency : m_tasks[i]->dependencies)
+		{
+			if (m_pathMs[dependency] > longest)
+			{
+				longest = m_pathMs[dependency];
+				m_pathPrevious[i] = dependency;
+			}
+		}
+
+		double taskMs = GetTaskEndMs(i) - GetTaskStartMs(i);
+		m_pathMs[i] = longest + taskMs;
+		m_tasks[i]->totalMs += taskMs;
+		if (m_pathMs[i] > m_pathMs[last])
+			last = i;
+	}
+
+	m_criticalPath.clear();
+	for (int task = last; task >= 0; task = m_pathPrevious[task])
+	{
+		m_criticalPath.push_back(task);
+		m_tasks[task]->numCritical++;
+	}
+	std::reverse(m_criticalPath.begin(), m_criticalPath.end());
+	m_criticalPathMs = m_pathMs[last];
+
+	m_numRuns++;
+	m_totalRunMs += m_lastRunMs;
+	m_totalCriticalPathMs += m_criticalPathMs;
+}
+
+double TaskGraph::GetTaskStartMs(int task) const
+{
+	return static_cast<double>(m_tasks[task]->start - m_runStart) / 1000000.0;
+}
+
+double TaskGraph::GetTaskEndMs(int task) const
+{
+	return static_cast<double>(m_tasks[task]->end - m_runStart) / 1000000.0;
+}
+
+void TaskGraph::WriteCriticalPath(std::ostream& out) const
+{
+	if (m_numRuns == 0)
+		return;
+
+	out << "last frame: " << m_lastRunMs << " ms, critical path " << m_criticalPathMs << " ms:";
+	for (size_t i = 0; i < m_criticalPath.size(); i++)
+		out << (i == 0 ? " " : " > ") << m_tasks[m_criticalPath[i]]->name;
+	out << std::endl;
+
+	// Tasks on the critical path are marked with a *
+	for (int i = 0; i < GetNumTasks(); i++)
+	{
+		const Task& task = *m_tasks[i];
+		bool isCritical = std::find(m_criticalPath.begin(), m_criticalPath.end(), i) != m_criticalPath.end();
+		out << (isCritical ? "* " : "  ") << task.name << (task.isMainThread ? " (main thread)" : "") << ": " << GetTaskStartMs(i) << " to "
+			<< GetTaskEndMs(i) << " ms, " << GetTaskEndMs(i) - GetTaskStartMs(i) << " ms";
+		for (size_t d = 0; d < task.dependencies.size(); d++)
+			out << (d == 0 ? ", after " : ", ") << m_tasks[task.dependencies[d]]->name;
+		out << std::endl;
+	}
+
+	out << "over " << m_numRuns << " frames: " << m_totalRunMs / m_numRuns << " ms per frame, critical path " << m_totalCriticalPathMs / m_numRuns << " ms" << std::endl;
+	for (const std::unique_ptr<Task>& task : m_tasks)
+	{
+		out << "  " << task->name << ": " << task->totalMs / m_numRuns << " ms, on the critical path of "
+			<< 100.0 * task->numCritical / m_numRuns << "% of the frames" << std::endl;
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The stages of a frame as tasks that name the resources they read and write. Wherever resources
+// overlap, tasks run in the order they were added: a task waits for the last task that wrote
+// anything it reads or writes, a writer also for the tasks that read since then. Everything else
+// runs in parallel on the JobSystem. Main thread tasks only run on the thread calling Run, for the
+// window and the device context.
+class TaskGraph
+{
+public:
+	TaskGraph();
+
+	// Returns the index of the task
+	int AddTask(const char* name, const std::function<void()>& run, std::initializer_list<const char*> reads, std::initializer_list<const char*> writes, bool isMainThread = false);
+	// Runs every task once and returns when all of them are done
+	void Run();
+
+	int GetNumTasks() const { return static_cast<int>(m_tasks.size()); }
+	const char* GetTaskName(int task) const { return m_tasks[task]->name; }
+	const std::vector<int>& GetDependencies(int task) const { return m_tasks[task]->dependencies; }
+
+	// Of the last Run, in ms since it started
+	double GetTaskStartMs(int task) const;
+	double GetTaskEndMs(int task) const;
+	double GetLastRunMs() const { return m_lastRunMs; }
+	// The chain of dependencies whose tasks took longest in the last Run, first to last. Waiting
+	// for a free thread does not count, so it is how fast the frame could be with threads to spare.
+	const std::vector<int>& GetCriticalPath() const { return m_criticalPath; }
+	double GetCriticalPathMs() const { return m_criticalPathMs; }
+
+	// The last Run task by task with its critical path, then the averages over every Run
+	void WriteCriticalPath(std::ostream& out) const;
+
+private:
+	struct Task
+	{
+		const char* name;
+		std::function<void()> run;
+		bool isMainThread;
+		std::vector<int> dependencies;
+		std::vector<int> successors;
+		std::atomic<int> numWaiting;
+		int64_t start;
+		int64_t end;
+		double totalMs;
+		int numCritical;	// Runs the task was on the critical path of
+	};
+
+	// Last writer and the readers since, while tasks are added
+	struct ResourceState
+	{
+		int writer;
+		std::vector<int> readers;
+	};
+
+	void AddDependency(int task, int dependency);
+	void Schedule(int task);
+	void Execute(int task);
+	void UpdateCriticalPath();
+
+	std::vector<std::unique_ptr<Task>> m_tasks;
+	std::unordered_map<std::string, ResourceState> m_resources;
+
+	std::atomic<int> m_numLeft;
+	std::mutex m_mainThreadMutex;
+	std::vector<int> m_mainThreadReady;
+	int64_t m_runStart;
+
+	double m_lastRunMs;
+	std::vector<double> m_pathMs;		// Longest chain ending with each task
+	std::vector<int> m_pathPrevious;
+	std::vector<int> m_criticalPath;
+	double m_criticalPathMs;
+	int m_numRuns;
+	double m_totalRunMs;
+	double m_totalCriticalPathMs;
+};
@@ -0,0 +1,717 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+#include "TriangleBvh.h"
+#include "JobSystem.h"
+
+namespace
+{
+	const int MAX_LEAF_TRIANGLES = 8;
+	const int NUM_SAH_BINS = 16;
+	const int PARALLEL_BUILD_MIN_TRIANGLES = 4096;
+	const int EMPTY_CHILD = ~0;
+	// Traversals of trees up to 42 levels deep keep their stack on the stack
+	const int LOCAL_STACK_SIZE = 128;
+
+	inline DirectX::XMFLOAT3 Subtract(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return DirectX::XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	inline float Dot(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline DirectX::XMFLOAT3 Cross(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+	{
+		return DirectX::XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline DirectX::XMFLOAT3 MultiplyAdd(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, float s)
+	{
+		return DirectX::XMFLOAT3(a.x + b.x * s, a.y + b.y * s, a.z + b.z * s);
+	}
+
+	inline float GetComponent(const DirectX::XMFLOAT3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	inline void GrowBounds(DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT3& otherMin, const DirectX::XMFLOAT3& otherMax)
+	{
+		boundsMin = DirectX::XMFLOAT3(std::min(boundsMin.x, otherMin.x), std::min(boundsMin.y, otherMin.y), std::min(boundsMin.z, otherMin.z));
+		boundsMax = DirectX::XMFLOAT3(std::max(boundsMax.x, otherMax.x), std::max(boundsMax.y, otherMax.y), std::max(boundsMax.z, otherMax.z));
+	}
+
+	inline float GetHalfArea(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax)
+	{
+		DirectX::XMFLOAT3 extent = Subtract(boundsMax, boundsMin);
+		if (extent.x < 0.0f)
+			return 0.0f;
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	inline float GetInverse(float value)
+	{
+		// Avoids inf * 0 = NaN in the slab test for axis aligned segments
+		if (std::fabs(value) < 1e-20f)
+			return value < 0.0f ? -1e30f : 1e30f;
+		return 1.0f / value;
+	}
+
+	inline bool IsLeaf(int child)
+	{
+		return child < 0;
+	}
+
+	inline int GetLeafFirst(int child)
+	{
+		return (~child) >> 4;
+	}
+
+	inline int GetLeafCount(int child)
+	{
+		return (~child) & 15;
+	}
+
+	// Pushes the hit children so the nearest one is popped first
+	inline void PushSorted(int* stack, int& stackSize, const int* children, const float* distances, int mask)
+	{
+		int order[4];
+		float keys[4];
+		int numHits = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			int k = numHits++;
+			while (k > 0 && keys[k - 1] < distances[i])
+			{
+				keys[k] = keys[k - 1];
+				order[k] = order[k - 1];
+				k--;
+			}
+			keys[k] = distances[i];
+			order[k] = children[i];
+		}
+
+		for (int i = 0; i < numHits; i++)
+			stack[stackSize++] = order[i];
+	}
+}
+
+TriangleBvh::TriangleBvh()
+{
+	m_maxStackSize = 1;
+}
+
+void TriangleBvh::Build(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices)
+{
+	m_vertices = vertices;
+	m_indices = indices;
+	m_nodes.clear();
+	m_triangles.clear();
+	m_maxStackSize = 4;
+
+	int numTriangles = static_cast<int>(indices.size() / 3);
+	m_triangleOrder.resize(numTriangles);
+	std::vector<DirectX::XMFLOAT3> centroids(numTriangles);
+	std::vector<DirectX::XMFLOAT3> boundsMin(numTriangles);
+	std::vector<DirectX::XMFLOAT3> boundsMax(numTriangles);
+
+	JobSystem& jobSystem = JobSystem::GetInstance();
+	jobSystem.ParallelFor(numTriangles, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const DirectX::XMFLOAT3& a = m_vertices[m_indices[i * 3]];
+			const DirectX::XMFLOAT3& b = m_vertices[m_indices[i * 3 + 1]];
+			const DirectX::XMFLOAT3& c = m_vertices[m_indices[i * 3 + 2]];
+			boundsMin[i] = DirectX::XMFLOAT3(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z)));
+			boundsMax[i] = DirectX::XMFLOAT3(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z)));
+			centroids[i] = DirectX::XMFLOAT3((a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f);
+			m_triangleOrder[i] = i;
+		}
+	}, 4096);
+
+	if (numTriangles == 0)
+		return;
+
+	// Split the top of the tree serially until every thread has a few subtrees to build
+	struct SubtreeTask
+	{
+		int node;
+		int first;
+		int count;
+	};
+
+	std::vector<BuildNode> buildNodes(1);
+	buildNodes[0].left = -1;
+	buildNodes[0].right = -1;
+	buildNodes[0].first = 0;
+	buildNodes[0].count = numTriangles;
+
+	std::vector<SubtreeTask> tasks(1);
+	tasks[0].node = 0;
+	tasks[0].first = 0;
+	tasks[0].count = numTriangles;
+
+	int targetTasks = jobSystem.GetNumThreads() > 1 ? jobSystem.GetNumThreads() * 4 : 1;
+	while (static_cast<int>(tasks.size()) < targetTasks)
+	{
+		int largest = 0;
+		for (int i = 1; i < static_cast<int>(tasks.size()); i++)
+		{
+			if (tasks[i].count > tasks[largest].count)
+				largest = i;
+		}
+
+		SubtreeTask task = tasks[largest];
+		if (task.count < PARALLEL_BUILD_MIN_TRIANGLES)
+			break;
+
+		int splitCount;
+		DirectX::XMFLOAT3 rangeMin;
+		DirectX::XMFLOAT3 rangeMax;
+		if (!SplitRange(task.first, task.count, centroids, boundsMin, boundsMax, splitCount, rangeMin, rangeMax))
+			break;
+
+		int left = static_cast<int>(buildNodes.size());
+		buildNodes.resize(buildNodes.size() + 2);
+		buildNodes[task.node].boundsMin = rangeMin;
+		buildNodes[task.node].boundsMax = rangeMax;
+		buildNodes[task.node].left = left;
+		buildNodes[task.node].right = left + 1;
+
+		tasks[largest].node = left;
+		tasks[largest].count = splitCount;
+
+		SubtreeTask rightTask;
+		rightTask.node = left + 1;
+		rightTask.first = task.first + splitCount;
+		rightTask.count = task.count - splitCount;
+		tasks.push_back(rightTask);
+	}
+
+	std::vector<std::vector<BuildNode>> subtrees(tasks.size());
+	jobSystem.ParallelFor(static_cast<int>(tasks.size()), [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+			BuildSubtree(subtrees[i], tasks[i].first, tasks[i].count, centroids, boundsMin, boundsMax);
+	}, 1);
+
+	// Subtree roots replace their placeholders, the other nodes are appended
+	for (size_t i = 0; i < tasks.size(); i++)
+	{
+		int offset = static_cast<int>(buildNodes.size()) - 1;
+		for (size_t k = 0; k < subtrees[i].size(); k++)
+		{
+			BuildNode node = subtrees[i][k];
+			if (node.left >= 0)
+			{
+				node.left += offset;
+				node.right += offset;
+			}
+
+			if (k == 0)
+				buildNodes[tasks[i].node] = node;
+			else
+				buildNodes.push_back(node);
+		}
+	}
+
+	m_nodes.reserve(buildNodes.size() / 2 + 1);
+	if (buildNodes[0].left >= 0)
+	{
+		Collapse(buildNodes, 0, 0);
+	}
+	else
+	{
+		Node root;
+		for (int i = 0; i < 4; i++)
+		{
+			root.minX[i] = root.minY[i] = root.minZ[i] = FLT_MAX;
+			root.maxX[i] = root.maxY[i] = root.maxZ[i] = -FLT_MAX;
+			root.children[i] = EMPTY_CHILD;
+		}
+		root.minX[0] = buildNodes[0].boundsMin.x;
+		root.minY[0] = buildNodes[0].boundsMin.y;
+		root.minZ[0] = buildNodes[0].boundsMin.z;
+		root.maxX[0] = buildNodes[0].boundsMax.x;
+		root.maxY[0] = buildNodes[0].boundsMax.y;
+		root.maxZ[0] = buildNodes[0].boundsMax.z;
+		root.children[0] = ~((buildNodes[0].first << 4) | buildNodes[0].count);
+		m_nodes.push_back(root);
+	}
+
+	m_triangles.resize(numTriangles);
+	for (int i = 0; i < numTriangles; i++)
+	{
+		int id = m_triangleOrder[i];
+		const DirectX::XMFLOAT3& a = m_vertices[m_indices[id * 3]];
+		m_triangles[i].v0 = a;
+		m_triangles[i].edge1 = Subtract(m_vertices[m_indices[id * 3 + 1]], a);
+		m_triangles[i].edge2 = Subtract(m_vertices[m_indices[id * 3 + 2]], a);
+		m_triangles[i].id = id;
+	}
+}
+
+int TriangleBvh::BuildSubtree(std::vector<BuildNode>& nodes, int first, int count, const std::vector<DirectX::XMFLOAT3>& centroids, const std::vector<DirectX::XMFLOAT3>& boundsMin, const std::vector<DirectX::XMFLOAT3>& boundsMax)
+{
+	int index = static_cast<int>(nodes.size());
+	nodes.resize(nodes.size() + 1);
+
+	int splitCount;
+	DirectX::XMFLOAT3 rangeMin;
+	DirectX::XMFLOAT3 rangeMax;
+	bool split = SplitRange(first, count, centroids, boundsMin, boundsMax, splitCount, rangeMin, rangeMax);
+
+	nodes[index].boundsMin = rangeMin;
+	nodes[index].boundsMax = rangeMax;
+	nodes[index].first = first;
+	nodes[index].count = count;
+	nodes[index].left = -1;
+	nodes[index].right = -1;
+
+	if (!split)
+		return index;
+
+	int left = BuildSubtree(nodes, first, splitCount, centroids, boundsMin, boundsMax);
+	int right = BuildSubtree(nodes, first + splitCount, count - splitCount, centroids, boundsMin, boundsMax);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+bool TriangleBvh::SplitRange(int first, int count, const std::vector<DirectX::XMFLOAT3>& centroids, const std::vector<DirectX::XMFLOAT3>& boundsMin, const std::vector<DirectX::XMFLOAT3>& boundsMax, int& splitCount, DirectX::XMFLOAT3& rangeMin, DirectX::XMFLOAT3& rangeMax)
+{
+	rangeMin = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	rangeMax = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	DirectX::XMFLOAT3 centroidMin = rangeMin;
+	DirectX::XMFLOAT3 centroidMax = rangeMax;
+
+	for (int i = first; i < first + count; i++)
+	{
+		int triangle = m_triangleOrder[i];
+		GrowBounds(rangeMin, rangeMax, boundsMin[triangle], boundsMax[triangle]);
+		GrowBounds(centroidMin, centroidMax, centroids[triangle], centroids[triangle]);
+	}
+
+	if (count <= 2)
+		return false;
+
+	// Binned SAH over all three axes, a triangle test costs as much as a node visit
+	struct Bin
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		DirectX::XMFLOAT3 boundsMax;
+		int count;
+	};
+
+	float bestCost = static_cast<float>(count);
+	int bestAxis = -1;
+	int bestBin = 0;
+	float parentArea = GetHalfArea(rangeMin, rangeMax);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float axisMin = GetComponent(centroidMin, axis);
+		float axisExtent = GetComponent(centroidMax, axis) - axisMin;
+		float scale = NUM_SAH_BINS / axisExtent;
+		// Denormal extents of degenerate meshes would give an infinite scale and NaN bins
+		if (axisExtent <= 0.0f || !std::isfinite(scale))
+			continue;
+
+		Bin bins[NUM_SAH_BINS];
+		for (Bin& bin : bins)
+		{
+			bin.boundsMin = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			bin.boundsMax = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			bin.count = 0;
+		}
+
+		for (int i = first; i < first + count; i++)
+		{
+			int triangle = m_triangleOrder[i];
+			int binIndex = std::min(NUM_SAH_BINS - 1, static_cast<int>((GetComponent(centroids[triangle], axis) - axisMin) * scale));
+			GrowBounds(bins[binIndex].boundsMin, bins[binIndex].boundsMax, boundsMin[triangle], boundsMax[triangle]);
+			bins[binIndex].count++;
+		}
+
+		// Sweep from the right to get the cost of every split plane
+		float rightAreas[NUM_SAH_BINS];
+		int rightCounts[NUM_SAH_BINS];
+		DirectX::XMFLOAT3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		DirectX::XMFLOAT3 sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		int sweepCount = 0;
+		for (int i = NUM_SAH_BINS - 1; i > 0; i--)
+		{
+			GrowBounds(sweepMin, sweepMax, bins[i].boundsMin, bins[i].boundsMax);
+			sweepCount += bins[i].count;
+			rightAreas[i] = GetHalfArea(sweepMin, sweepMax);
+			rightCounts[i] = sweepCount;
+		}
+
+		sweepMin = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		sweepMax = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		sweepCount = 0;
+		for (int i = 1; i < NUM_SAH_BINS; i++)
+		{
+			GrowBounds(sweepMin, sweepMax, bins[i - 1].boundsMin, bins[i - 1].boundsMax);
+			sweepCount += bins[i - 1].count;
+			if (sweepCount == 0 || rightCounts[i] == 0)
+				continue;
+
+			float cost = 1.0f + (GetHalfArea(sweepMin, sweepMax) * sweepCount + rightAreas[i] * rightCounts[i]) / parentArea;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+	{
+		if (count <= MAX_LEAF_TRIANGLES)
+			return false;
+
+		// All centroids coincide, any split is as good as another
+		splitCount = count / 2;
+		return true;
+	}
+
+	float axisMin = GetComponent(centroidMin, bestAxis);
+	float scale = NUM_SAH_BINS / (GetComponent(centroidMax, bestAxis) - axisMin);
+	int* middle = std::partition(m_triangleOrder.data() + first, m_triangleOrder.data() + first + count, [&](int triangle)
+	{
+		return std::min(NUM_SAH_BINS - 1, static_cast<int>((GetComponent(centroids[triangle], bestAxis) - axisMin) * scale)) < bestBin;
+	});
+
+	splitCount = static_cast<int>(middle - (m_triangleOrder.data() + first));
+	return true;
+}
+
+int TriangleBvh::Collapse(const std::vector<BuildNode>& buildNodes, int buildNodeIndex, int depth)
+{
+	m_maxStackSize = std::max(m_maxStackSize, 3 * depth + 4);
+
+	// Open the largest inner children until four children are gathered
+	int children[4] = { buildNodes[buildNodeIndex].left, buildNodes[buildNodeIndex].right, -1, -1 };
+	int numChildren = 2;
+	while (numChildren < 4)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int i = 0; i < numChildren; i++)
+		{
+			const BuildNode& child = buildNodes[children[i]];
+			float area = GetHalfArea(child.boundsMin, child.boundsMax);
+			if (child.left >= 0 && area > largestArea)
+			{
+				largest = i;
+				largestArea = area;
+			}
+		}
+
+		if (largest < 0)
+			break;
+
+		const BuildNode& opened = buildNodes[children[largest]];
+		children[largest] = opened.left;
+		children[numChildren++] = opened.right;
+	}
+
+	int nodeIndex = static_cast<int>(m_nodes.size());
+	m_nodes.resize(m_nodes.size() + 1);
+	for (int i = 0; i < 4; i++)
+	{
+		Node& node = m_nodes[nodeIndex];
+		node.minX[i] = node.minY[i] = node.minZ[i] = FLT_MAX;
+		node.maxX[i] = node.maxY[i] = node.maxZ[i] = -FLT_MAX;
+		node.children[i] = EMPTY_CHILD;
+	}
+
+	for (int i = 0; i < numChildren; i++)
+	{
+		const BuildNode& child = buildNodes[children[i]];
+		int childIndex = child.left >= 0 ? Collapse(buildNodes, children[i], depth + 1) : ~((child.first << 4) | child.count);
+
+		Node& node = m_nodes[nodeIndex];
+		node.minX[i] = child.boundsMin.x;
+		node.minY[i] = child.boundsMin.y;
+		node.minZ[i] = child.boundsMin.z;
+		node.maxX[i] = child.boundsMax.x;
+		node.maxY[i] = child.boundsMax.y;
+		node.maxZ[i] = child.boundsMax.z;
+		node.children[i] = childIndex;
+	}
+
+	return nodeIndex;
+}
+
+ClosestTriangleHit TriangleBvh::FindClosest(const DirectX::XMFLOAT3& point, float maxDistance) const
+{
+	ClosestTriangleHit hit;
+	hit.triangle = -1;
+	hit.feature = TRIANGLE_FEATURE_FACE;
+	hit.distanceSq = maxDistance * maxDistance;
+	hit.point = point;
+
+	if (m_nodes.empty())
+		return hit;
+
+	const __m128 px = _mm_set1_ps(point.x);
+	const __m128 py = _mm_set1_ps(point.y);
+	const __m128 pz = _mm_set1_ps(point.z);
+	const __m128 zero = _mm_setzero_ps();
+
+	// Degenerate meshes can give deeper trees than the local stack holds
+	int localStack[LOCAL_STACK_SIZE];
+	std::vector<int> deepStack;
+	int* stack = localStack;
+	if (m_maxStackSize > LOCAL_STACK_SIZE)
+	{
+		deepStack.resize(m_maxStackSize);
+		stack = deepStack.data();
+	}
+
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		int current = stack[--stackSize];
+
+		if (IsLeaf(current))
+		{
+			int first = GetLeafFirst(current);
+			for (int i = first; i < first + GetLeafCount(current); i++)
+			{
+				int triangle = m_triangles[i].id;
+				TriangleFeature feature;
+				DirectX::XMFLOAT3 closest = ClosestPointOnTriangle(point, m_vertices[m_indices[triangle * 3]], m_vertices[m_indices[triangle * 3 + 1]], m_vertices[m_indices[triangle * 3 + 2]], feature);
+				DirectX::XMFLOAT3 offset = Subtract(point, closest);
+				float distanceSq = Dot(offset, offset);
+
+				if (distanceSq < hit.distanceSq)
+				{
+					hit.triangle = triangle;
+					hit.feature = feature;
+					hit.distanceSq = distanceSq;
+					hit.point = closest;
+				}
+			}
+			continue;
+		}
+
+		// Distance from the point to all four child boxes at once
+		const Node& node = m_nodes[current];
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), px), zero), _mm_sub_ps(px, _mm_loadu_ps(node.maxX)));
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), py), zero), _mm_sub_ps(py, _mm_loadu_ps(node.maxY)));
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), pz), zero), _mm_sub_ps(pz, _mm_loadu_ps(node.maxZ)));
+		__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		int mask = _mm_movemask_ps(_mm_cmplt_ps(distanceSq, _mm_set1_ps(hit.distanceSq)));
+
+		float distances[4];
+		_mm_storeu_ps(distances, distanceSq);
+		for (int i = 0; i < 4; i++)
+		{
+			if (node.children[i] == EMPTY_CHILD)
+				mask &= ~(1 << i);
+		}
+
+		PushSorted(stack, stackSize, node.children, distances, mask);
+	}
+
+	return hit;
+}
+
+SegmentHit TriangleBvh::IntersectSegment(const DirectX::XMFLOAT3& start, const DirectX::XMFLOAT3& end) const
+{
+	SegmentHit hit;
+	hit.triangle = -1;
+	hit.distance = 0.0f;
+	hit.normal = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+	DirectX::XMFLOAT3 direction = Subtract(end, start);
+	float length = std::sqrt(Dot(direction, direction));
+	if (m_nodes.empty() || length <= 0.0f)
+		return hit;
+
+	// t runs from 0 at start to 1 at end
+	const __m128 ox = _mm_set1_ps(start.x);
+	const __m128 oy = _mm_set1_ps(start.y);
+	const __m128 oz = _mm_set1_ps(start.z);
+	const __m128 ix = _mm_set1_ps(GetInverse(direction.x));
+	const __m128 iy = _mm_set1_ps(GetInverse(direction.y));
+	const __m128 iz = _mm_set1_ps(GetInverse(direction.z));
+	const __m128 zero = _mm_setzero_ps();
+	float closestT = 1.0f;
+	int closestTriangle = -1;
+
+	// Degenerate meshes can give deeper trees than the local stack holds
+	int localStack[LOCAL_STACK_SIZE];
+	std::vector<int> deepStack;
+	int* stack = localStack;
+	if (m_maxStackSize > LOCAL_STACK_SIZE)
+	{
+		deepStack.resize(m_maxStackSize);
+		stack = deepStack.data();
+	}
+
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		int current = stack[--stackSize];
+
+		if (IsLeaf(current))
+		{
+			// Moeller-Trumbore
+			int first = GetLeafFirst(current);
+			for (int i = first; i < first + GetLeafCount(current); i++)
+			{
+				const PackedTriangle& triangle = m_triangles[i];
+				DirectX::XMFLOAT3 p = Cross(direction, triangle.edge2);
+				float determinant = Dot(triangle.edge1, p);
+				if (std::fabs(determinant) < 1e-12f)
+					continue;
+
+				float inverseDeterminant = 1.0f / determinant;
+				DirectX::XMFLOAT3 s = Subtract(start, triangle.v0);
+				float u = Dot(s, p) * inverseDeterminant;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+
+				DirectX::XMFLOAT3 q = Cross(s, triangle.edge1);
+				float v = Dot(direction, q) * inverseDeterminant;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+
+				float t = Dot(triangle.edge2, q) * inverseDeterminant;
+				if (t >= 0.0f && t < closestT)
+				{
+					closestT = t;
+					closestTriangle = i;
+				}
+			}
+			continue;
+		}
+
+		// Slab test against all four child boxes at once
+		const Node& node = m_nodes[current];
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+		__m128 tNear = _mm_max_ps(zero, _mm_min_ps(t0, t1));
+		__m128 tFar = _mm_min_ps(_mm_set1_ps(closestT), _mm_max_ps(t0, t1));
+
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+		tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+		tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+		int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+		for (int i = 0; i < 4; i++)
+		{
+			if (node.children[i] == EMPTY_CHILD)
+				mask &= ~(1 << i);
+		}
+
+		float distances[4];
+		_mm_storeu_ps(distances, tNear);
+		PushSorted(stack, stackSize, node.children, distances, mask);
+	}
+
+	if (closestTriangle < 0)
+		return hit;
+
+	const PackedTriangle& triangle = m_triangles[closestTriangle];
+	DirectX::XMFLOAT3 normal = Cross(triangle.edge1, triangle.edge2);
+	float normalLength = std::sqrt(Dot(normal, normal));
+	float sign = Dot(normal, direction) > 0.0f ? -1.0f : 1.0f;
+
+	hit.triangle = triangle.id;
+	hit.distance = closestT * length;
+	hit.normal = DirectX::XMFLOAT3(normal.x * sign / normalLength, normal.y * sign / normalLength, normal.z * sign / normalLength);
+	return hit;
+}
+
+void TriangleBvh::IntersectSegments(const DirectX::XMFLOAT3* starts, const DirectX::XMFLOAT3* ends, int count, SegmentHit* hits) const
+{
+	JobSystem::GetInstance().ParallelFor(count, [&](int begin, int end, int chunk)
+	{
+		for (int i = begin; i < end; i++)
+			hits[i] = IntersectSegment(starts[i], ends[i]);
+	}, 256);
+}
+
+// Closest point by Voronoi regions, after Ericson, Real-Time Collision Detection 5.1.5
+DirectX::XMFLOAT3 TriangleBvh::ClosestPointOnTriangle(const DirectX::XMFLOAT3& point, const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c, TriangleFeature& feature)
+{
+	DirectX::XMFLOAT3 ab = Subtract(b, a);
+	DirectX::XMFLOAT3 ac = Subtract(c, a);
+	DirectX::XMFLOAT3 ap = Subtract(point, a);
+	float d1 = Dot(ab, ap);
+	float d2 = Dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+	{
+		feature = TRIANGLE_FEATURE_VERTEX0;
+		return a;
+	}
+
+	DirectX::XMFLOAT3 bp = Subtract(point, b);
+	float d3 = Dot(ab, bp);
+	float d4 = Dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+	{
+		feature = TRIANGLE_FEATURE_VERTEX1;
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		feature = TRIANGLE_FEATURE_EDGE01;
+		return MultiplyAdd(a, ab, d1 / (d1 - d3));
+	}
+
+	DirectX::XMFLOAT3 cp = Subtract(point, c);
+	float d5 = Dot(ab, cp);
+	float d6 = Dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+	{
+		feature = TRIANGLE_FEATURE_VERTEX2;
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		feature = TRIANGLE_FEATURE_EDGE20;
+		return MultiplyAdd(a, ac, d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		feature = TRIANGLE_FEATURE_EDGE12;
+		return MultiplyAdd(b, Subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denominator = 1.0f / (va + vb + vc);
+	float v = vb * denominator;
+	float w = vc * denominator;
+	feature = TRIANGLE_FEATURE_FACE;
+	return MultiplyAdd(MultiplyAdd(a, ab, v), ac, w);
+}
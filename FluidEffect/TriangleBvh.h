@@ -0,0 +1,98 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+enum TriangleFeature
+{
+	TRIANGLE_FEATURE_FACE,
+	TRIANGLE_FEATURE_VERTEX0,
+	TRIANGLE_FEATURE_VERTEX1,
+	TRIANGLE_FEATURE_VERTEX2,
+	TRIANGLE_FEATURE_EDGE01,
+	TRIANGLE_FEATURE_EDGE12,
+	TRIANGLE_FEATURE_EDGE20
+};
+
+struct ClosestTriangleHit
+{
+	int triangle;		// -1 if no triangle is closer than the search distance
+	TriangleFeature feature;
+	float distanceSq;
+	DirectX::XMFLOAT3 point;
+};
+
+struct SegmentHit
+{
+	int triangle;		// -1 if the segment does not hit the mesh
+	float distance;		// From the segment start
+	DirectX::XMFLOAT3 normal;	// Unit geometric normal, facing the segment start
+};
+
+// Bounding volume hierarchy over an indexed triangle list. Built as a binary tree with binned
+// SAH splits, subtrees in parallel, then collapsed into 4-wide nodes whose child boxes are
+// tested with SSE in one go.
+class TriangleBvh
+{
+public:
+	TriangleBvh();
+
+	void Build(const std::vector<DirectX::XMFLOAT3>& vertices, const std::vector<unsigned int>& indices);
+
+	ClosestTriangleHit FindClosest(const DirectX::XMFLOAT3& point, float maxDistance) const;
+
+	SegmentHit IntersectSegment(const DirectX::XMFLOAT3& start, const DirectX::XMFLOAT3& end) const;
+	// Spreads the segments over the JobSystem
+	void IntersectSegments(const DirectX::XMFLOAT3* starts, const DirectX::XMFLOAT3* ends, int count, SegmentHit* hits) const;
+
+	int GetNumNodes() const { return static_cast<int>(m_nodes.size()); }
+	int GetNumTriangles() const { return static_cast<int>(m_triangles.size()); }
+	// Deepest stack a query needs, over 128 entries only for degenerate meshes
+	int GetMaxStackSize() const { return m_maxStackSize; }
+
+	static DirectX::XMFLOAT3 ClosestPointOnTriangle(const DirectX::XMFLOAT3& point, const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c, TriangleFeature& feature);
+
+private:
+	// Child boxes as structure of arrays, so one SSE register holds the same bound of all four children.
+	// Children >= 0 are nodes, leaves store ~(first << 4 | count) with count 0 for unused slots.
+	struct Node
+	{
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+		int children[4];
+	};
+
+	// Triangles in leaf order, as vertex and edges for the ray test
+	struct PackedTriangle
+	{
+		DirectX::XMFLOAT3 v0;
+		DirectX::XMFLOAT3 edge1;
+		DirectX::XMFLOAT3 edge2;
+		int id;
+	};
+
+	struct BuildNode
+	{
+		DirectX::XMFLOAT3 boundsMin;
+		DirectX::XMFLOAT3 boundsMax;
+		int left;			// Child node index, -1 for leaves
+		int right;
+		int first;
+		int count;
+	};
+
+	int BuildSubtree(std::vector<BuildNode>& nodes, int first, int count, const std::vector<DirectX::XMFLOAT3>& centroids, const std::vector<DirectX::XMFLOAT3>& boundsMin, const std::vector<DirectX::XMFLOAT3>& boundsMax);
+	bool SplitRange(int first, int count, const std::vector<DirectX::XMFLOAT3>& centroids, const std::vector<DirectX::XMFLOAT3>& boundsMin, const std::vector<DirectX::XMFLOAT3>& boundsMax, int& splitCount, DirectX::XMFLOAT3& rangeMin, DirectX::XMFLOAT3& rangeMax);
+	int Collapse(const std::vector<BuildNode>& buildNodes, int buildNodeIndex, int depth);
+
+	std::vector<Node> m_nodes;
+	// Entries a traversal can have on its stack, each level below the root adds at most three
+	int m_maxStackSize;
+	std::vector<PackedTriangle> m_triangles;
+	std::vector<int> m_triangleOrder;
+	std::vector<DirectX::XMFLOAT3> m_vertices;
+	std::vector<unsigned int> m_indices;
+};
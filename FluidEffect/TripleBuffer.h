@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Hands the newest of a stream of values from one writer thread to one reader thread without locks
+// or waiting. Writer and reader own a slot each, the third one is swapped with whichever side is done
+// with its slot. So the reader always gets the newest value published and the writer never writes
+// into a slot the reader still uses. Slots are reused, so values keep their allocations.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : m_slots(), m_shared(1), m_writeIndex(0), m_readIndex(2)
+	{
+	}
+
+	// Writer only
+	T& GetWriteBuffer() { return m_slots[m_writeIndex]; }
+
+	// Writer only, the write buffer becomes the newest value and the writer gets another slot
+	void Publish()
+	{
+		uint32_t previous = m_shared.exchange(m_writeIndex | NEW_BIT, std::memory_order_acq_rel);
+		m_writeIndex = previous & INDEX_MASK;
+	}
+
+	// Reader only, true if a value was published since the last call, the read buffer holds it then
+	bool Update()
+	{
+		if (!(m_shared.load(std::memory_order_relaxed) & NEW_BIT))
+			return false;
+
+		uint32_t previous = m_shared.exchange(m_readIndex, std::memory_order_acq_rel);
+		m_readIndex = previous & INDEX_MASK;
+		return true;
+	}
+
+	// Reader only
+	T& GetReadBuffer() { return m_slots[m_readIndex]; }
+
+private:
+	static const uint32_t INDEX_MASK = 3;
+	static const uint32_t NEW_BIT = 4;
+
+	T m_slots[3];
+	// Index of the slot nobody owns, NEW_BIT while it holds a value the reader did not get yet
+	std::atomic<uint32_t> m_shared;
+	uint32_t m_writeIndex;
+	uint32_t m_readIndex;
+};